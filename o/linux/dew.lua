@@ -0,0 +1,4047 @@
+fmt = string.format
+numtype = math.type -- "integer" or "float"
+
+function noop() end
+function printf(...) print(fmt(...)) end
+dlog = printf
+
+local function _print_table(tbl, indent, seen)
+    local indent_chunk = "  "
+    local indent_str = string.rep(indent_chunk, indent)
+    if type(tbl) ~= "table" then
+        print(indent_str .. tostring(tbl))
+        return
+    end
+    if seen[tbl] then
+        print("<cycle " .. tostring(tbl) .. ">")
+        return
+    end
+    seen[tbl] = true
+    print(indent_str .. "{ " .. tostring(tbl))
+    -- print(indent_str .. "{")
+    local keys = {}
+    for k in pairs(tbl) do table.insert(keys, tostring(k)) end
+    table.sort(keys)
+    for _, k in ipairs(keys) do
+        local key = tostring(k)
+        local v = tbl[k]
+        if v == nil then
+            io.write(indent_str .. indent_chunk)
+            v = k
+        else
+            io.write(indent_str .. indent_chunk .. "[" .. key .. "] = ")
+        end
+        if type(v) == "table" then
+            _print_table(v, indent + 1, seen)
+        else
+            print(tostring(v))
+        end
+    end
+    print(indent_str .. "}")
+end
+
+function print_table(tbl, indent)
+    _print_table(tbl, indent or 0, {})
+end
+
+function limit_string(s, maxlen)
+    if #s <= maxlen then return s end
+    return s:sub(1, maxlen - 1) .. "…"
+end
+
+function trim_string(s)
+    return s:gsub("^%s*(.-)%s*$", "%1")
+end
+
+function string_starts_with(s, prefix)
+    return s:sub(1, #prefix) == prefix
+end
+
+function format_monotime_duration(monotime_duration) --> string
+    -- note: assumes monotime_duration is in same units as __rt.monotime(), which is nanoseconds
+    if monotime_duration < 1000 then return fmt("%d ns", monotime_duration) end
+    if monotime_duration < 1000000 then return fmt("%d us", monotime_duration // 1000) end
+    if monotime_duration < 1000000000 then return fmt("%.2f ms", monotime_duration / 1000000.0) end
+    return fmt("%.2f s", monotime_duration / 1000000000.0)
+end
+
+function memory_usage()
+    return collectgarbage("count") -- Returns memory usage in kilobytes
+end
+
+B = string.byte
+-- hash_mix64 "mixes" a 64-bit integer value, based on MurmurHash3's finalizer.
+-- Provides excellent avalanche properties for individual hash values
+function hash_mix64(h)
+	h = h ~ (h >> 33)
+	h = (h * 0xFF51AFD7ED558CCD) & 0xFFFFFFFFFFFFFFFF
+	h = h ~ (h >> 33)
+	h = (h * 0xC4CEB9FE1A85EC53) & 0xFFFFFFFFFFFFFFFF
+	h = h ~ (h >> 33)
+	return h
+end
+
+-- hash_combine64 combines two 64-bit hashes with good distribution.
+-- Uses a variant of the FNV-1a approach with better constants
+function hash_combine64(h1, h2)
+    return hash_mix64(((h1 ~ (h2 << 1)) * 0x9E3779B97F4A7C15) & 0xFFFFFFFFFFFFFFFF)
+end
+function unit_create_buf(srcfile, src)
+	return {
+		srcfile = srcfile,
+		src = src,
+		-- ast = __rt.buf_create(128), -- created by parse_unit
+		-- ast_srcmap = {}, -- created by parse_unit
+		-- ir = __rt.buf_create(128), -- created by resolve_unit
+		-- ir_srcmap = {}, -- created by resolve_unit
+		ast_idx = -1, -- AST node representing the unit (unit.ast[unit.ast_idx])
+		errcount = 0, -- number of diagnostic errors reported
+		include_comments = false, -- used by tokenizer
+		-- commentmap = {}, -- idx:[comment] created by parser if include_comments
+		-- diag_handler = function(unit, kind, srcpos, msg_format, ...) -- custom callback
+	}
+end
+
+function unit_create_file(srcfile)
+	local f, err = io.open(srcfile)
+	if err ~= nil then error(err) end
+	local src = f:read("a")
+	f:close()
+	return unit_create_buf(srcfile, src)
+end
+DIAG_ERR  = "error"
+DIAG_WARN = "warning"
+DIAG_INFO = "note"
+
+DIAG_COLORS = {
+    [DIAG_ERR] = "31", -- red
+    [DIAG_WARN] = "33", -- yellow
+    [DIAG_INFO] = "",
+}
+
+function diag(unit, level, srcpos, format, ...) --> void
+    assert(srcpos ~= nil)
+    if level == DIAG_ERR then
+        unit.errcount = unit.errcount + 1
+    end
+    if unit.diag_handler ~= nil then
+        return unit:diag_handler(level, srcpos, format, ...)
+    else
+        return diag_print(unit, level, srcpos, format, ...)
+    end
+end
+
+function diag_fmt(unit, level, srcpos, format, ...) --> string
+    local s = fmt("%s: \x1b[0;1;%sm%s:\x1b[0m " .. format,
+                  srcpos_fmt(srcpos, unit), DIAG_COLORS[level], level, ...)
+
+    -- if level == DIAG_ERR then
+    local as_error = level == DIAG_ERR
+    local context_lines = as_error and 1 or 0
+    local source_snippet = srcpos_source_snippet(srcpos, unit, as_error, context_lines)
+    if #source_snippet > 0 then
+        s = s .. source_snippet
+    end
+    -- end
+
+    return s
+end
+
+function diag_print(unit, level, srcpos, format, ...)
+    return io.stderr:write(diag_fmt(unit, level, srcpos, format, ...) .. "\n")
+end
+function srcpos_make(off, span)
+    -- bit           1111111111222222222233 33333333 444444444455555555556666
+    --     01234567890123456789012345678901 23456789 012345678901234567890123
+    --     unused                           span     off
+    --     u32                              u8       u24
+    -- assert(numtype(off) == 'integer', fmt("numtype(off) = %s", numtype(off)))
+    -- assert(numtype(span) == 'integer', fmt("numtype(span) = %s", numtype(span)))
+    return ((off > 0xffffff and 0xffffff or off) & 0xffffff) |
+           (((span > 0xff and 0xff or span) & 0xff) << 24)
+end
+
+function srcpos_off(srcpos) return srcpos & 0xffffff end
+function srcpos_span(srcpos) return srcpos>>24 & 0xff end
+
+function srcpos_union(srcpos1, srcpos2) --> srcpos
+    if srcpos1 == 0 then
+        return srcpos2
+    end
+    if srcpos2 == 0 then
+        return srcpos1
+    end
+    local start1, start2 = srcpos_off(srcpos1), srcpos_off(srcpos2)
+    local end1, end2 = start1 + srcpos_span(srcpos1), start2 + srcpos_span(srcpos2)
+    local start3 = start1 < start2 and start1 or start2
+    local end3 = end1 > end2 and end1 or end2
+    return srcpos_make(start3, end3 - start3)
+end
+
+function srcpos_after(srcpos, span) --> srcpos
+    local off = srcpos_off(srcpos) + srcpos_span(srcpos)
+    if span == nil then span = 0 end
+    return srcpos_make(off, span)
+end
+
+function srcpos_linecol(srcpos, src) --> line, col
+    assert(srcpos ~= nil)
+    local off = srcpos_off(srcpos)
+    local i, j, iend, line = 1, 0, off, 1
+    local col, col_prev = 0, 0
+    while i < iend do
+        j = string.find(src, '\n', i, true)
+        if j == nil or j > iend then break end
+        line = line + 1
+        i = j + 1
+        col_prev = col
+        col = (off - i) + 1
+    end
+    -- synthetic semicolon appears at the newline position, which ends up with the
+    -- otherwise impossible column '0', so we check for that and return the end of the
+    -- previous line for synthetic semicolons:
+    if col == 0 and line > 1 then
+        return line - 1, col_prev
+    end
+    return line, (off - i) + 1
+end
+
+function srcpos_fmt(srcpos, unit, omit_srcfile) --> string
+    if srcpos == 0 or unit == nil or unit.src == nil or #unit.src == 0 then
+        if omit_srcfile or unit == nil then
+            return ""
+        end
+        return unit.srcfile
+    end
+    local line, col = srcpos_linecol(srcpos, unit.src)
+    if omit_srcfile then
+        return fmt("%d:%d", line, col)
+    end
+    return fmt("%s:%d:%d", unit.srcfile, line, col)
+end
+
+function srcpos_source_snippet(srcpos, unit, as_error, context_lines) --> string
+    local src = unit.src
+    local buf = __rt.buf_create(256)
+
+    local function find_line_start(begin_at_offs) --> start_offs
+        for i = begin_at_offs, 0, -1 do
+            if string.byte(src, i) == 0x0A then
+                return i + 1
+            end
+        end
+        return 0
+    end
+
+    local function find_line_end(begin_at_offs) --> end_offs
+        local end_offs = string.find(src, '\n', begin_at_offs, true)
+        return end_offs == nil and #src + 1 or end_offs
+    end
+
+    -- find focus line
+    local offs = srcpos_off(srcpos)
+    local line_start = find_line_start(offs)
+    local line_end = find_line_end(offs)
+    local ctx_line_start, ctx_line_end
+    local line_no, column = srcpos_linecol(srcpos, unit.src)
+
+    -- find & add context line before focus line
+    if line_start > 1 and context_lines > 0 then
+        ctx_line_end = line_start - 1
+        ctx_line_start = find_line_start(ctx_line_end - 1)
+        buf:append(fmt("\n\x1b[2m%6d │", line_no - 1))
+        buf:append(src:sub(ctx_line_start, ctx_line_end - 1))
+        buf:append("\x1b[0m")
+    end
+
+    -- add focus line
+    if as_error then
+        buf:append(fmt("\n\x1b[1;41;37m%6d \x1b[0;2m│\x1b[0m", line_no))
+    else
+        buf:append(fmt("\n\x1b[47;30m%6d \x1b[0;2m│\x1b[0m", line_no))
+    end
+    local line = src:sub(line_start, line_end - 1)
+    buf:append(line)
+
+    -- find context line after focus line
+    ctx_line_start = line_end + 1
+    ctx_line_end = find_line_end(ctx_line_start)
+
+    -- highlight relevant range with arrow or underline
+    local span = srcpos_span(srcpos)
+    local indent = line:gsub("^(%s*).*$", "%1") -- leading whitespace
+    if column > #indent then
+        indent = indent .. string.rep(" ", (column - 1) - #indent)
+    end
+    if ctx_line_start < ctx_line_end and context_lines > 0 then
+        buf:append("\n       \x1b[2m│\x1b[22m" .. indent)
+    else
+        buf:append("\n        " .. indent)
+    end
+    local highlight_style = as_error and "\x1b[1;31m" or "\x1b[1m"
+    if span == 0 then
+        buf:append(highlight_style .. "▲\x1b[0m")
+    else
+        buf:append(highlight_style .. string.rep("▔", span) .. "\x1b[0m")
+    end
+
+    -- add context line after focus line
+    if ctx_line_start < ctx_line_end and context_lines > 0 then
+        buf:append(fmt("\n\x1b[2m%6d │", line_no + 1))
+        buf:append(src:sub(ctx_line_start, ctx_line_end - 1))
+        buf:append("\x1b[0m")
+    end
+
+    return buf:str()
+end
+token_names = {}
+keywords = {}
+keywordmin, keywordmax = 1000, 0
+
+function tokname(tok) return token_names[tok] end
+
+do
+local function deftok(name)
+	local tok = #token_names + 1; assert(tok <= 0xff)
+	token_names[tok] = name
+	return tok
+end
+local function defkeyword(name)
+	local tok = deftok(name)
+	keywords[name] = tok
+	if #name < keywordmin then keywordmin = #name end
+	if #name > keywordmax then keywordmax = #name end
+	return tok
+end
+
+-- tokens
+TOK_SEMI                                 = deftok(';')
+TOK_COMMA                                = deftok(',')
+TOK_COLON                                = deftok(':')
+TOK_DOT,     TOK_DOTDOTDOT               = deftok('.'),  deftok('...')
+TOK_LPAREN,  TOK_RPAREN                  = deftok('('),  deftok(')')
+TOK_LBRACK,  TOK_RBRACK                  = deftok('['),  deftok(']')
+TOK_LBRACE,  TOK_RBRACE                  = deftok('{'),  deftok('}')
+TOK_LT,      TOK_LTEQ                    = deftok('<'),  deftok('<=')
+TOK_GT,      TOK_GTEQ                    = deftok('>'),  deftok('>=')
+TOK_LTLT,    TOK_LTLTEQ                  = deftok('<<'), deftok('<<=')
+TOK_GTGT,    TOK_GTGTEQ                  = deftok('>>'), deftok('>>=')
+TOK_EQ,      TOK_EQEQ                    = deftok('='),  deftok('==')
+TOK_NOT,     TOK_NOTEQ                   = deftok('!'),  deftok('!=')
+TOK_PLUS,    TOK_PLUSPLUS,   TOK_PLUSEQ  = deftok('+'),  deftok('++'), deftok('+=')
+TOK_MINUS,   TOK_MINUSMINUS, TOK_MINUSEQ = deftok('-'),  deftok('--'), deftok('-=')
+TOK_STAR,    TOK_STARSTAR,   TOK_STAREQ  = deftok('*'),  deftok('**'), deftok('*=')
+TOK_SLASH,   TOK_SLASHEQ                 = deftok('/'),  deftok('/=')
+TOK_PERCENT, TOK_PERCENTEQ               = deftok('%'),  deftok('%=')
+TOK_HAT,     TOK_HATEQ                   = deftok('^'),  deftok('^=')
+TOK_AND,     TOK_ANDAND,     TOK_ANDEQ   = deftok('&'),  deftok('&&'), deftok('&=')
+TOK_OR,      TOK_OROR,       TOK_OREQ    = deftok('|'),  deftok('||'), deftok('|=')
+TOK_TILDE                                = deftok('~')
+
+TOK_COMMENT = deftok('COMMENT')
+TOK_ID      = deftok('ID')
+TOK_INT     = deftok('INT')   -- base 10
+TOK_INT2    = deftok('INT2')  -- base 2
+TOK_INT8    = deftok('INT8')  -- base 8
+TOK_INT16   = deftok('INT16') -- base 16
+TOK_INTBIG  = deftok('INTBIG') -- too big
+TOK_FLOAT   = deftok('FLOAT')
+
+-- keywords
+TOK_FUN    = defkeyword('fun')
+TOK_RETURN = defkeyword('return')
+
+end
+
+function tokenize_unit(unit)
+	local include_comments = unit.include_comments
+	local src = unit.src
+	local srcidx, srcend = 1, #src + 1
+	local tok, tokstart, tokend = TOK_SEMI, 1, 0
+	local lineidx, lineno = 1, 1, 0
+	local insertsemi = false
+	local column = function() return (tokstart + 1) - lineidx end
+	local curr_byte = function() return string.byte(src, srcidx) end
+	local value = nil
+	local value_is_int = false
+
+	local function diag_err(format, ...)
+		local srcpos = srcpos_make(tokstart, tokend - tokstart)
+		diag(unit, DIAG_ERR, srcpos, format, ...)
+		if DEBUG_TOKENS then error("syntax error") end
+	end
+
+	local function stop_scanning()
+		srcidx = srcend
+	end
+
+	local function next_byte(byte1, byte2)
+		if string.byte(src, srcidx) == byte1 then
+			if byte2 == nil then
+				tokend = tokend + 1
+				srcidx = srcidx + 1
+				return true
+			elseif string.byte(src, srcidx + 1) == byte2 then
+				tokend = tokend + 2
+				srcidx = srcidx + 2
+				return true
+			end
+		end
+		return false
+	end
+
+	local function scan_comment()
+		-- enter with srcidx just after second "/" in "// comment"
+		while srcidx < srcend do
+			byte = string.byte(src, srcidx)
+			if byte == 0x0A then break end
+			srcidx = srcidx + 1
+		end
+		tokend = srcidx
+		value = string.sub(src, tokstart, tokend - 1)
+	end
+
+	local function scan_block_comment()
+		diag_err("block comments not implemented")
+		stop_scanning()
+	end
+
+	local function byte_is_sep(byte)
+		return (byte < B('0') and byte ~= B('$')) or -- 0x00..SP !"#%&'()*+,-./
+		       (byte > B('9') and byte < B('A')) or -- :;<=>?@
+		       (byte > B('Z') and byte < B('a') and byte ~= B('_')) or -- [\]^`
+		       (byte > B('z') and byte < 0x7F) -- {|}~
+	end
+
+	local function scan_ident()
+		while srcidx < srcend do
+			byte = string.byte(src, srcidx)
+			if byte_is_sep(byte) then
+				break
+			end
+			srcidx = srcidx + 1
+		end
+		tokend = srcidx
+		insertsemi = true
+
+		local str = string.sub(src, tokstart, tokend - 1)
+
+		-- lookup keyword
+		local len = tokend - tokstart
+		if len >= keywordmin and len <= keywordmax then
+			local kw_tok = keywords[str]
+			if kw_tok ~= nil then
+				return kw_tok
+			end
+		end
+
+		value = id_intern(str) -- id_idx
+		value_is_int = true -- id_idx is an integer
+		return TOK_ID
+	end
+
+	local function scan_num(base)
+		local allowsign = false
+		local allowdot = base == 10
+		local need_tr = false
+		value_is_int = true
+		local function err_invalid(format, ...)
+			diag_err("invalid %s literal" .. format,
+			         value_is_int and "integer" or "floating-point", ...)
+		end
+		while srcidx < srcend do
+			byte = string.byte(src, srcidx)
+			if byte == B('E') or byte == B('e') then
+				if base == 10 then
+					allowsign = true
+					allowdot = false
+					value_is_int = false
+				elseif base ~= 16 then
+					break
+				end
+			elseif byte == B('+') or byte == B('-') then
+				if base ~= 10 or not allowsign then
+					break
+				end
+				value_is_int = false
+			elseif byte == B('.') then
+				if not allowdot then
+					tokstart = srcidx
+					tokend = srcidx + 1
+					err_invalid(": unexpected '.'")
+					break
+				end
+				allowsign = true
+				value_is_int = false
+			elseif byte == B('_') then
+				need_tr = true
+			elseif byte_is_sep(byte) then
+				break
+			end
+			srcidx = srcidx + 1
+		end
+		tokend = srcidx
+		insertsemi = true
+
+		-- interpret number literal
+		local tokstart_off = base ~= 10 and 2 or 0 -- skip leading "0x"
+		value = string.sub(src, tokstart + tokstart_off, tokend - 1)
+		if value_is_int then
+			-- since we don't know the type, interpret number as u64; limit=0xffffffffffffffff
+			value, err = __rt.intscan(value, base, 0xffffffffffffffff)
+			if err ~= 0 then
+				if err == __rt.ERR_RANGE then
+					-- diag_err("integer literal overflows uint64")
+					value = 0
+					return TOK_INTBIG
+				else
+					local errname, errdesc = __rt.errstr(err)
+					err_invalid("; %s", errdesc)
+				end
+			end
+			return base == 10 and TOK_INT or
+			       base ==  2 and TOK_INT2 or
+			       base ==  8 and TOK_INT8 or
+			       base == 16 and TOK_INT16
+		else
+			if need_tr then
+				if string.byte(value, #value - 1) == B('_') then
+					err_invalid("; ends with '_'")
+				end
+				value = string.gsub(value, "_", "")
+			end
+			value = tonumber(value, nil)
+			if value == nil or numtype(value) ~= 'float' then
+				err_invalid("")
+			end
+			return TOK_FLOAT
+		end
+	end
+
+	local function scan_charlit()
+		error("scan_charlit not implemented")
+	end
+	local function scan_strlit()
+		error("scan_strlit not implemented")
+	end
+	local function scan_num0()
+		-- e.g. 0xBEEF, 0o0644, 0b01011, 0.12, 0123
+		local base = 10
+		local byte = curr_byte()
+		if     byte == B('x') or byte == B('X') then base = 16; srcidx = srcidx + 1
+		elseif byte == B('o') or byte == B('O') then base = 8; srcidx = srcidx + 1
+		elseif byte == B('b') or byte == B('B') then base = 2; srcidx = srcidx + 1
+		end
+		return scan_num(base)
+	end
+
+	local function scan_next()
+		value = nil
+		value_is_int = false
+		local byte = 0
+		local insertsemi_do = false
+		local insertsemi_prev = insertsemi
+
+		-- whitespace
+		while true do
+			-- check for end of input
+			if srcidx == srcend then
+				tokend = srcidx
+				tokstart = srcidx
+				if insertsemi then insertsemi = false; return TOK_SEMI end
+				return nil
+			end
+			byte = curr_byte()
+			-- dlog("%3d\t%2d:%-2d\t%02X\t%c",
+			--      srcidx, lineno, column(), byte, (byte > 20) and byte or 0x20)
+			srcidx = srcidx + 1
+			if byte == B('\n') then
+				lineidx = srcidx
+				lineno = lineno + 1
+				insertsemi_do = insertsemi
+			elseif byte ~= B('\t') and byte ~= B(' ') then
+				break
+			end
+		end
+
+		insertsemi = false -- reset state
+		if insertsemi_do then
+			srcidx = srcidx - 1
+			tokstart = tokstart + (tokend - tokstart)
+			return TOK_SEMI
+		end
+		tokstart = srcidx - 1
+		tokend = srcidx
+
+		-- token
+		if     byte == B(';') then return TOK_SEMI
+		elseif byte == B(',') then return TOK_COMMA
+		elseif byte == B(':') then return TOK_COLON
+		elseif byte == B('.') then
+			if next_byte(B('.'),B('.')) then insertsemi = true; return TOK_DOTDOTDOT end
+			return TOK_DOT
+		elseif byte == B('(') then return TOK_LPAREN
+		elseif byte == B(')') then insertsemi = true; return TOK_RPAREN
+		elseif byte == B('[') then return TOK_LBRACK
+		elseif byte == B(']') then insertsemi = true; return TOK_RBRACK
+		elseif byte == B('{') then return TOK_LBRACE
+		elseif byte == B('}') then insertsemi = true; return TOK_RBRACE
+		elseif byte == B('<') then
+			if next_byte(B('<'),B('=')) then return TOK_LTLTEQ end
+			if next_byte(B('<')) then return TOK_LTLT end
+			if next_byte(B('=')) then return TOK_LTEQ end
+			return TOK_LT
+		elseif byte == B('>') then
+			if next_byte(B('>'),B('=')) then return TOK_GTGTEQ end
+			if next_byte(B('>')) then return TOK_GTGT end
+			if next_byte(B('=')) then return TOK_GTEQ end
+			return TOK_GT
+		elseif byte == B('=') then return next_byte(B('=')) and TOK_EQEQ or TOK_EQ
+		elseif byte == B('!') then return next_byte(B('=')) and TOK_NOTEQ or TOK_NOT
+		elseif byte == B('+') then
+			if next_byte(B('+')) then insertsemi = true; return TOK_PLUSPLUS end
+			if next_byte(B('=')) then return TOK_PLUSEQ end
+			return TOK_PLUS
+		elseif byte == B('-') then
+			if next_byte(B('-')) then insertsemi = true; return TOK_MINUSMINUS end
+			if next_byte(B('=')) then return TOK_MINUSEQ end
+			return TOK_MINUS
+		elseif byte == B('*') then
+			if next_byte(B('*')) then return TOK_STARSTAR end
+			if next_byte(B('=')) then return TOK_STAREQ end
+			return TOK_STAR
+		-- elseif byte == 0xC3 and next_byte(0x97) then -- U+00D7 "×"
+		-- 	return TOK_STAR
+		elseif byte == B('/') then
+			if next_byte(B('/')) then
+				insertsemi = insertsemi_prev
+				scan_comment()
+				if include_comments then return TOK_COMMENT end
+				return scan_next()
+			end
+			if next_byte(B('*')) then
+				insertsemi = insertsemi_prev
+				scan_block_comment()
+				if include_comments then return TOK_COMMENT end
+				return scan_next()
+			end
+			if next_byte(B('=')) then return TOK_SLASHEQ end
+			return TOK_SLASH
+		elseif byte == B('%') then return next_byte(B('%')) and TOK_PERCENTEQ or TOK_PERCENT
+		elseif byte == B('^') then return next_byte(B('^')) and TOK_HATEQ or TOK_HAT
+		elseif byte == B('&') then
+			if next_byte(B('&')) then return TOK_ANDAND end
+			if next_byte(B('=')) then return TOK_ANDEQ end
+			return TOK_AND
+		elseif byte == B('|') then
+			if next_byte(B('|')) then return TOK_OROR end
+			if next_byte(B('=')) then return TOK_OREQ end
+			return TOK_OR
+		elseif byte == B('~') then return TOK_TILDE
+		elseif byte == B("'") then return scan_charlit()
+		elseif byte == B('"') then return scan_strlit()
+		elseif byte == B('0') then return scan_num0()
+		elseif byte >= B('1') and byte <= B('9') then return scan_num(10)
+		else return scan_ident()
+		end
+	end
+
+	-- scan & encode tokens
+	local tokens = {}
+	while true do
+		tok = scan_next()
+		if tok == nil then
+			break
+		end
+
+		-- if DEBUG_TOKENS then
+		-- 	dlog("token: %s:%d:%d\t%s\t[%d:%d] '%s'",
+		-- 	     unit.srcfile, lineno, column(), tokname(tok), tokstart, tokend,
+		-- 	     string.sub(src, tokstart, tokend - 1))
+		-- end
+
+		-- Encode token into u64.
+		-- Most tokens need just one u64, where there's no additional value (e.g. punctuation)
+		-- or the value is a small integer (e.g. operator or identifier.)
+		-- Tokens with large or complex values (e.g. floating-point or string literal) have their
+		-- value stored in a second array slot.
+		-- The primary encoding looks like this:
+		--
+		-- bit           1111111111222222222233 333333334444444444555555 55556666
+		--     01234567890123456789012345678901 234567890123456789012345 67890123
+		--     srcpos                           value                    tok
+		--     u32                              u24                      u8
+		--
+		local srcpos = srcpos_make(tokstart, tokend - tokstart)
+		local p1 = tok | (srcpos & 0xffffffff)<<32
+		if value_is_int then
+			if value >= 0 and value < 0xffffff then
+				-- squeeze value into 24 bits of token entry
+				p1 = p1 | value<<8
+				value = nil
+			else
+				p1 = p1 | 0xffffff00
+			end
+		end
+		tokens[#tokens + 1] = p1
+		tokens[#tokens + 1] = value -- no-op if value is nil
+	end
+
+	if DEBUG_TOKENS then
+		dlog("tokens of unit %s:", unit.srcfile); dlog_tokens(tokens, unit)
+	end
+
+	return tokens
+end
+
+
+function token_iterator(tokens)
+	local i, tok, srcpos, value = 1, 0, 0, 0, 0
+	local function next()
+		if i > #tokens then
+			return nil, 0, nil
+		end
+		local v = tokens[i]
+		tok = v & 0xff
+		srcpos = v>>32
+		value = v>>8 & 0xffffff
+		assert(value ~= 0 or tok ~= TOK_ID, "ID with separate value (id_idx > 0xffffff)")
+		if tok == TOK_COMMENT or tok == TOK_FLOAT or
+		   (tok >= TOK_INT and tok <= TOK_INT16 and value == 0xffffff)
+		then
+			i = i + 1 -- value in second array slot
+			value = tokens[i]
+		end
+		i = i + 1
+		return tok, srcpos, value
+	end
+	local function save_state()
+		return { i, tok, srcpos, value }
+	end
+	local function restore_state(snapshot)
+		i, tok, srcpos, value = table.unpack(snapshot)
+		return tok, srcpos, value
+	end
+	return next, save_state, restore_state
+end
+
+
+function dlog_tokens(tokens, unit, line_prefix)
+	local i = 1
+	line_prefix = line_prefix and line_prefix or ""
+	for tok, srcpos, value, meta in token_iterator(tokens) do
+		local srcpos_str = (unit == nil) and "" or srcpos_fmt(srcpos, unit, true)
+		if tok == TOK_INT then
+			value = fmt("%8s", __rt.intfmt(value, 10, true))
+			-- value = fmt("%8d 0x%x", value, value)
+		elseif tok == TOK_INT2 then
+			value = fmt("0b%-8s", __rt.intfmt(value, 2, true))
+		elseif tok == TOK_INT8 then
+			value = fmt("0o%-8s", __rt.intfmt(value, 8, true))
+		elseif tok == TOK_INT16 then
+			value = fmt("0x%-8s", __rt.intfmt(value, 16, true))
+		elseif tok == TOK_FLOAT then
+			value = fmt("%8g", value)
+		elseif tok == TOK_ID then
+			value = id_str(value)
+		else
+			value = tostring(value)
+		end
+		dlog("%s%3d │ %-8s #%-3d %5d+%-3d  %-8s  %8s",
+		     line_prefix, i,
+		     token_names[tok], tok,
+		     srcpos_off(srcpos), srcpos_span(srcpos), srcpos_str,
+		     value)
+		i = i + 1
+	end
+end
+identifiers, identifier_names = {}, {}
+function id_intern(name)
+	local idx = identifier_names[name]
+	if idx == nil then
+		idx = #identifiers + 1
+		-- Note: AST encoding of ID uses a uint24 to encode the identifier index
+		if idx == 0xffffff then error("too many identifiers") end
+		identifiers[idx] = name
+		identifier_names[name] = idx
+		-- dlog("+ID #%4d '%s'", idx, name)
+	end
+	return idx
+end
+
+function assert_id_valid(id_idx)
+	assert(id_idx > 0 and id_idx <= #identifiers, fmt("invalid id_idx %d", id_idx))
+end
+
+function id_str(id_idx) return identifiers[id_idx] end
+
+ID__ = id_intern("_")
+-- Supplementary runtime functions implemented in lua.
+-- Note that most runtime functions are implemented in C.
+
+-- sintconv converts between integer types
+function __rt.sintconv(v, nbits)
+    -- mask
+    local r = v & ((1 << nbits) - 1)
+    -- sign extend if sign bit is set
+    return (v & (1 << (nbits - 1)) ~= 0) and r - (1 << nbits) or r
+end
+
+-- f_trunc_{s,u} converts a floating-point number to an integer by truncation
+function __rt.f_trunc_s(v, nbits)
+    return __rt.sintconv(math.modf(v), nbits)
+end
+function __rt.f_trunc_u(v, nbits)
+    return math.modf(v) & ((1 << nbits) - 1)
+end
+do
+
+function ast_offs_of_idx(idx) return (idx - 1) * 8 end
+function ast_idx_of_offs(offs) return offs//8 + 1 end
+
+-- child visitor functions
+local function visit_i32imm(ast, idx, visit)
+    -- Node { kind u8; _ u24; imm_idx u32; }
+    return visit(ast:get_i32(ast_offs_of_idx(idx) + 4))
+end
+local function visit_i32(ast, idx, visit)
+    -- Node { kind u8; _ u24; meta u32; child_idx i32; }
+    return visit(ast:get_i32(ast_offs_of_idx(idx) + 8))
+end
+local function visit_i32x2(ast, idx, visit)
+    -- Node { kind u8; _ u24; meta u32; child1_idx, child2_idx i32; }
+    local offs = ast_offs_of_idx(idx)
+    visit(ast:get_i32(offs + 8))
+    return visit(ast:get_i32(offs + 12))
+end
+local function visit_i32x3(ast, idx, visit)
+    -- Node { kind u8; _ u24; meta u32; child1_idx, child2_idx, child3_idx i32; }
+    local offs = ast_offs_of_idx(idx)
+    visit(ast:get_i32(offs + 8))
+    visit(ast:get_i32(offs + 12))
+    return visit(ast:get_i32(offs + 16))
+end
+local function visit_list(ast, idx, visit)
+    -- List { kind u8; count u24; meta u32; idxv i32[.count] }
+    local offs = ast_offs_of_idx(idx)
+    local count = ast:get_u32(offs) >> 8
+    for offs = offs + 8, offs + 4 + (count * 4), 4 do
+        visit(ast:get_i32(offs))
+    end
+end
+local function visit_list_2d(ast, idx, visit)
+    -- List2D { kind u8; count1 u24; count2 u32; idx1v i32[.count1]; idx2v i32[.count2] }
+    local offs = ast_offs_of_idx(idx)
+    local count = (ast:get_u32(offs) >> 8) + ast:get_u32(offs + 4)
+    for offs = offs + 8, offs + 4 + (count * 4), 4 do
+        visit(ast:get_i32(offs))
+    end
+end
+local function visit_varlist(ast, idx, visit)
+    -- List { kind u8; count u24; meta u32; vars Var[.count] }
+    local offs = ast_offs_of_idx(idx)
+    local count = ast:get_u32(offs) >> 8
+    offs = offs + 8
+    local end_offs = offs + count*AST_VAR.size
+    while offs < end_offs do
+        visit(ast_idx_of_offs(offs))
+        offs = offs + AST_VAR.size
+    end
+end
+local function visit_TODO(ast, idx) --> fun()i32?
+    local kind = ast:get_u8(ast_offs_of_idx(idx))
+    error("TODO: AST visitor for " .. ast_info[kind].name)
+    return function() end
+end
+
+-- AST nodes
+ast_info = {} -- kind u8 => info table
+local function _(name, descr, visit)
+    local info = {
+        name = name,
+        descr = descr,
+        visit = visit,
+        kind = #ast_info + 1,
+        is_type = name:sub(-4) == "TYPE",
+    }
+    ast_info[info.kind] = info
+    return info
+end
+ast_info[0] = {
+    name = "<?>",
+    descr = "<?>",
+    kind = 0,
+    is_type = false,
+}
+
+-- Pure rvalues (can only be used as rvalues, not as alone as "statements" in a block)
+AST_NIL      = _('NIL',      'nil',                   nil) -- nil
+AST_BOOL     = _('BOOL',     'boolean',               nil) -- true
+AST_INT      = _('INT',      'integer',               nil) -- 123
+AST_FLOAT    = _('FLOAT',    'floating-point number', nil) -- 1.23
+AST_BINOP    = _('BINOP',    'infix operation',       visit_i32x2) -- 2 + 3
+AST_PREFIXOP = _('PREFIXOP', 'prexif operation',      visit_i32) -- -n
+AST_ID       = _('ID',       'identifier',            nil) -- x
+AST_REF      = _('REF',      'REF',                   visit_i32imm) -- <reference>
+AST_TUPLE    = _('TUPLE',    'tuple',                 visit_list) -- (x, 3)
+AST_RVALUE_MAX_KIND = AST_TUPLE.kind
+
+-- other expressions & statements
+AST_NOOP      = _('NOOP',      'NOOP',                nil)
+AST_PARAM     = _('PARAM',     'parameter',           visit_i32x2)   -- x int
+AST_VAR       = _('VAR',       'variable definition', visit_i32)     -- id = expr
+AST_MULTIVAR  = _('MULTIVAR',  'variables',           visit_varlist) -- x, y, z = 1, 2, 3
+AST_SPREADVAR = _('SPREADVAR', 'variables',           visit_varlist) -- x, y, z = expr
+AST_ASSIGN    = _('ASSIGN',    'assignment',          visit_i32x2)   -- x.y = z
+AST_BLOCK     = _('BLOCK',     'block',               visit_list)    -- { ... }
+AST_FUN       = _('FUN',       'function',            visit_i32x3)   -- fun f(x, y T) T
+AST_RETURN    = _('RETURN',    'return statement',    visit_i32)     -- return 3
+AST_CALL      = _('CALL',      'function call',       visit_list)    -- x(y, z)
+AST_CONS      = _('CONS',      'constructor',         visit_list)    -- T(y, z)
+AST_CAST      = _('CAST',      'type cast',           visit_i32)     -- T(x)
+
+-- types
+AST_PRIMTYPE  = _('PRIMTYPE',  'PRIMTYPE',      nil)         -- int
+AST_TUPLETYPE = _('TUPLETYPE', 'tuple type',    visit_list)  -- (T, T)
+AST_FUNTYPE   = _('FUNTYPE',   'function type', visit_i32x2) -- T -> T
+AST_RESTTYPE  = _('RESTTYPE',  'rest type',     visit_i32)   -- ...T
+
+-- TODO
+AST_REST      = _('REST', 'rest', visit_TODO) -- ...
+AST_ARRAYTYPE = _('ARRAYTYPE', 'array type', visit_TODO) -- [T]
+
+--[[
+Node {
+    kind u8
+    _    u24
+    meta union {
+        srcpos  u32
+        typ_idx i32
+        builtin u32
+    }
+}
+]]
+-------------------------------------------------------
+-- Bool { kind u8; value u8; _ u16; meta u32 }
+function AST_BOOL.repr(ast, idx, write)
+    write(ast:get_u8(ast_offs_of_idx(idx) + 1) == 1 and " true" or " false")
+end
+-------------------------------------------------------
+-- Int { kind u8; base u8; is_neg u8; _ u8; meta u32; value u64 }
+function AST_INT.make(ast, meta, base, is_neg, value)
+    local v24 = base | (is_neg and 0x100 or 0x000)
+    return ast_add_u24_u64(ast, AST_INT.kind, meta, v24, value)
+end
+function AST_INT.load(ast, idx) --> base, is_neg, value
+    local offs = ast_offs_of_idx(idx)
+    local h = ast:get_u32(offs)
+    return ((h>>8) & 0xff), (h>>16 & 0xff) == 1, ast:get_i64(offs + 8)
+end
+function AST_INT.str(ast, idx) --> string
+    local base, is_neg, value = AST_INT.load(ast, idx)
+    local prefix = base == 10 and "" or base == 16 and "0x" or base == 8 and "0o" or "0b"
+    return prefix .. __rt.intfmt(value, base, not is_neg)
+end
+function AST_INT.repr(ast, idx, write, repr)
+    return write(" " .. AST_INT.str(ast, idx))
+end
+function AST_INT.fmt(ast, idx, write, fmtchild)
+    return write(AST_INT.str(ast, idx))
+end
+function AST_INT.resolve(ast, idx, ir, resolver, flags)
+    -- if flags & RVALUE == 0 then
+    --     resolver.diag_warn(ast_srcpos(ast, idx), "unused %s", ast_descr(ast, idx))
+    -- end
+    local base, is_neg, value = AST_INT.load(ast, idx)
+
+    -- select type
+    local typ_idx = resolver.ctxtype
+    if not ast_is_inttype(typ_idx) then
+        typ_idx = TYPE_int
+    end
+
+    -- check for overflow
+    local nbits, is_signed = inttype_info(typ_idx)
+    local function err_overflow()
+        resolver.diag_err(ast_srcpos(ast, idx), "integer literal overflows %s",
+                          ast_descr(ast, typ_idx))
+    end
+    if base == 0 then
+        err_overflow()
+    elseif is_signed then
+        local smin = -(1 << (nbits - 1))
+        local smax = (1 << (nbits - 1)) - 1
+        -- dlog("AST_INT.resolve> %s nbits=%d is_signed=%s\n" ..
+        --      "  smin  %20d 0x%016x\n" ..
+        --      "  smax  %20d 0x%016x\n" ..
+        --      "  value " .. (is_neg and "%20d" or "%20u") .. " 0x%016x",
+        --      ast_descr(ast, typ_idx), nbits, tostring(is_signed),
+        --      smin, smin, smax, smax, value, value)
+        if (value < 0 and value < smin) or
+           (value > 0 and value > smax) or
+           (nbits == 64 and not is_neg and value < 0)
+        then
+            err_overflow()
+        end
+    else
+        local umax = (1 << nbits) - 1
+        -- dlog("AST_INT.resolve> %s nbits=%d is_signed=%s\n" ..
+        --      "  umax  %20u 0x%016x\n" ..
+        --      "  value " .. (is_neg and "%20d" or "%20u") .. " 0x%016x",
+        --      ast_descr(ast, typ_idx), nbits, tostring(is_signed),
+        --      umax, umax, value, value)
+        if is_neg then
+            -- e.g. "uint(-3)" or "uint(2 * -3)" or "fun f(x uint); f(-3)"
+            -- Semantics: "uint16(-3)" => "uint16(UINT16_MAX - 3)" => "uint16(0xfffd)"
+            local smin = -(1 << (nbits - 1))
+            if (nbits < 64 and value+1 >= -umax) or value >= smin then
+                value = __rt.intconv(value, 64, nbits, true, false)
+            end
+        end
+        if nbits < 64 and (value < 0 or value > umax) then
+            err_overflow()
+        end
+    end
+
+    return AST_INT.make(ir, typ_idx, base, is_neg, value)
+end
+-------------------------------------------------------
+-- Float { kind u8; _ u24; meta u32;
+--         value f64 }
+function AST_FLOAT.make(ast, meta, value)
+    return ast_add_u24_f64(ast, AST_FLOAT.kind, meta, 0, value)
+end
+function AST_FLOAT.load(ast, idx) --> float
+    return ast:get_f64(ast_offs_of_idx(idx) + 8)
+end
+function AST_FLOAT.repr(ast, idx, write, repr)
+    return write(fmt(" %g", AST_FLOAT.load(ast, idx)))
+end
+function AST_FLOAT.resolve(ast, idx, ir, resolver)
+    -- select type
+    local typ_idx = resolver.ctxtype
+    if not ast_is_floattype(typ_idx) then
+        typ_idx = TYPE_float
+    end
+    return AST_FLOAT.make(ir, typ_idx, ast:get_f64(ast_offs_of_idx(idx) + 8))
+end
+-------------------------------------------------------
+-- Id { kind u8; id_idx u24; meta u32; }
+function AST_ID.make(ast, meta, id_idx)
+    return ast_add_u24(ast, AST_ID.kind, meta, id_idx)
+end
+function AST_ID.repr(ast, idx, write, repr)
+    local id_idx = ast:get_u32(ast_offs_of_idx(idx)) >> 8
+    return write(" " .. id_str(id_idx))
+end
+function AST_ID.resolve(ast, idx, ir, resolver, flags) --> REF
+    local id_idx = ast:get_u32(ast_offs_of_idx(idx)) >> 8
+    local target_idx = resolver.id_lookup(id_idx)
+    if target_idx == 0 then
+        resolver.diag_err(ast_srcpos(ast, idx), "undefined '%s'", id_str(id_idx))
+    elseif target_idx > 0 then
+        -- increment load_count
+        local target_kind = ast_kind(ir, target_idx)
+        if target_kind == AST_VAR.kind or
+           target_kind == AST_PARAM.kind or
+           target_kind == AST_FUN.kind
+        then
+            AST_VAR.load_inc(ir, target_idx, 1)
+        elseif not ast_info[target_kind].is_type then
+            printf("TODO: #%d %s.load_inc (in AST_ID.resolve)",
+                   target_idx, ast_info[target_kind].name)
+        end
+    end
+    if ast_istype(ir, target_idx) then
+        return target_idx
+    end
+    return AST_REF.make(ir, id_idx, target_idx)
+end
+-------------------------------------------------------
+-- Ref { kind u8; id_idx u24; target_idx i32; }
+function AST_REF.make(ast, id_idx, target_idx)
+    return ast_add_u24(ast, AST_REF.kind, target_idx, id_idx)
+end
+function AST_REF.target(ast, idx) --> target_idx, id_idx
+    local offs = ast_offs_of_idx(idx)
+    return ast:get_i32(offs + 4), ast:get_u32(offs) >> 8
+end
+function AST_REF.repr(ast, idx, write, repr)
+    local target_idx, id_idx = AST_REF.target(ast, idx)
+    if id_idx ~= 0 then
+        write(" " .. id_str(id_idx))
+    end
+    return repr(target_idx)
+end
+-------------------------------------------------------
+-- Var { kind u8; id_idx u24; meta u32;
+--       value_idx i32; load_count u16; store_count u16 }
+AST_VAR.size = 16
+function AST_VAR.make(ast, meta, id_idx, value_idx)
+    return ast_add_u24_i32(ast, AST_VAR.kind, meta, id_idx, value_idx)
+end
+function AST_VAR.cons(ast, offs, meta, id_idx, value_idx) --> offs+size
+    return ast_set_u24_i32x2(ast, offs, AST_VAR.kind, meta, id_idx, value_idx, 0)
+end
+function AST_VAR.set_value(ast, offs, value_idx) --> offs+size
+    ast:set_i32(offs + 8, value_idx)
+end
+function AST_VAR.load_inc(ast, idx, additional_count)
+    return ast:inc_u16(ast_offs_of_idx(idx) + 12, additional_count)
+end
+function AST_VAR.store_inc(ast, idx, additional_count)
+    return ast:inc_u16(ast_offs_of_idx(idx) + 14, additional_count)
+end
+function AST_VAR.repr(ast, idx, write, repr)
+    local offs = ast_offs_of_idx(idx)
+    local id_idx = ast:get_u32(offs) >> 8
+    write(" " .. id_str(id_idx))
+    if id_idx ~= ID__ then
+        local load_count = ast:get_u16(offs + 12)
+        local store_count = ast:get_u16(offs + 14)
+        write(fmt(" \x1b[1;34m{stores=%d loads=%d}\x1b[0m", store_count, load_count))
+    end
+    local value_idx = ast:get_i32(offs + 8)
+    return repr(value_idx)
+end
+function AST_VAR.id(ast, idx) --> string
+    local id_idx = ast:get_u32(ast_offs_of_idx(idx)) >> 8
+    return id_str(id_idx)
+end
+function AST_VAR.fmt(ast, idx, write, fmt)
+    return write("'" .. AST_VAR.id(ast, idx) .. "'")
+end
+function AST_VAR.resolve_cons(ast, ir, ast_offs, ir_offs, resolver, flags) --> idx
+    local id_idx = ast:get_u32(ast_offs) >> 8
+    local value_idx = ast:get_i32(ast_offs + 8)
+
+    -- lookup existing storage
+    local def_idx = resolver.id_lookup_def(id_idx)
+
+    -- resolve value, in the context of the storage's type if existing storage was found
+    local def_typ_idx = def_idx == 0 and 0 or resolver.typeof(def_idx)
+    local outer_ctxtype = resolver.ctxtype
+    resolver.ctxtype = def_typ_idx
+    local ir_value_idx = resolver.resolve(value_idx, flags | RVALUE)
+    local value_typ_idx = resolver.typeof(ir_value_idx)
+    resolver.ctxtype = outer_ctxtype
+
+    -- if no existing storage was found, construct a VAR definition
+    if def_idx == 0 then
+        AST_VAR.cons(ir, ir_offs, value_typ_idx, id_idx, ir_value_idx)
+        if value_typ_idx == TYPE_nil and id_idx ~= ID__ then
+            -- TODO: when/if we support optional values, allow use of 'nil' to signify "empty"
+            resolver.diag_err(ast_srcpos(ast, value_idx), "cannot define a variable of type nil")
+        elseif flags & RVALUE ~= 0 then
+            local idx = ast_idx_of_offs(ast_offs)
+            resolver.diag_err(ast_srcpos(ast, idx), "cannot use %s as a result value",
+                  ast_descr(ast, idx))
+            -- avoid "warning: unused variable"
+            AST_VAR.load_inc(ir, ast_idx_of_offs(ir_offs), 1)
+        end
+        return resolver.id_define(id_idx, ast_idx_of_offs(ir_offs))
+    end
+    -- else, construct ASSIGN
+
+    -- check if destination can be stored to
+    local def_kind = ast_kind(ir, def_idx)
+    if def_idx == ir_value_idx then
+        -- e.g. "x = x"
+        resolver.diag_err(
+            srcpos_union(ast_srcpos(ast, ast_idx_of_offs(ast_offs)),
+                         ast_srcpos(ast, value_idx)),
+            "cannot assign %s to itself", ast_descr(ir, def_idx))
+    else
+        resolver.check_type_assignable(def_typ_idx, value_typ_idx, ir_value_idx)
+    end
+
+    -- increment store_count
+    local target_kind = ast_kind(ir, def_idx)
+    if target_kind == AST_VAR.kind or target_kind == AST_PARAM.kind then
+        AST_VAR.store_inc(ir, def_idx, 1)
+    elseif not ast_info[target_kind].is_type then
+        printf("TODO: #%d %s.store_inc", def_idx, ast_kindname(ast, def_idx))
+    end
+
+    AST_ASSIGN.cons(ir, ir_offs, value_typ_idx, def_idx, ir_value_idx)
+    return ast_idx_of_offs(ir_offs)
+end
+function AST_VAR.resolve(ast, idx, ir, resolver, flags)
+    local ast_offs = ast_offs_of_idx(idx)
+    local ir_offs = ir:alloc(AST_VAR.size)
+    return AST_VAR.resolve_cons(ast, ir, ast_offs, ir_offs, resolver, flags)
+end
+-------------------------------------------------------
+-- Assign { kind u8; _ u24; meta u32;
+--          dst_idx i32; value_idx i32; }
+function AST_ASSIGN.cons(ast, offs, meta, dst_idx, value_idx) --> offs+size
+    return ast_set_u24_i32x2(ast, offs, AST_ASSIGN.kind, meta, 0, dst_idx, value_idx)
+end
+-------------------------------------------------------
+-- MultiVar = { kind u8; count u24; meta u32;
+--              vars Var[.count] }
+function AST_MULTIVAR.alloc(ast, meta, count) --> offs
+    return varlist_alloc(ast, AST_MULTIVAR.kind, meta, count)
+end
+function AST_MULTIVAR.resolve(ast, idx, ir, resolver, flags)
+    local ast_offs = ast_offs_of_idx(idx)
+    local count = ast:get_u32(ast_offs) >> 8
+    local ir_offs = varlist_alloc(ir, AST_MULTIVAR.kind, TYPE_nil, count)
+    local ir_idx = ast_idx_of_offs(ir_offs)
+    ast_offs = ast_offs + 8
+    ir_offs = ir_offs + 8
+    for i = 0, count - 1 do
+        AST_VAR.resolve_cons(ast, ir, ast_offs + i*AST_VAR.size, ir_offs + i*AST_VAR.size,
+                             resolver, flags)
+    end
+    return ir_idx
+end
+-------------------------------------------------------
+-- SpreadVar = { kind u8; count u24; meta u32;
+--               vars Var[.count] }
+function AST_SPREADVAR.resolve(ast, idx, ir, resolver, flags)
+    local ast_offs = ast_offs_of_idx(idx)
+    local count = ast:get_u32(ast_offs) >> 8
+    local ir_offs = varlist_alloc(ir, AST_SPREADVAR.kind, TYPE_nil, count)
+    local ir_idx = ast_idx_of_offs(ir_offs)
+    ast_offs = ast_offs + 8
+    ir_offs = ir_offs + 8
+
+    -- temporary storage of effective TUPLETYPE of destination vars
+    typ_idxv = __rt.buf_create(count * 4)
+    typ_idxv:alloc(count * 4)
+
+    -- resolve value (its idx is stored in the first VAR's value_idx slot)
+    local value_idx = ast:get_i32(ast_offs + 8)
+    local ir_value_idx = resolver.resolve(value_idx, flags | RVALUE)
+    local value_typ_idx = resolver.typeof(ir_value_idx)
+
+    -- check if RHS is of tuple type, with matching count
+    local value_count = 0
+    if ast_kind(ir, value_typ_idx) ~= AST_TUPLETYPE.kind then
+        resolver.diag_err(ast_srcpos(ast, value_idx),
+            "cannot spread value of non-tuple type %s", ast_fmt(ir, value_typ_idx))
+    else
+        value_count = ast_list_count(ir, value_typ_idx)
+        if value_count ~= count then
+            if value_count > count then
+                resolver.diag_err(ast_srcpos(ast, value_idx),
+                                  "too many values in spread expression: want %d, got %d",
+                                  count, value_count)
+            else
+                resolver.diag_err(ast_srcpos(ast, value_idx),
+                                  "not enough values in spread expression: want %d, got %d." ..
+                                  " Use '_' to ignore value",
+                                  count, value_count)
+            end
+        end
+    end
+
+    -- resolve VARs as either VAR (definition) or ASSIGN (assignment)
+    for i = 0, count - 1 do
+        local id_idx = ast:get_u32(ast_offs + i*AST_VAR.size) >> 8
+        local def_idx = resolver.id_lookup_def(id_idx)
+        local val_type = TYPE_any
+        if i < value_count then
+            val_type = ast_list_elem(ir, value_typ_idx, i)
+        end
+        if i > 0 then
+            ir_value_idx = 0
+        end
+        if def_idx == 0 then
+            -- variable definition
+            local var_offs = ir_offs + i*AST_VAR.size
+            AST_VAR.cons(ir, var_offs, val_type, id_idx, ir_value_idx)
+            local var_idx = ast_idx_of_offs(var_offs)
+            resolver.id_define(id_idx, var_idx)
+        else
+            -- assignment
+            local def_typ_idx = resolver.typeof(def_idx)
+            if def_typ_idx ~= val_type and val_type ~= TYPE_any then
+                local var_idx = ast_idx_of_offs(ast_offs + i*AST_VAR.size)
+                resolver.diag_err(ast_srcpos(ast, var_idx),
+                    "cannot assign spread value of type %s to %s of type %s",
+                    ast_fmt(ir, val_type), ast_descr(ir, def_idx), ast_fmt(ir, def_typ_idx))
+            end
+            AST_ASSIGN.cons(ir, ir_offs + i*AST_VAR.size, val_type, def_idx, ir_value_idx)
+        end
+    end
+
+    return ir_idx
+end
+-------------------------------------------------------
+-- AstParam { kind u8; id_idx u24; meta u32;
+--            initval_idx i32; typ_idx i32; }
+-- IRParam = Var
+function AST_PARAM.make(ast, meta, id_idx, initval_idx, typ_idx)
+    return ast_add_u24_i32x2(ast, AST_PARAM.kind, meta, id_idx, initval_idx, typ_idx)
+end
+function AST_PARAM.set_type(ast, offs, typ_idx)
+    return ast:set_i32(offs + 12, typ_idx)
+end
+function AST_PARAM.load(ast, idx) --> id_idx, initval_idx, typ_idx
+    local offs = ast_offs_of_idx(idx)
+    return (ast:get_u32(offs) >> 8), ast:get_i32(offs + 8), ast:get_i32(offs + 12)
+end
+function AST_PARAM.repr(ast, idx, write, repr, as_ir)
+    local id_idx, initval_idx, typ_idx = AST_PARAM.load(ast, idx)
+    write(" " .. id_str(id_idx))
+    if as_ir then
+        if id_idx ~= ID__ then
+            local offs = ast_offs_of_idx(idx)
+            local load_count = ast:get_u16(offs + 12)
+            local store_count = ast:get_u16(offs + 14)
+            write(fmt(" \x1b[1;34m{stores=%d loads=%d}\x1b[0m", store_count, load_count))
+        end
+    else
+        repr(typ_idx)
+    end
+    if initval_idx ~= 0 then
+        return repr(initval_idx)
+    end
+end
+function AST_PARAM.fmt(ast, idx, write, fmt)
+    return AST_VAR.fmt(ast, idx, write, fmt)
+end
+function AST_PARAM.resolve(ast, idx, ir, resolver, flags)
+    local offs = ast_offs_of_idx(idx)
+    local id_idx = ast:get_u32(offs) >> 8
+    local initval_idx = ast:get_i32(offs + 8)
+    local typ_idx = ast:get_i32(offs + 12)
+    typ_idx = resolver.resolve(typ_idx, flags | RVALUE)
+    if initval_idx ~= 0 then
+        initval_idx = resolver.resolve(initval_idx, flags | RVALUE)
+        dlog("TODO: PARAM.resovle: check type match of initval_idx vs typ_idx")
+    end
+    local collision = resolver.id_lookup_def_in_current_scope(id_idx)
+    if collision ~= 0 then
+        resolver.diag_err(ast_srcpos(ast, idx), "duplicate parameter '%s'", id_str(id_idx))
+    end
+    idx = AST_PARAM.make(ir, typ_idx, id_idx, initval_idx, 0)
+    return resolver.id_define(id_idx, idx)
+end
+-------------------------------------------------------
+-- List { kind u8; count u24; meta u32;
+--        idxv i32[.count] }
+-- Block = List of Stmt
+function AST_BLOCK.make(ast, meta, idxv_i32)
+    return ast_list_add(ast, AST_BLOCK.kind, meta, idxv_i32)
+end
+function AST_BLOCK.resolve(ast, idx, ir, resolver, flags)
+    local offs = ast_offs_of_idx(idx)
+    local kind, count = 0, ast:get_u32(offs)
+    kind, count = count & 0xff, count >> 8
+    local id_scope = resolver.id_scope_open()
+
+    -- if the block contains just a single thing, just yield that
+    -- e.g. "{3}" => "3"
+    if count == 1 then
+        local elem_idx = ast:get_i32(offs + 8)
+        -- Note: we must keep BLOCK around VAR definition because of lexical scoping of variables
+        if ast_kind(ast, elem_idx) ~= AST_VAR.kind then
+            idx = resolver.resolve(elem_idx, flags)
+            resolver.id_scope_close(id_scope, true)
+            return idx
+        end
+    end
+
+    local ir_offs = ast_list_add_upfront(ir, kind, TYPE_nil, count)
+
+    if count > 0 then
+        -- Open ctxtype scope: saves current resolver.ctxtype and resets it to 0.
+        -- Later, for the last expression of the block, we restore ctxtype.
+        --   e.g. "4" in "uint8({ 4; 5 })" should be interpreted as default "int", not "uint8".
+        local ctxtype = resolver.ctxtype
+        resolver.ctxtype = 0
+        local end_offs = offs + 4 + (count * 4)
+        local elem_offs = ir_offs + 8
+        local elem_idx = 0
+        local child_flags = flags & ~RVALUE
+        for offs = offs + 8, end_offs, 4 do
+            if offs == end_offs then -- last child
+                child_flags = flags
+                resolver.ctxtype = ctxtype
+            end
+
+            elem_idx = ast:get_i32(offs)
+            elem_idx = resolver.resolve(elem_idx, child_flags)
+
+            ir:set_i32(elem_offs, elem_idx)
+            elem_offs = elem_offs + 4
+        end
+        -- When a block is used as an rvalue, its type is the type of the last expression
+        if flags & RVALUE ~= 0 then
+            ir:set_i32(ir_offs + 4, resolver.typeof(elem_idx))
+        end
+    end
+
+    resolver.id_scope_close(id_scope, true)
+
+    return ast_idx_of_offs(ir_offs)
+end
+-------------------------------------------------------
+-- Tuple = List of Expr
+function AST_TUPLE.make(ast, meta, idxv_i32)
+    return ast_list_add(ast, AST_TUPLE.kind, meta, idxv_i32)
+end
+function AST_TUPLE.fmt(ast, idx, write, fmt)
+    return ast_list_fmt(ast, idx, write, fmt)
+end
+function AST_TUPLE.resolve_elems(ast, ast_offs, ir, ir_offs, count, resolver, flags) --> typ_idx
+    -- temporary storage for element types
+    local typ_idxv_offs = 0
+    local typ_idxv = __rt.buf_create(count * 4, count * 4)
+
+    -- ctxtype spread, i.e.
+    --   ctxtype "(TUPLETYPE (int16, uint8))"
+    --   value   "(1, 2)"
+    --   means ctxtype is "int16" for "1" and "uint8" for "2"
+    local ctxtype = resolver.ctxtype
+    local ctxtype_offs = 0
+    if ast_kind(ir, ctxtype) == AST_TUPLETYPE.kind and ast_list_count(ir, ctxtype) >= count then
+        ctxtype_offs = ast_offs_of_idx(ctxtype) + 8 -- first List element
+    end
+
+    -- resolve each element
+    for elem_offs = ast_offs, (ast_offs + ((count - 1) * 4)), 4 do
+        if ctxtype_offs ~= 0 then
+            resolver.ctxtype = ir:get_i32(ctxtype_offs)
+            ctxtype_offs = ctxtype_offs + 4
+        end
+
+        local elem_idx = ast:get_i32(elem_offs)
+        elem_idx = resolver.resolve(elem_idx, flags)
+
+        ir:set_i32(ir_offs, elem_idx)
+        ir_offs = ir_offs + 4
+
+        local elem_typ_idx = resolver.typeof(elem_idx)
+
+        -- If any type is invalid, make the list's type invalid.
+        -- For example in "(x, y, ze)" say "ze" is undefined which means its type is 0,
+        -- then we want the type of the tuple to also be 0. Otherwise we would produce
+        -- cascading (confusing) error messages.
+        if elem_typ_idx == 0 then
+            resolver.ctxtype = ctxtype
+            return 0
+        end
+
+        typ_idxv:set_i32(typ_idxv_offs, elem_typ_idx)
+        typ_idxv_offs = typ_idxv_offs + 4
+    end
+
+    resolver.ctxtype = ctxtype
+
+    -- Intern TUPLETYPE (should match AST_TUPLETYPE.resolve & resolver.intern_type).
+    -- TODO: consider if/when we can use ctxtype (when ctxtype_offs~=0).
+    -- We can simply hash the array of idx values, with the type's kind as the hash seed.
+    local typ_hash = typ_idxv:hash(AST_TUPLETYPE.kind)
+    local typ_idx = resolver.internmap[typ_hash]
+    if typ_idx == nil then
+        typ_idx = ast_list_add(ir, AST_TUPLETYPE.kind, TYPE_type, typ_idxv)
+        resolver.internmap[typ_hash] = typ_idx
+    end
+
+    return typ_idx
+end
+function AST_TUPLE.resolve(ast, idx, ir, resolver, flags)
+    local ast_offs = ast_offs_of_idx(idx)
+    local kind = ast:get_u8(ast_offs)
+    local count = ast:get_u32(ast_offs) >> 8
+    local ir_offs = ast_list_add_upfront(ir, kind, 0, count)
+    local typ_idx = AST_TUPLE.resolve_elems(
+        ast, ast_offs + 8, ir, ir_offs + 8, count, resolver, flags|RVALUE)
+    ir:set_i32(ir_offs + 4, typ_idx)
+    return ast_idx_of_offs(ir_offs)
+end
+-------------------------------------------------------
+
+-- TupleType = List of Type
+function AST_TUPLETYPE.make(ast, meta, idxv_i32)
+    return ast_list_add(ast, AST_TUPLETYPE.kind, meta, idxv_i32)
+end
+function AST_TUPLETYPE.resolve(ast, idx, ir, resolver, flags)
+    local offs = ast_offs_of_idx(idx)
+    local count = ast:get_u32(offs) >> 8
+    local ir_offs = ast_list_add_upfront(ir, AST_TUPLETYPE.kind, TYPE_type, count)
+    local ir_child_offs = ir_offs + 8
+    flags = flags | RVALUE -- make sure IDs resolve to targets rather than REFs
+    for offs = offs + 8, offs + 4 + (count * 4), 4 do
+        local child_idx = resolver.resolve(ast:get_i32(offs), flags)
+        ir:set_i32(ir_child_offs, child_idx)
+        ir_child_offs = ir_child_offs + 4
+    end
+    -- intern type (should match AST_TUPLE.resolve)
+    local hash_offs, hash_size = ir_offs+8, count*4
+    idx = ast_idx_of_offs(ir_offs)
+    return resolver.intern_type(idx, AST_TUPLETYPE.kind, ir_offs, hash_offs, hash_size)
+end
+function AST_TUPLETYPE.fmt(ast, idx, write, fmt)
+    return ast_list_fmt(ast, idx, write, fmt)
+end
+-------------------------------------------------------
+-- Return { kind u8; _ u24; meta u32;
+--          value_idx i32; _ u32; }
+function AST_RETURN.alloc(ast) --> offs
+    return ast:alloc(16)
+end
+function AST_RETURN.cons(ast, offs, meta, value_idx) --> idx
+    ast_set_node(ast, offs, AST_RETURN.kind, meta, 0)
+    ast:set_i32(offs + 8, value_idx)
+    return offs // 8 + 1
+end
+function AST_RETURN.make(ast, meta, value_idx)
+    return AST_RETURN.cons(ast, AST_RETURN.alloc(ast), meta, value_idx)
+end
+function AST_RETURN.value(ast, idx) --> idx
+    return ast:get_i32(ast_offs_of_idx(idx) + 8)
+end
+function AST_RETURN.resolve(ast, idx, ir, resolver, flags)
+    local ir_offs = AST_RETURN.alloc(ir)
+    local typ_idx = TYPE_nil
+    local value_idx = ast:get_i32(ast_offs_of_idx(idx) + 8)
+
+    if resolver.fun_idx == 0 then
+        resolver.diag_err(ast_srcpos(ast, idx), "return statement outside function body")
+        value_idx = 0
+    elseif value_idx ~= 0 then
+        -- set ctxtype to function's result type
+        local outer_ctxtype = resolver.ctxtype
+        resolver.ctxtype = resolver.fun_restyp_idx
+        value_idx = resolver.resolve(value_idx, flags | RVALUE)
+        resolver.ctxtype = outer_ctxtype
+        typ_idx = resolver.typeof(value_idx)
+    end
+
+    local ir_idx = AST_RETURN.cons(ir, ir_offs, typ_idx, value_idx)
+
+    resolver.record_srcpos(ir_idx, ast_srcpos(ast, idx))
+    if resolver.fun_idx ~= 0 then
+        AST_FUN.check_result_type(ir, resolver.fun_idx, ir_idx, resolver)
+    end
+    return ir_idx
+end
+-------------------------------------------------------
+-- Cast { kind u8; _ u24; dst_typ_idx i32;
+--        src_val_idx i32; _ i32 }
+function AST_CAST.make(ast, dst_typ_idx, src_val_idx) --> idx
+    return ast_add_u24_i32(ast, AST_CAST.kind, dst_typ_idx, 0, src_val_idx)
+end
+function AST_CAST.load(ast, idx) --> dst_typ_idx, src_val_idx
+    local offs = ast_offs_of_idx(idx)
+    return ast:get_i32(offs + 4), ast:get_i32(offs + 8)
+end
+-------------------------------------------------------
+-- Cons { kind u8; _ u24; meta u32;
+--        recv_idx i32; args_idxv i32[.count-1]; }
+-------------------------------------------------------
+-- Call { kind u8; count u24; meta u32;            -- List with recv_idx as first element
+--        recv_idx i32; args_idxv i32[.count-1]; }
+function AST_CALL.resolve_cast(ast, idx, ir, resolver, flags, dst_typ, count)
+    local src_idx = (count > 1) and ast:get_i32(ast_offs_of_idx(idx) + 12) or 0
+    resolver.ctxtype = dst_typ
+    src_idx = resolver.resolve(src_idx, flags)
+    local src_typ = resolver.typeof(src_idx)
+
+    -- special handling of "type(expr)"
+    if dst_typ == TYPE_type then
+        -- return (flags & RVALUE ~= 0) and src_typ or AST_REF.make(ir, 0, src_typ)
+        return src_typ
+    end
+
+    -- if argument is already of same type, there's no need for conversion
+    if src_typ == dst_typ or dst_typ == 0 then
+        return src_idx
+    end
+
+    -- if dst_typ > TYPE_any then
+    --     resolver.diag_err(ast_srcpos(ast, idx), "cannot convert %s to %s",
+    --                       ast_descr(ir, src_idx), ast_fmt(ir, dst_typ))
+    --     return 0
+    -- end
+    -- if dst_typ ~= TYPE_any then ... end
+
+    -- Check if types are convertible.
+    -- Note: Currentl resolve_cast is only called when we know that the destination type
+    -- is a primitive. Assert for now, as that may change (i.e. for tuples or arrays)
+    assert(dst_typ < 0 and dst_typ >= TYPE_last_int_type)
+    if src_typ > 0 or src_typ < TYPE_last_int_type then
+        -- source is not a primitive type
+        dlog("TODO: check is_convertible %s -> %s (AST_CALL.resolve_cast)",
+             ast_fmt(ir, src_typ), ast_fmt(ir, dst_typ))
+        resolver.diag_err(ast_srcpos(ast, idx), "cannot convert %s to %s",
+                          ast_fmt(ir, src_typ), ast_fmt(ir, dst_typ))
+        return 0
+    elseif src_typ == TYPE_nil or src_typ == TYPE_type then
+        resolver.diag_err(ast_srcpos(ast, idx), "cannot convert %s to %s",
+                          ast_fmt(ir, src_typ), ast_fmt(ir, dst_typ))
+        return 0
+    elseif src_typ == TYPE_any then
+        error("TODO: convert from 'any' type")
+    end
+
+    return AST_CAST.make(ir, dst_typ, src_idx)
+end
+function AST_CALL.resolve_cons(ast, idx, ir, resolver, flags, recv_idx, count)
+    -- result type of construction is the type being constructed
+    resolver.ctxtype = recv_idx
+
+    -- lookup constructor function for recv_idx
+    local cons_fn_idx = 0 -- TODO FIXME
+    if cons_fn_idx ~= 0 then
+        dlog("TODO: custom constructor call (AST_CALL.resolve_cons)")
+        return AST_CALL.resolve_call(ast, idx, ir, resolver, flags, cons_fn_idx, count)
+    end
+
+    local ir_idx, args_typ = AST_CALL.resolve_call1(
+        ast, idx, ir, resolver, flags, AST_CONS.kind, recv_idx, recv_idx, count)
+    local resolve_default_cons = ast_info[ast_kind(ir, recv_idx)].resolve_default_cons
+    if resolve_default_cons ~= nil then
+        if resolve_default_cons(ir, ir_idx, resolver, recv_idx) then
+            return ir_idx
+        end
+    end
+
+    local args_fmt = "()"
+    if args_typ ~= 0 then
+        args_fmt = ast_fmt(ir, args_typ)
+        if ast_kind(ir, args_typ) ~= AST_TUPLETYPE.kind then
+            args_fmt = "(" .. args_fmt .. ")"
+        end
+    end
+    return resolver.diag_err(ast_srcpos(ast, idx), "no constructor available for %s%s",
+                             ast_fmt(ir, recv_idx), args_fmt)
+end
+function AST_CALL.resolve_call(ast, idx, ir, resolver, flags, recv_idx, count)
+    -- result type of a call is the result type of the function being called
+    local typ_idx = AST_FUN.result_type(ir, recv_idx)
+    resolver.ctxtype = 0
+    dlog("TODO: set ctxtype for %s (AST_CALL.resolve_call)", ast_kindname(ir, recv_idx))
+    return AST_CALL.resolve_call1(
+        ast, idx, ir, resolver, flags, AST_CALL.kind, typ_idx, recv_idx, count)
+end
+function AST_CALL.resolve_call1(ast, idx, ir, resolver, flags, kind, typ_idx, recv_idx, count)
+    --> idx, typ_idx
+    local ast_offs = ast_offs_of_idx(idx)
+    local ir_offs = ast_list_add_upfront(ir, kind, typ_idx, count + 1)
+    ir:set_i32(ir_offs + 8, recv_idx)
+    local args_typ_idx = AST_TUPLE.resolve_elems(
+        ast, ast_offs + 12, ir, ir_offs + 12, count - 1, resolver, flags | RVALUE)
+    -- last list element is TUPLETYPE of arguments
+    ir:set_i32(ir_offs + 8 + count*4, args_typ_idx)
+    return ast_idx_of_offs(ir_offs), args_typ_idx
+end
+function AST_CALL.resolve(ast, idx, ir, resolver, flags) --> idx
+    local ast_offs = ast_offs_of_idx(idx)
+    local count = ast:get_u32(ast_offs) >> 8
+    local recv_idx = ast:get_i32(ast_offs + 8)
+    local ir_recv_idx = ast_deref(ir, resolver.resolve(recv_idx, flags | RVALUE))
+    local outer_ctxtype = resolver.ctxtype
+    if ast_istype(ir, ir_recv_idx) then
+        if ir_recv_idx < 0 and ir_recv_idx >= TYPE_last_int_type then
+            -- there are no constructors for PRIMTYPEs, only conversion: e.g. "int8(int32(1000))"
+            idx = AST_CALL.resolve_cast(ast, idx, ir, resolver, flags, ir_recv_idx, count)
+        else
+            idx = AST_CALL.resolve_cons(ast, idx, ir, resolver, flags, ir_recv_idx, count)
+        end
+    elseif ast_kind(ir, resolver.typeof(ir_recv_idx)) == AST_FUNTYPE.kind then
+        idx = AST_CALL.resolve_call(ast, idx, ir, resolver, flags, ir_recv_idx, count)
+    else
+        idx = 0
+        resolver.diag_err(ast_srcpos(ast, recv_idx), "cannot call %s of type %s",
+                          ast_fmt(ir, ir_recv_idx),
+                          ast_fmt(ir, resolver.typeof(ir_recv_idx)))
+    end
+    resolver.ctxtype = outer_ctxtype
+    return idx
+end
+-------------------------------------------------------
+-- RestType { kind u8; _ u24; meta u32;
+--            elem_typ_idx i32; _ u32; }
+function AST_RESTTYPE.alloc(ast) --> offs
+    return ast:alloc(16)
+end
+function AST_RESTTYPE.cons(ast, offs, meta, elem_typ_idx) --> idx
+    ast_set_node(ast, offs, AST_RESTTYPE.kind, meta, 0)
+    ast:set_i32(offs + 8, elem_typ_idx)
+    return offs // 8 + 1
+end
+function AST_RESTTYPE.make(ast, meta, elem_typ_idx)
+    return AST_RESTTYPE.cons(ast, AST_RESTTYPE.alloc(ast), meta, elem_typ_idx)
+end
+function AST_RESTTYPE.resolve(ast, idx, ir, resolver, flags)
+    local ir_offs = AST_RESTTYPE.alloc(ir)
+
+    local elem_typ_idx = ast:get_i32(ast_offs_of_idx(idx) + 8)
+    elem_typ_idx = resolver.resolve(elem_typ_idx)
+    local typ_idx = resolver.typeof(elem_typ_idx)
+
+    idx = AST_RESTTYPE.cons(ir, ir_offs, typ_idx, elem_typ_idx)
+
+    -- intern type
+    local typ_hash = ir:hash(AST_RESTTYPE.kind, ir_offs, ir_offs+4)
+    local other_idx = resolver.internmap[typ_hash]
+    if other_idx == nil then
+        resolver.internmap[typ_hash] = idx
+        return idx
+    else
+        ir:resize(ir_offs) -- undo additions to IR stack
+        return other_idx
+    end
+end
+-------------------------------------------------------
+-- Fun { kind u8; id_idx u24; meta u32;       ╮_ binary compat. with Var
+--       body_idx i32; load_count u16; _ u16; ╯
+--       params_idx i32; result_idx i32; }
+function AST_FUN.make(ast, meta, id_idx, body_idx, params_idx, result_idx)
+    local header = AST_FUN.kind | (id_idx & 0xffffff)<<8 | ((meta & 0xffffffff) << 32)
+    local offs = ast:push_u64(header)
+    local a = body_idx & 0xffffffff
+    local b = (params_idx & 0xffffffff) | (result_idx & 0xffffffff)<<32
+    ast:push_u64x2(a, b)
+    return ast_idx_of_offs(offs)
+end
+function AST_FUN.alloc(ast, id_idx) --> offs
+    local offs = ast:alloc(24)
+    ast:set_u32(offs, AST_FUN.kind | (id_idx & 0xffffff)<<8)
+    return offs
+end
+function AST_FUN.load(ast, idx) --> id_idx, body_idx, params_idx, result_idx
+    local offs = ast_offs_of_idx(idx)
+    local id_idx = ast:get_u32(offs) >> 8
+    local body_idx = ast:get_i32(offs + 8)
+    local params_idx = ast:get_i32(offs + 16)
+    local result_idx = ast:get_i32(offs + 20)
+    return id_idx, body_idx, params_idx, result_idx
+end
+function AST_FUN.result(ast, idx) --> result_idx
+    return ast:get_i32(ast_offs_of_idx(idx) + 20)
+end
+function AST_FUN.result_type(ast, idx) --> typ_idx
+    local result_idx = ast:get_i32(ast_offs_of_idx(idx) + 20)
+    if ast_kind(ast, result_idx) == AST_TUPLE.kind then
+        -- result is named parameters; use type of that tuple, e.g. "(a, b int)" => "(int,int)"
+        return ast_typeof(ast, result_idx)
+    end
+    return result_idx
+end
+function AST_FUN.body(ast, idx) --> body_idx
+    return ast:get_i32(ast_offs_of_idx(idx) + 8)
+end
+function AST_FUN.repr(ast, idx, write, repr)
+    local id_idx, body_idx, params_idx, result_idx = AST_FUN.load(ast, idx)
+    if id_idx ~= 0 and id_idx ~= ID__ then
+        write(" " .. id_str(id_idx))
+        local load_count = ast:get_u16(ast_offs_of_idx(idx) + 12)
+        write(fmt(" \x1b[1;34m{uses=%d}\x1b[0m", load_count))
+    else
+        write(" _")
+    end
+    if params_idx == 0 and result_idx == 0 and body_idx == 0 then return end
+    repr(params_idx)
+    if result_idx == 0 and body_idx == 0 then return end
+    repr(result_idx)
+    if body_idx == 0 then return end
+    return repr(body_idx)
+end
+function AST_FUN.fmt(ast, idx, write, fmt)
+    -- TODO: custom
+    return AST_VAR.fmt(ast, idx, write, fmt)
+end
+function AST_FUN.resolve(ast, idx, ir, resolver, flags)
+    local id_idx, body_idx, params_idx, result_idx = AST_FUN.load(ast, idx)
+
+    -- make & define function up front, since its params and body may reference it
+    local offs = AST_FUN.alloc(ir, id_idx)
+    resolver.id_define(id_idx, ast_idx_of_offs(offs))
+
+    local child_flags = flags & ~RVALUE
+    local param_scope = resolver.id_scope_open()
+    params_idx = params_idx == 0 and 0 or resolver.resolve(params_idx, child_flags)
+    result_idx = result_idx == 0 and TYPE_nil or resolver.resolve(result_idx, child_flags)
+
+    -- result is named parameters; use type of that tuple, e.g. "(a, b int)" => "(int,int)"
+    local result_typ_idx = result_idx
+    if ast_kind(ir, result_idx) == AST_TUPLE.kind then
+        result_typ_idx = ast_typeof(ir, result_idx)
+    end
+
+    local typ_idx = AST_FUNTYPE.make(ir, resolver, params_idx, result_typ_idx)
+    ir:set_i32(offs + 4, typ_idx)
+    ir:set_i64(offs + 8, 0) -- body_idx i32, load_count u16; _ u16;
+    ir:set_i32(offs + 16, params_idx)
+    ir:set_i32(offs + 20, result_idx) -- body_idx
+
+    local ir_idx = ast_idx_of_offs(offs)
+    local warn_unused = false -- don't warn about unused params unless there's a body
+
+    if body_idx ~= 0 then
+        warn_unused = true
+        resolver.record_srcpos(ir_idx, ast_srcpos(ast, idx))
+
+        local body_scope = resolver.id_scope_open()
+        local outer_fun_idx = resolver.fun_idx
+        local outer_fun_restyp_idx = resolver.fun_restyp_idx
+        resolver.fun_idx = ir_idx
+        resolver.fun_restyp_idx = result_typ_idx
+
+        local outer_ctxtype = resolver.ctxtype
+        if result_idx ~= TYPE_nil then
+            child_flags = child_flags | RVALUE
+            resolver.ctxtype = result_typ_idx
+        else
+            resolver.ctxtype = 0
+        end
+
+        local body_ir_idx = resolver.resolve(body_idx, child_flags)
+
+        resolver.ctxtype = outer_ctxtype
+
+        resolver.fun_restyp_idx = outer_fun_restyp_idx
+        resolver.fun_idx = outer_fun_idx
+        resolver.id_scope_close(body_scope, warn_unused)
+
+        if result_idx ~= TYPE_nil then
+            AST_FUN.check_result_type(ir, ir_idx, body_ir_idx, resolver)
+        end
+
+        ir:set_i32(offs + 8, body_ir_idx)
+    end
+
+    resolver.id_scope_close(param_scope, warn_unused)
+
+    return ir_idx
+end
+function AST_FUN.check_result_type(ir, fun_idx, src_idx, resolver)
+    local dst_idx = AST_FUN.result(ir, fun_idx)
+    local dst_typ_idx = ast_istype(ir, dst_idx) and dst_idx or resolver.typeof(dst_idx)
+    local src_typ_idx = resolver.typeof(src_idx)
+    if resolver.is_type_assignable(dst_typ_idx, src_typ_idx) then
+        return
+    end
+
+    -- select srcpos
+    local focus_idx = src_idx
+    if ast_kind(ir, src_idx) == AST_BLOCK.kind and ast_list_count(ir, src_idx) > 0 then
+        -- use srcpos of last expression of block
+        focus_idx = ast_list_elem(ir, src_idx, ast_list_count(ir, src_idx) - 1)
+    end
+    local srcpos = resolver.srcpos(focus_idx)
+
+    -- produce diagnostic
+    if src_typ_idx == TYPE_nil then
+        srcpos = srcpos_after(srcpos, 0) -- point to just after "return" or after "{" in "{}"
+        resolver.diag_err(srcpos, "missing return value (of type %s)", ast_fmt(ir, dst_typ_idx))
+    else
+        if ast_kind(ir, src_idx) == AST_RETURN.kind then
+            srcpos = resolver.srcpos(AST_RETURN.value(ir, src_idx)) -- point to return value
+        end
+        resolver.diag_err(srcpos,
+                          "returning %s from function with result type %s",
+                          ast_fmt(ir, src_typ_idx), ast_fmt(ir, dst_typ_idx))
+    end
+    -- clear type of value, to avoid reporting more errors about its type
+    ast_set_meta(ir, ast_offs_of_idx(src_idx), 0)
+end
+-------------------------------------------------------
+-- FunType { kind u8; _ u24; meta u32;
+--           param_typ_idx i32; result_typ_idx i32 }
+function AST_FUNTYPE.make(ir, resolver, params_idx, result_typ_idx) --> idx
+    params_idx = ast_typeof(ir, params_idx)
+    local idx = ast_add_u24_i32x2(ir, AST_FUNTYPE.kind, TYPE_type, 0, params_idx, result_typ_idx)
+    local offs = ast_offs_of_idx(idx)
+    return resolver.intern_type(idx, AST_FUNTYPE.kind, offs, offs + 8, 8)
+end
+-------------------------------------------------------
+-- BinOp { kind u8; op u8; _ u16; meta u32; -- op is token for AST, opcode for IR
+--         left_idx i32; right_idx i32 }
+function AST_BINOP.alloc(ast) --> offs
+    return ast:alloc(16)
+end
+function AST_BINOP.cons(ast, offs, meta, op, left_idx, right_idx) --> idx
+    ast_set_node(ast, offs, AST_BINOP.kind, meta, op)
+    ast:set_i64(offs + 8, (left_idx & 0xffffffff) | (right_idx & 0xffffffff)<<32)
+    return offs // 8 + 1
+end
+function AST_BINOP.load(ast, idx) --> op, left_idx, right_idx
+    local offs = ast_offs_of_idx(idx)
+    return ast:get_u8(offs + 1), ast:get_i32(offs + 8), ast:get_i32(offs + 12)
+end
+function AST_BINOP.repr(ast, idx, write, repr, as_ir)
+    local offs = ast_offs_of_idx(idx)
+    local op = ast:get_u8(offs + 1)
+    local left_idx, right_idx = ast:get_i32(offs + 8), ast:get_i32(offs + 12)
+    write(" " .. tokname(op))
+    repr(left_idx)
+    return repr(right_idx)
+end
+function AST_BINOP.resolve(ast, idx, ir, resolver)
+    local offs = ast_offs_of_idx(idx)
+    local op = ast:get_u8(offs + 1)
+    local ir_offs = AST_BINOP.alloc(ir)
+
+    local lval = resolver.resolve(ast:get_i32(offs + 8), RVALUE)
+    local ltyp = resolver.typeof(lval)
+
+    local outer_ctxtype = resolver.ctxtype
+    resolver.ctxtype = ltyp
+
+    local rval = resolver.resolve(ast:get_i32(offs + 12), RVALUE)
+    local rtyp = resolver.typeof(rval)
+
+    resolver.ctxtype = outer_ctxtype
+
+    if ltyp ~= rtyp then
+        if ltyp ~= 0 and rtyp ~= 0 then
+            resolver.diag_err(ast_srcpos(ast, idx),
+                "invalid operation; mismatched types %s and %s",
+                ast_fmt(ir, ltyp), ast_fmt(ir, rtyp))
+        end
+    else -- check if operation is available for type
+        if not op_is_defined(op, ltyp, OP_POS_BIN) then
+            resolver.diag_err(ast_srcpos(ast, idx), "operator %s not defined for type %s",
+                tokname(op), ast_fmt(ir, ltyp))
+        end
+    end
+    return AST_BINOP.cons(ir, ir_offs, ltyp, op, lval, rval)
+end
+-------------------------------------------------------
+-- PrefixOp { kind u8; op u8; _ u16; meta u32;   -- op is token for AST, opcode for IR
+--            operand_idx i32; _ i32 }
+function AST_PREFIXOP.alloc(ast) --> offs
+    return ast:alloc(16)
+end
+function AST_PREFIXOP.cons(ast, offs, meta, op, operand_idx) --> idx
+    ast_set_node(ast, offs, AST_PREFIXOP.kind, meta, op)
+    ast:set_i64(offs + 8, operand_idx & 0xffffffff)
+    return offs // 8 + 1
+end
+function AST_PREFIXOP.load(ast, idx) --> op, operand_idx
+    local offs = ast_offs_of_idx(idx)
+    return ast:get_u8(offs + 1), ast:get_i32(offs + 8)
+end
+function AST_PREFIXOP.repr(ast, idx, write, repr, as_ir)
+    local offs = ast_offs_of_idx(idx)
+    local op = ast:get_u8(offs + 1)
+    write(" " .. tokname(op))
+    local operand_idx = ast:get_i32(offs + 8)
+    return repr(operand_idx)
+end
+function AST_PREFIXOP.resolve(ast, idx, ir, resolver)
+    local offs = ast_offs_of_idx(idx)
+    local op = ast:get_u8(offs + 1)
+    local ir_offs = AST_BINOP.alloc(ir)
+    local ir_operand_idx = resolver.resolve(ast:get_i32(offs + 8), RVALUE)
+    local typ_idx = resolver.typeof(ir_operand_idx)
+    if not op_is_defined(op, typ_idx, OP_POS_PRE) then
+        resolver.diag_err(ast_srcpos(ast, idx), "prefix operator %s not defined for type %s",
+            tokname(op), ast_fmt(ir, typ_idx))
+    end
+    return AST_PREFIXOP.cons(ir, ir_offs, typ_idx, op, ir_operand_idx)
+end
+-------------------------------------------------------
+-- PrimType { u8 kind; u8 flags; id_idx u16; typ_idx i32; }
+function AST_PRIMTYPE.repr(ast, idx, write)
+    write(" " .. id_str(builtin_id_idx(idx)))
+end
+
+
+-- Built-in IR things. They use negative idx in AST & IR, e.g. -7 for "int"
+BUILTIN_TYPE_FLAG_INT    = 1<<0 -- integer
+BUILTIN_TYPE_FLAG_SIGNED = 1<<1 -- signed
+BUILTIN_TYPE_FLAG_BOOL   = 1<<2 -- boolean
+builtin_ir = __rt.buf_create(512)
+builtin_idtab = __rt.buf_create(32) -- [ [id_idx-builtin_idtab_offs] => idx u8 ]
+builtin_idtab_offs = 0xffff
+local function builtin_idtab_set(id_idx, idx) --> -idx
+    assert(id_idx > 0)
+    -- Set builtin_idtab_offs.
+    -- Note: we assume id_idx's are allocated during call to builtin_add
+    if builtin_idtab_offs == 0xffff then
+        builtin_idtab_offs = id_idx
+    else
+        assert(id_idx > builtin_idtab_offs)
+    end
+    local offs = id_idx - builtin_idtab_offs
+    -- dlog("builtin_idtab[%d (id_idx=%d \"%s\")] => #%d", offs, id_idx, id_str(id_idx), -idx)
+    if #builtin_idtab <= offs then builtin_idtab:resize(offs+1, 0) end
+    builtin_idtab:set_u8(offs, idx)
+    return -idx
+end
+function builtin_idtab_lookup(id_idx) --> idx
+    id_idx = id_idx - builtin_idtab_offs
+    if id_idx < 0 or id_idx >= #builtin_idtab then
+        return 0
+    end
+    return -builtin_idtab:get_u8(id_idx)
+end
+function builtin_id_idx(idx) --> id_idx
+    if idx < 0 then idx = -idx end
+    return builtin_ir:get_u16(ast_offs_of_idx(idx) + 2)
+end
+function builtin_name(idx)
+    return id_str(builtin_id_idx(idx))
+end
+function builtin_flags(idx) --> u8
+    if idx < 0 then idx = -idx end
+    return builtin_ir:get_u8(ast_offs_of_idx(idx) + 1)
+end
+local function builtin_add(name, kind, a_u8, typ_idx) --> -idx
+    local id_idx = id_intern(name)
+    assert(id_idx <= 0xffff)
+    kind = kind | (a_u8 & 0xff)<<8 | (id_idx & 0xffff)<<16 | ((typ_idx & 0xffffffff) << 32)
+    local idx = builtin_ir:push_u64(kind) // 8 + 1
+    return builtin_idtab_set(id_idx, idx)
+end
+local function builtin_primtype_add(name, bitsize, flags) --> idx
+    -- bitsize is currently unused
+    return builtin_add(name, AST_PRIMTYPE.kind, flags, TYPE_type)
+end
+
+-- Built-in primitive types
+-- PrimType { u8 kind; u8 flags; id_idx u16; typ_idx i32; }
+TYPE_type  = builtin_add("type", AST_PRIMTYPE.kind, 0, 0)
+TYPE_nil   = builtin_primtype_add("nil",    0, 0)
+TYPE_any   = builtin_primtype_add("any",    0, 0)
+TYPE_bool  = builtin_primtype_add("bool",   1, 0)
+TYPE_float = builtin_primtype_add("float", 64, 0)
+TYPE_int   = builtin_primtype_add("int",   64, BUILTIN_TYPE_FLAG_INT|BUILTIN_TYPE_FLAG_SIGNED)
+TYPE_uint  = builtin_primtype_add("uint",  64, BUILTIN_TYPE_FLAG_INT)
+-- Built-in primitive types, explicit-size integers
+-- Note: If order or stride changes, remember to update inttype_info
+TYPE_last_int_type = TYPE_uint
+for bitsize = 64, 2, -1 do
+    builtin_primtype_add(
+        "int"..tostring(bitsize), bitsize, BUILTIN_TYPE_FLAG_INT|BUILTIN_TYPE_FLAG_SIGNED)
+    TYPE_last_int_type = builtin_primtype_add(
+        "uint"..tostring(bitsize), bitsize, BUILTIN_TYPE_FLAG_INT)
+end
+
+-- Built-in constants
+CONST_nil   = builtin_add("nil", AST_NIL.kind, 0, TYPE_nil) -- note: shadows 'nil' type
+CONST_true  = builtin_add("true", AST_BOOL.kind, 1, TYPE_bool)
+CONST_false = builtin_add("false", AST_BOOL.kind, 0, TYPE_bool)
+
+
+-- Built-in operators
+OP_POS_BIN  = 0 -- requires two operands
+OP_POS_PRE  = 1 -- before one operand
+OP_POS_POST = 2 -- after one operand
+OP_FLAG_TYPE_INT   = 1<<0 -- available for all integer types
+OP_FLAG_TYPE_FLOAT = 1<<1 -- available for all floating-point types
+OP_FLAG_TYPE_BOOL  = 1<<2 -- available for booleans
+local opmap = __rt.buf_create(136)
+-- opmap maps token to operation flags: [ tok = [ binflags u8, preflags u8, postflags u8 ] ]
+_ = function(tok, op_pos, flags) --> nil
+    if #opmap < tok*3 then opmap:resize(tok*3, 0) end
+    opmap:set_u8((tok - 1)*3 + op_pos, flags)
+end
+local Int, Float, Bool = OP_FLAG_TYPE_INT, OP_FLAG_TYPE_FLOAT, OP_FLAG_TYPE_BOOL
+local Bin, Pre, Post = OP_POS_BIN, OP_POS_PRE, OP_POS_POST
+-- comparison
+_(TOK_EQEQ,  Bin, Int|Float) -- (EQ)  L == R
+_(TOK_NOTEQ, Bin, Int|Float) -- (NEQ) L != R
+_(TOK_LT,    Bin, Int|Float) -- (LT)  L <  R
+_(TOK_LTEQ,  Bin, Int|Float) -- (LTE) L <= R
+_(TOK_GT,    Bin, Int|Float) -- (GT)  L >  R
+_(TOK_GTEQ,  Bin, Int|Float) -- (GTE) L >= R
+-- arithmetic
+_(TOK_PLUS,     Bin, Int|Float) -- (ADD) L +  R
+_(TOK_MINUS,    Bin, Int|Float) -- (SUB) L -  R
+_(TOK_STAR,     Bin, Int|Float) -- (MUL) L *  R
+_(TOK_STARSTAR, Bin, Int|Float) -- (EXP) L ** R -- exponentiation
+_(TOK_SLASH,    Bin, Int|Float) -- (DIV) L /  R
+_(TOK_PERCENT,  Bin, Int|Float) -- (MOD) L %  R -- remainder of division
+_(TOK_MINUS,    Pre, Int|Float) -- (NEG)   -  R
+-- bitwise
+_(TOK_AND,   Bin, Int) -- (AND) L &  R
+_(TOK_OR,    Bin, Int) -- (OR)  L |  R
+_(TOK_HAT,   Bin, Int) -- (XOR) L ^  R -- xor
+_(TOK_LTLT,  Bin, Int) -- (LSH) L << R
+_(TOK_GTGT,  Bin, Int) -- (RSH) L >> R
+_(TOK_TILDE, Pre, Int) -- (INV)    ~ R -- invert bits (aka binary NOT)
+-- logical
+_(TOK_ANDAND, Bin, Bool) -- (LAND) L && R
+_(TOK_OROR,   Bin, Bool) -- (LOR)  L || R
+_(TOK_NOT,    Pre, Bool) -- (NOT)     ! R
+-- dlog("opmap: %d B", #opmap)
+----
+function op_is_defined(tok, typ_idx, op_pos) --> bool
+    if typ_idx >= 0 or #opmap < tok*3 then
+        -- (typ_idx >= 0): only built-in types have operations defined (for now)
+        return false
+    end
+    local opflags = opmap:get_u8((tok - 1)*3 + op_pos)
+    if typ_idx == TYPE_bool then
+        return opflags & OP_FLAG_TYPE_BOOL ~= 0
+    elseif typ_idx == TYPE_float then
+        return opflags & OP_FLAG_TYPE_FLOAT ~= 0
+    elseif builtin_flags(typ_idx) & BUILTIN_TYPE_FLAG_INT ~= 0 then
+        return opflags & OP_FLAG_TYPE_INT ~= 0
+    end
+    return false
+end
+
+
+-- Operator precedence
+-- Binary operators of the same precedence associate from left to right.
+-- E.g. x / y * z is the same as (x / y) * z.
+PREC_MAX    = 8  --│ . (member)
+PREC_UNPRE  = 7  --│ +  -  !  ~  *  &  ?
+PREC_UNPOST = 6  --│ ++  --  ()  []
+PREC_BIN5   = 5  --│ *  /  %  <<  >>  &
+PREC_BIN4   = 4  --│ +  -  |  ^
+PREC_BIN3   = 3  --│ ==  !=  <  <=  >  >=
+PREC_BIN2   = 2  --│ &&
+PREC_BIN1   = 1  --│ ||
+PREC_MIN    = 0  --│ ,
+
+-- flags used with resolve and codegen functions
+AST_FLAG_RVALUE = 1<<0 -- as rvalue
+RVALUE = AST_FLAG_RVALUE
+
+end
+
+--------------------------------------------------------------------------------------------------
+
+function ast_srcpos(ast, idx) --> srcpos
+    return ast:get_u32(ast_offs_of_idx(idx) + 4)
+end
+
+function ast_kind(ast, idx) -- u32
+    if idx == 0 then
+        return 0
+    end
+    if idx < 0 then
+        ast = builtin_ir
+        idx = -idx
+    end
+    return ast:get_u8(ast_offs_of_idx(idx))
+end
+
+function ast_kindname(ast, idx) -- string
+    if idx == 0 then
+        return "?"
+    end
+    return ast_info[ast_kind(ast, idx)].name
+end
+
+function ast_istype(ast, idx) -- bool
+    if idx == 0 then
+        return false
+    end
+    return ast_info[ast_kind(ast, idx)].is_type
+end
+
+function ast_is_floattype(idx) --> bool
+    return idx == TYPE_float
+end
+
+function ast_is_inttype(idx) --> bool
+    return idx < 0 and (idx <= TYPE_int and idx >= TYPE_last_int_type)
+end
+
+function inttype_info(idx) --> nbits, is_signed
+    assert(ast_is_inttype(idx))
+    local nbits = idx >= TYPE_uint and 64 or (64 - ((TYPE_uint-1 - idx) // 2))
+    local is_signed = (idx - TYPE_int) % 2 == 0
+    return nbits, is_signed
+end
+
+function ast_deref(ast, idx)
+    while ast_kind(ast, idx) == AST_REF.kind do
+        idx = AST_REF.target(ast, idx)
+    end
+    return idx
+end
+
+function ast_typeof(ast, idx)
+    if idx < 0 then
+        ast = builtin_ir
+        idx = -idx
+    elseif idx == 0 then
+        return 0
+    elseif ast_kind(ast, idx) == AST_REF.kind then
+        return ast_typeof(ast, AST_REF.target(ast, idx))
+    end
+    return ast_deref(ast, ast:get_i32(ast_offs_of_idx(idx) + 4))
+end
+
+--------------------------------------------------------------------------------------------------
+
+function ast_fmt(ast, idx)
+    -- TODO: expand this function into a full-featured code formatter
+    local buf = __rt.buf_create(32)
+    local function write(s)
+        -- if #buf > 0 and buf:get_u8(#buf - 1) ~= " " then
+        --     s = " " .. s
+        -- end
+        return buf:append(s)
+    end
+    local function visit(idx)
+        if idx == 0 or idx == nil then
+            return write("<?>")
+        end
+        if idx < 0 then
+            return write(builtin_name(idx))
+        end
+        local info = ast_info[ast:get_u8(ast_offs_of_idx(idx))]
+        if info.fmt == nil then
+            dlog("TODO: " .. info.name .. ".fmt()")
+            return write(ast_kindname(ast, idx))
+        end
+        return info.fmt(ast, idx, write, visit)
+    end
+    visit(idx)
+    return buf:str()
+end
+
+function ast_descr(ast, idx)
+    if idx < 0 then
+        return builtin_name(idx)
+    end
+    local info = ast_info[ast:get_u8(ast_offs_of_idx(idx))]
+    if info.descr == nil then
+        dlog("TODO: " .. info.name .. ".descr")
+        return ast_kindname(ast, idx)
+    end
+    return info.descr
+end
+
+function ast_repr(unit, idx, as_ir)
+    local ast = as_ir and unit.ir or unit.ast
+    local depth = 0
+    local builtins_use_specialized_repr = true
+    local seen = {}
+    local buf = __rt.buf_create(64)
+    local function write(s) buf:append(s) end
+    local function writef(s, ...) buf:append(fmt(s, ...)) end
+
+    local function visit(idx)
+        local ast1 = ast
+        local idx_orig = idx
+        if idx == 0 then
+            return write(" \x1b[31;1m#0\x1b[0m")
+        elseif idx < 0 then -- built-in thing
+            ast1 = builtin_ir
+            idx = -idx
+        end
+
+        -- special representation of built-ins
+        if builtins_use_specialized_repr and idx_orig < 0 then
+            local prefix = ""
+            if #buf > 0 and buf:get_u8(#buf - 1) ~= 0x28 then -- 0x28 = "("
+                prefix = " "
+            end
+            return writef("%s\x1b[1;32m%s\x1b[0m", prefix, id_str(builtin_id_idx(idx)))
+        end
+
+        -- indentation
+        if depth > 0 then write("\n" .. string.rep("    ", depth)) end
+
+        -- get info
+        -- dlog("VISIT #%d offs=%u", idx_orig, ast_offs_of_idx(idx))
+        local offs = ast_offs_of_idx(idx)
+        local kind = ast1:get_u8(offs)
+        local info = ast_info[kind]
+
+        -- dlog("%srepr> #%d [%u] %s",
+        --      string.rep("    ", depth), idx_orig, offs,
+        --      info == nil and fmt("<kind?%d>", kind) or info.name)
+
+        -- node kind name
+        local style = info.is_type and "1;36" or "1"
+        writef("(\x1b[%sm%s\x1b[0m", style, info.name)
+        writef("\x1b[2m#%d\x1b[0m", idx_orig) -- idx
+
+        -- check if we have seen this already
+        if seen[idx_orig] ~= nil then
+            if seen[idx_orig] == 1 then
+                return write(" <recursive#"..idx_orig..">)")
+            else
+                return write(")")
+            end
+        end
+        seen[idx_orig] = 1
+
+        depth = depth + 1
+
+        -- visit children
+        if info.repr ~= nil then
+            info.repr(ast1, idx, write, visit, as_ir)
+        elseif info.visit ~= nil then
+            info.visit(ast1, idx, visit)
+        end
+
+        -- visit type
+        if as_ir and not ast_istype(ast1, idx) then
+            visit(ast_typeof(ast, idx))
+        end
+
+        -- comments
+        if unit.commentmap ~= nil then
+            local comments = unit.commentmap[idx_orig]
+            if comments ~= nil then
+                write("\n" .. string.rep("    ", depth) .. "\x1b[2;3m(COMMENT")
+                for i, c in ipairs(comments) do
+                    write(" \"")
+                    write(c.value)
+                    write("\"")
+                end
+                write(")\x1b[0m")
+            end
+        end
+
+        depth = depth - 1
+        seen[idx_orig] = 2 -- done
+
+        write(")")
+    end
+
+    visit(idx)
+    return buf:str()
+end
+
+function ir_repr(unit, idx)
+    local as_ir = true
+    return ast_repr(unit, idx, as_ir)
+end
+
+--------------------------------------------------------------------------------------------------
+-- ast encode functions
+
+function ast_set_node(ast, offs, kind, meta, a_u24)
+    return ast:set_i64(offs, kind | (a_u24 & 0xffffff)<<8 | ((meta & 0xffffffff) << 32))
+end
+function ast_set_meta(ast, offs, meta)
+    return ast:set_i32(offs + 4, meta)
+end
+function ast_add_u24(ast, kind, meta, a_u24)
+    kind = kind | (a_u24 & 0xffffff)<<8 | ((meta & 0xffffffff) << 32)
+    return ast:push_u64(kind) // 8 + 1
+end
+function ast_set_u24(ast, offs, kind, meta, a_u24)
+    ast:set_i64(offs, kind | (a_u24 & 0xffffff)<<8 | ((meta & 0xffffffff) << 32))
+    return offs + 16
+end
+function ast_add_u24_u64(ast, kind, meta, a_u24, b_u64)
+    kind = kind | (a_u24 & 0xffffff)<<8 | ((meta & 0xffffffff) << 32)
+    return ast:push_u64x2(kind, b_u64) // 8 + 1
+end
+function ast_add_u24_f64(ast, kind, meta, a_u24, b_f64)
+    kind = kind | (a_u24 & 0xffffff)<<8 | ((meta & 0xffffffff) << 32)
+    local offs = ast:push_u64(kind)
+    ast:push_f64(b_f64)
+    return offs // 8 + 1
+end
+function ast_set_u24_i32x2(ast, offs, kind, meta, a_u24, b_i32, c_i32)
+    ast:set_i64(offs,     kind | (a_u24 & 0xffffff)<<8 | ((meta & 0xffffffff) << 32))
+    ast:set_i64(offs + 8, (b_i32 & 0xffffffff) | (c_i32 & 0xffffffff)<<32)
+    return offs + 16
+end
+function ast_add_u24_i32x2(ast, kind, meta, a_u24, b_i32, c_i32)
+    local a = kind | (a_u24 & 0xffffff)<<8 | ((meta & 0xffffffff) << 32)
+    local b = (b_i32 & 0xffffffff) | (c_i32 & 0xffffffff)<<32
+    return ast:push_u64x2(a, b) // 8 + 1
+end
+function ast_add_u24_i32(ast, kind, meta, a_u24, b_i32)
+    return ast_add_u24_i32x2(ast, kind, meta, a_u24, b_i32, 0)
+end
+
+-- List { kind u8; count u24; meta u32; idxv? i32[.count] }
+function ast_list_add(ast, kind, meta, idxv_i32) --> idx
+    local count = idxv_i32 == nil and 0 or #idxv_i32 // 4
+    local idx = ast_add_u24(ast, kind, meta, count)
+    if count > 0 then
+        ast:append(idxv_i32)
+        if count % 2 == 1 then -- uphold 8-byte alignment of ast
+            ast:push_u32(0)
+        end
+    end
+    return idx
+end
+function ast_list_add_upfront(ast, kind, meta, count) --> offs
+    local offs = ast:alloc(8 + ((count + (count % 2)) * 4))
+    ast:set_i64(offs, kind | (count & 0xffffff)<<8 | ((meta & 0xffffffff) << 32))
+    return offs
+end
+function ast_list_count(ast, idx) --> u32
+    local offs = ast_offs_of_idx(idx)
+    return ast:get_u32(offs) >> 8
+end
+function ast_list_elem(ast, idx, elem_no) --> idx
+    local offs = ast_offs_of_idx(idx)
+    return ast:get_i32(offs + 8 + elem_no*4)
+end
+function ast_list_fmt(ast, idx, write, fmt)
+    local start_offs = ast_offs_of_idx(idx)
+    local count = ast:get_u32(start_offs) >> 8
+    start_offs = start_offs + 8
+    write("(")
+    for offs = start_offs, start_offs + (count-1)*4, 4 do
+        if offs > start_offs then
+            write(",")
+        end
+        fmt(ast:get_i32(offs))
+    end
+    write(")")
+end
+
+-- VarList = { kind u8; count u24; meta u32;
+--             vars Var[.count] }
+function varlist_alloc(ast, kind, meta, count) --> offs
+    local size = 8 + AST_VAR.size*count ; assert(AST_VAR.size % 8 == 0)
+    local offs = ast:alloc(size)
+    ast:set_i64(offs, kind | (count & 0xffffff)<<8 | ((meta & 0xffffffff) << 32))
+    return offs
+end
+
+
+-- -- extend Buf prototype
+-- local Buf = __rt.buf_create(0).__index
+
+-- function Buf.add_u8_u24_u24(buf, kind, a_u8, b_u24, c_u24)
+--     -- { kind u8; a u8; b u24; c u24; }
+--     kind = kind | (a_u8 << 8) | ((b_u24 & 0xffffff) << 16) | ((c_u24 & 0xffffff) << 40)
+--     return buf:push_u64(kind) // 8 + 1
+-- end
+-- function Buf.add_u32(buf, kind, a_u32) -- { kind u8; _ u8; _ u16; a u32; }
+--     return buf:push_u64(kind | (a_u32 & 0xffffffff)<<32) // 8 + 1
+-- end
+-- function Buf.add_u24_u32(buf, kind, a_u24, b_u32) -- { kind u8; a u24; b u32; }
+--     return buf:push_u64(kind | (a_u24 & 0xffffff)<<8 | ((b_u32 & 0xffffffff) << 32)) // 8 + 1
+-- end
+-- function Buf.add_u24_u32_u64(buf, kind, a_u24, b_u32, c_u64)
+--     -- { kind u8; a u24; b u32; c u64; }
+--     kind = kind | (a_u24 & 0xffffff)<<8 | ((b_u32 & 0xffffffff) << 32)
+--     return buf:push_u64x2(kind, c_u64) // 8 + 1
+-- end
+-- flags for parse_unit
+PARSE_SRCMAP = 1 -- enable populating unit.ast_srcmap
+
+function parse_unit(unit, tokens, flags) --> void
+	unit.ast = __rt.buf_create(2048)
+	unit.ast_srcmap = {}
+
+	local ast = unit.ast
+	local exprtab_prefix = {}
+	local exprtab_infix = {}
+	local typetab_prefix = {}
+	local typetab_infix = {}
+	local tok_iter, save_tokenizer_state, tok_iter_restore = token_iterator(tokens)
+	local tok, srcpos_curr, tok_value = 0, 0, nil
+
+	local function ast_make(N, srcpos, ...)
+		return N.cons(ast, N.alloc(ast), srcpos, ...)
+	end
+
+
+	-- tokenizer functions
+	local function next_token()
+		assert(tok ~= nil, "next_token called after already encountering END")
+		tok, srcpos_curr, tok_value = tok_iter()
+	end
+	local function restore_tokenizer_state(snapshot)
+		tok, srcpos_curr, tok_value = tok_iter_restore(snapshot)
+	end
+	local function tok_fastforward(stoptok)
+		-- advance to next semicolon or stoptok, whichever comes first
+		if tok == TOK_SEMI or tok == stoptok then
+			-- make sure we make _some_ progress
+			return tok ~= nil and next_token() or nil
+		end
+		while tok ~= nil and not (tok == TOK_SEMI or tok == stoptok) do
+			next_token()
+		end
+	end
+
+
+	-- comment-handling shims
+	local commentq = {}
+	local commentq_flush
+	if unit.include_comments then
+		-- enable handling of comments
+		unit.commentmap = {} -- idx => [comment]
+		next_token = function()
+			while true do
+				assert(tok ~= nil, "next_token called after already encountering END")
+				tok, srcpos_curr, tok_value = tok_iter()
+				if tok ~= TOK_COMMENT then
+					return
+				end
+				local comment = { tok = tok, value = tok_value, srcpos = srcpos_curr}
+				commentq[#commentq + 1] = comment
+			end
+		end
+		commentq_flush = function(idx)
+			-- if DEBUG_PARSER then
+			-- 	dlog("parse> associating %d comment%s with %s#%d:",
+			-- 	     #commentq, #commentq == 1 and "" or "s", ast_kindname(ast, idx), idx)
+			-- end
+			for i = 1, #commentq do
+				local comments = unit.commentmap[idx]
+				if comments == nil then
+					comments = {}
+					unit.commentmap[idx] = comments
+				end
+				comments[#comments + 1] = commentq[i]
+				commentq[i] = nil
+				-- if DEBUG_PARSER then
+				-- 	local c = comments[#comments]
+				-- 	local line, col = srcpos_linecol(c.srcpos, unit.src)
+				-- 	dlog("  %s\t%s:%d\t%s", tokname(c.tok), line, col, c.value)
+				-- end
+			end
+		end
+	end
+
+
+	-- diagnostics functions
+	local function diag_err(srcpos, format, ...)
+		if (flags & PARSE_SRCMAP) == 0 then
+			dlog("[diag] re-parsing with srcmap enabled")
+			return parse_unit(unit, tokens, flags | PARSE_SRCMAP)
+		end
+		if srcpos == nil then srcpos = srcpos_curr end
+		return diag(unit, DIAG_ERR, srcpos, format, ...)
+	end
+	local function diag_info(srcpos, format, ...)
+		if (flags & PARSE_SRCMAP) == 0 then
+			dlog("[diag] re-parsing with srcmap enabled")
+			return parse_unit(unit, tokens, flags | PARSE_SRCMAP)
+		end
+		if srcpos == nil then srcpos = srcpos_curr end
+		return diag(unit, DIAG_INFO, srcpos, format, ...)
+	end
+
+	local function syntax_error(format, ...)
+		if unit.errcount == 0 or tok ~= nil then -- avoid cascading errors after EOF
+			diag_err(srcpos_curr, format, ...)
+		end
+		return false
+	end
+
+	local function syntax_error_at(srcpos, format, ...)
+		if unit.errcount == 0 or tok ~= nil then -- avoid cascading errors after EOF
+			diag_err(srcpos, format, ...)
+		end
+		return false
+	end
+
+	local function syntax_error_unexpected(expected_tok)
+		if type(expected_tok) == "string" then
+			return syntax_error("unexpected '%s' (expected %s)", tokname(tok), expected_tok)
+		elseif expected_tok == TOK_RBRACE then
+			return syntax_error("unexpected '%s' (expected '%s' or ';')",
+			                    tokname(tok), tokname(expected_tok))
+		else
+			return syntax_error("unexpected '%s' (expected '%s')",
+			                    tokname(tok), tokname(expected_tok))
+		end
+	end
+
+	local function expect(expected_tok)
+		if tok == expected_tok then
+			return next_token()
+		end
+		syntax_error_unexpected(expected_tok)
+		tok_fastforward(expected_tok)
+	end
+
+
+	-- parselets
+	local function parselet(prec, tab_prefix, tab_infix)
+		-- check for end of input
+		if tok == nil then
+			return nil
+		end
+
+		-- prefix
+		local parselet = tab_prefix[tok]
+		if parselet == nil then
+			if unit.errcount == 0 then
+				syntax_error("unexpected '%s'", tokname(tok))
+				tok_fastforward()
+			end
+			return nil
+		end
+		assert(type(parselet) == 'function', fmt("tok='%s'", tokname(tok)))
+		local idx = parselet()
+		-- dlog("parselet> tab_prefix(%s) => %s", tokname(tok), tostring(idx))
+
+		-- infix
+		assert(prec ~= nil)
+		while tok ~= TOK_SEMI do
+			local t = tab_infix[tok] -- { parselet, parselet_prec }
+			if t == nil or t[2] < prec then
+				break
+			end
+			idx = t[1](idx, t[2], tok)
+		end
+
+		return idx
+	end
+
+	local function parse_expr(prec)
+		return parselet(prec, exprtab_prefix, exprtab_infix)
+	end
+
+	local function parse_type(prec)
+		return parselet(prec, typetab_prefix, typetab_infix)
+	end
+
+	local function parse_id_type()
+		local id_idx = tok_value
+		local srcpos = srcpos_curr
+		expect(TOK_ID)
+		return AST_ID.make(ast, srcpos, id_idx)
+	end
+	typetab_prefix[TOK_ID] = parse_id_type
+
+	local function parse_multivar(id_idx, srcpos, count)
+		-- e.g. "x, y, z = 1, 2, 3" or "x, y, z = source"
+
+		-- make list up front, create VARs by reading all IDs
+		local list_offs = AST_MULTIVAR.alloc(ast, srcpos, count)
+		local var_offs = list_offs + 8 -- VARs follow immediately
+		AST_VAR.cons(ast, var_offs, srcpos, id_idx, 0)
+		for i = 1, count - 1 do
+			assert(tok == TOK_COMMA)
+			next_token() -- consume ","
+			AST_VAR.cons(ast, var_offs + AST_VAR.size*i, srcpos_curr, tok_value, 0)
+			next_token() -- consume ID
+		end
+
+		assert(tok == TOK_EQ)
+		next_token() -- consume '='
+
+		-- read values
+		for i = 0, count - 1 do
+			local value_idx = parse_expr(PREC_MIN)
+			AST_VAR.set_value(ast, var_offs + AST_VAR.size*i, value_idx)
+			if i == count - 1 then
+				if tok == TOK_COMMA then -- e.g. "a, b = 1, 2, 3"
+					syntax_error("too many values in multi assignment")
+					tok_fastforward()
+				end
+				break
+			end
+
+			-- check next token
+			if tok == TOK_COMMA then
+				next_token() -- consume ","
+			elseif i == 0 then -- e.g. "x, y, z = tuple"
+				-- Convert AST_MULTIVAR to AST_SPREADVAR and process remaining identifiers
+				ast:set_u8(list_offs, AST_SPREADVAR.kind)
+				while i < count - 1 do
+					i = i + 1
+					AST_VAR.set_value(ast, var_offs + AST_VAR.size*i, 0)
+				end
+				break
+			elseif i < count - 1 then
+				local id_idx = ast:get_u32(var_offs + AST_VAR.size*(i + 1)) >> 8
+				if tok == TOK_SEMI then
+					syntax_error("missing value for '%s'", id_str(id_idx))
+				else
+					syntax_error_unexpected(TOK_COMMA)
+					tok_fastforward(TOK_COMMA)
+				end
+				break
+			end
+		end
+
+		return ast_idx_of_offs(list_offs)
+	end
+
+	local function parse_id_expr()
+		local srcpos = srcpos_curr
+		local id_idx = tok_value
+		next_token() -- consume ID
+
+		-- check for variable assignment, e.g. "x = 1"
+		if tok == TOK_EQ then -- single assignment, e.g. "x = 1"
+			next_token() -- consume "="
+			local value_idx = parse_expr(PREC_MIN)
+			return AST_VAR.make(ast, srcpos, id_idx, value_idx)
+		end
+
+		-- if we see a comma after id, look ahead for multi-var assignment, e.g. "x, y = 1, 2"
+		if tok == TOK_COMMA then
+			local tokstate = save_tokenizer_state()
+			local count = 1
+			next_token() -- consume ","
+			while tok == TOK_ID do
+				count = count + 1
+				next_token() -- consume ID
+				if tok == TOK_EQ then
+					restore_tokenizer_state(tokstate)
+					return parse_multivar(id_idx, srcpos, count)
+				elseif tok ~= TOK_COMMA then
+					break
+				end
+				next_token()
+			end
+			-- nope, this is something else; undo tokenizer changes
+			restore_tokenizer_state(tokstate)
+		end
+
+		return AST_ID.make(ast, srcpos, id_idx)
+	end
+	exprtab_prefix[TOK_ID] = parse_id_expr
+
+	local function parse_rest_expr()
+		error("TODO: convert to new AST")
+		local srcpos = srcpos_curr
+		expect(TOK_DOTDOTDOT)
+		return ast_add(ast_stack, AST_REST, 0, srcpos)
+	end
+	exprtab_prefix[TOK_DOTDOTDOT] = parse_rest_expr
+
+	local function parse_rest_type() -- "... type"
+		local srcpos = srcpos_curr
+		local type_idx = 0
+		expect(TOK_DOTDOTDOT)
+		if tok == TOK_DOTDOTDOT then
+			-- must handle special case of "... ..." here
+			syntax_error("unexpected '...', expected a type")
+			tok_fastforward()
+		else
+			type_idx = parse_type(PREC_MIN)
+		end
+		return AST_RESTTYPE.make(ast, srcpos, type_idx)
+	end
+	typetab_prefix[TOK_DOTDOTDOT] = parse_rest_type
+
+	local function parse_array_type() -- "[type]"
+		error("TODO: convert to new AST")
+		local srcpos = srcpos_curr
+		next_token() -- consume '['
+		parse_type(PREC_MIN)
+		expect(TOK_RBRACK)
+		return AST_ARRAYTYPE.create(ast_stack, srcpos)
+	end
+	typetab_prefix[TOK_LBRACK] = parse_array_type
+
+	-- parse_list and parse_list_elems parses one or more nodes separated by sep_tok.
+	-- Supports trailing sep_tok if stop_tok is provided.
+	local function parse_list_elems(sep_tok, stop_tok, parse_elem_fn, first_idx) --> idxv_i32
+		local idxv_i32 = __rt.buf_create(64)
+		if first_idx ~= nil then
+			idxv_i32:push_u32(first_idx)
+		end
+		while tok ~= stop_tok and tok ~= nil do
+			local idx = parse_elem_fn(PREC_MIN) -- PREC_MIN for sep_tok (',' or ';')
+
+			-- check unexpected EOF, for a partial list, e.g. "{ x; y"
+			if idx == nil then
+				if stop_tok ~= nil and unit.errcount == 0 then
+					syntax_error("unexpected end of input"..
+					             (tok == nil and "input" or "sequence"))
+				end
+				break
+			end
+
+			-- check for sublist, e.g. "x, y" in "{ x, y; z }"
+			if tok ~= sep_tok and tok == TOK_COMMA then
+				local srcpos = srcpos_curr
+				next_token() -- consume ','
+				local idxv2 = parse_list_elems(TOK_COMMA, sep_tok, parse_elem_fn, idx)
+				idx = ast_list_add(ast, AST_TUPLE.kind, srcpos, idxv2)
+			end
+
+			idxv_i32:push_u32(idx)
+
+
+			if tok ~= sep_tok then
+				if stop_tok == nil then
+					syntax_error_unexpected(sep_tok)
+					tok_fastforward()
+				end
+				break
+			end
+
+			next_token() -- consume sep_tok
+
+			if #commentq > 0 then
+				commentq_flush(idx)
+			end
+		end
+		return idxv_i32
+	end
+	local function parse_list(N, srcpos, sep_tok, stop_tok, parse_elem_fn, elide_if_empty) --> idx
+		local idxv_i32 = parse_list_elems(sep_tok, stop_tok, parse_elem_fn)
+		if #idxv_i32 == 0 and elide_if_empty then
+			return 0
+		end
+		-- if there's just one item in the list, return that item instead of creating a list
+		if #idxv_i32 == 4 then
+			return idxv_i32:get_u32(0)
+		end
+		return ast_list_add(ast, N.kind, srcpos, idxv_i32)
+	end
+
+	-- tuples
+	local function parse_tuple_body(N, srcpos, parse_elem_fn, elide_if_empty)
+		-- tuple_body = [ elem ("," elem)* ","? ]
+		-- e.g. "1" "1,2" "1,2,"
+		return parse_list(N, srcpos, TOK_COMMA, TOK_RPAREN, parse_elem_fn, elide_if_empty)
+	end
+	local function parse_tuple(N, parse_elem_fn)
+		-- tuple = "(" [ elem ("," elem)* ","? ] ")"
+		-- e.g. "()" "(1)" "(1,2)" "(1,2,)"
+		local srcpos = srcpos_curr
+		expect(TOK_LPAREN)
+		local elide_if_empty = false
+		local idx = parse_tuple_body(N, srcpos, parse_elem_fn, elide_if_empty, nil)
+		expect(TOK_RPAREN)
+		return idx
+	end
+	local function parse_expr_tuple()
+		return parse_tuple(AST_TUPLE, parse_expr)
+	end
+	local function parse_type_tuple()
+		return parse_tuple(AST_TUPLETYPE, parse_type)
+	end
+	exprtab_prefix[TOK_LPAREN] = parse_expr_tuple
+	typetab_prefix[TOK_LPAREN] = parse_type_tuple
+
+	-- blocks
+	local function parse_block_body(srcpos, stoptok, elide_if_empty)
+		-- block_body = [ expr (";" expr)* ";"? ]
+		-- e.g. "1;" "1;2" "1;2;"
+		local idxv_i32 = parse_list_elems(TOK_SEMI, stoptok, parse_expr)
+		if #idxv_i32 == 0 and elide_if_empty then
+			return 0
+		end
+		return ast_list_add(ast, AST_BLOCK.kind, srcpos, idxv_i32)
+		-- return parse_list(AST_BLOCK, srcpos, TOK_SEMI, stoptok, parse_expr, elide_if_empty)
+	end
+	local function parse_block(elide_if_empty)
+		-- block = "{" [ expr (";" expr)* ";"? ] "}"
+		local srcpos = srcpos_curr
+		expect(TOK_LBRACE)
+		local idx = parse_block_body(srcpos, TOK_RBRACE, elide_if_empty)
+		expect(TOK_RBRACE)
+		return idx
+	end
+	exprtab_prefix[TOK_LBRACE] = function() return parse_block(true) end
+
+	local function parse_params(allow_only_types) --> idx
+		-- Save token & ast state so that we can support only types.
+		-- e.g. undo when we discover "(T, T)" rather than "(name, name T)"
+		local tokstate = allow_only_types and save_tokenizer_state() or nil
+		local aststate = #ast
+
+		local list_srcpos = srcpos_curr
+		local idxv_i32 = __rt.buf_create(64)
+		local type_pending_start = -1 -- offset in idxv_i32
+
+		expect(TOK_LPAREN)
+		local srcpos = 0
+
+		local function report_err(name_id_idx)
+			if builtin_idtab_lookup(name_id_idx) ~= 0 then
+				-- handle common case of built-in named types
+				local f = function(...) return syntax_error_at(srcpos, ...) end
+				if type_pending_start > -1 then -- "(int, float)"
+					return f("missing name of parameters (use '_' for no name)")
+				else -- "(x int, float)"
+					return f("missing name of parameter (use '_' for no name)")
+				end
+			else
+				if type_pending_start > -1 then -- "(x, y)"
+					return f("missing type of parameters")
+				else -- "(x int, y)"
+					return f("missing type of parameter '%s'", id_str(name_id_idx))
+				end
+			end
+		end
+
+		while tok ~= TOK_RPAREN do
+			srcpos = srcpos_curr
+			local name_id_idx = tok_value
+			local typ_idx = 0
+			local value_idx = 0
+
+			-- either a name (param name or type name), or ...type
+			-- expect(TOK_ID)
+			if tok == TOK_ID then
+				next_token()
+			elseif allow_only_types and tok == TOK_DOTDOTDOT then -- ...
+				name_id_idx = ID__
+				typ_idx = parse_type(PREC_MIN)
+				-- ...T must be last parameter
+				if tok ~= TOK_RPAREN then
+					syntax_error_unexpected(TOK_RPAREN)
+					tok_fastforward(TOK_RPAREN)
+					break
+				end
+			elseif allow_only_types then -- T
+				name_id_idx = ID__
+				typ_idx = parse_type(PREC_MIN)
+			else
+				syntax_error_unexpected("parameter name or type")
+				tok_fastforward(TOK_RPAREN)
+				break
+			end
+
+			if tok == TOK_COMMA then
+				-- Type not yet known, e.g. parsing "x" in "(x, y T)"
+				if type_pending_start == -1 then
+					type_pending_start = #idxv_i32
+				end
+			elseif typ_idx == 0 and tok ~= TOK_RPAREN then
+				typ_idx = parse_type(PREC_MIN)
+				allow_only_types = false -- "t,t" no longer allowed when we've seen "x t"
+				-- fixup pending types
+				if type_pending_start > -1 then
+					if tok == TOK_EQ then
+						-- disallow ambiguous situation, e.g.
+						-- "f(x, y int = 2)"; does x have a default value?
+						syntax_error("ambiguous default value only applies to last parameter." ..
+						             " Use explicit type for other parameters")
+					end
+					for offs = type_pending_start, #idxv_i32 - 4, 4 do
+						local param_offs = ast_offs_of_idx(idxv_i32:get_u32(offs))
+						AST_PARAM.set_type(ast, param_offs, typ_idx)
+					end
+					type_pending_start = -1
+				end
+			else
+				if allow_only_types then
+					-- Oh, actually it's just a list of types, e.g. "(int, float)"
+					ast:resize(aststate) -- remove anything we added to the AST
+					restore_tokenizer_state(tokstate)
+					return parse_type_tuple() -- AST_TUPLETYPE
+				else
+					-- e.g. "(x, y)" missing type at end (while requiring types)
+					report_err(name_id_idx)
+				end
+			end
+
+			-- optional initial value, e.g. "x int = 3"
+			if tok == TOK_EQ then
+				next_token() -- consume "="
+				value_idx = parse_expr(PREC_MIN)
+			end
+
+			idxv_i32:push_u32(AST_PARAM.make(ast, srcpos, name_id_idx, value_idx, typ_idx))
+
+			-- If we get something else than a comma here, we are done
+			if tok ~= TOK_COMMA then break end
+			next_token() -- consume ","
+			srcpos = srcpos_curr
+			-- note: this supports trailing comma by virtue of the loop condition
+		end
+
+		expect(TOK_RPAREN)
+
+		-- return nothing, just one param or a tuple of params
+		if #idxv_i32 == 0 then
+			return 0
+		end
+		return ast_list_add(ast, AST_TUPLE.kind, list_srcpos, idxv_i32)
+	end
+
+	local function parse_fun(as_type)
+		local srcpos = srcpos_curr -- position of "fun" keyword
+		next_token() -- consume "fun" keyword
+
+		local name_id_idx = 0
+		local params_idx = 0
+		local result_idx = 0
+		local body_idx = 0
+
+		-- Name
+		if tok == TOK_ID then
+			name_id_idx = tok_value
+			srcpos = srcpos_union(srcpos, srcpos_curr)
+			next_token()
+		end
+
+		-- Parameters, e.g. "(x, y int)" or "()"
+		if tok == TOK_LPAREN then
+			params_idx = parse_params(as_type)
+		end
+
+		-- Return type, e.g. "int", or "(x, y int, z str)".
+		-- Thus, return type can be TUPLE or PARAM, in addition to some TYPE. I.e.
+		--   fun f() int                     -- (PRIMTYPE)
+		--   fun f() (x int)                 -- (PARAM)
+		--   fun f() (x int, y float, z int) -- (TUPLE (PARAM ...))
+		--   fun f() (int, float, int)       -- (TUPLETYPE (TYPE ...))
+		if tok == TOK_LPAREN then -- "fun() (int, int)"
+			result_idx = parse_params(true)
+		elseif tok ~= TOK_LBRACE and tok ~= TOK_SEMI then -- "fun() int"
+			result_idx = parse_type(PREC_MIN)
+			if tok == TOK_COMMA and not as_type then
+				-- handle common error "f () T, Y { ... }"
+				syntax_error("unexpected '%s'; expected '{' or ';'", tokname(tok))
+				diag_info(srcpos_curr, "Wrap multiple results in '(…)'")
+				tok_fastforward()
+			end
+		end
+
+		-- Body, e.g. "{ x; y }", "x;" (equivalent to "{x}")
+		if as_type ~= true and tok ~= TOK_SEMI then
+			body_idx = parse_block(false)
+		end
+
+		return AST_FUN.make(ast, srcpos, name_id_idx, body_idx, params_idx, result_idx)
+	end
+	exprtab_prefix[TOK_FUN] = parse_fun
+
+	local function parse_fun_type() return parse_fun(true) end
+	typetab_prefix[TOK_FUN] = parse_fun_type
+
+	local function parse_int_literal(neg_srcpos)
+		local srcpos = srcpos_curr
+		local value = tok_value
+		local base = tok == TOK_INT   and 10 or
+		             tok == TOK_INT2  and  2 or
+		             tok == TOK_INT8  and  8 or
+		             tok == TOK_INT16 and 16
+		local is_neg = neg_srcpos ~= nil
+		if is_neg then
+			-- has leading '-'; negate (must check for overflow first)
+			srcpos = srcpos_union(neg_srcpos, srcpos)
+			if value < 0 and value > -9223372036854775808 then
+				-- diag_err(srcpos, "integer literal overflows int64")
+				-- communicate to resolver that this value is out of range
+				base = 0
+			end
+			value = -value
+		end
+		next_token()
+		return AST_INT.make(ast, srcpos, base, is_neg, value)
+	end
+	exprtab_prefix[TOK_INT] = parse_int_literal
+	exprtab_prefix[TOK_INT2] = parse_int_literal
+	exprtab_prefix[TOK_INT8] = parse_int_literal
+	exprtab_prefix[TOK_INT16] = parse_int_literal
+	exprtab_prefix[TOK_INTBIG] = function()
+		local srcpos = srcpos_curr
+		next_token()
+		return AST_INT.make(ast, srcpos, 0, false, 0)
+	end
+
+	local function parse_float_literal(neg_srcpos)
+		local srcpos = srcpos_curr
+		local value = tok_value
+		if neg_srcpos ~= nil then
+			-- has leading '-'; negate
+			srcpos = srcpos_union(neg_srcpos, srcpos)
+			value = -value
+		end
+		next_token()
+		return AST_FLOAT.make(ast, srcpos, value)
+	end
+	exprtab_prefix[TOK_FLOAT] = parse_float_literal
+
+	local function parse_return()
+		-- return_stmt = "return" [expr ("," expr)*]
+		local srcpos = srcpos_curr
+		next_token()
+		local value_idx = 0
+		if tok ~= TOK_SEMI and tok ~= TOK_RBRACE then
+			local val_srcpos = srcpos_curr
+			local elide_if_empty = true
+			value_idx = parse_tuple_body(AST_TUPLE, val_srcpos, parse_expr, elide_if_empty, nil)
+		end
+		return AST_RETURN.make(ast, srcpos, value_idx)
+	end
+	exprtab_prefix[TOK_RETURN] = parse_return
+
+	local function parse_assign(left_idx, prec, tok)
+		error("TODO: convert to new AST")
+		local left_kind = ast_kind(ast_stack[left_idx])
+		if left_kind ~= AST_ID.kind then
+			syntax_error("cannot assign to %s", ast_info[left_kind].name)
+		end
+		local srcpos = srcpos_curr
+		next_token()
+		parse_expr(prec)
+		return ast_add_1op(ast_stack, AST_ASSIGN, 0, srcpos, left_idx)
+	end
+	exprtab_infix[TOK_EQ] = { parse_assign, PREC_MIN }
+
+	local function parse_call(recv_idx)
+		local srcpos = srcpos_curr
+		next_token() -- consume "("
+		local idxv_i32 = parse_list_elems(TOK_COMMA, TOK_RPAREN, parse_expr, recv_idx)
+		local idx = ast_list_add(ast, AST_CALL.kind, srcpos, idxv_i32)
+        -- local args_idx = ast_list_add(ast, AST_TUPLE.kind, srcpos, idxv_i32)
+        -- local idx = AST_CALL.make(ast, srcpos, recv_idx, idxv_i32)
+		expect(TOK_RPAREN) -- expect ")"
+		-- return AST_CALL.make(ast, srcpos, recv_idx, args_idx)
+		return idx
+	end
+	exprtab_infix[TOK_LPAREN] = { parse_call, PREC_UNPOST }
+
+	local function parse_binop(left_idx, prec, op)
+		local srcpos = srcpos_curr
+		next_token()
+		local right_idx = parse_expr(prec)
+		-- return ast_make(AST_BINOP, srcpos, op, left_idx, right_idx)
+		return AST_BINOP.cons(ast, AST_BINOP.alloc(ast), srcpos, op, left_idx, right_idx)
+	end
+	-- precedence level 5
+	exprtab_infix[TOK_STAR] = { parse_binop, PREC_BIN5 }
+	exprtab_infix[TOK_STARSTAR] = exprtab_infix[TOK_STAR]
+	exprtab_infix[TOK_SLASH] = exprtab_infix[TOK_STAR]
+	exprtab_infix[TOK_PERCENT] = exprtab_infix[TOK_STAR]
+	exprtab_infix[TOK_LTLT] = exprtab_infix[TOK_STAR]
+	exprtab_infix[TOK_GTGT] = exprtab_infix[TOK_STAR]
+	exprtab_infix[TOK_AND] = exprtab_infix[TOK_STAR]
+	-- precedence level 4
+	exprtab_infix[TOK_PLUS] = { parse_binop, PREC_BIN4 }
+	exprtab_infix[TOK_MINUS] = exprtab_infix[TOK_PLUS]
+	exprtab_infix[TOK_OR] = exprtab_infix[TOK_PLUS]
+	exprtab_infix[TOK_HAT] = exprtab_infix[TOK_PLUS]
+	-- precedence level 3
+	exprtab_infix[TOK_EQEQ] = { parse_binop, PREC_BIN3 }
+	exprtab_infix[TOK_NOTEQ] = exprtab_infix[TOK_EQEQ]
+	exprtab_infix[TOK_LT] = exprtab_infix[TOK_EQEQ]
+	exprtab_infix[TOK_LTEQ] = exprtab_infix[TOK_EQEQ]
+	exprtab_infix[TOK_GT] = exprtab_infix[TOK_EQEQ]
+	exprtab_infix[TOK_GTEQ] = exprtab_infix[TOK_EQEQ]
+	-- precedence level 2
+	exprtab_infix[TOK_ANDAND] = { parse_binop, PREC_BIN2 }
+	-- precedence level 1
+	exprtab_infix[TOK_OROR] = { parse_binop, PREC_BIN1 }
+
+	local function parse_prefixop()
+		local op, srcpos = tok, srcpos_curr
+		local offs = AST_PREFIXOP.alloc(ast)
+		next_token()
+		if op == TOK_MINUS then
+			if tok >= TOK_INT and tok <= TOK_INT16 then
+				return parse_int_literal(srcpos)
+			elseif tok == TOK_FLOAT then
+				return parse_float_literal(srcpos)
+			end
+		end
+		local operand_idx = parse_expr(PREC_UNPRE)
+		return AST_PREFIXOP.cons(ast, offs, srcpos, op, operand_idx)
+	end
+	exprtab_prefix[TOK_MINUS] = parse_prefixop
+	exprtab_prefix[TOK_NOT] = parse_prefixop
+	exprtab_prefix[TOK_TILDE] = parse_prefixop
+
+	-- parse unit
+	next_token()
+	if tok ~= nil then
+		unit.ast_idx = parse_block_body(srcpos_curr, nil, false)
+		-- assert(tok == nil, "stopped before EOF, at " .. tokname(tok))
+	else
+		unit.ast_idx = 0
+	end
+
+	if DEBUG_PARSER then
+		dlog("AST of unit %s: (%u B)", unit.srcfile, #unit.ast)
+		print(ast_repr(unit, unit.ast_idx))
+	end
+end
+function resolve_unit(unit)
+    unit.ir = __rt.buf_create(#unit.ast)
+    unit.ir_srcmap = {} -- set to nil to not save srcpos
+
+    local internmap = {} -- (hash u64) => (idx i32) -- TODO: per package? global?
+    local ast = unit.ast
+    local ir = unit.ir
+    local idstack = __rt.buf_create(256) -- [(id_idx u, idx u32)]
+    local idstack_scope_offs = 0 -- bottom of current scope
+    local resolver = {
+        ctxtype = 0,
+        unit = unit,
+        internmap = internmap,
+        fun_idx = 0, -- current function
+        fun_restyp_idx = 0, -- current function's result type
+    }
+
+    function resolver.typeof(idx)
+        return ast_typeof(ir, idx)
+    end
+
+    function resolver.diag_err(srcpos, format, ...)
+        return diag(unit, DIAG_ERR, srcpos, format, ...)
+    end
+
+    function resolver.diag_warn(srcpos, format, ...)
+        return diag(unit, DIAG_WARN, srcpos, format, ...)
+    end
+
+    function resolver.srcpos(idx)
+        return 0
+    end
+
+    function resolver.resolve(idx, flags) --> ir_idx
+        assert(idx ~= 0)
+        local kind = ast:get_u8(ast_offs_of_idx(idx))
+        local info = ast_info[kind]
+        assert(info.resolve ~= nil, "TODO: " .. info.name .. ".resolve")
+        if flags == nil then
+            flags = 0
+        end
+        return info.resolve(ast, idx, ir, resolver, flags)
+    end
+
+    function resolver.id_scope_open() --> scopestate
+        idstack_scope_offs = #idstack
+        return #idstack
+    end
+
+    function report_unused(idx, offs, kind)
+        -- TODO: for top-level (scope==0), ignore "pub" storage, exported from package
+        local load_and_store_count = ir:get_u32(offs + 12)
+        if load_and_store_count ~= 0 then
+            return
+        end
+        if kind == AST_FUN.kind and AST_FUN.body(ir, idx) == 0 then
+            return resolver.diag_warn(resolver.srcpos(idx),
+                                      "unused function declaration %s", ast_fmt(ir, idx))
+        end
+        return resolver.diag_warn(resolver.srcpos(idx),
+                                  "unused %s %s (use '_' to silence)",
+                                  ast_descr(ir, idx), ast_fmt(ir, idx))
+    end
+
+    function resolver.id_scope_close(scope, warn_unused)
+        assert(scope <= #idstack and scope % 8 == 0, tostring(#idstack) .. ", " .. tostring(scope))
+        if #idstack - scope == 0 then
+            return
+        end
+
+        -- check for unused storage (vars, params, local functions)
+        if warn_unused ~= false then
+            for idstack_offs = scope, #idstack - 8, 8 do
+                local idx = idstack:get_i32(idstack_offs + 4)
+                local offs = ast_offs_of_idx(idx)
+                local kind = ir:get_u8(offs)
+                if kind == AST_VAR.kind or kind == AST_PARAM.kind or kind == AST_FUN.kind then
+                    report_unused(idx, offs, kind)
+                end
+            end
+        end
+
+        idstack:resize(scope)
+        idstack_scope_offs = scope
+    end
+
+    local function idstack_lookup(id_idx, base_offs) --> idx (0 if not found)
+        assert(id_idx ~= 0)
+        if id_idx == ID__ then
+            return 0
+        end
+        local offs = idstack:find_u32(#idstack, base_offs, 8, id_idx)
+        return offs ~= nil and idstack:get_i32(offs + 4) or 0
+    end
+
+    function resolver.id_lookup(id_idx) --> idx (0 if not found)
+        assert(id_idx ~= 0)
+        local idx = idstack_lookup(id_idx, 0)
+        if idx ~= 0 then
+            return idx
+        end
+        -- fall back to looking for a built-in thing
+        return builtin_idtab_lookup(id_idx)
+    end
+
+    function resolver.id_lookup_def(id_idx) --> idx (0 if not found)
+        assert(id_idx ~= 0)
+        return idstack_lookup(id_idx, 0)
+    end
+
+    function resolver.id_lookup_def_in_current_scope(id_idx) --> idx (0 if not found)
+        assert(id_idx ~= 0)
+        return idstack_lookup(id_idx, idstack_scope_offs)
+    end
+
+    function resolver.id_define(id_idx, idx) --> idx
+        if id_idx ~= 0 and id_idx ~= ID__ then
+            idstack:push_u64((id_idx & 0xffffff) | ((idx & 0xffffffff) << 32))
+        end
+        return idx
+    end
+
+    function resolver.record_srcpos(ir_idx, srcpos)
+    end
+
+    function resolver.is_type_assignable(dst_typ_idx, src_typ_idx) --> bool
+        if dst_typ_idx == src_typ_idx then
+            return true
+        elseif (dst_typ_idx == 0 or src_typ_idx == 0) and unit.errcount > 0 then
+            return true -- avoid cascading errors
+        end
+        -- types differ; delegate to AST-kind-specific is_type_assignable function
+        local f = ast_info[ast_kind(ir, dst_typ_idx)].is_type_assignable
+        if f == nil then
+            return false
+        end
+        return f(ir, dst_typ_idx, src_typ_idx)
+    end
+
+    function resolver.check_type_assignable(dst_typ_idx, src_typ_idx, src_idx) --> bool
+        if resolver.is_type_assignable(dst_typ_idx, src_typ_idx) then
+            return true
+        end
+        resolver.diag_err(resolver.srcpos(src_idx ~= 0 and src_idx or src_typ_idx),
+            "value of type '%s' is not assignable to type '%s'",
+            ast_fmt(ir, src_typ_idx), ast_fmt(ir, dst_typ_idx))
+        return false
+    end
+
+    function resolver.intern_type(idx, kind, offs, hash_offs, hash_size) --> idx
+        assert(hash_offs >= offs)
+        local hash = ir:hash(kind, hash_offs, hash_offs + hash_size)
+        local other_idx = internmap[hash]
+        if other_idx ~= nil then
+            ir:resize(offs) -- undo additions to IR stack
+            return other_idx
+        end
+        internmap[hash] = idx
+        return idx
+    end
+
+    -- map ir_idx => srcpos, if requested
+    if unit.ir_srcmap ~= nil then
+        local resolve_fun = resolver.resolve
+        resolver.resolve = function(idx, flags)
+            local srcpos = ast:get_u32(ast_offs_of_idx(idx) + 4)
+            local ir_idx = resolve_fun(idx, flags)
+            -- trace("unit.ir_srcmap[%u] = 0x%08x", ir_idx, srcpos)
+            if ir_idx ~= 0 and ir_idx ~= nil and unit.ir_srcmap[ir_idx] == nil then
+                unit.ir_srcmap[ir_idx] = srcpos
+            end
+            return ir_idx
+        end
+        function resolver.srcpos(idx) --> srcpos
+            local srcpos = unit.ir_srcmap[idx]
+            return srcpos ~= nil and srcpos or 0
+        end
+        function resolver.record_srcpos(ir_idx, srcpos)
+            resolver.unit.ir_srcmap[ir_idx] = srcpos
+        end
+        -- function resolver.record_srcpos(idx, ir_idx)
+        --     resolver.unit.ir_srcmap[ir_idx] = ast_srcpos(ast, idx)
+        -- end
+    end
+
+    -- map ir_idx => [comment], if requested
+    if unit.commentmap ~= nil then
+        local resolve_fun = resolver.resolve
+        local commentmap_orig = unit.commentmap
+        unit.commentmap = {}
+        resolver.resolve = function(idx, flags)
+            local ir_idx = resolve_fun(idx, flags)
+            local comments = commentmap_orig[idx]
+            if comments ~= nil and ir_idx ~= 0 then
+                unit.commentmap[ir_idx] = comments
+            end
+            return ir_idx
+        end
+    end
+
+    if not DEBUG_RESOLVE then
+        unit.ir_idx = resolver.resolve(unit.ast_idx, 0)
+        return
+    end
+
+    -- DEBUG_RESOLVE (remainder of function)
+    -- wrap resolve() in trace statements, if DEBUG_RESOLVE is enabled
+    local trace_depth = 0
+    local function trace(format, ...)
+        dlog("\x1b[1;35mresolve⟩\x1b[0m " .. string.rep("    ", trace_depth) .. format, ...)
+    end
+    resolver.trace = trace
+
+    local id_scope_open_orig = resolver.id_scope_open
+    resolver.id_scope_open = function() --> offs
+        local scope = id_scope_open_orig()
+        trace("id_scope_open %d", scope)
+        return scope
+    end
+
+    local id_scope_close_orig = resolver.id_scope_close
+    resolver.id_scope_close = function(scope, ...)
+        trace("id_scope_close %d", scope)
+        local scope = id_scope_close_orig(scope, ...)
+        return scope
+    end
+
+    local id_define_orig = resolver.id_define
+    resolver.id_define = function(id_idx, idx) --> idx
+        trace("define ID %s => #%d [offs %u, scope %d]",
+              id_str(id_idx), idx, #idstack, idstack_scope_offs//8)
+        return id_define_orig(id_idx, idx)
+    end
+
+    local id_lookup_orig = resolver.id_lookup
+    resolver.id_lookup = function(id_idx)
+        trace("lookup ID %s ...", id_str(id_idx))
+        local idx = id_lookup_orig(id_idx)
+        if idx == 0 then
+            trace("lookup ID %s => NOT FOUND [scope %d]", id_str(id_idx), idstack_scope_offs//8)
+        else
+            trace("lookup ID %s => #%d [scope %d]", id_str(id_idx), idx, idstack_scope_offs//8)
+        end
+        return idx
+    end
+
+    local resolve_orig = resolver.resolve
+    resolver.resolve = function(idx, flags)
+        assert(idx ~= 0, "resolver.resolve(0)")
+        local info = ast_info[ast:get_u8(ast_offs_of_idx(idx))]
+        trace("%s#%d ...", info.name, idx)
+        trace_depth = trace_depth + 1
+        local ir_idx = resolve_orig(idx, flags)
+        trace_depth = trace_depth - 1
+        if ir_idx == 0 or ir_idx == nil then
+            trace("%s#%d => (nothing)", info.name, idx)
+        elseif ir_idx < 0 then
+            trace("%s#%d => builtin#%d %s", info.name, idx, ir_idx, builtin_name(ir_idx))
+        elseif ast_kind(ir, ir_idx) == AST_REF.kind then
+            -- ID & REF are special: stores target in the meta slot (unlike other nodes)
+            local target_idx = AST_REF.target(ir, ir_idx)
+            local typ_idx = resolver.typeof(target_idx)
+            trace("%s#%d => ir#%d REF -> ir#%d %s (type #%d %s)",
+                  info.name, idx, ir_idx, target_idx, ast_kindname(ir, target_idx),
+                  typ_idx, ast_kindname(ir, typ_idx))
+        else
+            local typ_idx = resolver.typeof(ir_idx)
+            trace("%s#%d => ir#%d %s (type #%d %s)",
+                  info.name, idx, ir_idx, ast_kindname(ir, ir_idx),
+                  typ_idx, ast_kindname(ir, typ_idx))
+        end
+        assert(ir_idx ~= nil, info.name .. ".resolve() returned nil")
+                local offs = ast_offs_of_idx(idx)
+        return ir_idx
+    end
+
+    trace("%s", unit.srcfile)
+
+    local unit_scope = resolver.id_scope_open()
+    if unit.ast_idx ~= 0 then
+        unit.ir_idx = resolver.resolve(unit.ast_idx)
+    else
+        unit.ir_idx = 0
+    end
+    resolver.id_scope_close(unit_scope, true)
+
+    printf("IR after resolve_unit: (%d B)", #unit.ir)
+    print(ir_repr(unit, unit.ir_idx))
+end
+local gen = {}
+
+function ast_is_nonnative_inttype(ast, typ_idx) --> bool
+    if ast_is_inttype(typ_idx) then
+        local nbits, _ = inttype_info(typ_idx)
+        return nbits ~= 64
+    end
+    return false
+end
+
+function AST_INT.codegen_lua(ir, idx, g, flags)
+    local _, is_neg, value = AST_INT.load(ir, idx)
+    local typ_idx = ast_typeof(ir, idx)
+    assert(ast_is_inttype(typ_idx))
+    local nbits, is_signed = inttype_info(typ_idx)
+    if (not is_signed and nbits > 63) or (is_neg and value < -9223372036854775807) then
+        -- must encode as hex or lua will convert to float, integers...
+        --   larger than 9223372036854775807 (INT64_MAX), or
+        --   smaller than -9223372036854775807 (INT64_MIN+1)
+        return g.write("0x" .. __rt.intfmt(value, 16, true))
+    end
+    return g.write(__rt.intfmt(value, 10, not is_neg))
+end
+
+function AST_FLOAT.codegen_lua(ir, idx, g, flags)
+    return g.write(tostring(AST_FLOAT.load(ir, idx)))
+end
+
+function AST_PREFIXOP.codegen_lua(ir, idx, g, flags)
+    local op, operand_idx = AST_PREFIXOP.load(ir, idx)
+    local typ_idx = g.typeof(idx)
+    local function gen_expr()
+        g.write(tokname(op))
+        g.codegen(operand_idx, RVALUE)
+    end
+    if ast_is_inttype(typ_idx) then
+        local dst_nbits, dst_is_signed = inttype_info(typ_idx)
+        error("FIXME")
+        return g.intcast(nbits, is_signed, gen_expr)
+    end
+    return gen_expr()
+end
+
+function AST_BINOP.codegen_lua(ir, idx, g, flags)
+    local op, left_idx, right_idx = AST_BINOP.load(ir, idx)
+    local typ_idx = g.typeof(idx)
+
+    local lua_op
+    if op == TOK_SLASH and ast_is_inttype(typ_idx) then -- intdiv
+        lua_op = '//'
+    elseif op == TOK_HAT then -- xor
+        lua_op = '~'
+    elseif op == TOK_STARSTAR then -- exponentiation
+        lua_op = '^'
+    elseif op == TOK_NOTEQ then -- neq
+        lua_op = '~='
+    elseif op == TOK_ANDAND then -- logical and
+        lua_op = 'and'
+    elseif op == TOK_OROR then -- logical or
+        lua_op = 'or'
+    elseif op == TOK_NOT then -- logical not
+        lua_op = 'not'
+    else -- same as dew
+        lua_op = tokname(op)
+    end
+
+    local function gen_expr()
+        g.write("(")
+        g.codegen(left_idx, RVALUE)
+        g.write(lua_op)
+        g.codegen(right_idx, RVALUE)
+        g.write(")")
+    end
+    if ast_is_inttype(typ_idx) then
+        local nbits, is_signed = inttype_info(typ_idx)
+        error("FIXME")
+        return g.intcast(nbits, is_signed, gen_expr)
+    end
+    return gen_expr()
+end
+
+function AST_REF.codegen_lua(ir, idx, g, flags)
+    local target_idx, id_idx = AST_REF.target(ir, idx)
+    if id_idx ~= 0 then
+        return g.write(id_str(id_idx))
+    end
+    return g.codegen(target_idx)
+end
+
+function AST_VAR.codegen_lua(ir, idx, g, flags)
+    local offs = ast_offs_of_idx(idx)
+    local id_idx = ir:get_u32(offs) >> 8
+    local value_idx = ir:get_i32(offs + 8)
+    -- Note: "ast_kind(ir, value_idx) <= AST_RVALUE_MAX_KIND" is needed here since Lua does not
+    -- allow rvalues to be used as statements. For example: (lua)
+    --     do
+    --         1 + 2
+    --     end
+    -- causes "syntax error near 'end'", so we check if the value is an rvalue and actually
+    -- store it to hole '_' if so. Otherwise, for non rvalues and non-pure rvalues,
+    -- like function calls, we elide the hole variable store, e.g. "_ = x()" becomes just "x()"
+    if id_idx ~= ID__ or ast_kind(ir, value_idx) <= AST_RVALUE_MAX_KIND then
+        if id_idx ~= ID__ then
+            g.write("local ")
+        end
+        g.write(id_str(id_idx) .. " = ")
+    end
+    return g.codegen(value_idx, RVALUE)
+end
+
+function AST_ASSIGN.codegen_lua(ir, idx, g, flags)
+    local offs = ast_offs_of_idx(idx)
+    local dst_idx = ir:get_i32(offs + 8)
+    local value_idx = ir:get_i32(offs + 12)
+    local dst_kind = ast_kind(ir, dst_idx)
+
+    if flags & RVALUE ~= 0 then
+        -- e.g. "x = y = 3" => "x = (function() y = 3; return y; end)()"
+        g.write("(function()")
+    end
+
+    local storage_lua = AST_VAR.id(ir, dst_idx)
+    if dst_kind == AST_VAR.kind then
+        g.write(storage_lua)
+    else
+        error("TODO: AST_ASSIGN.codegen_lua: storage %s", ast_descr(ir, dst_idx))
+    end
+
+    g.write(" = ")
+    g.codegen(value_idx, flags | RVALUE)
+
+    if flags & RVALUE ~= 0 then
+        g.write("; return ")
+        g.write(storage_lua)
+        g.write("; end)()")
+    end
+end
+
+function ast_list_elems_codegen_lua(ir, idx, g, flags, sepstr)
+    local offs = ast_offs_of_idx(idx)
+    local count = ir:get_u32(offs) >> 8
+    local end_offs = offs + 4 + (count * 4)
+    for offs = offs + 8, end_offs, 4 do
+        g.codegen(ir:get_i32(offs), flags)
+        if offs ~= end_offs then
+            g.write(sepstr)
+        end
+    end
+end
+
+function AST_TUPLE.codegen_lua(ir, idx, g, flags, is_retval)
+    local offs = ast_offs_of_idx(idx)
+    local count = ir:get_u32(offs) >> 8
+    local end_offs = offs + 4 + (count * 4)
+    flags = flags | RVALUE
+    if not is_retval then
+        g.write("{")
+    end
+    for offs = offs + 8, end_offs, 4 do
+        g.codegen(ir:get_i32(offs), flags)
+        if offs ~= end_offs then
+            g.write(",")
+        end
+    end
+    if not is_retval then
+        g.write("}")
+    end
+end
+
+function AST_BLOCK.codegen_lua(ir, idx, g, flags)
+    local offs = ast_offs_of_idx(idx)
+    local count = ir:get_u32(offs) >> 8
+    local end_offs = offs + 4 + (count * 4)
+
+    local function codegen_elem(idx, flags)
+        if flags & RVALUE == 0 and ast_kind(ir, idx) <= AST_RVALUE_MAX_KIND then
+            -- See "Note" in AST_VAR.codegen_lua
+            g.write("_ = ")
+        end
+        return g.codegen(idx, flags)
+    end
+
+    g.blocknest = g.blocknest + 1
+
+    if g.blocknest == 1 then
+        -- function body or unit
+        -- Make sure to handle implicit return
+        local return_last_elem = flags&RVALUE ~= 0 and g.fun_idx ~= 0
+        for offs = offs + 8, end_offs, 4 do
+            local elem_idx = ir:get_i32(offs)
+            g.write("\n")
+            if offs == end_offs and return_last_elem then
+                if ast_kind(ir, elem_idx) ~= AST_RETURN.kind then
+                    g.write("return ")
+                end
+                g.codegen(elem_idx, flags)
+            else
+                codegen_elem(elem_idx, flags)
+            end
+        end
+    elseif flags & RVALUE == 0 then
+        -- block as statement
+        g.write("do")
+        for offs = offs + 8, end_offs, 4 do
+            g.write("\n")
+            codegen_elem(ir:get_i32(offs), flags)
+        end
+        g.write("\nend")
+    else
+        -- block as expression (value)
+        g.write("(function()")
+        local child_flags = flags & ~RVALUE
+        for offs = offs + 8, end_offs, 4 do
+            if offs == end_offs then
+                child_flags = flags
+                g.write("\nreturn ")
+            else
+                g.write("\n")
+            end
+            codegen_elem(ir:get_i32(offs), child_flags)
+        end
+        g.write("\nend)()")
+    end
+
+    g.blocknest = g.blocknest - 1
+end
+
+function AST_PARAM.codegen_lua(ir, idx, g, flags)
+    local id_idx, initval_idx, typ_idx = AST_PARAM.load(ir, idx)
+    g.write(id_str(id_idx))
+end
+
+function AST_FUN.codegen_lua(ir, idx, g, flags)
+    local id_idx, body_idx, params_idx, result_idx = AST_FUN.load(ir, idx)
+    if body_idx == 0 then
+        -- pure declaration
+        return
+    end
+
+    local is_toplevel = flags&RVALUE == 0 and g.blocknest == 0
+    flags = flags & ~RVALUE
+
+    g.write("function")
+    if id_idx ~= 0 and id_idx ~= ID__ then
+        g.write(" " .. id_str(id_idx))
+    elseif is_toplevel then
+        g.write(" _")
+    end
+
+    -- parameters
+    g.write("(")
+    if ast_kind(ir, params_idx) == AST_TUPLE.kind then
+        -- two or more parameters
+        ast_list_elems_codegen_lua(ir, params_idx, g, flags, ", ")
+    else
+        if params_idx ~= 0 then
+            -- one parameter
+            g.codegen(params_idx, flags)
+        end
+    end
+    g.write(")")
+
+    -- body
+    local body_kind = ast_kind(ir, body_idx)
+    if result_idx ~= TYPE_nil then
+        -- function produces results
+        flags = flags | RVALUE
+    end
+
+    local blocknest = g.blocknest
+    local fun_idx = g.fun_idx
+    g.blocknest = 0
+    g.fun_idx = idx
+
+    if result_idx ~= TYPE_nil and body_kind ~= AST_BLOCK.kind and body_kind ~= AST_RETURN.kind then
+        g.write("return ")
+        g.codegen(body_idx, flags | RVALUE, true)
+    else
+        g.codegen(body_idx, flags)
+    end
+
+    g.fun_idx = fun_idx
+    g.blocknest = blocknest
+
+    g.write(" end")
+end
+
+function AST_RETURN.codegen_lua(ir, idx, g, flags)
+    local value_idx = AST_RETURN.value(ir, idx)
+    if value_idx == 0 then
+        return g.write("return")
+    end
+    g.write("return ")
+    return g.codegen(value_idx, flags | RVALUE, true)
+end
+
+function AST_CAST.codegen_lua(ir, idx, g, flags)
+    local dst_typ, src_val = AST_CAST.load(ir, idx)
+    local src_typ = g.typeof(src_val)
+    local function gen_expr()
+        g.codegen(src_val, RVALUE)
+    end
+
+    if ast_is_inttype(dst_typ) then
+        local dst_nbits, dst_is_signed = inttype_info(dst_typ)
+        if ast_is_inttype(src_typ) then
+            -- int -> int
+            local src_nbits, src_is_signed = inttype_info(src_typ)
+            return g.intcast(src_nbits, src_is_signed, dst_nbits, dst_is_signed, gen_expr)
+        elseif ast_is_floattype(src_typ) then
+            -- float -> int
+            g.write(dst_is_signed and "__rt.f_trunc_s(" or "__rt.f_trunc_u(")
+            gen_expr(); g.write(fmt(",%u)", dst_nbits))
+            return
+        else
+            error(fmt("TODO: %s -> %s", ast_fmt(ir, src_typ), ast_fmt(ir, dst_typ)))
+        end
+    elseif ast_is_floattype(dst_typ) then
+        -- if ast_is_inttype(src_typ) then
+        --     -- int -> float
+        -- end
+        error(fmt("TODO: %s -> %s", ast_fmt(ir, src_typ), ast_fmt(ir, dst_typ)))
+    else
+        error(fmt("TODO: %s -> %s", ast_fmt(ir, src_typ), ast_fmt(ir, dst_typ)))
+    end
+
+    return gen_expr()
+end
+
+
+---------------------------------------------------------------------------------------------------
+
+function codegen_lua(unit) -- code
+    if DEBUG_CODEGEN then dlog("\x1b[1;34mcodegen %s -> lua\x1b[0m", unit.srcfile) end
+
+    local ir = unit.ir
+    local depth = 0
+    local buf = __rt.buf_create(512)
+    local g = {
+        unit = unit,
+        blocknest = 0, -- current block depht, 0 = function or unit body
+        fun_idx = 0, -- current function
+    }
+
+    function g.write(s) buf:append(s) end
+
+    function g.typeof(idx)
+        local ast = ir
+        if idx < 0 then
+            ast = builtin_ir
+            idx = -idx
+        end
+        return ast:get_i32(ast_offs_of_idx(idx) + 4)
+    end
+
+    function g.intcast(src_nbits, src_is_signed, dst_nbits, dst_is_signed, inner_fn)
+        if src_nbits < dst_nbits and (not src_is_signed or dst_is_signed) then
+            -- trivial extension, e.g. u16(u8(3))=>3 or i16(u8(3))=>3 or i16(i8(-3))=>-3
+            return inner_fn()
+        elseif dst_is_signed then
+            -- mask & sign extend if needed (depends on value, so done at runtime)
+            g.write("__rt.sintconv("); inner_fn(); return g.write(fmt(",%u)", dst_nbits))
+        else
+            -- simple truncation
+            g.write("("); inner_fn(); return g.write(fmt("&0x%x)", (1 << dst_nbits) - 1))
+        end
+    end
+
+    function g.codegen(idx, flags, is_retval)
+        assert(idx ~= 0, "g.codegen got idx #0")
+        local kind
+        if idx > 0 then
+            kind = ir:get_u8(ast_offs_of_idx(idx))
+        else
+            kind = builtin_ir:get_u8(ast_offs_of_idx(-idx))
+        end
+        local info = ast_info[kind]
+        assert(info.codegen_lua ~= nil, "TODO: " .. info.name .. ".codegen_lua")
+        if flags == nil then
+            flags = 0
+        end
+        return info.codegen_lua(ir, idx, g, flags == nil and 0 or flags, is_retval)
+    end
+
+    if unit.ir_idx ~= 0 then
+        g.codegen(unit.ir_idx, 0)
+    end
+
+    local code = buf:str()
+
+    if DEBUG_CODEGEN then
+        print("\x1b[2m——————————————————————————————————————————————————\x1b[0;1m")
+        print(code)
+        print("\x1b[0;2m——————————————————————————————————————————————————\x1b[0m")
+    end
+    return code
+end
+
+
+function codegen_intconv(g, src_issigned, src_bits, dst_issigned, dst_bits, src_expr_gen)
+    if src_bits == dst_bits --[[and src_issigned == dst_issigned]] then
+        return src_expr_gen()
+    end
+    if not src_issigned and not dst_issigned then
+        g.write("(")
+        src_expr_gen()
+        local mask = (1 << math.min(src_bits, dst_bits)) - 1
+        g.write(fmt(" & 0x%x)", mask))
+    else
+        -- __rt.intconv(srcval, src_bits, dst_bits, src_issigned, dst_issigned)
+        g.write("__rt.intconv(")
+        src_expr_gen()
+        g.write(fmt(",%d,%d,%s,%s)",
+                    src_bits,
+                    dst_bits,
+                    src_issigned and "true" or "false",
+                    dst_issigned and "true" or "false"))
+    end
+end
+--[[
+'runtime' library exported as '__rt' implemented in runtime.c:
+
+type error int
+fun errstr(e error) (name, description str)
+fun intscan(s str, base int = 10, limit u64 = U64_MAX, isneg bool = false) (u64, error)
+fun intfmt(value i64, base int, is_unsigned bool = false) (str, error)
+fun intconv(value i64, src_bits, dst_bits uint, src_issigned, dst_issigned bool) int
+
+// error constants
+const ERR_OK
+const ERR_INVALID
+const ERR_RANGE
+const ERR_INPUT
+const ERR_...
+
+]]
+
+--require("util")
+--require("dew_debug")
+--require("hash")
+--require("unit")
+--require("diag")
+--require("srcpos")
+--require("tokenize")
+--require("id")
+--require("runtime")
+--require("ast")
+--require("parse")
+--require("resolve")
+--require("codegen")
+
+VERSION = "0.1"
+DEBUG_TOKENS = false
+DEBUG_PARSER = false
+DEBUG_RESOLVE = false
+DEBUG_CODEGEN = false
+VERBOSE = 1 -- 0=quiet, 1=normal, 2=verbose
+
+
+---------------------------------------------------------------------------------------------------
+-- run
+---------------------------------------------------------------------------------------------------
+
+
+function run(unit, code)
+	print("—— run")
+	code = "print(" .. code .. ")" -- XXX TEMP
+	local env = _ENV
+	local func, err = load(code, unit.srcfile, "t", env)
+	if not func then
+		print("Compile error: " .. err)
+	else
+		print(func())
+	end
+end
+
+
+---------------------------------------------------------------------------------------------------
+-- main
+---------------------------------------------------------------------------------------------------
+
+
+
+USAGE = [[
+usage: %s [options] <input> ...
+options:
+    -h, --help          Print help and exit
+    -v, --verbose       Log extra information
+    --version           Print version and exit
+    --debug-tokens      Print details about source tokenization
+    --debug-parse       Print details about parsing
+    --debug-resolve     Print details about identifier & type resolution
+    --debug-codegen     Print details about code generation
+    --debug-all         Print details about all phases
+    --selftest[=filter] Run tests of dew itself
+    --selftest-verbose  Print details about selftest
+<input>: file path]]
+
+function parse_args(args)
+	local opt = {
+		version = false,
+		selftest = nil, -- string?
+		selftest_verbose = false,
+		args = {}
+	}
+	local i = 1
+	while i <= #args do
+		local arg = args[i]
+		if arg == "-h" or arg == "--help" then
+			printf(USAGE, args[0])
+			os.exit(0)
+		elseif arg == "--version" then
+			print("dew version " .. VERSION)
+			os.exit(0)
+		elseif arg == "--debug-tokens" then
+			DEBUG_TOKENS = true
+		elseif arg == "--debug-parse" then
+			DEBUG_PARSER = true
+		elseif arg == "--debug-resolve" then
+			DEBUG_RESOLVE = true
+		elseif arg == "--debug-codegen" then
+			DEBUG_CODEGEN = true
+		elseif arg == "--selftest" then
+			opt.selftest = ""
+		elseif string_starts_with(arg, "--selftest=") then
+			opt.selftest = arg:sub(#"--selftest=" + 1)
+		elseif arg == "--selftest-verbose" then
+			opt.selftest_verbose = true
+		elseif arg == "--debug-all" then
+			DEBUG_TOKENS = true
+			DEBUG_PARSER = true
+			DEBUG_CODEGEN = true
+			DEBUG_RESOLVE = true
+		elseif arg == "-v" or arg == "--verbose" then
+			VERBOSE = 2
+		elseif arg == "-" or not arg:match("^%-") then
+			table.insert(opt.args, arg)
+		else
+			print("Unknown option: " .. arg)
+			os.exit(1)
+		end
+		i = i + 1
+	end
+	return opt
+end
+
+function compile_and_run(unit)
+	local function stop_if_errors()
+		if unit.errcount > 0 then
+			dlog("stopping after %d error(s)", unit.errcount)
+			return os.exit(1)
+		end
+	end
+
+	-- tokenize (text -> tokens)
+	tokens = tokenize_unit(unit)
+	stop_if_errors()
+
+	-- parse (tokens -> AST)
+	parse_unit(unit, tokens, PARSE_SRCMAP)
+	stop_if_errors()
+
+	-- resolve (AST -> IR)
+	resolve_unit(unit)
+	stop_if_errors()
+
+    -- print("TODO: ... os.exit(1)"); os.exit(1)
+
+	-- generate code (IR -> target)
+	code = codegen_lua(unit)
+	stop_if_errors()
+
+	-- run program
+	run(unit, code)
+end
+
+function main(args)
+	local prog = args[0]
+	local opt = parse_args(args)
+	if opt.selftest ~= nil then
+--require("selftest")(opt.selftest, opt.selftest_verbose)
+		os.exit(0)
+	end
+	if #opt.args == 0 then
+		io.stderr:write(fmt("%s: missing <input>\n", prog))
+		os.exit(1)
+	end
+	local unit, code
+	for i, filename in ipairs(opt.args) do
+		-- load source file
+		if filename == "-" then
+			unit = unit_create_buf("<stdin>", io.read("*a"))
+		else
+			unit = unit_create_file(filename)
+		end
+		compile_and_run(unit)
+	end
+end
+
+-- -- Runtime dev
+----require("tests/rt/worker-echo")
+----require("ast-lab")
+
+if false then
+	dew_debug_calltrace_enable()
+	xpcall(main, function(err)
+		debug.sethook()
+		print("[dew_debug] error: " .. debug.traceback(err, 2))
+		dew_debug_print_calltrace(20)
+		os.exit(3)
+	end, arg)
+else
+	return main(arg)
+end
@@ -1488,11 +1488,12 @@ LUA_API lua_Unsigned dew_lua_arraylen(lua_State *L, int idx) {
     // printf("isrealasize=%d, alimit=%u, lsizenode=%u, array=%p, node=%p\n",
     //        isrealasize(t), t->alimit, t->lsizenode, t->array, t->node);
 
-    // lsizenode is log2 of size of 'node' array (0 for "arrays")
+    // lsizenode is log2 of size of 'node' array (0 for "arrays", but also for dicts with
+    // a single entry, like '{x=1}', which have a non-dummy 'node' array of size 1.)
     // Note: this logic only holds for the Lua code Dew generates.
     // I.e. either strictly arrays '{1, "two"}' or dicts '{x=1, y="two"}', it does not work
     // correctly for mixed Lua tables like '{1, [2]="two"}'
-    if (t->lsizenode == 0)
+    if (t->lsizenode == 0 && isdummy(t))
       return lua_rawlen(L, idx);
   }
   return 0xffffffff;
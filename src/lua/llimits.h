@@ -294,6 +294,10 @@ typedef l_uint32 Instruction;
 #define luai_userstatefree(L,L1)	((void)L)
 #endif
 
+#if !defined(luai_userstaterecycle)
+#define luai_userstaterecycle(L,L1)	((void)L, 0)
+#endif
+
 #if !defined(luai_userstateresume)
 #define luai_userstateresume(L,n)	((void)L)
 #endif
@@ -177,15 +177,16 @@ LUAI_FUNC void luaE_incCstack (lua_State *L) {
 }
 
 
-static void stack_init (lua_State *L1, lua_State *L) {
+/*
+** [dew] initialize an allocated stack of 'size' (+ EXTRA_STACK) slots
+*/
+static void stack_reset (lua_State *L1, int size) {
   int i; CallInfo *ci;
-  /* initialize stack array */
-  L1->stack.p = luaM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, StackValue);
   L1->tbclist.p = L1->stack.p;
-  for (i = 0; i < BASIC_STACK_SIZE + EXTRA_STACK; i++)
+  for (i = 0; i < size + EXTRA_STACK; i++)
     setnilvalue(s2v(L1->stack.p + i));  /* erase new stack */
   L1->top.p = L1->stack.p;
-  L1->stack_last.p = L1->stack.p + BASIC_STACK_SIZE;
+  L1->stack_last.p = L1->stack.p + size;
   /* initialize first ci */
   ci = &L1->base_ci;
   ci->next = ci->previous = NULL;
@@ -200,6 +201,13 @@ static void stack_init (lua_State *L1, lua_State *L) {
 }
 
 
+static void stack_init (lua_State *L1, lua_State *L) {
+  /* initialize stack array */
+  L1->stack.p = luaM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, StackValue);
+  stack_reset(L1, BASIC_STACK_SIZE);
+}
+
+
 static void freestack (lua_State *L) {
   if (L->stack.p == NULL)
     return;  /* stack not completely built yet */
@@ -310,11 +318,66 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
 }
 
 
+/*
+** [dew] Creates a new thread like 'lua_newthread', but reuses the memory
+** of thread 'L1' (including its stack and CallInfo list), which must
+** have been claimed by 'luai_userstaterecycle' when it was collected.
+*/
+LUA_API lua_State *lua_newthreadfrom (lua_State *L, lua_State *L1) {
+  global_State *g = G(L);
+  GCObject *o = obj2gco(L1);
+  StkId stack = L1->stack.p;
+  int size = stacksize(L1);
+  CallInfo *ci_ext = L1->base_ci.next;  /* keep extra CallInfos */
+  unsigned short nci = L1->nci;
+  lua_lock(L);
+  luaC_checkGC(L);
+  /* link thread into the list of GC objects as a new object (as luaC_newobj) */
+  o->marked = luaC_white(g);
+  o->tt = LUA_VTHREAD;
+  o->next = g->allgc;
+  g->allgc = o;
+  /* anchor it on L stack */
+  setthvalue2s(L, L->top.p, L1);
+  api_incr_top(L);
+  preinit_thread(L1, g);
+  L1->hookmask = L->hookmask;
+  L1->basehookcount = L->basehookcount;
+  L1->hook = L->hook;
+  resethookcount(L1);
+  /* initialize L1 extra space */
+  memcpy(lua_getextraspace(L1), lua_getextraspace(g->mainthread),
+         LUA_EXTRASPACE);
+  luai_userstatethread(L, L1);
+  /* reuse stack */
+  L1->stack.p = stack;
+  stack_reset(L1, size);
+  L1->base_ci.next = ci_ext;
+  L1->nci = nci;
+  lua_unlock(L);
+  return L1;
+}
+
+
+/*
+** [dew] Frees the memory of a thread which was claimed by
+** 'luai_userstaterecycle' and not reused with 'lua_newthreadfrom'.
+*/
+LUA_API void lua_freethread (lua_State *L, lua_State *L1) {
+  freestack(L1);
+  luaM_free(L, fromstate(L1));
+}
+
+
 void luaE_freethread (lua_State *L, lua_State *L1) {
   LX *l = fromstate(L1);
   luaF_closeupval(L1, L1->stack.p);  /* close all upvalues */
   lua_assert(L1->openupval == NULL);
   luai_userstatefree(L, L1);
+  /* [dew] let host keep the thread's memory for reuse (unless closing state) */
+  if (!(G(L)->gcstp & GCSTPCLS) && L1->stack.p != NULL &&
+      luai_userstaterecycle(L, L1))
+    return;
   freestack(L1);
   luaM_free(L, l);
 }
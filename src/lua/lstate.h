@@ -142,7 +142,10 @@ struct lua_longjmp;  /* defined in ldo.c */
 #define EXTRA_STACK   5
 
 
+/* [dew] may be defined in luaconf.h */
+#ifndef BASIC_STACK_SIZE
 #define BASIC_STACK_SIZE        (2*LUA_MINSTACK)
+#endif
 
 #define stacksize(th)	cast_int((th)->stack_last.p - (th)->stack.p)
 
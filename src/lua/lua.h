@@ -164,6 +164,8 @@ LUA_API lua_State *(lua_newstate) (lua_Alloc f, void *ud);
 LUA_API void       (lua_close) (lua_State *L);
 LUA_API lua_State *(lua_newthread) (lua_State *L);
 LUA_API int        (lua_closethread) (lua_State *L, lua_State *from);
+LUA_API lua_State *(lua_newthreadfrom) (lua_State *L, lua_State *L1); // [dew]
+LUA_API void       (lua_freethread) (lua_State *L, lua_State *L1); // [dew]
 LUA_API int        (lua_resetthread) (lua_State *L);  /* Deprecated! */
 
 LUA_API lua_CFunction (lua_atpanic) (lua_State *L, lua_CFunction panicf);
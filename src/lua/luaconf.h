@@ -777,9 +777,15 @@
 	#undef  LUA_KCONTEXT
 	#define LUA_KCONTEXT unsigned long
 
-	#define SIZEOF_DEW_T    (sizeof(void*)*2 + sizeof(uint64_t)*5)
+	#define SIZEOF_DEW_T    (sizeof(void*)*6 + sizeof(uint64_t)*5)
 	#define LUA_EXTRASPACE  SIZEOF_DEW_T
 
+	// BASIC_STACK_SIZE is the initial stack size of threads (see lstate.h.)
+	// Every task is a thread, so this is a large part of the memory cost of a task.
+	// This leaves room for a small function calling into a C function (which is guaranteed
+	// LUA_MINSTACK slots) without growing the stack. Default is 2*LUA_MINSTACK.
+	#define BASIC_STACK_SIZE (LUA_MINSTACK + 10)
+
 	// luai_userstatefree is called by luaE_freethread when a lua thread is free'd (GC'd.)
 	// We use this for a callback.
 	// L is parent, L1 is lua thread
@@ -787,6 +793,13 @@
 	typedef struct T T;
 	void t_gc(lua_State* L, T*);
 	#define luai_userstatefree(L, L1) t_gc((L), (T*)((unsigned char*)(L1) - SIZEOF_DEW_T))
+
+	// luai_userstaterecycle is called by luaE_freethread after luai_userstatefree.
+	// If it returns non-zero, the memory of L1 is not freed but owned by the callee, which
+	// later passes it to either lua_newthreadfrom or lua_freethread.
+	int t_recycle(lua_State* L, T*);
+	#define luai_userstaterecycle(L, L1) \
+		t_recycle((L), (T*)((unsigned char*)(L1) - SIZEOF_DEW_T))
 #else
 	#define LUA_EXTRASPACE		0
 #endif
@@ -1,9 +1,19 @@
 #include "buf.h"
 #include "lutil.h"
 #include "string_repr.h"
+#include <stdatomic.h>
 
 
 static u8 g_buf_luatabkey; // Buf object prototype
+static u8 g_sharedbuf_luatabkey; // SharedBuf object prototype
+
+// BUF_EMBED_MAX is the largest capacity of a Buf which bytes are allocated together with
+// the Buf object by l_buf_createx
+#define BUF_EMBED_MAX 1024
+
+// BUF_GC_EXTERNAL_MIN is the least amount of memory allocated for Bufs outside of the Lua
+// allocator which makes l_buf_account collect garbage
+#define BUF_GC_EXTERNAL_MIN (8*1024*1024)
 
 
 int buf_free(Buf* buf) {
@@ -109,24 +119,144 @@ Buf* nullable l_buf_check(lua_State* L, int idx) {
 }
 
 
+Buf* nullable l_buf_check_ro(lua_State* L, int idx) {
+    UVal* uval = lua_touserdata(L, idx);
+    if LIKELY(uval && (uval->type == UValType_Buf || uval->type == UValType_SharedBuf))
+        return (Buf*)uval;
+    luaL_typeerror(L, idx, "Buf");
+    return NULL;
+}
+
+
+void sharedbufdata_retain(SharedBufData* data) {
+    atomic_fetch_add_explicit(&data->refcount, 1, memory_order_relaxed);
+}
+
+
+void sharedbufdata_release(SharedBufData* data) {
+    if (atomic_fetch_sub_explicit(&data->refcount, 1, memory_order_acq_rel) > 1)
+        return;
+    // free bytes, unless they are allocated together with data
+    if (data->bytes != (u8*)(data + 1))
+        free(data->bytes);
+    free(data);
+}
+
+
+SharedBuf* nullable l_sharedbuf_createx(lua_State* L, SharedBufData* data) {
+    SharedBuf* sb = uval_new(L, UValType_SharedBuf, sizeof(SharedBuf), 0);
+    if UNLIKELY(!sb) {
+        sharedbufdata_release(data);
+        return NULL;
+    }
+    sb->buf.bytes = data->bytes;
+    sb->buf.cap = data->len;
+    sb->buf.len = data->len;
+    sb->data = data;
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &g_sharedbuf_luatabkey);
+    lua_setmetatable(L, -2);
+    return sb;
+}
+
+
+static int l_sharedbuf_gc(lua_State* L) {
+    SharedBuf* sb = lua_touserdata(L, 1);
+    sharedbufdata_release(sb->data);
+    return 0;
+}
+
+
+// fun sharedbuf_create(buf Buf) SharedBuf
+// Creates an immutable SharedBuf with the contents of buf, which is left empty.
+// The memory of buf is moved to the SharedBuf when possible, rather than copied.
+int l_sharedbuf_create(lua_State* L) {
+    Buf* buf = l_buf_check(L, 1);
+    u8* embedded_bytes = (u8*)buf + sizeof(*buf);
+    SharedBufData* data;
+    if (buf->bytes == embedded_bytes) {
+        if (!( data = malloc(sizeof(SharedBufData) + buf->len) ))
+            return l_errno_error(L, ENOMEM);
+        data->bytes = (u8*)(data + 1);
+        memcpy(data->bytes, buf->bytes, buf->len);
+    } else {
+        if (!( data = malloc(sizeof(SharedBufData)) ))
+            return l_errno_error(L, ENOMEM);
+        data->bytes = buf->bytes;
+        buf->bytes = embedded_bytes;
+    }
+    data->len = buf->len;
+    data->refcount = 1;
+    buf->cap = 0;
+    buf->len = 0;
+    if UNLIKELY(!l_sharedbuf_createx(L, data))
+        return l_errno_error(L, ENOMEM);
+    return 1;
+}
+
+
 int l_buf_gc(lua_State* L) {
     Buf* buf = lua_touserdata(L, 1);
     return buf_free(buf);
 }
 
 
+// tls_buf_external is the amount of memory allocated for Bufs outside of the Lua allocator
+// by the current thread since l_buf_account last collected garbage
+static thread_local usize tls_buf_external = 0;
+
+
+void l_buf_account(lua_State* L, usize size) {
+    // Collect garbage once more memory than the size of the Lua heap has been allocated this
+    // way, so that the cost of collecting stays proportional to the amount allocated.
+    // Note that a step (LUA_GCSTEP) does not free Bufs in generational mode: the minor
+    // collection it runs resurrects unreachable Bufs for their finalizers, making them old.
+    tls_buf_external += size;
+    if (tls_buf_external < BUF_GC_EXTERNAL_MIN)
+        return;
+    if (tls_buf_external < (usize)lua_gc(L, LUA_GCCOUNT) * 1024)
+        return;
+    tls_buf_external = 0;
+    lua_gc(L, LUA_GCCOLLECT);
+}
+
+
+void* nullable l_buf_reserve(lua_State* L, Buf* buf, usize minavail) {
+    if LIKELY(buf->cap - buf->len >= minavail)
+        return buf->bytes + buf->len;
+    usize external = buf_external_cap(buf);
+    if (!buf_reserve(buf, minavail))
+        return NULL;
+    if (buf_external_cap(buf) > external)
+        l_buf_account(L, buf_external_cap(buf) - external);
+    return buf->bytes + buf->len;
+}
+
+
 Buf* nullable l_buf_createx(lua_State* L, u64 cap) {
     int nuvalue = 0;
+    // Large buffers have their bytes allocated separately from the Buf object, so that their
+    // memory can be moved to another worker with send_transfer.
+    usize embedcap = cap > BUF_EMBED_MAX ? 0 : (usize)cap;
     // See comment in l_iodesc_create.
     // dlog("allocating buffer with cap %lu (total %zu B)", cap, sizeof(Buf) + (usize)cap);
-    Buf* buf = uval_new(L, UValType_Buf, sizeof(Buf) + (usize)cap, nuvalue);
+    Buf* buf = uval_new(L, UValType_Buf, sizeof(Buf) + embedcap, nuvalue);
     if (!buf)
         return NULL;
-    buf->cap = (usize)cap;
+    buf->cap = embedcap;
     buf->len = 0;
     buf->bytes = (u8*)buf + sizeof(Buf);
     lua_rawgetp(L, LUA_REGISTRYINDEX, &g_buf_luatabkey);
     lua_setmetatable(L, -2);
+    if (cap > BUF_EMBED_MAX) {
+        void* bytes = malloc((usize)cap);
+        if (!bytes) {
+            lua_pop(L, 1);
+            return NULL;
+        }
+        buf->bytes = bytes;
+        buf->cap = (usize)cap;
+        l_buf_account(L, (usize)cap);
+    }
     return buf;
 }
 
@@ -175,7 +305,7 @@ int l_buf_resize(lua_State* L) {
     Buf* buf = l_buf_check(L, 1);
     u64 newlen = lua_tointegerx(L, 2, NULL);
     if (newlen > buf->cap) {
-        if UNLIKELY(!buf_resize(buf, newlen))
+        if UNLIKELY(!l_buf_reserve(L, buf, newlen - buf->len))
             return l_errno_error(L, ENOMEM);
         int fill_ok;
         u8 fill = lua_tointegerx(L, 3, &fill_ok);
@@ -188,7 +318,7 @@ int l_buf_resize(lua_State* L) {
 
 
 int l_buf_len(lua_State* L) {
-    Buf* buf = l_buf_check(L, 1);
+    Buf* buf = l_buf_check_ro(L, 1);
     if (!buf)
         return 0;
     lua_pushinteger(L, buf->len);
@@ -197,8 +327,8 @@ int l_buf_len(lua_State* L) {
 
 
 int l_buf_equal(lua_State* L) {
-    Buf* a = l_buf_check(L, 1);
-    Buf* b = l_buf_check(L, 2);
+    Buf* a = l_buf_check_ro(L, 1);
+    Buf* b = l_buf_check_ro(L, 2);
     if (!a || !b)
         return 0;
     lua_pushboolean(L, a->len == b->len && memcmp(a->bytes, b->bytes, a->len) == 0);
@@ -207,8 +337,8 @@ int l_buf_equal(lua_State* L) {
 
 
 int l_buf_compare(lua_State* L) {
-    Buf* a = l_buf_check(L, 1);
-    Buf* b = l_buf_check(L, 2);
+    Buf* a = l_buf_check_ro(L, 1);
+    Buf* b = l_buf_check_ro(L, 2);
     if (!a || !b)
         return 0;
     usize min_len = (a->len < b->len) ? a->len : b->len;
@@ -222,30 +352,33 @@ int l_buf_compare(lua_State* L) {
 
 // fun Buf.append(self Buf, other Buf|string)
 int l_buf_append(lua_State* L) {
-    const void* src;
+    const void* src = NULL;
     usize srclen = 0;
     Buf* buf = l_buf_check(L, 1);
+    Buf* other = NULL;
     switch (lua_type(L, 2)) {
         case LUA_TSTRING:
             src = lua_tolstring(L, 2, &srclen);
             break;
-        case LUA_TUSERDATA: {
-            Buf* other = l_buf_check(L, 2);
-            src = other->bytes;
+        case LUA_TUSERDATA:
+            other = l_buf_check_ro(L, 2);
             srclen = other->len;
             break;
-        }
         default:
             luaL_typeerror(L, 2, "Buf|string");
     }
-    if UNLIKELY(!buf_append(buf, src, srclen))
+    if UNLIKELY(!l_buf_reserve(L, buf, srclen))
         return l_errno_error(L, ENOMEM);
+    if (other)
+        src = other->bytes; // other may be buf, which bytes l_buf_reserve may have moved
+    memcpy(buf->bytes + buf->len, src, srclen);
+    buf->len += srclen;
     return 0;
 }
 
 
 int l_buf_str(lua_State* L) {
-    Buf* buf = l_buf_check(L, 1);
+    Buf* buf = l_buf_check_ro(L, 1);
     if (!buf)
         return 0;
     lua_pushlstring(L, (char*)buf->bytes, buf->len);
@@ -257,7 +390,7 @@ static int l_buf_tostring(lua_State* L) {
     #define ELLIPSIS     "…"
     #define ELLIPSIS_LEN strlen(ELLIPSIS)
 
-    Buf* buf = l_buf_check(L, 1);
+    Buf* buf = l_buf_check_ro(L, 1);
     if (!buf)
         return 0;
     // TODO: optional second argument for how to encode the data, e.g. verbatim, hex, base64
@@ -319,7 +452,7 @@ static int l_buf_tostring(lua_State* L) {
 
 
 int l_buf_get_i64(lua_State* L) {
-    Buf* buf = l_buf_check(L, 1);
+    Buf* buf = l_buf_check_ro(L, 1);
     u64 offs = lua_tointegerx(L, 2, NULL);
     assert_buf_offs(L, buf, offs, 8);
     lua_pushinteger(L, *(i64*)&buf->bytes[offs]);
@@ -336,7 +469,7 @@ int l_buf_set_i64(lua_State* L) {
 
 
 int l_buf_get_f64(lua_State* L) {
-    Buf* buf = l_buf_check(L, 1);
+    Buf* buf = l_buf_check_ro(L, 1);
     u64 offs = lua_tointegerx(L, 2, NULL);
     assert_buf_offs(L, buf, offs, 8);
     lua_pushnumber(L, *(float64*)&buf->bytes[offs]);
@@ -353,7 +486,7 @@ int l_buf_set_f64(lua_State* L) {
 
 
 int l_buf_get_u32(lua_State* L) {
-    Buf* buf = l_buf_check(L, 1);
+    Buf* buf = l_buf_check_ro(L, 1);
     u64 offs = lua_tointegerx(L, 2, NULL);
     assert_buf_offs(L, buf, offs, 4);
     lua_pushinteger(L, *(u32*)&buf->bytes[offs]);
@@ -370,7 +503,7 @@ int l_buf_set_u32(lua_State* L) {
 
 
 int l_buf_get_i32(lua_State* L) {
-    Buf* buf = l_buf_check(L, 1);
+    Buf* buf = l_buf_check_ro(L, 1);
     u64 offs = lua_tointegerx(L, 2, NULL);
     assert_buf_offs(L, buf, offs, 4);
     lua_pushinteger(L, *(i32*)&buf->bytes[offs]);
@@ -394,7 +527,7 @@ int l_buf_pop_i32(lua_State* L) {
 
 
 int l_buf_get_u16(lua_State* L) {
-    Buf* buf = l_buf_check(L, 1);
+    Buf* buf = l_buf_check_ro(L, 1);
     u64 offs = lua_tointegerx(L, 2, NULL);
     assert_buf_offs(L, buf, offs, 2);
     lua_pushinteger(L, *(u16*)&buf->bytes[offs]);
@@ -428,7 +561,7 @@ int l_buf_set_u8(lua_State* L) {
     return 0;
 }
 int l_buf_get_u8(lua_State* L) {
-    Buf* buf = l_buf_check(L, 1);
+    Buf* buf = l_buf_check_ro(L, 1);
     u64 offs = lua_tointegerx(L, 2, NULL);
     assert_buf_offs(L, buf, offs, 1);
     lua_pushinteger(L, buf->bytes[offs]);
@@ -440,12 +573,8 @@ int l_buf_get_u8(lua_State* L) {
 int l_buf_push_u32(lua_State* L) {
     Buf* buf = l_buf_check(L, 1);
     u32 val = lua_tointegerx(L, 2, NULL);
-    usize avail = buf->cap - buf->len;
-    if UNLIKELY(avail < 4) {
-        usize newcap = buf->cap + (4 - avail);
-        if (!buf_resize(buf, newcap))
-            return l_errno_error(L, ENOMEM);
-    }
+    if UNLIKELY(!l_buf_reserve(L, buf, 4))
+        return l_errno_error(L, ENOMEM);
     u64 offs = buf->len;
     buf->len += 4;
     *(u32*)&buf->bytes[offs] = val;
@@ -458,12 +587,8 @@ int l_buf_push_u32(lua_State* L) {
 int l_buf_push_u64(lua_State* L) {
     Buf* buf = l_buf_check(L, 1);
     u64 val = lua_tointegerx(L, 2, NULL);
-    usize avail = buf->cap - buf->len;
-    if UNLIKELY(avail < 8) {
-        usize newcap = buf->cap + (8 - avail);
-        if (!buf_resize(buf, newcap))
-            return l_errno_error(L, ENOMEM);
-    }
+    if UNLIKELY(!l_buf_reserve(L, buf, 8))
+        return l_errno_error(L, ENOMEM);
     u64 offs = buf->len;
     buf->len += 8;
     memcpy(&buf->bytes[offs], &val, 8);
@@ -476,12 +601,8 @@ int l_buf_push_u64(lua_State* L) {
 int l_buf_push_f64(lua_State* L) {
     Buf* buf = l_buf_check(L, 1);
     float64 val = lua_tonumberx(L, 2, NULL);
-    usize avail = buf->cap - buf->len;
-    if UNLIKELY(avail < 8) {
-        usize newcap = buf->cap + (8 - avail);
-        if (!buf_resize(buf, newcap))
-            return l_errno_error(L, ENOMEM);
-    }
+    if UNLIKELY(!l_buf_reserve(L, buf, 8))
+        return l_errno_error(L, ENOMEM);
     u64 offs = buf->len;
     buf->len += 8;
     memcpy(&buf->bytes[offs], &val, 8);
@@ -495,12 +616,8 @@ int l_buf_push_u64x2(lua_State* L) {
     Buf* buf = l_buf_check(L, 1);
     u64 val1 = lua_tointegerx(L, 2, NULL);
     u64 val2 = lua_tointegerx(L, 3, NULL);
-    usize avail = buf->cap - buf->len;
-    if UNLIKELY(avail < 16) {
-        usize newcap = buf->cap + (16 - avail);
-        if (!buf_resize(buf, newcap))
-            return l_errno_error(L, ENOMEM);
-    }
+    if UNLIKELY(!l_buf_reserve(L, buf, 16))
+        return l_errno_error(L, ENOMEM);
     u64 offs = buf->len;
     buf->len += 16;
     memcpy(&buf->bytes[offs], &val1, 8);
@@ -512,7 +629,7 @@ int l_buf_push_u64x2(lua_State* L) {
 
 // fun find_u32(buf Buf, start_offs, end_offs, stride uint, key u32) uint?
 int l_buf_find_u32(lua_State* L) {
-    Buf* buf = l_buf_check(L, 1);
+    Buf* buf = l_buf_check_ro(L, 1);
     i64 start_offs = lua_tointegerx(L, 2, NULL);
     i64 end_offs = lua_tointegerx(L, 3, NULL);
     i64 stride   = lua_tointegerx(L, 4, NULL);
@@ -567,12 +684,8 @@ int l_buf_find_u32(lua_State* L) {
 int l_buf_alloc(lua_State* L) {
     Buf* buf = l_buf_check(L, 1);
     usize nbyte = lua_tointegerx(L, 2, NULL);
-    usize avail = buf->cap - buf->len;
-    if UNLIKELY(avail < nbyte) {
-        usize newcap = buf->cap + (nbyte - avail);
-        if (!buf_resize(buf, newcap))
-            return l_errno_error(L, ENOMEM);
-    }
+    if UNLIKELY(!l_buf_reserve(L, buf, nbyte))
+        return l_errno_error(L, ENOMEM);
     u64 offs = buf->len;
     buf->len += nbyte;
     lua_pushinteger(L, offs);
@@ -584,7 +697,7 @@ static u64 wyhash(const void* data, usize len, u64 seed, const u64 secret[4]);
 
 // fun Buf.hash(seed=0, start=0, end=0 int) uint
 int l_buf_hash(lua_State* L) {
-    Buf* buf  = l_buf_check(L, 1);
+    Buf* buf  = l_buf_check_ro(L, 1);
     u64 seed  = lua_tointegerx(L, 2, NULL);
     i64 start = lua_tointegerx(L, 3, NULL);
     i64 end   = lua_tointegerx(L, 4, NULL);
@@ -748,4 +861,28 @@ void luaopen_buf(lua_State* L) {
     lua_pushcfunction(L, l_buf_push_f64); lua_setfield(L, -2, "push_f64");
 
     lua_rawsetp(L, LUA_REGISTRYINDEX, &g_buf_luatabkey);
+
+    // SharedBuf has the read-only subset of Buf's functions
+    luaL_newmetatable(L, "SharedBuf");
+
+    lua_pushcfunction(L, l_sharedbuf_gc); lua_setfield(L, -2, "__gc");
+    lua_pushcfunction(L, l_buf_tostring); lua_setfield(L, -2, "__tostring");
+    lua_pushcfunction(L, l_buf_len); lua_setfield(L, -2, "__len");
+
+    lua_pushvalue(L, -1);  // Duplicate metatable
+    lua_setfield(L, -2, "__index");  // metatable.__index = metatable
+
+    lua_pushcfunction(L, l_buf_compare); lua_setfield(L, -2, "compare");
+    lua_pushcfunction(L, l_buf_equal); lua_setfield(L, -2, "equal");
+    lua_pushcfunction(L, l_buf_str); lua_setfield(L, -2, "str");
+    lua_pushcfunction(L, l_buf_hash); lua_setfield(L, -2, "hash");
+    lua_pushcfunction(L, l_buf_find_u32); lua_setfield(L, -2, "find_u32");
+    lua_pushcfunction(L, l_buf_get_u8); lua_setfield(L, -2, "get_u8");
+    lua_pushcfunction(L, l_buf_get_u16); lua_setfield(L, -2, "get_u16");
+    lua_pushcfunction(L, l_buf_get_u32); lua_setfield(L, -2, "get_u32");
+    lua_pushcfunction(L, l_buf_get_i32); lua_setfield(L, -2, "get_i32");
+    lua_pushcfunction(L, l_buf_get_i64); lua_setfield(L, -2, "get_i64");
+    lua_pushcfunction(L, l_buf_get_f64); lua_setfield(L, -2, "get_f64");
+
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &g_sharedbuf_luatabkey);
 }
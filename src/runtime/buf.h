@@ -10,6 +10,20 @@ typedef struct Buf {
     u8* nullable bytes;
 } Buf;
 
+// SharedBufData is the immutable memory of SharedBufs, which may be referenced by many workers
+typedef struct SharedBufData {
+    _Atomic(u32) refcount;
+    usize        len;
+    u8* nullable bytes;
+} SharedBufData;
+
+// SharedBuf is a read-only Buf, referencing SharedBufData.
+// Its Buf header has .uval.type=UValType_SharedBuf and .bytes=data->bytes.
+typedef struct SharedBuf {
+    Buf            buf;
+    SharedBufData* data;
+} SharedBuf;
+
 typedef struct MiniBuf {
     usize len;
     u8    bytes[];
@@ -35,10 +49,36 @@ inline static bool buf_append_byte(Buf* buf, u8 byte) {
 // It puts a Lua buffer object on L's stack.
 Buf* nullable l_buf_createx(lua_State* L, u64 cap);
 
+// l_buf_account accounts for size bytes of memory of a Buf that were allocated outside of
+// the Lua allocator, which L's garbage collector does not know about, so that large Bufs
+// cause collections
+void l_buf_account(lua_State* L, usize size);
+
+// l_buf_reserve is buf_reserve for a Buf which is a Lua object; memory allocated outside of
+// the Lua allocator is accounted for with l_buf_account
+void* nullable l_buf_reserve(lua_State* L, Buf* buf, usize minavail);
+
+// buf_external_cap returns the capacity of buf when its bytes are allocated separately from
+// the Buf (i.e. not embedded by l_buf_createx), else 0
+inline static usize buf_external_cap(const Buf* buf) {
+    return buf->bytes == (u8*)buf + sizeof(*buf) ? 0 : buf->cap;
+}
+
+// l_buf_check_ro returns a Buf or SharedBuf, for read-only access
+Buf* nullable l_buf_check_ro(lua_State* L, int idx);
+
+void sharedbufdata_retain(SharedBufData* data);
+void sharedbufdata_release(SharedBufData* data);
+
+// l_sharedbuf_createx puts a SharedBuf for data on L's stack, taking over a reference to data.
+// Returns NULL, having released the reference, if memory allocation failed.
+SharedBuf* nullable l_sharedbuf_createx(lua_State* L, SharedBufData* data);
+
 int l_buf_gc(lua_State* L);
 int l_buf_create(lua_State* L);
 int l_buf_resize(lua_State* L);
 int l_buf_str(lua_State* L);
+int l_sharedbuf_create(lua_State* L);
 Buf* nullable l_buf_check(lua_State* L, int idx);
 
 void luaopen_buf(lua_State* L);
@@ -23,10 +23,16 @@ Design:
 #include <stdatomic.h>
 API_BEGIN
 
+#include <sched.h>
+
 #define SPIN_YIELD() cpu_yield()
-// #include <sched.h>
 // #define SPIN_YIELD() sched_yield()
 
+// CHAN_COMMIT_SPIN_LIMIT is the number of times chan_commit spins before yielding to the OS
+// scheduler. The thread we are waiting for may have been preempted, in which case spinning
+// just burns our time slice. This matters when there are more threads than CPU cores.
+#define CHAN_COMMIT_SPIN_LIMIT 64
+
 
 struct Chan { // aligned to CPU_CACHE_LINE_SIZE
     // writer/producer fields
@@ -131,21 +137,26 @@ static bool chan_sem_wait2(
     TSem* sem, _Atomic(u32)* sem_value, _Atomic(u32)* sem_waiters, u32 flags)
 {
     atomic_fetch_add(sem_waiters, 1);
-
-    // Check if a resource became available after incrementing waiters
-    u32 expected = atomic_load(sem_value);
-    if (expected > 0 &&
-        atomic_compare_exchange_strong(sem_value, &expected, expected - 1)) {
-        atomic_fetch_sub(sem_waiters, 1);
-        return true;
-    } else if (flags & CHAN_TRY) {
-        return false;
+    for (;;) {
+        // Check if a resource became available after incrementing waiters (or after waking up)
+        u32 expected = atomic_load(sem_value);
+        while (expected > 0) {
+            if (atomic_compare_exchange_weak(sem_value, &expected, expected - 1)) {
+                atomic_fetch_sub(sem_waiters, 1);
+                return true;
+            }
+        }
+        if (flags & CHAN_TRY) {
+            // Note: must not leave waiters incremented, or every signal would call tsem_signal
+            atomic_fetch_sub(sem_waiters, 1);
+            return false;
+        }
+        // No resource available, wait on OS semaphore.
+        // Note that waking up does not mean we got a resource; the OS semaphore may have been
+        // signalled more times than there are waiters, or another thread may have taken the
+        // resource before us, so we must claim it from sem_value like everyone else.
+        tsem_wait(sem);
     }
-
-    // No resource available, wait on OS semaphore
-    tsem_wait(sem);
-    atomic_fetch_sub(sem_waiters, 1);
-    return true;
 }
 
 
@@ -172,6 +183,45 @@ static void chan_sem_signal(TSem* sem, _Atomic(u32)* sem_value, _Atomic(u32)* se
 }
 
 
+// chan_sem_trytake decrements sem_value by up to n without blocking.
+// Returns the amount decremented, which is 0 if sem_value is 0.
+static u32 chan_sem_trytake(_Atomic(u32)* sem_value, u32 n) {
+    u32 expected = atomic_load(sem_value);
+    while (expected > 0) {
+        u32 k = MIN(expected, n);
+        if (atomic_compare_exchange_weak(sem_value, &expected, expected - k))
+            return k;
+    }
+    return 0;
+}
+
+
+// chan_sem_take is like chan_sem_wait but takes up to n units with one CAS.
+// Blocks until at least one unit is available, unless flags&CHAN_TRY.
+// Returns the number of units taken.
+static u32 chan_sem_take(
+    TSem* sem, _Atomic(u32)* sem_value, _Atomic(u32)* sem_waiters, u32 flags, u32 n)
+{
+    u32 k = chan_sem_trytake(sem_value, n);
+    if LIKELY(k > 0)
+        return k;
+    if (!chan_sem_wait2(sem, sem_value, sem_waiters, flags))
+        return 0;
+    // we got one unit; take more if they are available now
+    return 1 + chan_sem_trytake(sem_value, n - 1);
+}
+
+
+static void chan_sem_signal_n(
+    TSem* sem, _Atomic(u32)* sem_value, _Atomic(u32)* sem_waiters, u32 n)
+{
+    assert(atomic_load(sem_value) <= U32_MAX - n);
+    atomic_fetch_add(sem_value, n);
+    for (u32 nwake = MIN(atomic_load(sem_waiters), n); nwake > 0; nwake--)
+        tsem_signal(sem);
+}
+
+
 ChanTx chan_write_begin(Chan* ch, u32 flags) {
     if UNLIKELY(
         !chan_sem_wait(&ch->w_sem, &ch->w_sem_value, &ch->w_sem_waiters, flags) ||
@@ -214,7 +264,7 @@ ChanTx chan_read_begin(Chan* ch, u32 flags) {
     return (ChanTx){ .entry = &ch->entries[entry_idx], .tx = r_head };
 }
 
-static void chan_commit(Chan* ch, u32 my_head, _Atomic(u32)* tailp, char op) {
+static void chan_commit(Chan* ch, u32 my_head, u32 n, _Atomic(u32)* tailp, char op) {
     // Make sure we don't increment tail until other writer threads that started before us
     // have finished. Essentially:
     //   w_tail = MIN(w_tail of each writer)
@@ -283,20 +333,25 @@ static void chan_commit(Chan* ch, u32 my_head, _Atomic(u32)* tailp, char op) {
         expect_tail = new_tail-1; // CAS operation updates expect_tail
     }
 #else
-    while (atomic_load_explicit(tailp, memory_order_acquire) != my_head)
-        SPIN_YIELD();
-    atomic_store_explicit(tailp, my_head+1, memory_order_release);
+    for (u32 nspins = 0; atomic_load_explicit(tailp, memory_order_acquire) != my_head; nspins++) {
+        if (nspins < CHAN_COMMIT_SPIN_LIMIT) {
+            SPIN_YIELD();
+        } else {
+            sched_yield();
+        }
+    }
+    atomic_store_explicit(tailp, my_head+n, memory_order_release);
     // atomic_fetch_add_explicit(tailp, 1, memory_order_release);
 #endif
 }
 
 void chan_write_commit(Chan* ch, ChanTx tx) {
-    chan_commit(ch, tx.tx, &ch->w_tail, 'w');
+    chan_commit(ch, tx.tx, 1, &ch->w_tail, 'w');
     chan_sem_signal(&ch->r_sem, &ch->r_sem_value, &ch->r_sem_waiters);
 }
 
 void chan_read_commit(Chan* ch, ChanTx tx) {
-    chan_commit(ch, tx.tx, &ch->r_tail, 'r');
+    chan_commit(ch, tx.tx, 1, &ch->r_tail, 'r');
     chan_sem_signal(&ch->w_sem, &ch->w_sem_value, &ch->w_sem_waiters);
 }
 
@@ -318,4 +373,77 @@ bool chan_read(Chan* ch, u32 flags, void* value_dst) {
     return true;
 }
 
+// chan_copy copies n entries between the ring, starting at index idx, and buf.
+// Handles the case of the range wrapping around the end of the ring.
+static void chan_copy(Chan* ch, u32 idx, void* buf, u32 n, bool to_ring) {
+    u32 i = idx & ch->w_mask;
+    u32 n1 = MIN(n, ch->w_mask + 1 - i); // entries until end of ring
+    u8* ring1 = &ch->entries[i * ch->entsize];
+    u8* buf2 = (u8*)buf + (usize)n1 * ch->entsize;
+    usize size1 = (usize)n1 * ch->entsize;
+    usize size2 = (usize)(n - n1) * ch->entsize;
+    if (to_ring) {
+        memcpy(ring1, buf, size1);
+        memcpy(ch->entries, buf2, size2);
+    } else {
+        memcpy(buf, ring1, size1);
+        memcpy(buf2, ch->entries, size2);
+    }
+}
+
+u32 chan_write_many(Chan* ch, u32 flags, const void* values_src, u32 n) {
+    if (n == 0)
+        return 0;
+    n = chan_sem_take(&ch->w_sem, &ch->w_sem_value, &ch->w_sem_waiters, flags, n);
+    if UNLIKELY(n == 0 || atomic_load_explicit(&ch->w_shutdown, memory_order_acquire))
+        return 0;
+
+    // claim n slots
+    u32 w_head = atomic_fetch_add_explicit(&ch->w_head, n, memory_order_acq_rel);
+    u32 r_tail = atomic_load_explicit(&ch->r_tail, memory_order_acquire);
+    while UNLIKELY(w_head + (n - 1) - r_tail >= ch->w_mask) {
+        // queue is full; we lost the race to another thread (see chan_write_begin)
+        SPIN_YIELD();
+        if UNLIKELY(atomic_load_explicit(&ch->w_shutdown, memory_order_acquire))
+            return 0;
+        r_tail = atomic_load_explicit(&ch->r_tail, memory_order_acquire);
+    }
+
+    chan_copy(ch, w_head, (void*)values_src, n, true);
+
+    chan_commit(ch, w_head, n, &ch->w_tail, 'w');
+    chan_sem_signal_n(&ch->r_sem, &ch->r_sem_value, &ch->r_sem_waiters, n);
+    return n;
+}
+
+u32 chan_read_many(Chan* ch, u32 flags, void* values_dst, u32 n) {
+    if (n == 0)
+        return 0;
+    n = chan_sem_take(&ch->r_sem, &ch->r_sem_value, &ch->r_sem_waiters, flags, n);
+    if UNLIKELY(n == 0)
+        return 0;
+
+    // claim n slots
+    u32 r_head = atomic_fetch_add_explicit(&ch->r_head, n, memory_order_acq_rel);
+    u32 w_tail = atomic_load_explicit(&ch->w_tail, memory_order_acquire);
+    u32 nread = n;
+    while UNLIKELY(w_tail - (r_head + n) >= ch->w_mask) {
+        // slots are not yet available to read; wait for w_tail to advance
+        if UNLIKELY(atomic_load_explicit(&ch->r_shutdown, memory_order_acquire)) {
+            // chan_shutdown saturates the semaphore, so we may have claimed slots which
+            // will never be written. Read the ones that were.
+            nread = (i32)(w_tail - r_head) > 0 ? w_tail - r_head : 0;
+            break;
+        }
+        SPIN_YIELD();
+        w_tail = atomic_load_explicit(&ch->w_tail, memory_order_acquire);
+    }
+
+    chan_copy(ch, r_head, values_dst, nread, false);
+
+    chan_commit(ch, r_head, n, &ch->r_tail, 'r');
+    chan_sem_signal_n(&ch->w_sem, &ch->w_sem_value, &ch->w_sem_waiters, n);
+    return nread;
+}
+
 API_END
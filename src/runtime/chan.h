@@ -30,4 +30,11 @@ void   chan_read_commit(Chan* ch, ChanTx tx);
 bool chan_write(Chan* ch, u32 flags, const void* value_src);
 bool chan_read(Chan* ch, u32 flags, void* value_dst);
 
+// batch functions which claim up to n contiguous entries in one atomic transaction and
+// commit them together. Block until at least one entry can be written or read, unless
+// flags&CHAN_TRY. Return the number of entries written or read; 0 if the channel is closed
+// (or, with CHAN_TRY, full or empty.)
+u32 chan_write_many(Chan* ch, u32 flags, const void* values_src, u32 n);
+u32 chan_read_many(Chan* ch, u32 flags, void* values_dst, u32 n);
+
 API_END
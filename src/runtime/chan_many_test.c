@@ -0,0 +1,35 @@
+// Tests chan_write_many and chan_read_many; see chan_test.c for single-entry operations
+#include "chan.c"
+
+#define NUM_PRODUCER_THREADS 1
+#define NUM_CONSUMER_THREADS 1
+#define OPS_PER_PRODUCER 1000000
+#define QUEUE_BATCH_SIZE 16
+
+Chan* nullable queue_create() {
+    u32 cap = 64;
+    u32 entsize = sizeof(int);
+    return chan_open(cap, entsize);
+}
+
+int queue_enqueue_many(Chan* q, const int* values, int n) {
+    return (int)chan_write_many(q, 0, values, (u32)n);
+}
+
+int queue_dequeue_many(Chan* q, int* values_out, int n) {
+    return (int)chan_read_many(q, 0, values_out, (u32)n);
+}
+
+#define HAS_QUEUE_CLOSE_ENQUEUE
+static void queue_close_enqueue(Chan* q) {
+    // called when all messages have been written
+    chan_shutdown(q);
+}
+
+void queue_destroy(Chan* q) {
+    chan_close(q);
+}
+
+#define Queue Chan
+
+#include "queue_test.h"
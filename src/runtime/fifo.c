@@ -7,6 +7,12 @@ static bool fifo_allocsize(u32 cap, usize elemsize, usize* nbyte_out) {
 }
 
 
+// Entries immediately follow the FIFO header, i.e. struct { FIFO fifo; T entries[]; }.
+// Note: FIFO is 16 bytes, so entries are suitably aligned for any element type.
+static_assert(sizeof(FIFO) % 16 == 0, "");
+#define FIFO_ENTRIES(q) ((u8*)(q) + sizeof(FIFO))
+
+
 FIFO* nullable fifo_alloc(u32 cap, usize elemsize) {
 	FIFO* q;
 	usize newsize;
@@ -53,7 +59,7 @@ static int _fifo_grow(FIFO** qp, usize elemsize, u32 maxcap) {
 	if (q->head > q->tail) {
 		u32 tailcount = q->cap - q->head;
 		u32 new_head = q->head + (newcap - q->cap);
-		void* entries = (u8*)q + ALIGN2(sizeof(*q), elemsize);
+		void* entries = FIFO_ENTRIES(q);
 		void* dst = entries + (usize)new_head*elemsize;
 		void* src = entries + (usize)q->head*elemsize;
 		memmove(dst, src, tailcount*elemsize);
@@ -76,7 +82,7 @@ void* nullable fifo_push(FIFO** qp, usize elemsize, u32 maxcap) {
 		q = *qp;
 		newtail = (q->tail + 1) % q->cap;
 	}
-	void* entries = (u8*)q + ALIGN2(sizeof(*q), elemsize);
+	void* entries = FIFO_ENTRIES(q);
 	void* entry = entries + (usize)q->tail*elemsize;
 	q->tail = newtail;
 	return entry;
@@ -86,7 +92,7 @@ void* nullable fifo_push(FIFO** qp, usize elemsize, u32 maxcap) {
 void* nullable fifo_pop(FIFO* q, usize elemsize) {
 	if (q->head == q->tail) // empty
 		return NULL;
-	void* entries = (u8*)q + ALIGN2(sizeof(*q), elemsize);
+	void* entries = FIFO_ENTRIES(q);
 	void* entry = entries + (usize)q->head*elemsize;
 	q->head = (q->head + 1) % q->cap;
 	return entry;
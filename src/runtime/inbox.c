@@ -25,6 +25,7 @@ const char* inbox_msg_type_str(enum InboxMsgType t) {
     case InboxMsgType_MSG_DIRECT:    return "MSG_DIRECT";
     case InboxMsgType_MSG_REMOTE:    return "MSG_REMOTE";
     case InboxMsgType_WORKER_CLOSED: return "WORKER_CLOSED";
+    case InboxMsgType_PUBLISH:       return "PUBLISH";
     }
     return "?";
 }
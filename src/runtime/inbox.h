@@ -8,6 +8,7 @@ typedef struct Inbox    Inbox;
 typedef struct InboxMsg InboxMsg;
 typedef struct UWorker  UWorker;
 typedef struct S        S;
+typedef struct Publication Publication;
 
 enum InboxMsgType {
     InboxMsgType_TIMER,         // timer rang
@@ -15,6 +16,7 @@ enum InboxMsgType {
     InboxMsgType_MSG_DIRECT,    // message via send(task ...) delivered directly
     InboxMsgType_MSG_REMOTE,    // message via send(remotetask ...)
     InboxMsgType_WORKER_CLOSED, // message sent by runtime when a worker closed
+    InboxMsgType_PUBLISH,       // message published to a topic which the task subscribes to
 };
 
 struct InboxMsg {
@@ -26,7 +28,7 @@ struct InboxMsg {
         } __attribute__((packed)) timer;
         struct { // InboxMsgType_MSG, InboxMsgType_MSG_DIRECT
             u16 nres; // number of result values
-            int ref;  // Lua ref to an array table holding values
+            int base; // stack index of first value in T.stash
         } __attribute__((packed)) msg;
         struct { // InboxMsgType_MSG_REMOTE
             u16      _unused1;
@@ -40,6 +42,11 @@ struct InboxMsg {
             u32      _unused2;
             UWorker* worker; // reference owned by this InboxMsg
         } __attribute__((packed)) worker_closed;
+        struct { // InboxMsgType_PUBLISH
+            u16          _unused1;
+            u32          _unused2;
+            Publication* pub; // reference owned by this InboxMsg
+        } __attribute__((packed)) publish;
     };
 };
 
@@ -63,6 +70,10 @@ inline static InboxMsg* nullable inbox_pop(Inbox* inbox) {
     return fifo_pop(&inbox->fifo, sizeof(*inbox->entries));
 }
 
+inline static bool inbox_isempty(const Inbox* nullable inbox) {
+    return !inbox || inbox->fifo.head == inbox->fifo.tail;
+}
+
 const char* inbox_msg_type_str(enum InboxMsgType t);
 
 API_END
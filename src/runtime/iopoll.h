@@ -27,6 +27,11 @@ struct IODesc {
     i64         nwrite; // bytes available to write, or -errno on error
 };
 
+// iodesc_readable returns true if reading from d would not block (data, EOF or error)
+inline static bool iodesc_readable(const IODesc* d) {
+    return d->nread != 0 || d->events == 'r'+'w';
+}
+
 int  iopoll_init(IOPoll* iopoll, S* s);
 void iopoll_dispose(IOPoll* iopoll);
 int  iopoll_interrupt(IOPoll* iopoll); // -errno on error
@@ -5,10 +5,11 @@ static bool pool_grow(Pool** pp, u32 newcap, usize elemsize) {
 	Pool* p = *pp;
 	u32 oldcap = 0;
 
-	// if p is not empty, newcap is current capacity + one extra chunk
+	// If p is not empty, newcap is twice the current capacity.
+	// Growing geometrically keeps the amortized cost of moving entries constant.
 	if (p && p->cap > 0) {
 		oldcap = p->cap;
-		if (check_add_overflow(oldcap, 64u, &newcap))
+		if (check_mul_overflow(oldcap, 2u, &newcap))
 			return false;
 	}
 
@@ -35,16 +36,17 @@ static bool pool_grow(Pool** pp, u32 newcap, usize elemsize) {
 	if (oldcap == 0) {
 		// new allocation; set all freebm chunks' bits to 1 (all slots are free)
 		p->maxidx = 0;
+		p->freehint = 0;
 		memset(p->freebm, 0xff, (usize)newcap >> 3);
 		// zero entries data
 		memset(pool_entries(p), 0x00, (usize)newcap * elemsize);
 	} else {
 		// new freebm overlap with existing entries, so we need to move the entries up
-		// before we set all bits to 1 in the new freebm chunk
+		// before we set all bits to 1 in the new freebm chunks
 		void* oldfreebm = (u8*)p->freebm + ((usize)oldcap >> 3);
 		void* newfreebm = (u8*)p->freebm + ((usize)newcap >> 3);
 		memmove(newfreebm, oldfreebm, p->maxidx * elemsize);
-		*(u64*)oldfreebm = ~(u64)0; // set all bits to 1 (all slots are free);
+		memset(oldfreebm, 0xff, (usize)(newcap - oldcap) >> 3); // all new slots are free
 		// zero new entries data
 		memset(pool_entries(p) + oldcap*elemsize, 0x00, (usize)(newcap - oldcap) * elemsize);
 	}
@@ -68,7 +70,8 @@ void* nullable pool_entry_alloc(Pool** pp, u32* idxp, usize elemsize) {
 		goto grow;
 again:
 	p = *pp;
-	for (u32 chunk_idx = 0, nchunks = p->cap>>6; chunk_idx < nchunks; chunk_idx++) {
+	// all chunks below freehint are full
+	for (u32 chunk_idx = p->freehint, nchunks = p->cap>>6; chunk_idx < nchunks; chunk_idx++) {
 		u64 bm = p->freebm[chunk_idx];
 		u32 bit_idx = dew_ffs(bm); // find first free buffer id (if any) in this chunk
 		if (bit_idx) {
@@ -76,6 +79,7 @@ again:
 			u32 idx = chunk_idx*64 + bit_idx; // note: idx is 1-based, not 0-based
 			// dlog(">>> allocate bit %u in chunk %u (idx = %u)", bit_idx-1, chunk_idx, idx);
 			p->freebm[chunk_idx] = bm & ~((u64)1 << (bit_idx - 1));
+			p->freehint = chunk_idx;
 			*idxp = idx;
 			if (idx > p->maxidx)
 				p->maxidx = idx;
@@ -84,6 +88,7 @@ again:
 		// all blocks of this chunk are in use; try next chunk
 	}
 	// all chunks were occupied; grow pool
+	p->freehint = p->cap >> 6;
 grow:
 	if (!pool_grow(pp, 64, elemsize))
 		return NULL;
@@ -105,6 +110,8 @@ void pool_entry_free(Pool* p, u32 idx) {
 	//      p->freebm[chunk_idx] | ((u64)1 << bit_idx));
 
 	p->freebm[chunk_idx] |= (u64)1 << bit_idx;
+	if (chunk_idx < p->freehint)
+		p->freehint = chunk_idx;
 
 	if (idx != p->maxidx)
 		return;
@@ -125,7 +132,7 @@ void pool_entry_free(Pool* p, u32 idx) {
 			// Find first 0 bit by first flipping all bits with xor,
 			// then use ffs to find the first 1 bit.
 			// dlog(">> chunk %u has at least one 0 bit: 0x%016lx", chunk_idx, chunk);
-			p->maxidx = (sizeof(chunk) * 8) - dew_clz(~chunk);
+			p->maxidx = (chunk_idx << 6) + (sizeof(chunk) * 8) - dew_clz(~chunk);
 			break;
 		} else {
 			// chunk is completely free
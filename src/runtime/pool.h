@@ -9,6 +9,8 @@ API_BEGIN
 typedef struct Pool {
     u32 cap;      // capacity, a multiple of 64
     u32 maxidx;   // max allocated index
+    u32 freehint; // index of first freebm chunk which may have a free slot
+    u32 _unused;
     u64 freebm[]; // bitmap; bit=1 means entries[bit] is free
     // TYPE entries[];
 } Pool;
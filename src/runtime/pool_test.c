@@ -47,6 +47,51 @@ static void pool_test_bug1() {
     dlog("OK: %s", __FUNCTION__);
 }
 
+static void pool_test_bug2() {
+    // regression test for a bug in pool_entry_free where the new maxidx would be calculated
+    // without accounting for the chunk offset, when maxidx is freed in any chunk but the first.
+    Pool* p;
+    bool ok = pool_init(&p, 8, 8);
+    assert(ok);
+    u32 idx;
+    for (u32 i = 1; i <= 100; i++) {
+        assertnotnull(pool_entry_alloc(&p, &idx, 8));
+        assert(idx == i);
+    }
+    pool_entry_free(p, 100); assertf(p->maxidx == 99, "%u", p->maxidx);
+    pool_entry_free(p, 99);  assertf(p->maxidx == 98, "%u", p->maxidx);
+    pool_entry_free(p, 50);  assertf(p->maxidx == 98, "%u", p->maxidx);
+    for (u32 i = 98; i > 64; i--)
+        pool_entry_free(p, i);
+    assertf(p->maxidx == 64, "%u", p->maxidx);
+    pool_free_pool(p);
+    dlog("OK: %s", __FUNCTION__);
+}
+
+static void pool_test_grow() {
+    // growing a pool many times keeps entries intact, and allocation reuses the lowest
+    // free slot even when it's far below the most recently allocated slot
+    Pool* p;
+    bool ok = pool_init(&p, 8, 8);
+    assert(ok);
+    u32 idx, N = 100000;
+    for (u32 i = 1; i <= N; i++) {
+        u64* vp = assertnotnull(pool_entry_alloc(&p, &idx, 8));
+        assert(idx == i);
+        *vp = i;
+    }
+    assertf(p->cap < N*2, "%u", p->cap);
+    for (u32 i = 1; i <= N; i++)
+        assert(*(u64*)pool_entry(p, i, 8) == i);
+    pool_entry_free(p, 70);
+    pool_entry_free(p, 3);
+    assertnotnull(pool_entry_alloc(&p, &idx, 8)); assert(idx == 3);
+    assertnotnull(pool_entry_alloc(&p, &idx, 8)); assert(idx == 70);
+    assertnotnull(pool_entry_alloc(&p, &idx, 8)); assert(idx == N + 1);
+    pool_free_pool(p);
+    dlog("OK: %s", __FUNCTION__);
+}
+
 __attribute__((constructor)) static void pool_test() {
     Pool* p;
     bool ok = pool_init(&p, /*cap*/3, 8);
@@ -123,6 +168,8 @@ __attribute__((constructor)) static void pool_test() {
     pool_free_pool(p);
 
     pool_test_bug1();
+    pool_test_bug2();
+    pool_test_grow();
 
     dlog("OK: %s", __FUNCTION__);
 }
@@ -51,6 +51,10 @@
 	#define trace_worker(fmt, ...) ((void)0)
 #endif
 
+// s_trace records an event in S's trace ring, if tracing is enabled (see schedtrace.h)
+#define s_trace(s, ev, sub, tid, arg) ( \
+	UNLIKELY((s)->trace) ? schedtrace_rec((s)->trace, (ev), (sub), (tid), (arg)) : ((void)0) )
+
 
 // LUA_EXTRASPACE is defined in src/lua/luaconf.h
 static_assert(sizeof(T) == LUA_EXTRASPACE, "");
@@ -60,13 +64,37 @@ static_assert(sizeof(AsyncWorkRes) % sizeof(void*) == 0, "");
 
 static u8 g_reftabkey;              // table of objects with compex lifetime, to avoid GC
 static u8 g_timerobj_luatabkey;     // Timer object prototype
+static u8 g_taskblock_luatabkey;    // TaskBlock handle prototype
 static u8 g_uworker_uval_luatabkey; // Worker object prototype (UWorkerUVal)
 static u8 g_remotetask_luatabkey;   // RemoteTask object prototype
 
+// T_FREELIST_MAX is the max number of GC'd task threads S keeps for reuse (see t_recycle)
+#define T_FREELIST_MAX 256
+
 // g_exiting is true when the process is about to exit().
 // Finalization code uses this to avoid doing unnecessary work.
 static _Atomic(bool) g_exiting = false;
 
+// g_topics is the list of all topics (see publish), guarded by g_topics_mu
+static Topic*          g_topics = NULL;
+static pthread_mutex_t g_topics_mu;
+
+// enum WorkerPlacementPolicy for user workers (see l_worker_placement)
+static _Atomic(u8) g_worker_placement_policy = WorkerPlacementPolicy_NONE;
+
+// default S.spin_max (set by dew_runtime_init)
+static u32 g_spin_max = 0;
+#define S_SPIN_MAX_DEFAULT 1024
+#define S_SPIN_MIN         32 // spin limit never adapts below this (unless spin_max is lower)
+
+// S_OUTBOX_CAP: max number of messages to another worker buffered in S.outbox
+#define S_OUTBOX_CAP 32
+
+#define ASYNCWORK_CQ_CAP       64 // capacity of S.asyncwork_cq (messages from other workers)
+#define ASYNCWORK_QUEUE_CAP    16 // max requests outstanding per AWorker (size of its sq & cq)
+#define ASYNCWORK_MAX_NWORKERS 64 // max AWorkers per S (default S.asyncwork_max)
+#define ASYNCWORK_IDLE_TIMEOUT (10*D_TIME_SECOND) // default S.asyncwork_idle_timeout
+
 // tls_s holds S for the current thread
 static _Thread_local S* tls_s = NULL;
 
@@ -84,6 +112,22 @@ static _Thread_local S* tls_s = NULL;
 static void worker_retain(Worker* w);
 static void worker_release(Worker* w);
 static bool worker_close(Worker* w);
+static void t_waitset_wake_kind(T* t, u8 kind, void* target, u8 wake_src, u32 wake_arg);
+static MiniBuf* l_encode_msg(lua_State* L, S* s, u64 flags, int nargs);
+static void t_send_remote(T* t, S* dst_s, u32 dst_tid, MiniBuf* minibuf);
+static void s_outbox_flush(S* s);
+static void s_warm_discard(S* s, u32 keep);
+static int s_warm_fill(S* s);
+static void s_asyncwork_remove_worker(S* s, AWorker* aw);
+static void s_asyncwork_reap(S* s);
+static AsyncWorkReq* nullable s_asyncwork_backlog_pop(S* s);
+static void asyncwork_discard(u16 op, u64 arg);
+static void s_asyncwork_submit(S* s, AWorker* aw, const AsyncWorkReq* req);
+static void s_chan_wake(S* s, u32 tid, ChannelData* ch);
+static void t_chan_unwait(T* t);
+static void s_recv_publication(S* s, Publication* pub, u32 publisher_sid);
+static void s_topics_unsubscribe(S* s, u32 tid, Topic* nullable tp);
+static void publication_release(Publication* pub);
 
 
 static int err_from_errno(int errno_val) {
@@ -253,6 +297,8 @@ static const char* t_status_str(u8 status) {
 		case T_WAIT_TASK:   return "T_WAIT_TASK";
 		case T_WAIT_WORKER: return "T_WAIT_WORKER";
 		case T_WAIT_ASYNC:  return "T_WAIT_ASYNC";
+		case T_WAIT_SET:    return "T_WAIT_SET";
+		case T_WAIT_CHAN:   return "T_WAIT_CHAN";
 		case T_DEAD:        return "T_DEAD";
 	}
 	return "?";
@@ -320,9 +366,7 @@ static T* nullable s_timers_check(S* s) {
 	while (s->timers.len > 0 && s->timers.v[0].when <= now) {
 		Timer* timer = timers_remove_min(&s->timers);
 		T* t = timer->f(timer, timer->arg);
-		if (t == NULL) {
-			now = DTimeNow();
-		} else if (timer->period > 0) {
+		if (timer->period > 0) {
 			// repeating timer
 			//
 			// Two different approaches to updating 'when':
@@ -340,18 +384,21 @@ static T* nullable s_timers_check(S* s) {
 
 			bool ok = timers_add(&s->timers, timer);
 			assert(ok); // never need to grow memory
-			return t;
 		} else {
 			// one-shot timer
 			// Since timers are accessible in userland, they are reference counted.
 			// We dereference the timer here rather than in timer->f since we need to access
 			// the timer after f returns.
+			T* owner = timer->arg;
 			timer->when = -1; // signals that timer is dead
 			timer_release(timer);
-			assert(t->ntimers > 0);
-			t->ntimers--;
-			return t;
+			assert(owner->ntimers > 0);
+			owner->ntimers--;
 		}
+		// f returns NULL when it woke t some other way (e.g. T_WAIT_SET)
+		if (t)
+			return t;
+		now = DTimeNow();
 	}
 	return NULL;
 }
@@ -378,6 +425,10 @@ static T* nullable l_timer_done(Timer* timer, void* arg) {
 		// Inbox is full (very full!) Drop timer with a warning.
 		logwarn("T%u inbox is full; dropping timer message", t->tid);
 	}
+	if (t->status == T_WAIT_SET) {
+		t_waitset_wake_kind(t, TWaitKind_RECV, t, STWake_TIMER, 0);
+		return NULL;
+	}
 	return t; // wake t
 }
 
@@ -561,40 +612,73 @@ static int l_sleep(lua_State* L) {
 
 
 typedef struct TaskInfo {
-	u8 gen;
-	T* t;
+	u16 gen; // generation of tid (TID_GEN_MASK)
+	T*  t;
 } TaskInfo;
 
 typedef struct SRegInfo {
 	u8 gen;
-	S* s;
 } SRegInfo;
 
-// global scheduler registry
-static Pool*           g_sreg = NULL;
-static pthread_mutex_t g_sreg_mu;
+// SRegSlot maps a sid to its S. Written by sreg_add & sreg_del, read by sreg_get.
+typedef struct SRegSlot {
+	_Atomic(u32) sid; // sid of s, or 0 if the slot is free
+	_Atomic(S*)  s;
+} SRegSlot;
+
+#define SREG_IDX_MAX     0xffffffu
+#define SREG_CHUNK_BITS  12
+#define SREG_CHUNK_LEN   (1u << SREG_CHUNK_BITS)
+#define SREG_NCHUNKS     ((SREG_IDX_MAX + 1) >> SREG_CHUNK_BITS)
+
+// global scheduler registry.
+// g_sreg allocates sids and tracks their generations; it's guarded by g_sreg_mu.
+// g_sreg_slots is the lookup table for sreg_get, which does not take g_sreg_mu.
+// Chunks of slots are allocated as needed (with g_sreg_mu held) and are never moved or
+// freed, so a reader only ever sees a NULL chunk or a valid one.
+static Pool*              g_sreg = NULL;
+static pthread_mutex_t    g_sreg_mu;
+static _Atomic(SRegSlot*) g_sreg_slots[SREG_NCHUNKS];
 
 /*
 GTID encoding:
 
-bit 00000000 011111111112222222222333 33333334 444444444555555555566666
-    12345678 901234567890123456789012 34567890 123456789012345678901234
+bit 0000000001111111111222 2222222333 333333344444444445555555 55566666
+    1234567890123456789012 3456789012 345678901234567890123456 78901234
    ┌───────────────────────────────────────────────────────────────────┐
-   │                              gtid (64)                            │
+   │                             gtid (64)                             │
    ├─────────────────────────────────┬─────────────────────────────────┤
-   │             tid (32)            │             sid (32)            │
-   ├────────────────────────┬────────┼────────────────────────┬────────┤
-   │         idx (24)       │ gen (8)│         idx (24)       │ gen (8)│
-   └────────────────────────┴────────┴────────────────────────┴────────┘
-
-E.g. {s_gen=0, s_idx=1, t_gen=1, t_idx=3} 0x0000000101000003 in little endian:
-    00000000 000000000000000000000001 00000001 000000000000000000000011
-    └─s_gen┘ └─────────s_idx────────┘ └─t_gen┘ └─────────t_idx────────┘
+   │            tid (32)             │            sid (32)             │
+   ├──────────────────────┬──────────┼────────────────────────┬────────┤
+   │       idx (22)       │ gen (10) │        idx (24)        │ gen (8)│
+   └──────────────────────┴──────────┴────────────────────────┴────────┘
+
+E.g. {s_gen=0, s_idx=1, t_gen=1, t_idx=3} 0x0000000100400003 in little endian:
+    00000000 000000000000000000000001 0000000001 0000000000000000000011
+    └─s_gen┘ └─────────s_idx────────┘ └──t_gen─┘ └───────t_idx────────┘
+
+A task's generation is incremented each time its registry slot is reused, which lets
+s_task_checked detect stale tids. With 10 bits, a slot must be reused 1024 times before a
+stale tid can alias a new task.
 */
 
+#define TID_IDX_BITS 22
+#define TID_IDX_MAX  ((1u << TID_IDX_BITS) - 1)        // max tasks per S (~4M)
+#define TID_GEN_MASK ((1u << (32 - TID_IDX_BITS)) - 1) // 1024 generations
+
+inline static u32 tid_idx(u32 tid) { return tid & TID_IDX_MAX; }
+inline static u32 tid_gen(u32 tid) { return tid >> TID_IDX_BITS; }
+
 
 void dew_runtime_init() {
 	pthread_mutex_init(&g_sreg_mu, NULL);
+	pthread_mutex_init(&g_topics_mu, NULL);
+
+	// spinning is pointless with only one CPU, since the thread we would wait for can't run
+	#ifdef _SC_NPROCESSORS_ONLN
+	if (sysconf(_SC_NPROCESSORS_ONLN) > 1)
+		g_spin_max = S_SPIN_MAX_DEFAULT;
+	#endif
 }
 
 
@@ -603,11 +687,34 @@ inline static u32 gtid_sid(GTID gtid) { return (u32)(gtid >> 32); }
 inline static u32 gtid_tid(GTID gtid) { return (u32)(gtid & 0xfffffffful); }
 
 
+// sreg_slot_alloc returns the lookup slot for sid index idx, allocating its chunk if needed.
+// Must be called with g_sreg_mu held.
+static SRegSlot* nullable sreg_slot_alloc(u32 idx) {
+	_Atomic(SRegSlot*)* chunkp = &g_sreg_slots[idx >> SREG_CHUNK_BITS];
+	SRegSlot* chunk = atomic_load_explicit(chunkp, memory_order_relaxed);
+	if (chunk == NULL) {
+		chunk = calloc(SREG_CHUNK_LEN, sizeof(SRegSlot));
+		if UNLIKELY(chunk == NULL)
+			return NULL;
+		atomic_store_explicit(chunkp, chunk, memory_order_release);
+	}
+	return &chunk[idx & (SREG_CHUNK_LEN - 1)];
+}
+
+
 static bool sreg_add(S* s) {
 	u32 idx;
 	assertf(s->sid == 0, "%u", s->sid);
 	pthread_mutex_lock(&g_sreg_mu);
 	SRegInfo* sinfo = pool_entry_alloc(&g_sreg, &idx, sizeof(SRegInfo));
+	SRegSlot* slot = NULL;
+
+	if LIKELY(sinfo != NULL) {
+		if UNLIKELY(idx > SREG_IDX_MAX || !(slot = sreg_slot_alloc(idx))) {
+			pool_entry_free(g_sreg, idx);
+			sinfo = NULL;
+		}
+	}
 
 	if UNLIKELY(sinfo == NULL) {
 		pthread_mutex_unlock(&g_sreg_mu);
@@ -615,13 +722,12 @@ static bool sreg_add(S* s) {
 		return false;
 	}
 
-	if UNLIKELY(idx > 0xffffff) {
-		pool_entry_free(g_sreg, idx);
-		sinfo = NULL;
-	} else {
-		sinfo->s = s;
-		s->sid = idx | ((u32)sinfo->gen << 24);
-	}
+	s->sid = idx | ((u32)sinfo->gen << 24);
+
+	// publish s before its sid, since sreg_get checks sid first
+	atomic_store(&slot->s, s);
+	atomic_store(&slot->sid, s->sid);
+
 	pthread_mutex_unlock(&g_sreg_mu);
 	trace_sched("[sreg] assigned sid %u to S %p", s->sid, s);
 	return true;
@@ -629,77 +735,87 @@ static bool sreg_add(S* s) {
 
 
 static void sreg_del(S* s) {
-	u32 idx = s->sid & 0xffffff;
+	u32 idx = s->sid & SREG_IDX_MAX;
 	pthread_mutex_lock(&g_sreg_mu);
 	SRegInfo* sinfo = pool_entry(g_sreg, idx, sizeof(SRegInfo));
 	assertf((u8)(s->sid >> 24) == sinfo->gen, "%u, %u", (s->sid >> 24), sinfo->gen);
 	sinfo->gen++; // increment generation so we can detect invalid deref
 	pool_entry_free(g_sreg, idx);
+
+	SRegSlot* slot = &atomic_load_explicit(
+		&g_sreg_slots[idx >> SREG_CHUNK_BITS], memory_order_relaxed)[idx & (SREG_CHUNK_LEN - 1)];
+	atomic_store(&slot->sid, 0);
+	atomic_store(&slot->s, NULL);
+
 	pthread_mutex_unlock(&g_sreg_mu);
 	// note: intentionally not setting 's->sid = 0' here so that l_recv_deliver_worker_closed
 	// can access the SID.
 }
 
 
+// sreg_get looks up the S of sid without locking.
+// Note: the caller must make sure that S stays alive while using it.
 static S* nullable sreg_get(u32 sid) {
-	SRegInfo* sinfo = NULL;
-	u32 idx = sid & 0xffffff;
-	assert(idx != 0); // more helpful error messages than pool_entry, which has the same check
-	pthread_mutex_lock(&g_sreg_mu);
-	if (!pool_idx_isdead(g_sreg, idx))
-		sinfo = pool_entry(g_sreg, idx, sizeof(SRegInfo));
-	pthread_mutex_unlock(&g_sreg_mu);
-	if (sinfo == NULL || sinfo->gen != (u16)(sid >> 24))
+	u32 idx = sid & SREG_IDX_MAX;
+	assert(idx != 0);
+	SRegSlot* chunk = atomic_load_explicit(
+		&g_sreg_slots[idx >> SREG_CHUNK_BITS], memory_order_acquire);
+	if UNLIKELY(chunk == NULL)
 		return NULL;
-	return sinfo->s;
+	SRegSlot* slot = &chunk[idx & (SREG_CHUNK_LEN - 1)];
+
+	// The sid includes the generation of the slot, so comparing sids detects both a free slot
+	// and a slot reused by another S. Loading sid again after s makes sure the slot wasn't
+	// deleted (or reused) while we loaded s. All slot accesses are sequentially consistent.
+	if (atomic_load(&slot->sid) != sid)
+		return NULL;
+	S* s = atomic_load(&slot->s);
+	if UNLIKELY(atomic_load(&slot->sid) != sid)
+		return NULL;
+	return s;
 }
 
 
 static bool s_taskreg_add(S* s, T* t) {
 	TaskInfo* tinfo = pool_entry_alloc(&s->taskreg, &t->tid, sizeof(TaskInfo));
 	if LIKELY(tinfo != NULL) {
-		if UNLIKELY(t->tid > 0xffffff) {
+		if UNLIKELY(t->tid > TID_IDX_MAX) {
 			dlog(S_ID_F " out of TIDs", s_id(s));
 			pool_entry_free(s->taskreg, t->tid);
 			t->tid = 0;
 			return false;
 		}
 		tinfo->t = t;
-		t->tid |= (u32)tinfo->gen << 24;
+		t->tid |= (u32)tinfo->gen << TID_IDX_BITS;
 	}
 	return tinfo != NULL;
 }
 
 
 static void s_taskreg_remove(S* s, T* t) {
-	u32 idx = t->tid & 0xffffff;
+	u32 idx = tid_idx(t->tid);
 
 	// increment generation so that s_task_checked can detect invalid tid_gen
 	TaskInfo* tinfo = pool_entry(s->taskreg, idx, sizeof(TaskInfo));
-	#ifdef DEBUG
-		u8 gen = (u8)(t->tid >> 24);
-		assertf(gen == tinfo->gen, "%u, %u", gen, tinfo->gen);
-	#endif
-	tinfo->gen++;
+	assertf(tid_gen(t->tid) == tinfo->gen, "%u, %u", tid_gen(t->tid), tinfo->gen);
+	tinfo->gen = (tinfo->gen + 1) & TID_GEN_MASK;
 
 	pool_entry_free(s->taskreg, idx);
 }
 
 
 inline static T* s_task(S* s, u32 tid) {
-	u32 idx = tid & 0xffffff;
-	TaskInfo* tinfo = pool_entry(s->taskreg, idx, sizeof(TaskInfo));
+	TaskInfo* tinfo = pool_entry(s->taskreg, tid_idx(tid), sizeof(TaskInfo));
 	return tinfo->t;
 }
 
 
 static T* nullable s_task_checked(S* s, u32 tid) {
-	u32 idx = tid & 0xffffff;
-	u8 gen = (u8)(tid >> 24);
-	if UNLIKELY(pool_idx_isdead(s->taskreg, idx))
+	u32 idx = tid_idx(tid);
+	if UNLIKELY(idx == 0 || pool_idx_isdead(s->taskreg, idx))
 		return NULL;
 	TaskInfo* tinfo = pool_entry(s->taskreg, idx, sizeof(TaskInfo));
-	if (tinfo->gen != gen)
+	if (tinfo->gen != tid_gen(tid))
 		return NULL;
 	return tinfo->t;
 }
@@ -981,12 +1097,92 @@ static void t_stop(T* nullable parent, T* child) {
 }
 
 
+// t_stop_r stops child and all of its siblings.
+// Siblings are visited in a loop rather than recursively since a task may have millions of
+// children. Children of each child are stopped by t_finalize.
 static void t_stop_r(T* parent, T* child) {
-	if (child->next_sibling)
-		t_stop_r(parent, s_task(parent->s, child->next_sibling));
-	if (child->first_child)
-		t_stop_r(child, s_task(parent->s, child->first_child));
-	return t_stop(parent, child);
+	for (;;) {
+		u32 next_sibling = child->next_sibling;
+		t_stop(parent, child);
+		if (next_sibling == 0)
+			break;
+		child = s_task(parent->s, next_sibling);
+	}
+}
+
+
+// taskblock_reserve makes sure there's space for one more member in tb.
+// Members which have exited are dropped before growing the array of members.
+static bool taskblock_reserve(TaskBlock* tb, S* s) {
+	if (tb->len < tb->cap)
+		return true;
+	u32 n = 0;
+	for (u32 i = 0; i < tb->len; i++) {
+		T* member = s_task_checked(s, tb->tids[i]);
+		if (member && member->status != T_DEAD)
+			tb->tids[n++] = tb->tids[i];
+	}
+	tb->len = n;
+	if (tb->cap > 0 && n <= tb->cap / 2)
+		return true;
+	if UNLIKELY(tb->cap > U32_MAX / 2)
+		return false;
+	u32 cap = tb->cap ? tb->cap * 2 : 8;
+	u32* tids = realloc(tb->tids, (usize)cap * sizeof(*tids));
+	if UNLIKELY(!tids)
+		return false;
+	tb->tids = tids;
+	tb->cap = cap;
+	return true;
+}
+
+
+// t_taskblock_of returns the task block t is a member of, or NULL if none
+static TaskBlock* nullable t_taskblock_of(T* t) {
+	if (t->parent == 0)
+		return NULL;
+	T* parent = s_task(t->s, t->parent);
+	for (TaskBlock* tb = parent->tblock; tb; tb = tb->outer) {
+		for (u32 i = 0; i < tb->len; i++) {
+			if (tb->tids[i] == t->tid)
+				return tb;
+		}
+	}
+	return NULL;
+}
+
+
+// t_taskblock_stop stops all members of tb (opened by t) which are still running
+static void t_taskblock_stop(T* t, TaskBlock* tb) {
+	for (u32 i = 0; i < tb->len; i++) {
+		T* member = s_task_checked(t->s, tb->tids[i]);
+		if (member && member->status != T_DEAD)
+			t_stop(t, member);
+	}
+}
+
+
+// t_taskblock_pop removes and frees the innermost task block of t
+static void t_taskblock_pop(T* t) {
+	TaskBlock* tb = assertnotnull(t->tblock);
+	t->tblock = tb->outer;
+	if (tb->errref != LUA_NOREF)
+		luaL_unref(t->s->L, LUA_REGISTRYINDEX, tb->errref);
+	free(tb->tids);
+	free(tb);
+}
+
+
+// t_taskblock_report_error reports the error of a member of a task block which taskblock_end
+// can no longer raise (errref), as an uncaught error
+static void t_taskblock_report_error(T* t, int errref) {
+	S* s = t->s;
+	lua_rawgeti(s->L, LUA_REGISTRYINDEX, errref);
+	luaL_unref(s->L, LUA_REGISTRYINDEX, errref);
+	const char* msg = luaL_tolstring(s->L, -1, NULL);
+	fprintf(stderr, "Uncaught error in task block of: [" T_ID_F "]\n%s\n", t_id(t), msg);
+	lua_pop(s->L, 2);
+	s->exiterr = true;
 }
 
 
@@ -995,24 +1191,39 @@ __attribute__((visibility("hidden")))
 void t_gc(lua_State* L, T* t) {
 	trace_sched(T_ID_F " GC", t_id(t));
 	// Remove from S's 'tasks' registry, effectively invalidating tid.
-	// Skip useless work in case of main task (tid 1)
-	if (t->tid != 1)
+	// Skip useless work in case of main task (tid 1) and tasks which failed to spawn (tid 0)
+	if (t->tid > 1)
 		s_taskreg_remove(t->s, t);
 }
 
 
+// t_recycle is called by Lua's luaE_freethread after t_gc, thus it must not be 'static'.
+// Instead of freeing the memory of a GC'd task's Lua thread, we keep it on a per-S free list
+// for s_spawn_task to reuse with lua_newthreadfrom. This saves allocating and freeing a
+// lua_State, its stack and CallInfo list for every task, which dominates the cost of
+// spawning short-lived tasks. Stacks which have grown are reused as-is.
+__attribute__((visibility("hidden")))
+int t_recycle(lua_State* L, T* t) {
+	S* s = t->s;
+	if (t->tid < 2 || s->isclosed || s->tfree_len >= T_FREELIST_MAX)
+		return 0;
+	trace_sched(T_ID_F " recycle", t_id(t));
+	t->info.free.next = s->tfree;
+	s->tfree = t;
+	s->tfree_len++;
+	return 1;
+}
+
+
 static void t_release_to_gc(T* t) {
 	trace_sched(T_ID_F " release to GC", t_id(t));
 	assert(t->status == T_DEAD);
 	// remove GC ref to allow task (Lua thread) to be garbage collected
-	lua_State* TL = t_L(t);
 	lua_State* SL = t->s->L;
 	lua_rawgetp(SL, LUA_REGISTRYINDEX, &g_reftabkey); // put ref table on stack
-	lua_pushthread(TL);   // Push the thread onto its own stack
-	lua_xmove(TL, SL, 1); // Move the thread object to the `SL` state
-	lua_pushnil(SL);      // Use `nil` to remove the key
-	lua_rawset(SL, -3);   // reftab[thread] = nil in `SL`
-	lua_pop(SL, 1);       // Remove the thread table from the stack
+	lua_pushnil(SL);
+	lua_rawseti(SL, -2, tid_idx(t->tid)); // reftab[tid_idx] = nil
+	lua_pop(SL, 1); // Remove the ref table from the stack
 }
 
 
@@ -1071,6 +1282,7 @@ static void worker_wake_waiters(Worker* w) {
 			        "%s (%u)", t_status_str(waiting_t->status), waiting_t->status);
 
 			// put waiting task on (priority) runq
+			s_trace(s, STEv_WAKE, STWake_WORKER, tid, 0);
 			bool ok;
 			if (tid == w->waiters) {
 				ok = s_runq_put_runnext(s, waiting_t);
@@ -1097,6 +1309,7 @@ static void t_wake_waiters(T* t, u32 waiters) {
 			   waiting_t->status == T_WAIT_SEND);
 
 		trace_sched("wake " T_ID_F " waiting on " T_ID_F, t_id(waiting_t), t_id(t));
+		s_trace(s, STEv_WAKE, STWake_TASK, tid, t->tid);
 
 		// put waiting task on (priority) runq
 		bool ok;
@@ -1115,6 +1328,121 @@ static void t_wake_waiters(T* t, u32 waiters) {
 }
 
 
+// t_waitset_unlink removes node n from the list of waiters of its target
+static void t_waitset_unlink(TWaitNode* n) {
+	n->linked = false;
+	TWaitNode** p;
+	switch ((enum TWaitKind)n->kind) {
+	case TWaitKind_TASK:
+		p = &((T*)n->target)->mwaiters;
+		break;
+	case TWaitKind_WORKER:
+		p = &((Worker*)n->target)->mwaiters;
+		break;
+	case TWaitKind_RECV:
+		return;
+	case TWaitKind_IO: {
+		IODesc* d = n->target;
+		if (d->t == n->ws->t)
+			d->t = NULL;
+		return;
+	}
+	case TWaitKind_TIMER: {
+		Timer* timer = n->target;
+		T* t = n->ws->t;
+		timers_remove(&t->s->timers, timer);
+		timer->when = -1; // signals that the timer is dead
+		timer_release(timer);
+		assert(t->ntimers > 0);
+		t->ntimers--;
+		n->target = NULL;
+		return;
+	}
+	}
+	for (; *p; p = &(*p)->next) {
+		if (*p == n) {
+			*p = n->next;
+			n->next = NULL;
+			return;
+		}
+	}
+	// not found; list is being visited by t_waitset_wake_list
+}
+
+
+// t_waitset_cancel unlinks all nodes of ws which events have not yet occurred
+static void t_waitset_cancel(TWaitSet* ws) {
+	for (u32 i = 0; i < ws->len; i++) {
+		if (ws->nodes[i].linked)
+			t_waitset_unlink(&ws->nodes[i]);
+	}
+}
+
+
+// t_waitset_fire is called when the event of node n has occurred.
+// Wakes up the waiting task if this was the last event it was waiting for.
+static void t_waitset_fire(S* s, TWaitNode* n, u8 wake_src, u32 wake_arg) {
+	TWaitSet* ws = n->ws;
+	n->linked = false;
+	n->next = NULL;
+	if (ws->first == 0)
+		ws->first = (u32)(n - ws->nodes) + 1;
+	if (--ws->nwait > 0)
+		return;
+
+	// unlink from anything else t is waiting for (e.g. await_any)
+	t_waitset_cancel(ws);
+
+	T* t = ws->t;
+	assert(t->status == T_WAIT_SET);
+	trace_sched("wake " T_ID_F " waiting on wait set", t_id(t));
+	s_trace(s, STEv_WAKE, wake_src, t->tid, wake_arg);
+	if UNLIKELY(!s_runq_put(s, t))
+		panic_oom();
+}
+
+
+// t_waitset_wake_list fires all nodes in list *listp, leaving the list empty
+static void t_waitset_wake_list(S* s, TWaitNode** listp, u8 wake_src, u32 wake_arg) {
+	TWaitNode* n = *listp;
+	*listp = NULL;
+	while (n) {
+		// Note: firing a node may cancel other nodes of the same wait set, which are possibly
+		// in this list (if the set contains duplicates.) t_waitset_unlink does not change
+		// 'next' of nodes it can't find, so it's safe to continue down the list.
+		TWaitNode* next = n->next;
+		if (n->linked)
+			t_waitset_fire(s, n, wake_src, wake_arg);
+		n = next;
+	}
+}
+
+
+// t_waitset_wake_kind fires the first pending node of kind with target of t's wait set.
+// Called for events which are not tracked with a list of waiters, like I/O.
+static void t_waitset_wake_kind(T* t, u8 kind, void* target, u8 wake_src, u32 wake_arg) {
+	assert(t->status == T_WAIT_SET);
+	TWaitSet* ws = t->info.wait_set.ws;
+	for (u32 i = 0; i < ws->len; i++) {
+		TWaitNode* n = &ws->nodes[i];
+		if (n->linked && n->kind == kind && n->target == target)
+			return t_waitset_fire(t->s, n, wake_src, wake_arg);
+	}
+}
+
+
+// t_waitset_release is called when t is no longer waiting (woken or stopped)
+static void t_waitset_release(TWaitSet* ws) {
+	t_waitset_cancel(ws);
+	for (u32 i = 0; i < ws->len; i++) {
+		if (ws->nodes[i].kind == TWaitKind_WORKER && ws->nodes[i].target) {
+			worker_release(ws->nodes[i].target);
+			ws->nodes[i].target = NULL;
+		}
+	}
+}
+
+
 static UWorker* s_worker(S* s) {
 	assert(s->isworker);
 	return (UWorker*)((u8*)s - offsetof(UWorker, s));
@@ -1131,8 +1459,18 @@ UNUSED static const char* TDied_str(enum TDied died_how) {
 };
 
 
+// s_worker_msg_uncount subtracts a message sent to task dst_tid of dst_s from the worker's
+// count of pending messages (Worker.npending), if it was counted by t_send_remote.
+// Called when the message is received or discarded.
+static void s_worker_msg_uncount(S* dst_s, u32 dst_tid) {
+	if (dst_s->isworker && dst_tid == 1)
+		atomic_fetch_sub_explicit(&s_worker(dst_s)->npending, 1, memory_order_relaxed);
+}
+
+
 static void msg_msg_remote_free(InboxMsg* msg) {
 	assert(msg->type == InboxMsgType_MSG_REMOTE);
+	structclone_discard(msg->msg_remote.buf->bytes, msg->msg_remote.buf->len);
 	free(msg->msg_remote.buf);
 	msg->msg_remote.buf = NULL;
 }
@@ -1144,6 +1482,48 @@ static void msg_worker_closed_free(InboxMsg* msg) {
 }
 
 
+static void msg_publish_free(InboxMsg* msg) {
+	assert(msg->type == InboxMsgType_PUBLISH);
+	publication_release(msg->publish.pub);
+}
+
+
+// t_stash_reserve makes sure there's room for n values in the stash of t, creating it if
+// needed. The stash is a Lua thread which holds the payload of messages buffered in t's inbox,
+// in FIFO order, on its stack. It is anchored in the registry (keyed by t) so that the values
+// are kept alive until the message is delivered or the inbox is freed.
+// This avoids allocating a table and a registry ref per buffered message.
+static bool t_stash_reserve(lua_State* L, T* t, int n) {
+	if UNLIKELY(!t->stash) {
+		lua_State* stash = lua_newthread(L);
+		memset(L_t(stash), 0, sizeof(T)); // not a task; extra space is a copy of main thread's
+		lua_rawsetp(L, LUA_REGISTRYINDEX, t);
+		t->stash = stash;
+	}
+	return lua_checkstack(t->stash, n);
+}
+
+
+static void t_stash_free(T* t) {
+	lua_State* L = t->s->L;
+	lua_pushnil(L);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, t);
+	t->stash = NULL;
+}
+
+
+// t_stash_rebase adjusts the stash index of buffered messages after 'delta' values have been
+// removed from the bottom of the stash
+static void t_stash_rebase(T* t, int delta) {
+	FIFO* q = &t->inbox->fifo;
+	for (u32 i = q->head; i != q->tail; i = (i + 1) % q->cap) {
+		InboxMsg* msg = &t->inbox->entries[i];
+		if (msg->type == InboxMsgType_MSG)
+			msg->msg.base -= delta;
+	}
+}
+
+
 static void t_inbox_free(T* t) {
 	InboxMsg* msg;
 	while (( msg = inbox_pop(t->inbox) )) {
@@ -1154,11 +1534,15 @@ static void t_inbox_free(T* t) {
 				// no cleanup required
 				break;
 			case InboxMsgType_MSG_REMOTE:
+				s_worker_msg_uncount(t->s, t->tid);
 				msg_msg_remote_free(msg);
 				break;
 			case InboxMsgType_WORKER_CLOSED:
 				msg_worker_closed_free(msg);
 				break;
+			case InboxMsgType_PUBLISH:
+				msg_publish_free(msg);
+				break;
 		}
 	}
 	inbox_free(t->inbox);
@@ -1176,14 +1560,25 @@ static void t_finalize(T* t, enum TDied died_how, u8 prev_tstatus) {
 	// the current value of t->status in here but must use prev_tstatus.
 	trace_sched(T_ID_F " exited (died_how=%s, status=%s)",
 	            t_id(t), TDied_str(died_how), t_status_str(prev_tstatus));
+	TaskBlock* tb = NULL;
 	if UNLIKELY(died_how == TDied_ERR) {
-		s->exiterr = true;
-
 		// one error as the final result value
 		t->resume_nres = 1;
 
+		// If t is a member of a task block, the error is raised by taskblock_end.
+		// Keep the error of the first member to fail.
+		if (( tb = t_taskblock_of(t) )) {
+			if (tb->errref == LUA_NOREF) {
+				lua_pushvalue(t_L(t), -1);
+				lua_xmove(t_L(t), s->L, 1);
+				tb->errref = luaL_ref(s->L, LUA_REGISTRYINDEX);
+			}
+		} else {
+			s->exiterr = true;
+		}
+
 		// unless there are tasks waiting for this task, report the error as unhandled
-		if (t->waiters == 0) {
+		if (t->waiters == 0 && t->mwaiters == NULL && tb == NULL) {
 			if (s->isworker && t->tid == 1) {
 				// main task of a worker
 				UWorker* w = s_worker(s);
@@ -1227,17 +1622,34 @@ static void t_finalize(T* t, enum TDied died_how, u8 prev_tstatus) {
 		// Task was stopped while waiting for another task.
 		// Remove task from list of waiters of target task.
 		t_remove_from_waiters(t);
+	} else if (prev_tstatus == T_WAIT_SET) {
+		t_waitset_release(t->info.wait_set.ws);
 	}
 
 	// stop child tasks
 	if (t->first_child)
 		t_stop_r(t, s_task(s, t->first_child));
 
+	// close task blocks which t left open (e.g. by exiting without calling taskblock_end)
+	while (t->tblock) {
+		if (t->tblock->errref != LUA_NOREF) {
+			t_taskblock_report_error(t, t->tblock->errref);
+			t->tblock->errref = LUA_NOREF;
+		}
+		t_taskblock_pop(t);
+	}
+
 	// wake any tasks waiting for this task to exit
 	if (t->waiters) {
 		t_wake_waiters(t, t->waiters);
 		t->waiters = 0;
 	}
+	if (t->mwaiters)
+		t_waitset_wake_list(s, &t->mwaiters, STWake_TASK, t->tid);
+
+	// an error in a member of a task block stops the other members of the block
+	if (tb)
+		t_taskblock_stop(s_task(s, t->parent), tb);
 
 	// // if S is supposed to exit() when done, do that now if this is the last task
 	// if (s->doexit && s->nlive == 0 && s->workers == NULL) {
@@ -1245,9 +1657,19 @@ static void t_finalize(T* t, enum TDied died_how, u8 prev_tstatus) {
 	// 	return exit(s->exiterr);
 	// }
 
+	// unsubscribe from topics
+	if (s->topicsubs.len)
+		s_topics_unsubscribe(s, t->tid, NULL);
+
 	// free any un-recv messages in inbox
 	if (t->inbox)
 		t_inbox_free(t);
+	if (t->stash)
+		t_stash_free(t);
+
+	// leave the wait queue of a channel, or pass on a wakeup from it
+	if (t->chan)
+		t_chan_unwait(t);
 
 	// stop any still-running timers (optimization: skip when S is shutting down)
 	if UNLIKELY(t->ntimers && !s->isclosed)
@@ -1263,6 +1685,7 @@ static void t_finalize(T* t, enum TDied died_how, u8 prev_tstatus) {
 
 	// set info.dead.how
 	t->info.dead.how = died_how;
+	s_trace(s, STEv_EXIT, died_how, t->tid, 0);
 
 	// release S's "live" reference to the task
 	t_release(t);
@@ -1284,14 +1707,17 @@ static void t_resume(T* t) {
 
 	trace_sched("resume " T_ID_F " nargs=%d", t_id(t), nargs);
 	// dlog_lua_stackf(L, "stack: (nargs=%d)", nargs);
+	s_trace(t->s, STEv_RESUME, 0, t->tid, nargs);
 	int status = lua_resume(L, t->s->L, nargs, &nres);
 
 	// check if task exited
 	if UNLIKELY(status != LUA_YIELD) {
+		s_trace(t->s, STEv_SUSPEND, T_DEAD, t->tid, 0);
 		t->resume_nres = nres > 0xff ? 0xff : nres;
 		u8 died_how = (status == LUA_OK) ? TDied_CLEAN : TDied_ERR;
 		return t_finalize(t, died_how, t->status);
 	}
+	s_trace(t->s, STEv_SUSPEND, t->status, t->tid, 0);
 
 	// discard results
 	return lua_pop(L, nres);
@@ -1324,8 +1750,20 @@ static int s_spawn_task(S* s, lua_State* L, T* nullable parent) {
 	// rest of arguments will be passed along to the task's main function when started
 	int nargs = lua_gettop(L) - 1;
 
-	// create "thread" & push it on stack
-	lua_State* NL = lua_newthread(L);
+	// make room for the new task in the parent's current task block
+	if (parent && parent->tblock && UNLIKELY(!taskblock_reserve(parent->tblock, s)))
+		return l_errno_error(L, ENOMEM);
+
+	// create "thread" & push it on stack, reusing the memory of a GC'd task if possible
+	lua_State* NL;
+	if (s->tfree) {
+		T* free_t = s->tfree;
+		s->tfree = free_t->info.free.next;
+		s->tfree_len--;
+		NL = lua_newthreadfrom(L, t_L(free_t));
+	} else {
+		NL = lua_newthread(L);
+	}
 
 	// Move value on top of stack (the "thread" object) to the bottom of the stack.
 	// I.e. [function, arg1, arg2, argN, thread] -> [thread, function, arg1, arg2, argN]
@@ -1335,18 +1773,6 @@ static int s_spawn_task(S* s, lua_State* L, T* nullable parent) {
 	// What remains on L's stack is the "thread".
 	lua_xmove(L, NL, 1 + nargs);
 
-	// Hold on to a GC reference to thread, e.g. "S.L.reftab[thread] = true"
-	// Note: this is quite complex of a Lua stack operation. In particular lua_pushthread is
-	// gnarly as it pushes the thread onto its own stack, which we then move over to S's stack.
-	// If we get things wrong we (at best) get a memory bus error in asan with no stack trace,
-	// making this tricky to debug.
-	lua_rawgetp(s->L, LUA_REGISTRYINDEX, &g_reftabkey); // push table on S's stack
-	lua_pushvalue(L, 1);      // Copy thread
-	lua_xmove(L, s->L, 1);    // Move thread to S's stack
-	lua_pushboolean(s->L, 1); // "true"
-	lua_rawset(s->L, -3);     // reftab[thread] = true
-	lua_pop(s->L, 1);         // Remove table from stack
-
 	// initialize T struct (which lives in the LUA_EXTRASPACE header of lua_State)
 	T* t = L_t(NL);
 	memset(t, 0, sizeof(*t));
@@ -1363,22 +1789,37 @@ static int s_spawn_task(S* s, lua_State* L, T* nullable parent) {
 	}
 	trace_sched("register task " T_ID_F " (L=%p)", t_id(t), t_L(t));
 
+	// Hold on to a GC reference to thread, e.g. "S.L.reftab[tid_idx] = thread".
+	// Since tid indices are small and densely allocated, this uses the table's array part.
+	lua_rawgetp(s->L, LUA_REGISTRYINDEX, &g_reftabkey); // push table on S's stack
+	lua_pushvalue(L, 1);                     // Copy thread
+	lua_xmove(L, s->L, 1);                   // Move thread to S's stack
+	lua_rawseti(s->L, -2, tid_idx(t->tid)); // reftab[tid_idx] = thread
+	lua_pop(s->L, 1);                        // Remove table from stack
+
 	// assert that main task is assigned tid 1
 	if (!parent)
 		assertf(t->tid == 1, "main task was not assigned tid 1");
 
 	// setup t to be run next by schedule
 	if UNLIKELY(!s_runq_put_runnext(s, t)) {
+		t->status = T_DEAD;
+		t_release_to_gc(t);
 		s_taskreg_remove(s, t);
+		t->tid = 0;
 		lua_closethread(NL, L);
 		return l_errno_error(L, ENOMEM);
 	}
 
 	s->nlive++;
+	s_trace(s, STEv_SPAWN, 0, t->tid, parent ? parent->tid : 0);
 
 	// add t as a child of parent
-	if (parent)
+	if (parent) {
 		t_add_child(parent, t);
+		if (parent->tblock)
+			parent->tblock->tids[parent->tblock->len++] = t->tid;
+	}
 
 	if (parent) {
 		trace_sched(T_ID_F " spawns " T_ID_F, t_id(parent), t_id(t));
@@ -1406,7 +1847,16 @@ int s_iopoll_wake(S* s, IODesc** dv, u32 count) {
 		// that occurs when the task is running.
 		d->t = NULL;
 
+		if (t->status == T_WAIT_SET) {
+			if (iodesc_readable(d))
+				t_waitset_wake_kind(t, TWaitKind_IO, d, STWake_IOPOLL, (u32)d->fd);
+			else
+				d->t = t; // not readable; keep waiting
+			continue;
+		}
+
 		trace_sched(T_ID_F " woken by iopoll" , t_id(t));
+		s_trace(s, STEv_WAKE, STWake_IOPOLL, t->tid, (u32)d->fd);
 
 		// TODO: check if t is already on runq and don't add it if so.
 		// For now, use an assertion (note: this is likely to happen)
@@ -1445,7 +1895,10 @@ static void t_send_worker_closed_msg(T* t, UWorker* uw) {
 	// the message will be delivered later.
 	if (t->status == T_WAIT_RECV) {
 		trace_sched("wake " T_ID_F " waiting on recv", t_id(t));
+		s_trace(t->s, STEv_WAKE, STWake_WORKER_MSG, t->tid, uw->s.sid);
 		s_runq_put_runnext(t->s, t);
+	} else if (t->status == T_WAIT_SET) {
+		t_waitset_wake_kind(t, TWaitKind_RECV, t, STWake_WORKER_MSG, uw->s.sid);
 	} else {
 		trace_sched("deliver buffered msg to " T_ID_F, t_id(t));
 	}
@@ -1461,19 +1914,31 @@ static void s_on_worker_closed(S* s, Worker* w) {
 	// below becomes simpler.
 	if (w->waiters)
 		worker_wake_waiters(w);
+	if (w->mwaiters)
+		t_waitset_wake_list(s, &w->mwaiters, STWake_WORKER, 0);
 
 	// post a message to the spawner
 	if (w->wkind == WorkerKind_USER) {
 		UWorker* uw = (UWorker*)w;
 		T* t = s_task_checked(s, uw->spawned_by_tid);
 		if (t && t->status != T_DEAD) {
-			assert(t->status != T_WAIT_WORKER); // handled by worker_wake_waiters
+			// Note: t may be in T_WAIT_WORKER here if it's waiting for a different worker.
+			// (If it was waiting for w it was made T_READY by worker_wake_waiters.)
 			t_send_worker_closed_msg(t, uw);
 		} else {
 			// The task that spawned the worker has exited.
 			// We could use S's main task here instead, but that might muddy the waters of
 			// semantics a bit, making it harder to understand.
 		}
+	} else {
+		AWorker* aw = (AWorker*)w;
+		s_asyncwork_remove_worker(s, aw);
+		// a worker S stopped for being idle is not joined by s_finalize; do it now
+		if (aw->reaped) {
+			int err = pthread_join(w->thread, NULL);
+			if (err)
+				logwarn("failed to wait for %s: %s", fmtworker(w), strerror(err));
+		}
 	}
 
 	worker_release(w);
@@ -1506,20 +1971,26 @@ static void s_reap_workers(S* s) {
 
 static void s_recv_worker_msg(S* s, AsyncWorkRes* res) {
 	// This function is called when S discovers that a message has been sent to its worker.
-	// Its job is to deliver the message to this S's main task.
+	// Its job is to deliver the message to the task it's addressed to (res->msg.dst_tid.)
 	assert(res->op == AsyncWorkOp_WORKER_MSG);
 
 	// Inbox is practically unbounded in this case. The only other option is to drop the message.
 	const u32 maxcap = U32_MAX;
 
-	// find main task, which will receive the message
-	T* t = (s->nlive > 0) ? s_task(s, 1) : NULL;
-	if UNLIKELY(!t || t->status == T_DEAD || s->isclosed) {
+	if UNLIKELY(s->nlive == 0 || s->isclosed) {
 		// we are called to "clean up" when a worker is exiting, just free the memory
 		logwarn("ignoring message from worker received during shutdown");
 		goto bail;
 	}
 
+	// find the receiving task. The sender may hold a stale tid, which is caught by its generation.
+	T* t = s_task_checked(s, res->msg.dst_tid);
+	if UNLIKELY(!t || t->status == T_DEAD) {
+		logwarn("dropping message from S%u T%u to dead task T%u",
+		        res->msg.sender_sid, res->msg.sender_tid, res->msg.dst_tid);
+		goto bail;
+	}
+
 	// put a message in its inbox
 	InboxMsg* msg = inbox_add(&t->inbox, maxcap);
 	if UNLIKELY(msg == NULL) {
@@ -1535,7 +2006,10 @@ static void s_recv_worker_msg(S* s, AsyncWorkRes* res) {
 	// the message will be delivered later.
 	if (t->status == T_WAIT_RECV) {
 		trace_sched("wake " T_ID_F " waiting on recv", t_id(t));
+		s_trace(s, STEv_WAKE, STWake_MSG_REMOTE, t->tid, res->msg.sender_sid);
 		s_runq_put_runnext(s, t);
+	} else if (t->status == T_WAIT_SET) {
+		t_waitset_wake_kind(t, TWaitKind_RECV, t, STWake_MSG_REMOTE, res->msg.sender_sid);
 	} else {
 		trace_sched("deliver buffered msg to " T_ID_F, t_id(t));
 	}
@@ -1543,37 +2017,63 @@ static void s_recv_worker_msg(S* s, AsyncWorkRes* res) {
 	return;
 
 bail:
+	s_worker_msg_uncount(s, res->msg.dst_tid);
+	structclone_discard(res->msg.buf->bytes, res->msg.buf->len);
 	free(res->msg.buf);
 }
 
 
-static void s_asyncwork_read_cq(S* s) {
-	// There's a natural race condition with asyncwork completions where delivering
-	// S_NOTE_ASYNCWORK to wake up a runloop races with delivery of AsyncWorkRes on the
-	// completion queue.
-	//
-	// N completions may lead <=N S_NOTE_ASYNCWORK deliveries because notes are delivered not in
-	// a queue but as a signal to wake up S's runloop. I.e. many logical notes may result in just
-	// one runloop wakeup; one call to s_check_notes.
-	//
-	// Because of this, we sometimes process many completions in this loop and sometimes no
-	// completions at all (when we processed them in a previous loop.) Since NOTEs are always
-	// causally delivered after writing to the CQ, completions can never "appear" _after_ a
-	// NOTE, only _before_ a NOTE (i.e. when we process more than one completion in one note.)
-	AsyncWorkRes res;
-	while (s->asyncwork_cq != NULL) {
-		if (!chan_read(s->asyncwork_cq, CHAN_TRY, &res))
-			break;
-
-		if (res.op == AsyncWorkOp_WORKER_MSG) {
-			s_recv_worker_msg(s, &res);
+// s_recv_publication puts a reference to pub in the inbox of each task of s which is
+// subscribed to pub's topic. It's called by the publisher's S when it has subscribers itself,
+// and via the CQ for other S's (see l_publish.) The caller's reference is not consumed.
+static void s_recv_publication(S* s, Publication* pub, u32 publisher_sid) {
+	if UNLIKELY(s->nlive == 0 || s->isclosed)
+		return;
+	for (u32 i = 0; i < s->topicsubs.len; i++) {
+		if (s->topicsubs.v[i].topic != pub->topic)
+			continue;
+		T* t = s_task_checked(s, s->topicsubs.v[i].tid);
+		if UNLIKELY(!t || t->status == T_DEAD)
 			continue;
+		InboxMsg* msg = inbox_add(&t->inbox, U32_MAX);
+		if UNLIKELY(msg == NULL) {
+			logwarn("T%u inbox is full; dropping published message", t->tid);
+			continue;
+		}
+		msg->type = InboxMsgType_PUBLISH;
+		msg->publish.pub = pub;
+		atomic_fetch_add_explicit(&pub->refcount, 1, memory_order_relaxed);
+
+		if (t->status == T_WAIT_RECV) {
+			trace_sched("wake " T_ID_F " waiting on recv", t_id(t));
+			s_trace(s, STEv_WAKE, STWake_PUBLISH, t->tid, publisher_sid);
+			if UNLIKELY(!s_runq_put(s, t))
+				panic_oom();
+		} else if (t->status == T_WAIT_SET) {
+			t_waitset_wake_kind(t, TWaitKind_RECV, t, STWake_PUBLISH, publisher_sid);
 		}
+	}
+}
+
+
+// s_asyncwork_read_worker_cq wakes the tasks waiting for work that aw has completed
+static void s_asyncwork_read_worker_cq(S* s, AWorker* aw) {
+	AsyncWorkRes res;
+	while (aw->nqueued > 0 && spsc_read(aw->cq, &res)) {
+		aw->nqueued--;
 
 		// Lookup task waiting for this work.
-		// Note: No need for tid_gen check here since the task can't exit as its suspended.
+		// Note: No need for tid_gen check here since the work holds a reference to the task.
+		// The task may however have been stopped (e.g. by its parent exiting) while waiting.
 		T* t = s_task(s, res.tid);
+		if UNLIKELY(t->status == T_DEAD) {
+			trace_sched("drop asyncwork result for dead " T_ID_F, t_id(t));
+			asyncwork_discard(res.op, res.arg);
+			t_release(t);
+			goto next;
+		}
 		trace_sched("wake " T_ID_F " waiting on asyncwork", t_id(t));
+		s_trace(s, STEv_WAKE, STWake_ASYNCWORK, t->tid, res.op);
 		if (res.flags & AsyncWorkFlag_HAS_CONT) {
 			t->info.wait_async.result = res.result;
 		} else {
@@ -1583,33 +2083,94 @@ static void s_asyncwork_read_cq(S* s) {
 		if UNLIKELY(!s_runq_put(s, t))
 			panic_oom();
 		t_release(t);
+
+	next:
+		// hand the worker the request which has waited the longest for one
+		if (aw->nqueued == 0 && !aw->reaped &&
+		    atomic_load_explicit(&aw->w.status, memory_order_acquire) != Worker_CLOSED)
+		{
+			AsyncWorkReq* req = s_asyncwork_backlog_pop(s);
+			if (req)
+				s_asyncwork_submit(s, aw, req);
+		}
+	}
+}
+
+
+static void s_asyncwork_read_cq(S* s) {
+	// There's a natural race condition with asyncwork completions where delivering
+	// S_NOTE_ASYNCWORK to wake up a runloop races with delivery of AsyncWorkRes on the
+	// completion queue.
+	//
+	// N completions may lead <=N S_NOTE_ASYNCWORK deliveries because notes are delivered not in
+	// a queue but as a signal to wake up S's runloop. I.e. many logical notes may result in just
+	// one runloop wakeup; one call to s_check_notes.
+	//
+	// Because of this, we sometimes process many completions in this loop and sometimes no
+	// completions at all (when we processed them in a previous loop.) Since NOTEs are always
+	// causally delivered after writing to the CQ, completions can never "appear" _after_ a
+	// NOTE, only _before_ a NOTE (i.e. when we process more than one completion in one note.)
+	// messages sent by other workers, drained in batches to amortize the cost of
+	// claiming & committing entries
+	if (s->asyncwork_cq != NULL) {
+		AsyncWorkRes resv[16];
+		u32 n;
+		while ((n = chan_read_many(s->asyncwork_cq, CHAN_TRY, resv, countof(resv)))) {
+			for (u32 i = 0; i < n; i++) {
+				if (resv[i].op == AsyncWorkOp_CHAN_WAKE) {
+					s_chan_wake(s, resv[i].tid, (ChannelData*)(uintptr)resv[i].result);
+				} else if (resv[i].op == AsyncWorkOp_PUBLISH) {
+					Publication* pub = (Publication*)(uintptr)resv[i].result;
+					s_recv_publication(s, pub, resv[i].tid);
+					publication_release(pub);
+				} else {
+					s_recv_worker_msg(s, &resv[i]);
+				}
+			}
+		}
 	}
+
+	// completed async work
+	for (u32 i = 0; i < s->asyncwork_nworkers; i++)
+		s_asyncwork_read_worker_cq(s, s->asyncwork_workers[i]);
 }
 
 
 static void s_check_notes(S* s, u8 notes) {
+	// Clear notes bits before handling them.
+	// A worker which adds an event after this will set its bit again, so s_find_runnable
+	// calls s_check_notes again. (Clearing after handling would lose an event that was added
+	// while handling, if its bit was already set.)
+	atomic_fetch_and_explicit(&s->notes, (u8)~notes, memory_order_acq_rel);
+
 	// note: must check asyncwork before calling s_reap_workers to avoid race condition where
 	// a worker's task send()s a message to the parent S's T1 just before it exits.
 	if (notes & S_NOTE_ASYNCWORK)
 		s_asyncwork_read_cq(s);
 
+	if (notes & S_NOTE_AWIDLE)
+		s_asyncwork_reap(s);
+
+	if (notes & S_NOTE_WARMFILL) {
+		int err = s_warm_fill(s);
+		if UNLIKELY(err)
+			logwarn("failed to start pre-warmed worker: %s", strerror(-err));
+	}
+
 	if (notes & S_NOTE_WEXIT)
 		s_reap_workers(s);
-
-	// Clear notes bits.
-	// We are racing with worker threads here, so use a CAS but don't loop to retry since
-	// s_check_notes is called by s_find_runnable, which will call s_check_notes again if a
-	// worker raced us and added more events.
-	atomic_compare_exchange_strong_explicit(
-		&s->notes, &notes, 0, memory_order_acq_rel, memory_order_relaxed);
 }
 
 
 static void s_shutdown(S* s) {
 	// note: this function is only called by other threads, never from "inside" S
-	if (atomic_exchange_explicit(&s->isclosed, true, memory_order_acq_rel) == false) {
-		trace_sched("interrupting iopoll");
-		iopoll_interrupt(&s->iopoll);
+	if (atomic_exchange_explicit(&s->isclosed, true, memory_order_seq_cst) == false) {
+		// Interrupt iopoll if S is blocked in it (see s_poll.)
+		// Note: S may not even have started yet, e.g. a parked pre-warmed worker.
+		if (atomic_exchange_explicit(&s->ispolling, false, memory_order_seq_cst)) {
+			trace_sched("interrupting iopoll");
+			iopoll_interrupt(&s->iopoll);
+		}
 	}
 }
 
@@ -1620,10 +2181,26 @@ static void s_free(S* s) {
 	if (s->sid != 0)
 		sreg_del(s);
 
-	iopoll_dispose(&s->iopoll);
+	if (s->iopoll.s) // S may have been closed before it started (see uworker_main)
+		iopoll_dispose(&s->iopoll);
 	pool_free_pool(s->taskreg);
+	buf_free(&s->warm_lcode);
+	free(s->asyncwork_workers);
+	fifo_free(s->asyncwork_backlog);
+	free(s->outbox);
+	schedtrace_close(s->trace);
+	s->trace = NULL;
 	free(s->runq);
 	array_free((struct Array*)&s->timers);
+	array_free((struct Array*)&s->topicsubs);
+
+	// free memory of recycled task threads (see t_recycle)
+	while (s->tfree) {
+		T* t = s->tfree;
+		s->tfree = t->info.free.next;
+		lua_freethread(s->L, t_L(t));
+	}
+	s->tfree_len = 0;
 
 	if (s->isworker) {
 		// Close all active to-be-closed variables in the main thread, release all objects in
@@ -1653,9 +2230,22 @@ static int s_finalize(S* s) {
 		t_stop(NULL, s_task(s, 1));
 	}
 
+	// stop receiving publications (normally done already as tasks exited)
+	if (s->topicsubs.len)
+		s_topics_unsubscribe(s, 0, NULL);
+
 	// clear timers before GC to avoid costly (and useless) timers_remove
 	s->timers.len = 0;
 
+	// release tasks of asyncwork requests which never made it to a worker
+	if (s->asyncwork_backlog) {
+		AsyncWorkReq* req;
+		while (( req = fifo_pop(s->asyncwork_backlog, sizeof(*req)) )) {
+			asyncwork_discard(req->op, req->arg);
+			t_release(s_task(s, req->tid));
+		}
+	}
+
 	// run GC to ensure pending IODesc close before S goes away
 	lua_gc(s->L, LUA_GCCOLLECT);
 
@@ -1664,12 +2254,14 @@ static int s_finalize(S* s) {
 	if (!exiting)
 		s_asyncwork_read_cq(s);
 
+	// close parked pre-warmed workers, along with the others below
+	s->warm_target = 0;
+	s_warm_discard(s, 0);
+
 	// stop & wait for workers
 	if UNLIKELY(s->workers || s->isworker) {
 
-		// shutdown asyncwork channels as worker may be blocked on sq
-		if (s->asyncwork_sq != NULL)
-			chan_shutdown(s->asyncwork_sq);
+		// shutdown asyncwork channel as a worker may be blocked sending to us
 		if (s->asyncwork_cq != NULL)
 			chan_shutdown(s->asyncwork_cq);
 
@@ -1700,11 +2292,11 @@ static int s_finalize(S* s) {
 			trace_sched("exit(%d)", (int)s->exiterr);
 			exit(s->exiterr);
 		}
-	} else {
-		if (s->asyncwork_sq)
-			chan_close(s->asyncwork_sq);
-		if (s->asyncwork_cq)
-			chan_close(s->asyncwork_cq);
+	} else if (s->asyncwork_cq && !s->isworker) {
+		// Note: a worker's CQ is closed by worker_free rather than here since other workers
+		// may still hold a reference to the worker and try to write to it (which fails, as the
+		// CQ has been shut down above.)
+		chan_close(s->asyncwork_cq);
 	}
 
 	trace_sched("finalized " S_ID_F, s_id(s));
@@ -1723,10 +2315,56 @@ static int s_finalize(S* s) {
 }
 
 
+// s_spin busy-waits for notes from other threads (workers or asyncwork completions) for a
+// bounded number of iterations. Returns true if notes arrived.
+// This avoids the latency of blocking in iopoll and being woken up by iopoll_interrupt when
+// another thread is about to send us work, e.g. a reply from a worker.
+// Note: Other threads set S.notes after writing to the asyncwork CQ, so that's all we check.
+//
+// The spin limit adapts to how often spinning succeeds: it doubles when spinning finds work
+// and halves when it doesn't, within [S_SPIN_MIN, spin_max].
+static bool s_spin(S* s) {
+	u32 limit = s->spin_limit;
+	for (u32 i = 0; i < limit; i++) {
+		if (atomic_load_explicit(&s->notes, memory_order_relaxed)) {
+			s->spin_hits++;
+			s->spin_limit = MIN(limit * 2, s->spin_max);
+			return true;
+		}
+		cpu_yield();
+	}
+	s->spin_misses++;
+	s->spin_limit = MAX(limit / 2, MIN(S_SPIN_MIN, s->spin_max));
+	return false;
+}
+
+
+// s_poll blocks in iopoll_poll, letting other threads know that S needs to be interrupted
+// when they notify it (see s_notify.)
+static int s_poll(S* s, DTime deadline, DTimeDuration deadline_leeway) {
+	// Announce that we are about to sleep, then check notes again.
+	// This pairs with s_notify, which sets notes and then reads ispolling. Since both sides
+	// use sequentially-consistent operations, either we see the notes here or the notifier
+	// sees ispolling=true and interrupts iopoll.
+	// The same goes for s_shutdown and isclosed.
+	atomic_store_explicit(&s->ispolling, true, memory_order_seq_cst);
+	if (atomic_load_explicit(&s->notes, memory_order_seq_cst) ||
+	    atomic_load_explicit(&s->isclosed, memory_order_seq_cst))
+	{
+		atomic_store_explicit(&s->ispolling, false, memory_order_relaxed);
+		return 0;
+	}
+	int n = iopoll_poll(&s->iopoll, deadline, deadline_leeway);
+	atomic_store_explicit(&s->ispolling, false, memory_order_relaxed);
+	return n;
+}
+
+
 static int s_find_runnable(S* s, T** tp) {
 	// check for expired timers
 	if (( *tp = s_timers_check(s) )) {
 		trace_sched(T_ID_F " taken from timers", t_id(*tp));
+		s_trace(s, STEv_WAKE, STWake_TIMER, (*tp)->tid, 0);
 		return 1;
 	}
 
@@ -1752,6 +2390,10 @@ static int s_find_runnable(S* s, T** tp) {
 	}
 
 	// There are no tasks which are ready to run.
+	// If another thread may notify us, spin for a little while before blocking.
+	if (s->spin_limit > 0 && (s->isworker || s->workers || s->asyncwork_nworkers) && s_spin(s))
+		return_tail s_find_runnable(s, tp);
+
 	// Poll for I/O events (with timeout if there are any active timers.)
 
 	// determine iopoll deadline
@@ -1773,7 +2415,16 @@ static int s_find_runnable(S* s, T** tp) {
 	#endif
 
 	// wait for events
-	int n = iopoll_poll(&s->iopoll, deadline, deadline_leeway);
+	if UNLIKELY(s->trace) {
+		u32 timeout_ms = U32_MAX;
+		if (deadline != (DTime)-1) {
+			DTimeDuration d = DTimeUntil(deadline);
+			timeout_ms = d <= 0 ? 0 : (u32)MIN(d / D_TIME_MILLISECOND, (i64)U32_MAX - 1);
+		}
+		schedtrace_rec(s->trace, STEv_POLL_ENTER, 0, 0, timeout_ms);
+	}
+	int n = s_poll(s, deadline, deadline_leeway);
+	s_trace(s, STEv_POLL_EXIT, 0, 0, (u32)n);
 	if UNLIKELY(n < 0) {
 		if (s->isclosed) // ignore i/o errors that occur during shutdown
 			return 0;
@@ -1810,12 +2461,22 @@ static int s_main(S* s) {
 		tls_s_id = atomic_fetch_add(&tls_s_idgen, 1);
 	#endif
 
+	// enable event tracing if requested via DEW_SCHEDTRACE=<number of records>
+	u32 trace_cap = schedtrace_cap_from_env();
+	if (trace_cap && s->trace == NULL && !( s->trace = schedtrace_open(trace_cap) ))
+		logwarn("failed to enable DEW_SCHEDTRACE: %s", strerror(ENOMEM));
+
+	s->spin_max = s->spin_limit = g_spin_max;
+	s->asyncwork_max = ASYNCWORK_MAX_NWORKERS;
+	s->asyncwork_idle_timeout = ASYNCWORK_IDLE_TIMEOUT;
+	s->warm_fnref = LUA_NOREF;
+
 	// allocate runq with inital space for (8 - 1) entries
 	if (!( s->runq = (RunQ*)fifo_alloc(8, sizeof(*s->runq)) ))
 		return l_errno_error(L, ENOMEM);
 
 	// allocate task pool with inital space for 8 entries
-	if UNLIKELY(!pool_init(&s->taskreg, 8, sizeof(T*)))
+	if UNLIKELY(!pool_init(&s->taskreg, 8, sizeof(TaskInfo)))
 		return l_errno_error(L, ENOMEM);
 
 	// register S
@@ -1832,8 +2493,8 @@ static int s_main(S* s) {
 		return l_errno_error(L, -err);
 	}
 
-	// create refs table (for GC management)
-	lua_createtable(L, 0, /*estimated common-case lowball count*/8);
+	// create refs table (for GC management), indexed by tid index
+	lua_createtable(L, /*estimated common-case lowball count*/8, 0);
 	lua_rawsetp(L, LUA_REGISTRYINDEX, &g_reftabkey);
 
 	// create main task
@@ -1849,8 +2510,10 @@ static int s_main(S* s) {
 	// scheduler loop: finds a runnable task and executes it.
 	// Stops when all tasks have finished (or an error occurred.)
 	T* t;
-	while (!s->isclosed && s_find_runnable(s, &t))
+	while (!s->isclosed && s_find_runnable(s, &t)) {
 		t_resume(t);
+		s_outbox_flush(s);
+	}
 
 	// exit scheduler (if managed by a worker, worker_thread_exit will take care of it)
 	if (s->isworker)
@@ -1886,6 +2549,7 @@ static RemoteTask* remotetask_create(lua_State* L, u32 sid, u32 tid) {
 	rt->flags = 0;
     rt->tid = tid;
     rt->sid = sid;
+    rt->worker = NULL;
     return rt;
 }
 
@@ -1902,16 +2566,12 @@ static int l_remotetask_gc(lua_State* L) {
 	RemoteTask* rt = lua_touserdata(L, 1);
 	trace_sched("GC RemoteTask %p", rt);
 
-	// release reference to worker, if any
+	// release reference to worker, if any.
+	// Note: the worker may have exited and been removed from sreg; rt->worker is still valid.
 	if ((rt->flags & RemoteTask_FLAG_WORKER_REF) &&
 	    !atomic_load_explicit(&g_exiting, memory_order_acquire))
 	{
-		S* s = sreg_get(rt->sid);
-		if (s) {
-			assert(s->isworker);
-			UWorker* uw = s_worker(s);
-			worker_release(&uw->w);
-		}
+		worker_release(&rt->worker->w);
 	}
 
 	return 0;
@@ -1920,12 +2580,26 @@ static int l_remotetask_gc(lua_State* L) {
 
 static void worker_free(Worker* w) {
 	trace_worker("free Worker %p", w);
-	if (w->wkind == WorkerKind_USER && !((UWorker*)w)->errdesc_invalid) {
-		free(((UWorker*)w)->errdesc);
-		((UWorker*)w)->errdesc = NULL;
-	}
-	free(w);
-}
+	if (w->wkind == WorkerKind_USER) {
+		UWorker* uw = (UWorker*)w;
+		if (!uw->errdesc_invalid) {
+			free(uw->errdesc);
+			uw->errdesc = NULL;
+		}
+		if (uw->iswarm) {
+			free(uw->warm_lcode);
+			tsem_close(&uw->warm_sem);
+		}
+		if (uw->s.asyncwork_cq)
+			chan_close(uw->s.asyncwork_cq);
+	} else {
+		AWorker* aw = (AWorker*)w;
+		spsc_close(aw->sq);
+		spsc_close(aw->cq);
+		tsem_close(&aw->sem);
+	}
+	free(w);
+}
 
 
 static void worker_retain(Worker* w) {
@@ -2009,26 +2683,32 @@ static void s_notify(S* s, u8 addl_notes) {
 	for (;;) {
 		u8 newnotes = notes | addl_notes;
 		if (atomic_compare_exchange_weak_explicit(
-				&s->notes, &notes, newnotes, memory_order_acq_rel, memory_order_relaxed))
+				&s->notes, &notes, newnotes, memory_order_seq_cst, memory_order_relaxed))
 		{
 			break;
 		}
 	}
-	iopoll_interrupt(&s->iopoll);
+	// Only interrupt iopoll if S is sleeping in it. If S is busy it will see the notes the
+	// next time it looks for runnable tasks (see s_poll.) Clearing ispolling means that only
+	// the first of several concurrent notifiers pays for the syscall.
+	if (atomic_load_explicit(&s->ispolling, memory_order_seq_cst) &&
+	    atomic_exchange_explicit(&s->ispolling, false, memory_order_acq_rel))
+	{
+		iopoll_interrupt(&s->iopoll);
+	}
 }
 
 
 static void asyncworker_complete(AWorker* aw, i64 result) {
-	S* s = aw->w.s;
-
-	ChanTx tx = chan_write_begin(s->asyncwork_cq, 0);
-	assertf(tx.entry != NULL, "chan_write(cq) failed");
-	AsyncWorkRes* res = tx.entry;
+	// Note: cq can't be full since S never has more requests outstanding than cq can hold
+	AsyncWorkRes* res = spsc_write_begin(aw->cq);
+	assertf(res != NULL, "asyncwork CQ full");
 	res->op = aw->req.op;
 	res->flags = aw->req.flags;
 	res->tid = aw->req.tid;
 	res->result = result;
-	chan_write_commit(s->asyncwork_cq, tx);
+	res->arg = aw->req.arg;
+	spsc_write_commit(aw->cq);
 
 	trace_sched("T%u TCQ write_commit result=%ld", res->tid, result);
 	aw->req_is_active = 0;
@@ -2037,6 +2717,12 @@ static void asyncworker_complete(AWorker* aw, i64 result) {
 
 static void worker_thread_exit(Worker** wp) {
 	Worker* w = *wp;
+
+	// A worker closed before it disabled cancelation (e.g. right after being spawned) has a
+	// pending cancelation request, which would otherwise abort this function at its first
+	// cancelation point, leaking the worker.
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
 	trace_worker("exit");
 
 	// set status to CLOSED (likely already set via worker_cas_status)
@@ -2078,7 +2764,33 @@ static const char* uworker_load_reader(lua_State* L, void* ud, usize* lenp) {
 }
 
 
+// uworker_load loads the worker's main function from mainfun_lcode onto L's stack
+static int uworker_load(UWorker* w, lua_State* L) {
+	if (w->mainfun_lcode == NULL)
+		return LUA_ERRERR;
+	int status = lua_load(L, uworker_load_reader, (void*)w, "=worker", "bt");
+
+	// free memory back to malloc so we don't hold on to it "forever"
+	free(w->mainfun_lcode);
+	w->mainfun_lcode_len = 0; // sets errdesc_invalid=0
+	w->mainfun_lcode = NULL;
+
+	if UNLIKELY(status != LUA_OK) {
+		logwarn("failed to load worker function: %s", lua_tostring(L, -1));
+		lua_pop(L, 1); // error
+	}
+	return status;
+}
+
+
 static void uworker_main(UWorker* w) {
+	// allocate memory of this thread (e.g. the Lua heap) from the requested NUMA node
+	if (w->numa_node >= 0) {
+		int err = worker_thread_set_numa_node((u32)w->numa_node);
+		if (err)
+			logwarn("failed to set NUMA node %d: %s", w->numa_node, strerror(-err));
+	}
+
 	// create a Lua environment for this thread
 	lua_State* L = luaL_newstate();
 	w->s.L = L;
@@ -2088,6 +2800,24 @@ static void uworker_main(UWorker* w) {
 	luaL_requiref(L, "__rt", luaopen_runtime, 1);
 	lua_setglobal(L, "__rt");
 
+	// A pre-warmed worker preloads S.warm_fnref of its spawner (if any), then parks until
+	// spawn_worker hands it a main function (see l_spawn_warm_worker.)
+	int status = LUA_ERRERR;
+	if (w->iswarm) {
+		if (w->mainfun_lcode)
+			status = uworker_load(w, L);
+		tsem_wait(&w->warm_sem);
+		if (w->warm_lcode) {
+			// handed a different function than the preloaded one
+			if (status == LUA_OK)
+				lua_pop(L, 1);
+			w->mainfun_lcode = w->warm_lcode;
+			w->mainfun_lcode_len = w->warm_lcode_len;
+			w->warm_lcode = NULL;
+			status = LUA_ERRERR;
+		}
+	}
+
 	// switch status to READY while checking if worker has been closed
 	if UNLIKELY(!worker_cas_status((Worker*)w, Worker_READY))
 		return trace_worker("CLOSED before getting READY");
@@ -2096,12 +2826,8 @@ static void uworker_main(UWorker* w) {
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
 	// load Lua function from mainfun_lcode
-	int status = lua_load(L, uworker_load_reader, (void*)w, "=worker", "bt");
-
-	// free memory back to malloc so we don't hold on to it "forever"
-	free(w->mainfun_lcode);
-	w->mainfun_lcode_len = 0; // sets errdesc_invalid=0
-	w->mainfun_lcode = NULL;
+	if (status != LUA_OK)
+		status = uworker_load(w, L);
 
 	// check if load succeeded
 	if UNLIKELY(status != LUA_OK) {
@@ -2115,10 +2841,6 @@ static void uworker_main(UWorker* w) {
 }
 
 
-#define ASYNCWORK_SQ_CAP 64
-#define ASYNCWORK_CQ_CAP ASYNCWORK_SQ_CAP
-
-
 static int s_asyncwork_cq_setup(S* s) {
 	trace_sched("creating asyncwork CQ with cap=%d", ASYNCWORK_CQ_CAP);
 	Chan* cq = chan_open(ASYNCWORK_CQ_CAP, sizeof(AsyncWorkRes));
@@ -2129,16 +2851,6 @@ static int s_asyncwork_cq_setup(S* s) {
 }
 
 
-static int s_asyncwork_sq_setup(S* s) {
-	trace_sched("creating asyncwork SQ with cap=%d", ASYNCWORK_SQ_CAP);
-	Chan* sq = chan_open(ASYNCWORK_SQ_CAP, sizeof(AsyncWorkReq));
-	if (!sq)
-		return -ENOMEM;
-	s->asyncwork_sq = sq;
-	return 0;
-}
-
-
 static i64 asyncwork_do(const AsyncWorkReq* req);
 
 
@@ -2153,15 +2865,35 @@ static void asyncworker_main(AWorker* aw) {
 		// pick up a work request
 		// Note: This can't be interrupted by pthread_cancel; work_is_active checks are safe
 		trace_worker("asyncwork SQ read...");
-		if UNLIKELY(!chan_read(aw->w.s->asyncwork_sq, 0, &aw->req)) {
-			// asyncwork_sq closed
-			break;
+		if (!spsc_read(aw->sq, &aw->req)) {
+			// Wait for S to submit work. This pairs with t_asyncwork_req, which writes to sq
+			// and then checks 'sleeping': either we see the request here or S sees
+			// sleeping=true and signals sem.
+			// If no work arrives within idle_timeout, tell S, which decides whether we should
+			// exit (see s_asyncwork_reap.)
+			atomic_store_explicit(&aw->sleeping, true, memory_order_relaxed);
+			atomic_thread_fence(memory_order_seq_cst);
+			if (spsc_isempty(aw->sq)) {
+				DTimeDuration timeout =
+					atomic_load_explicit(&aw->idle_timeout, memory_order_relaxed);
+				if (timeout <= 0) {
+					tsem_wait(&aw->sem);
+				} else if (!tsem_timedwait(&aw->sem, (u64)timeout / 1000)) {
+					s_notify(aw->w.s, S_NOTE_AWIDLE);
+				}
+			}
+			atomic_store_explicit(&aw->sleeping, false, memory_order_relaxed);
+			if UNLIKELY(atomic_load_explicit(&aw->w.status, memory_order_acquire) == Worker_CLOSED)
+				break;
+			continue;
 		}
 
 		// perform the work
 		i64 result = asyncwork_do(&aw->req);
 
-		// notify S that the work has completed
+		// notify S that the work has completed.
+		// Note: idle_since is published to S by the CQ write
+		atomic_store_explicit(&aw->idle_since, DTimeNow(), memory_order_relaxed);
 		asyncworker_complete(aw, result);
 		s_notify(aw->w.s, S_NOTE_ASYNCWORK);
 	}
@@ -2189,18 +2921,48 @@ static void worker_thread(Worker* w) {
 }
 
 
-static int worker_start(Worker* w) {
+static int worker_start(Worker* w, const WorkerPlacement* nullable placement) {
+	int err = 0;
+	pthread_attr_t attr;
+	pthread_attr_t* thr_attr = NULL;
+	if (placement) {
+		if UNLIKELY(( err = pthread_attr_init(&attr) ))
+			goto error;
+		thr_attr = &attr;
+		if UNLIKELY(( err = -worker_thread_attr(placement, thr_attr) ))
+			goto error;
+	}
 	w->status = Worker_OPEN;
 	worker_retain(w); // thread's reference
-	pthread_attr_t* thr_attr = NULL;
-	int err = pthread_create(&w->thread, thr_attr, (void*(*)(void*))worker_thread, w);
+	err = pthread_create(&w->thread, thr_attr, (void*(*)(void*))worker_thread, w);
 	trace_sched("spawn %s os_thread=%p", fmtworker(w), w->thread);
-	if UNLIKELY(err) {
-		free(w);
-		return -err;
-	}
-	s_workers_add(w->s, w); // add worker to S's list of live workers
+	if UNLIKELY(err)
+		goto error;
+	if (thr_attr)
+		pthread_attr_destroy(thr_attr);
+	// add worker to S's list of live workers (parked workers are added when handed out)
+	if (w->wkind != WorkerKind_USER || !((UWorker*)w)->iswarm)
+		s_workers_add(w->s, w);
 	return 0;
+
+error:
+	if (thr_attr)
+		pthread_attr_destroy(thr_attr);
+	if (w->wkind == WorkerKind_USER) {
+		// undo uworker_open
+		sreg_del(&((UWorker*)w)->s);
+		chan_close(((UWorker*)w)->s.asyncwork_cq);
+		if (((UWorker*)w)->iswarm)
+			tsem_close(&((UWorker*)w)->warm_sem);
+	} else {
+		// undo s_asyncwork_spawn_worker
+		AWorker* aw = (AWorker*)w;
+		spsc_close(aw->sq);
+		spsc_close(aw->cq);
+		tsem_close(&aw->sem);
+	}
+	free(w);
+	return -err;
 }
 
 
@@ -2217,7 +2979,9 @@ static int uworker_open(
 	S*        s,
 	void*     mainfun_lcode,
 	u32       mainfun_lcode_len,
-    u32       spawned_by_tid)
+    u32       spawned_by_tid,
+	const WorkerPlacement* nullable placement,
+	bool      warm)
 {
 	UWorker* uw = calloc(1, sizeof(UWorker));
 	if (!uw)
@@ -2230,6 +2994,7 @@ static int uworker_open(
 	}
 
     uw->spawned_by_tid = spawned_by_tid;
+	uw->numa_node = placement ? placement->numa_node : -1;
 	uw->mainfun_lcode_len = mainfun_lcode_len;
 	uw->mainfun_lcode = mainfun_lcode;
 	uw->s.isworker = true; // note: uw->s is the worker's S, not the spawner S 's'
@@ -2253,8 +3018,18 @@ static int uworker_open(
 		}
 	}
 
+	if (warm) {
+		if (( err = tsem_open(&uw->warm_sem, 0) )) {
+			sreg_del(&uw->s);
+			chan_close(uw->s.asyncwork_cq);
+			free(uw);
+			return err;
+		}
+		uw->iswarm = true;
+	}
+
 	*uwp = uw;
-	return worker_start((Worker*)uw);
+	return worker_start((Worker*)uw, placement);
 }
 
 
@@ -2268,13 +3043,20 @@ static bool worker_close(Worker* w) {
 
 	trace_worker("closing %s", fmtworker(w));
 
+	// deliver messages sent to the worker before closing it
+	if (tls_s && tls_s->outbox_dst == &((UWorker*)w)->s)
+		s_outbox_flush(tls_s);
+
 	// signal to worker's scheduler that it's time to shut down
 	if (w->wkind == WorkerKind_USER) {
 		s_shutdown(&((UWorker*)w)->s);
+		// wake the worker in case it's parked (sem wait may not be a cancellation point)
+		if (((UWorker*)w)->iswarm)
+			tsem_signal(&((UWorker*)w)->warm_sem);
 	} else {
 		assert(w->wkind == WorkerKind_ASYNC);
-		AWorker* aw = (AWorker*)w;
-		// w->s->asyncwork_nworkers--;
+		// wake the worker in case it's waiting for work
+		tsem_signal(&((AWorker*)w)->sem);
 	}
 
 	pthread_cancel(w->thread);
@@ -2282,195 +3064,754 @@ static bool worker_close(Worker* w) {
 }
 
 
-static int l_spawn_worker(lua_State* L) {
-	T* t = REQUIRE_TASK(L);
-	luaL_checktype(L, 1, LUA_TFUNCTION);
-
-	// Encode the thread's main function as Lua code, to be transferred to the thread.
-	// TODO: consider copying upvalues the way structclone does it.
-	lua_settop(L, 1); // ensure function is on the top of the stack
-	Buf buf = {};
-	int err = buf_append_luafun(&buf, L, /*strip_debuginfo*/false);
-	if UNLIKELY(err) {
-		buf_free(&buf);
-		if (err == -EINVAL)
-			return luaL_error(L, "unable to serialize worker function");
-		return l_errno_error(L, -err);
+// l_worker_placement_opts reads thread placement options from the table at idx, if any.
+// idx=0 means "no options."
+// Returns false if there's nothing to configure (all OS defaults.)
+static bool l_worker_placement_opts(lua_State* L, int idx, WorkerPlacement* p) {
+	worker_placement_init(p);
+	int err;
+	if (idx != 0 && !lua_isnoneornil(L, idx)) {
+		luaL_checktype(L, idx, LUA_TTABLE);
+
+		// stack_size: thread stack size in bytes
+		if (lua_getfield(L, idx, "stack_size") != LUA_TNIL) {
+			lua_Integer v = luaL_checkinteger(L, -1);
+			if (v < PTHREAD_STACK_MIN || v > U32_MAX)
+				luaL_error(L, "stack_size out of range");
+			p->stack_size = (u32)v;
+		}
+		lua_pop(L, 1);
+
+		// cpu: CPU, or list of CPUs, the worker's thread may run on
+		int typ = lua_getfield(L, idx, "cpu");
+		if (typ == LUA_TTABLE) {
+			lua_Integer n = luaL_len(L, -1);
+			for (lua_Integer i = 1; i <= n; i++) {
+				lua_geti(L, -1, i);
+				lua_Integer cpu = luaL_checkinteger(L, -1);
+				if (cpu < 0 || cpu >= WORKER_MAXCPUS)
+					luaL_error(L, "cpu %d out of range", (int)cpu);
+				worker_placement_setcpu(p, (u32)cpu);
+				lua_pop(L, 1);
+			}
+		} else if (typ != LUA_TNIL) {
+			lua_Integer cpu = luaL_checkinteger(L, -1);
+			if (cpu < 0 || cpu >= WORKER_MAXCPUS)
+				luaL_error(L, "cpu %d out of range", (int)cpu);
+			worker_placement_setcpu(p, (u32)cpu);
+		}
+		lua_pop(L, 1);
+
+		// numa_node: NUMA node to allocate memory from; also the default CPUs
+		if (lua_getfield(L, idx, "numa_node") != LUA_TNIL) {
+			lua_Integer node = luaL_checkinteger(L, -1);
+			if (node < 0 || node >= WORKER_MAXCPUS)
+				luaL_error(L, "numa_node out of range");
+			p->numa_node = (i32)node;
+			WorkerPlacement node_cpus = {};
+			if (( err = worker_placement_numa_cpus(&node_cpus, (u32)node) ))
+				luaL_error(L, "numa_node %d: %s", (int)node, strerror(-err));
+			if (!worker_placement_hascpus(p))
+				memcpy(p->cpumask, node_cpus.cpumask, sizeof(p->cpumask));
+		}
+		lua_pop(L, 1);
 	}
 
-	// start a worker
-	UWorker* uw;
-	if UNLIKELY(( err = uworker_open(&uw, t->s, buf.bytes, buf.len, t->tid) )) {
-		buf_free(&buf);
-		return l_errno_error(L, -err);
+	// apply runtime-wide placement policy, unless explicit CPUs were requested
+	if (!worker_placement_hascpus(p) &&
+	    atomic_load_explicit(&g_worker_placement_policy, memory_order_relaxed) ==
+	    WorkerPlacementPolicy_CORE)
+	{
+		if (( err = worker_placement_next_core(p) ))
+			logwarn("worker placement policy \"core\": %s", strerror(-err));
 	}
 
-	// Create a remote task handle representing the main task of the worker.
+	return p->stack_size || p->numa_node >= 0 || worker_placement_hascpus(p);
+}
+
+
+// l_push_worker_handle pushes a RemoteTask representing the main task of uw
+static RemoteTask* l_push_worker_handle(lua_State* L, UWorker* uw) {
 	// Note: a worker's main task is linked to the worker's lifetime.
 	// Note: tid of main task is always 1
 	RemoteTask* rt = remotetask_create(L, uw->s.sid, 1);
 
 	// remote task holds on to a ref to the worker, which is what keeps the worker alive
 	rt->flags |= RemoteTask_FLAG_WORKER_REF;
-    worker_retain(&uw->w);
-
-	return 1;
+	rt->worker = uw;
+	worker_retain(&uw->w);
+	return rt;
 }
 
 
-static int s_asyncwork_spawn_worker(S* s) {
-	trace_sched("spawn asyncwork worker");
-	AWorker* aw = calloc(1, sizeof(AWorker));
-	if (!aw)
+// workerpool_spawn starts a new worker and adds it to pool.
+// opts_idx is the stack index of spawn options (see l_worker_placement_opts), or 0.
+static int workerpool_spawn(lua_State* L, T* t, WorkerPool* pool, int opts_idx) {
+	WorkerPlacement placement;
+	bool has_placement = l_worker_placement_opts(L, opts_idx, &placement);
+
+	if (pool->len == pool->cap) {
+		u32 newcap = pool->cap ? pool->cap * 2 : 4;
+		UWorker** v = realloc(pool->workers, sizeof(*v) * (usize)newcap);
+		if (!v)
+			return -ENOMEM;
+		pool->workers = v;
+		pool->cap = newcap;
+	}
+
+	// each worker owns (and frees) its copy of the main function's code
+	void* lcode = malloc(pool->lcode.len);
+	if (!lcode)
 		return -ENOMEM;
-	int err = worker_open(&aw->w, s, WorkerKind_ASYNC);
-	if (err) {
-		free(aw);
+	memcpy(lcode, pool->lcode.bytes, pool->lcode.len);
+
+	UWorker* uw;
+	int err = uworker_open(
+		&uw, t->s, lcode, pool->lcode.len, pool->spawned_by_tid,
+		has_placement ? &placement : NULL, false);
+	if UNLIKELY(err) {
+		free(lcode);
 		return err;
 	}
-	aw->req_is_active = 0;
-	err = worker_start((Worker*)aw);
-	if (err == 0)
-		s->asyncwork_nworkers++;
-	return err;
+	pool->workers[pool->len++] = uw; // pool's reference (the one returned by uworker_open)
+	return 0;
 }
 
 
-static int s_asyncwork_prepare(S* s) {
-	u32 nreqs = atomic_fetch_add_explicit(&s->asyncwork_nreqs, 1, memory_order_acq_rel);
-	trace_sched("[asyncwork] nreqs, nworkers = %u, %u", nreqs+1, s->asyncwork_nworkers);
-	if LIKELY(s->asyncwork_sq != NULL && nreqs < s->asyncwork_nworkers)
-		return 0;
-	int err;
-	if (s->asyncwork_sq == NULL && (err = s_asyncwork_sq_setup(s)))
-		return err;
-	if (s->asyncwork_cq == NULL && (err = s_asyncwork_cq_setup(s)))
-		return err;
-	return s_asyncwork_spawn_worker(s);
+// workerpool_pick returns the live worker with the fewest pending messages,
+// or NULL if all workers have exited. Ties are broken in round-robin order.
+static UWorker* nullable workerpool_pick(WorkerPool* pool) {
+	UWorker* best = NULL;
+	u32 best_npending = U32_MAX, best_i = 0;
+	for (u32 k = 0; k < pool->len; k++) {
+		u32 i = (pool->next + k) % pool->len;
+		UWorker* uw = pool->workers[i];
+		if (atomic_load_explicit(&uw->w.status, memory_order_acquire) == Worker_CLOSED)
+			continue;
+		u32 npending = atomic_load_explicit(&uw->npending, memory_order_relaxed);
+		if (npending < best_npending) {
+			best = uw;
+			best_npending = npending;
+			best_i = i;
+			if (npending == 0)
+				break;
+		}
+	}
+	if (best)
+		pool->next = (best_i + 1) % pool->len;
+	return best;
 }
 
 
-static int t_asyncwork_req(
-	T* t, AsyncWorkReq* req, void* nullable cont_arg, TaskContinuation nullable cont)
-{
-	// if t is the only task running on S's thread we can just block, bypassing worker threads
-	if (t->s->nlive == 1 && t->ntimers == 0) {
-		trace_sched(T_ID_F " asyncwork op=%u immediate", t_id(t), req->op);
-		i64 result = asyncwork_do(req);
-		if (cont) {
-			t->info.wait_async.result = result;
-			return cont(t_L(t), T_RUNNING, cont_arg);
-		} else {
-			lua_pushinteger(t_L(t), result);
-			return 1;
-		}
+// l_worker_fn_dump encodes the function at idx as Lua code, to be transferred to a worker
+// thread. Throws on error, in which case buf is free'd.
+static void l_worker_fn_dump(lua_State* L, int idx, Buf* buf) {
+	// TODO: consider copying upvalues the way structclone does it.
+	lua_pushvalue(L, idx); // buf_append_luafun dumps the function on the top of the stack
+	int err = buf_append_luafun(buf, L, /*strip_debuginfo*/false);
+	lua_pop(L, 1);
+	if UNLIKELY(err) {
+		buf_free(buf);
+		if (err == -EINVAL)
+			luaL_error(L, "unable to serialize worker function");
+		l_errno_error(L, -err);
 	}
+}
 
-	// setup submission queue and/or spawn a worker thread, if needed
-	int err = s_asyncwork_prepare(t->s);
-	if (err)
-		return err;
 
-	// enqueue work request
-	req->flags |= (u16)(cont != NULL) * AsyncWorkFlag_HAS_CONT;
-	bool ok = chan_write(t->s->asyncwork_sq, 0, req);
-	if UNLIKELY (!ok)
-		return -ENOMEM;
-	t_retain(t); // work's ref, released by s_asyncwork_read_cq
-	trace_sched(T_ID_F " asyncwork op=%u SQ append", t_id(t), req->op);
+// s_warm_fill starts pre-warmed workers until there are S.warm_target of them.
+// A pre-warmed worker has a thread with a fully initialized Lua environment, which is
+// parked waiting to be handed a main function by spawn_worker.
+static int s_warm_fill(S* s) {
+	while (s->warm_len < s->warm_target) {
+		// each worker owns (and frees) its copy of the function to preload
+		void* lcode = NULL;
+		if (s->warm_lcode.len > 0) {
+			if (!( lcode = malloc(s->warm_lcode.len) ))
+				return -ENOMEM;
+			memcpy(lcode, s->warm_lcode.bytes, s->warm_lcode.len);
+		}
+		UWorker* uw;
+		int err = uworker_open(&uw, s, lcode, s->warm_lcode.len, 0, NULL, /*warm*/true);
+		if UNLIKELY(err) {
+			free(lcode);
+			return err;
+		}
+		uw->warm_next = s->warm_workers;
+		s->warm_workers = uw;
+		s->warm_len++;
+	}
+	return 0;
+}
 
-	// suspend task
-	t->resume_nres = 0;
-	return t_suspend(t, T_WAIT_ASYNC, cont_arg, (TaskContinuation)cont);
+
+// s_warm_discard closes parked workers until at most 'keep' remain
+static void s_warm_discard(S* s, u32 keep) {
+	while (s->warm_len > keep) {
+		UWorker* uw = s->warm_workers;
+		s->warm_workers = uw->warm_next;
+		s->warm_len--;
+		uw->warm_next = NULL;
+		// the worker exits and is reaped just like any other worker
+		s_workers_add(s, &uw->w);
+		worker_close(&uw->w);
+	}
 }
 
 
-static i64 asyncwork_do_nanosleep(const AsyncWorkReq* req) {
-	u64 nsec = req->arg;
-	struct timespec ts = {
-		.tv_sec = nsec / 1000000000,
-		.tv_nsec = nsec % 1000000000,
-	};
-	struct timespec ts_rem = {};
-	while (nanosleep(&ts, &ts) == -1) {
-		if (errno != EINTR)
-			return -errno;
-		if (ts_rem.tv_sec == 0 && ts_rem.tv_nsec < 100)
-			break;
-		dlog("nanosleep interrupted; continuing");
+// l_spawn_warm_worker hands the function at stack index 1 to a parked worker
+static int l_spawn_warm_worker(lua_State* L, T* t) {
+	S* s = t->s;
+
+	// skip encoding the function if the worker has already loaded it
+	bool preloaded = false;
+	if (s->warm_fnref != LUA_NOREF) {
+		lua_rawgeti(L, LUA_REGISTRYINDEX, s->warm_fnref);
+		preloaded = lua_rawequal(L, 1, -1);
+		lua_pop(L, 1);
 	}
-	return 0;
+	Buf buf = {};
+	if (!preloaded)
+		l_worker_fn_dump(L, 1, &buf);
+
+	UWorker* uw = s->warm_workers;
+	s->warm_workers = uw->warm_next;
+	s->warm_len--;
+	uw->warm_next = NULL;
+
+	trace_sched("unpark %s (preloaded=%d)", fmtworker(uw), preloaded);
+	uw->spawned_by_tid = t->tid;
+	uw->warm_lcode = buf.bytes; // NULL if preloaded
+	uw->warm_lcode_len = buf.len;
+	s_workers_add(s, &uw->w);
+	tsem_signal(&uw->warm_sem);
+
+	l_push_worker_handle(L, uw);
+
+	// replace the worker we just handed out, from the scheduler loop rather than here, so that
+	// the spawning task doesn't pay for starting a thread
+	atomic_fetch_or_explicit(&s->notes, S_NOTE_WARMFILL, memory_order_relaxed);
+	return 1;
 }
 
-static int l_syscall_nanosleep(lua_State* L) {
+
+// fun worker_prewarm(n uint, fn function = nil) uint
+// Keeps n worker threads, with fully initialized Lua environments, parked and ready to run
+// the function passed to spawn_worker. This removes thread and Lua setup from the latency of
+// spawn_worker. If fn is given, parked workers also preload fn, so that spawn_worker(fn)
+// skips encoding and loading the function.
+// Workers spawned with placement options (e.g. cpu) don't use parked workers.
+// Returns the number of parked workers.
+static int l_worker_prewarm(lua_State* L) {
 	T* t = REQUIRE_TASK(L);
-	u64 nsec = luaL_checkinteger(L, 1);
-	AsyncWorkReq req = {
-		.op = AsyncWorkOp_NANOSLEEP,
-		.tid = t->tid,
-		.arg = nsec,
-	};
-	return t_asyncwork_req(t, &req, NULL, NULL);
+	S* s = t->s;
+	lua_Integer n = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, n >= 0 && n <= 0xffff, 1, "out of range");
+	bool hasfn = !lua_isnoneornil(L, 2);
+	if (hasfn)
+		luaL_checktype(L, 2, LUA_TFUNCTION);
+
+	// if the function changed, discard workers that preloaded the old one
+	bool samefn = !hasfn && s->warm_fnref == LUA_NOREF;
+	if (hasfn && s->warm_fnref != LUA_NOREF) {
+		lua_rawgeti(L, LUA_REGISTRYINDEX, s->warm_fnref);
+		samefn = lua_rawequal(L, 2, -1);
+		lua_pop(L, 1);
+	}
+	if (!samefn) {
+		s_warm_discard(s, 0);
+		luaL_unref(L, LUA_REGISTRYINDEX, s->warm_fnref);
+		s->warm_fnref = LUA_NOREF;
+		buf_free(&s->warm_lcode);
+		s->warm_lcode = (Buf){};
+		if (hasfn) {
+			l_worker_fn_dump(L, 2, &s->warm_lcode);
+			lua_pushvalue(L, 2);
+			s->warm_fnref = luaL_ref(L, LUA_REGISTRYINDEX);
+		}
+	}
+
+	s->warm_target = (u32)n;
+	s_warm_discard(s, s->warm_target);
+	int err = s_warm_fill(s);
+	if UNLIKELY(err)
+		return l_errno_error(L, -err);
+	lua_pushinteger(L, s->warm_len);
+	return 1;
 }
 
 
-typedef struct AddrInfoReq {
-	u16                       port;
-	const char*               hostname;
-	struct addrinfo           hints;
-	struct addrinfo* nullable res;
-} AddrInfoReq;
+// fun spawn_worker(fn function, opts {stack_size, cpu, numa_node int} = nil) RemoteTask
+// opts.stack_size: size in bytes of the worker thread's stack
+// opts.cpu: CPU or list of CPUs the worker thread may run on
+// opts.numa_node: NUMA node the worker allocates memory from (and runs on, unless opts.cpu)
+static int l_spawn_worker(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	WorkerPlacement placement;
+	bool has_placement = l_worker_placement_opts(L, 2, &placement);
 
+	// use a pre-warmed worker, unless the caller wants a specific thread setup
+	if (t->s->warm_workers && !has_placement)
+		return l_spawn_warm_worker(L, t);
 
-static i64 asyncwork_do_addrinfo(const AsyncWorkReq* req) {
-	AddrInfoReq* aireq = (AddrInfoReq*)(uintptr)req->arg;
+	// Encode the thread's main function as Lua code, to be transferred to the thread.
+	Buf buf = {};
+	l_worker_fn_dump(L, 1, &buf);
 
-	char service[8];
-	sprintf(service, "%u", aireq->port);
-	trace_sched("getaddrinfo BEGIN hostname=\"%s\" port=%s", aireq->hostname, service);
+	// start a worker
+	int err;
+	UWorker* uw;
+	if UNLIKELY(( err = uworker_open(
+			&uw, t->s, buf.bytes, buf.len, t->tid, has_placement ? &placement : NULL, false) ))
+	{
+		buf_free(&buf);
+		return l_errno_error(L, -err);
+	}
 
-	return getaddrinfo(aireq->hostname, service, &aireq->hints, &aireq->res);
+	l_push_worker_handle(L, uw);
+	return 1;
 }
 
-static void l_syscall_addrinfo_cont_mkres(lua_State* L, AddrInfoReq* aireq) {
-	int index = 1;
-	char addr_str[INET6_ADDRSTRLEN];
 
-	#define KV_I(k, v) ( lua_pushstring(L, k), lua_pushinteger(L, v), lua_settable(L, -3) )
-	#define KV_S(k, v) ( lua_pushstring(L, k), lua_pushstring(L, v), lua_settable(L, -3) )
+// fun spawn_worker_pool(fn function, n uint, opts {...} = nil) WorkerPool
+// Spawns n workers running fn. opts are the same as for spawn_worker.
+// send(pool, ...) dispatches a message to the worker with the fewest pending messages.
+static int l_spawn_worker_pool(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	lua_Integer n = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, n > 0 && n <= 0xffff, 2, "out of range");
+	lua_settop(L, 3); // opts
 
-	lua_createtable(L, 0, 0);
+	WorkerPool* pool = uval_new(L, UValType_WorkerPool, sizeof(WorkerPool), 0);
+	memset(pool, 0, sizeof(*pool));
+	pool->uval.type = UValType_WorkerPool;
+	pool->spawned_by_tid = t->tid;
+	luaL_setmetatable(L, "WorkerPool");
 
-	for (struct addrinfo *rp = aireq->res; rp != NULL; rp = rp->ai_next) {
-		lua_createtable(L, 0, 5); // Table with 5 fields
-		KV_I("family", rp->ai_family);
-		KV_I("socktype", rp->ai_socktype);
-		KV_I("protocol", rp->ai_protocol);
-		if (rp->ai_family == AF_INET) {
-			struct sockaddr_in* sa = (struct sockaddr_in*)rp->ai_addr;
-			KV_I("port", ntohs(sa->sin_port));
-			if (inet_ntop(AF_INET, &(sa->sin_addr), addr_str, INET_ADDRSTRLEN) != NULL)
-				KV_S("addr", addr_str);
-		} else if (rp->ai_family == AF_INET6) {
-			struct sockaddr_in6* sa = (struct sockaddr_in6*)rp->ai_addr;
-			KV_I("port", ntohs(sa->sin6_port));
-			if (inet_ntop(AF_INET6, &(sa->sin6_addr), addr_str, INET6_ADDRSTRLEN) != NULL)
-				KV_S("addr", addr_str);
-		}
+	l_worker_fn_dump(L, 1, &pool->lcode);
 
-		// Add the address entry table to the main array at the current index
-		lua_rawseti(L, -2, index++);
+	int err;
+	while (pool->len < (u32)n) {
+		if UNLIKELY(( err = workerpool_spawn(L, t, pool, 3) )) {
+			// shut down the workers spawned so far (they are reaped like any other worker)
+			while (pool->len > 0) {
+				UWorker* uw = pool->workers[--pool->len];
+				worker_close(&uw->w);
+				worker_release(&uw->w); // pool's reference
+			}
+			return l_errno_error(L, -err);
+		}
 	}
+	return 1;
+}
 
-	#undef KV_I
-	#undef KV_S
+
+static int l_workerpool_gc(lua_State* L) {
+	WorkerPool* pool = lua_touserdata(L, 1);
+	trace_sched("GC WorkerPool %p", pool);
+	if (!atomic_load_explicit(&g_exiting, memory_order_acquire)) {
+		for (u32 i = 0; i < pool->len; i++)
+			worker_release(&pool->workers[i]->w);
+	}
+	free(pool->workers);
+	buf_free(&pool->lcode);
+	return 0;
 }
 
-static int l_syscall_addrinfo_cont(lua_State* L, int ltstatus, void* nullable arg) {
-	T* t = L_t(L);
-	AddrInfoReq* aireq = arg;
 
-	int res = (int)t->info.wait_async.result;
+static int l_workerpool_str(lua_State* L) {
+	WorkerPool* pool = lua_touserdata(L, 1);
+	lua_pushfstring(L, "WorkerPool#%p(%d)", pool, (int)pool->len);
+	return 1;
+}
+
+
+static int l_workerpool_len(lua_State* L) {
+	WorkerPool* pool = lua_touserdata(L, 1);
+	lua_pushinteger(L, pool->len);
+	return 1;
+}
+
+
+static int l_send_workerpool(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	WorkerPool* pool = luaL_checkudata(L, 1, "WorkerPool");
+	UWorker* uw = workerpool_pick(pool);
+	if UNLIKELY(!uw)
+		return luaL_error(L, "send to dead WorkerPool");
+	MiniBuf* minibuf = l_encode_msg(L, t->s, StructCloneEnc_PTRS, lua_gettop(L) - 1); // -1: pool
+	t_send_remote(t, &uw->s, 1, minibuf);
+	return 0;
+}
+
+
+// fun pool_broadcast(pool WorkerPool, msg... any) uint
+// Sends a message to every live worker of the pool. Returns the number of recipients.
+static int l_pool_broadcast(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	WorkerPool* pool = luaL_checkudata(L, 1, "WorkerPool");
+
+	// encode once, then copy the message for each worker.
+	// Each copy holds its own reference to any SharedBuf in the message.
+	MiniBuf* minibuf = l_encode_msg(L, t->s, StructCloneEnc_PTRS, lua_gettop(L) - 1);
+	usize size = sizeof(MiniBuf) + minibuf->len;
+	u32 nsent = 0;
+	for (u32 i = 0; i < pool->len; i++) {
+		UWorker* uw = pool->workers[i];
+		if (atomic_load_explicit(&uw->w.status, memory_order_acquire) == Worker_CLOSED)
+			continue;
+		MiniBuf* msg = malloc(size);
+		if UNLIKELY(!msg) {
+			structclone_discard(minibuf->bytes, minibuf->len);
+			free(minibuf);
+			return l_errno_error(L, ENOMEM);
+		}
+		memcpy(msg, minibuf, size);
+		structclone_retain(msg->bytes, msg->len);
+		t_send_remote(t, &uw->s, 1, msg);
+		nsent++;
+	}
+	structclone_discard(minibuf->bytes, minibuf->len);
+	free(minibuf);
+	lua_pushinteger(L, nsent);
+	return 1;
+}
+
+
+// fun pool_resize(pool WorkerPool, n uint) [RemoteTask]
+// Grows or shrinks the pool to n workers.
+// When shrinking, the removed workers are no longer sent messages by the pool but are
+// otherwise left running, so that they can finish pending work. Their handles are returned,
+// to be shut down and awaited by the caller. Returns an empty list when growing.
+static int l_pool_resize(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	WorkerPool* pool = luaL_checkudata(L, 1, "WorkerPool");
+	lua_Integer n = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, n >= 0 && n <= 0xffff, 2, "out of range");
+	lua_settop(L, 2);
+
+	lua_createtable(L, n < pool->len ? pool->len - n : 0, 0);
+	while (pool->len > (u32)n) {
+		UWorker* uw = pool->workers[--pool->len];
+		l_push_worker_handle(L, uw);
+		lua_rawseti(L, -2, pool->len - n + 1);
+		worker_release(&uw->w); // pool's reference
+	}
+	if (pool->next >= pool->len)
+		pool->next = 0;
+
+	while (pool->len < (u32)n) {
+		int err = workerpool_spawn(L, t, pool, 0);
+		if UNLIKELY(err)
+			return l_errno_error(L, -err);
+	}
+	return 1;
+}
+
+
+// fun pool_workers(pool WorkerPool) [RemoteTask]
+// Returns handles for the workers of the pool, e.g. for await_all
+static int l_pool_workers(lua_State* L) {
+	WorkerPool* pool = luaL_checkudata(L, 1, "WorkerPool");
+	lua_createtable(L, pool->len, 0);
+	for (u32 i = 0; i < pool->len; i++) {
+		l_push_worker_handle(L, pool->workers[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
+
+static int s_asyncwork_spawn_worker(S* s, AWorker** awp) {
+	trace_sched("spawn asyncwork worker");
+	if (s->asyncwork_nworkers % 8 == 0) {
+		AWorker** v = realloc(
+			s->asyncwork_workers, (s->asyncwork_nworkers + 8) * sizeof(*s->asyncwork_workers));
+		if (!v)
+			return -ENOMEM;
+		s->asyncwork_workers = v;
+	}
+	AWorker* aw = calloc(1, sizeof(AWorker));
+	if (!aw)
+		return -ENOMEM;
+	int err = worker_open(&aw->w, s, WorkerKind_ASYNC);
+	if (err) {
+		free(aw);
+		return err;
+	}
+	aw->sq = spsc_open(ASYNCWORK_QUEUE_CAP, sizeof(AsyncWorkReq));
+	aw->cq = spsc_open(ASYNCWORK_QUEUE_CAP, sizeof(AsyncWorkRes));
+	if (!aw->sq || !aw->cq || (err = tsem_open(&aw->sem, 0))) {
+		if (aw->sq) spsc_close(aw->sq);
+		if (aw->cq) spsc_close(aw->cq);
+		free(aw);
+		return err ? err : -ENOMEM;
+	}
+	aw->req_is_active = 0;
+	aw->idle_since = DTimeNow();
+	aw->idle_timeout = s->asyncwork_idle_timeout;
+	if (( err = worker_start((Worker*)aw, NULL) ))
+		return err;
+	// The reference returned by worker_open is S.asyncwork_workers' reference, released when
+	// aw is removed from it (s_asyncwork_remove_worker, s_asyncwork_reap.) worker_start took
+	// the thread's reference and s_workers_add S.workers' reference.
+	s->asyncwork_workers[s->asyncwork_nworkers++] = aw;
+	s->asyncwork_nspawned++;
+	*awp = aw;
+	return 0;
+}
+
+
+// s_asyncwork_remove_worker removes aw from S's asyncwork workers
+static void s_asyncwork_remove_worker(S* s, AWorker* aw) {
+	// wake tasks waiting for work that aw completed before it closed
+	s_asyncwork_read_worker_cq(s, aw);
+	for (u32 i = 0; i < s->asyncwork_nworkers; i++) {
+		if (s->asyncwork_workers[i] == aw) {
+			s->asyncwork_workers[i] = s->asyncwork_workers[--s->asyncwork_nworkers];
+			worker_release(&aw->w); // S.asyncwork_workers' reference
+			break;
+		}
+	}
+}
+
+
+// s_asyncwork_select picks the worker to submit a work request to.
+// An idle worker is preferred. If all workers are busy a new one is started, up to
+// S.asyncwork_max, after which *awp is set to NULL: the request should wait in
+// S.asyncwork_backlog for a worker to finish (rather than behind a possibly long-running
+// request of a particular worker.)
+// Since only S submits work and only S reads completions, nqueued is accurate; no races.
+static int s_asyncwork_select(S* s, AWorker** awp) {
+	for (u32 i = 0; i < s->asyncwork_nworkers; i++) {
+		AWorker* aw = s->asyncwork_workers[i];
+		if (aw->nqueued == 0) {
+			*awp = aw;
+			return 0;
+		}
+	}
+	trace_sched("[asyncwork] all %u workers busy", s->asyncwork_nworkers);
+	*awp = NULL;
+	if (s->asyncwork_nworkers < s->asyncwork_max) {
+		int err = s_asyncwork_spawn_worker(s, awp);
+		if (err && s->asyncwork_nworkers == 0)
+			return err;
+		// fall back to the backlog
+	}
+	return 0;
+}
+
+
+// s_asyncwork_submit hands req to aw
+static void s_asyncwork_submit(S* s, AWorker* aw, const AsyncWorkReq* req) {
+	// Note: sq can't be full since nqueued counts requests in sq plus those being worked on.
+	UNUSED bool ok = spsc_write(aw->sq, req);
+	assert(ok);
+	aw->nqueued++;
+	trace_sched("T%u asyncwork op=%u SQ append " AWORKER_ID_F, req->tid, req->op, aworker_id(aw));
+
+	// wake the worker if it's waiting for work (see asyncworker_main)
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&aw->sleeping, memory_order_relaxed) &&
+	    atomic_exchange_explicit(&aw->sleeping, false, memory_order_relaxed))
+	{
+		tsem_signal(&aw->sem);
+	}
+}
+
+
+static u32 s_asyncwork_backlog_len(const S* s) {
+	const FIFO* q = s->asyncwork_backlog;
+	return q ? (q->tail + q->cap - q->head) % q->cap : 0;
+}
+
+
+// s_asyncwork_backlog_pop removes the oldest request from S.asyncwork_backlog.
+// Requests of tasks which have been stopped while waiting are discarded.
+static AsyncWorkReq* nullable s_asyncwork_backlog_pop(S* s) {
+	AsyncWorkReq* req;
+	while (s->asyncwork_backlog && (req = fifo_pop(s->asyncwork_backlog, sizeof(*req)))) {
+		T* t = s_task(s, req->tid);
+		if LIKELY(t->status != T_DEAD)
+			return req;
+		trace_sched("drop asyncwork backlog request of dead " T_ID_F, t_id(t));
+		asyncwork_discard(req->op, req->arg);
+		t_release(t);
+	}
+	return NULL;
+}
+
+
+// s_asyncwork_reap stops workers which have been idle for S.asyncwork_idle_timeout, as well as
+// idle workers in excess of S.asyncwork_max, while keeping at least S.asyncwork_min workers.
+// Workers tell S when they have been idle for a while (S_NOTE_AWIDLE); S makes the decision
+// since it's the only one who knows if a worker is about to be handed work.
+static void s_asyncwork_reap(S* s) {
+	DTime now = DTimeNow();
+	DTimeDuration timeout = s->asyncwork_idle_timeout;
+	u32 i = 0;
+	while (i < s->asyncwork_nworkers && s->asyncwork_nworkers > s->asyncwork_min) {
+		AWorker* aw = s->asyncwork_workers[i];
+		DTime idle_since = atomic_load_explicit(&aw->idle_since, memory_order_relaxed);
+		if (aw->nqueued > 0 || (
+		    s->asyncwork_nworkers <= s->asyncwork_max &&
+		    (timeout <= 0 || now - idle_since < timeout) ))
+		{
+			i++;
+			continue;
+		}
+		trace_sched("[asyncwork] stopping idle " AWORKER_ID_F, aworker_id(aw));
+		s->asyncwork_workers[i] = s->asyncwork_workers[--s->asyncwork_nworkers];
+		s->asyncwork_nreaped++;
+		aw->reaped = true;
+		worker_close(&aw->w); // removed from S.workers when it has exited (see s_reap_workers)
+		worker_release(&aw->w); // S.asyncwork_workers' reference
+	}
+}
+
+
+static int t_asyncwork_req(
+	T* t, AsyncWorkReq* req, void* nullable cont_arg, TaskContinuation nullable cont)
+{
+	// if t is the only task running on S's thread we can just block, bypassing worker threads
+	if (t->s->nlive == 1 && t->ntimers == 0) {
+		trace_sched(T_ID_F " asyncwork op=%u immediate", t_id(t), req->op);
+		i64 result = asyncwork_do(req);
+		if (cont) {
+			t->info.wait_async.result = result;
+			return cont(t_L(t), T_RUNNING, cont_arg);
+		} else {
+			lua_pushinteger(t_L(t), result);
+			return 1;
+		}
+	}
+
+	// select a worker, spawning one if needed
+	S* s = t->s;
+	AWorker* aw;
+	int err = s_asyncwork_select(s, &aw);
+	if (err)
+		return err;
+
+	// submit work request, or put it in the backlog if all workers are busy
+	req->flags |= (u16)(cont != NULL) * AsyncWorkFlag_HAS_CONT;
+	if (aw) {
+		s_asyncwork_submit(s, aw, req);
+	} else {
+		if (!s->asyncwork_backlog && !( s->asyncwork_backlog = fifo_alloc(8, sizeof(*req)) ))
+			return -ENOMEM;
+		AsyncWorkReq* qreq = fifo_push(&s->asyncwork_backlog, sizeof(*req), U32_MAX);
+		if UNLIKELY(!qreq)
+			return -ENOMEM;
+		*qreq = *req;
+		u32 n = s_asyncwork_backlog_len(s);
+		if (n > s->asyncwork_backlog_max)
+			s->asyncwork_backlog_max = n;
+		trace_sched(T_ID_F " asyncwork op=%u backlog (%u)", t_id(t), req->op, n);
+	}
+	t_retain(t); // work's ref, released by s_asyncwork_read_worker_cq
+
+	// suspend task
+	t->resume_nres = 0;
+	return t_suspend(t, T_WAIT_ASYNC, cont_arg, (TaskContinuation)cont);
+}
+
+
+static i64 asyncwork_do_nanosleep(const AsyncWorkReq* req) {
+	u64 nsec = req->arg;
+	struct timespec ts = {
+		.tv_sec = nsec / 1000000000,
+		.tv_nsec = nsec % 1000000000,
+	};
+	struct timespec ts_rem = {};
+	while (nanosleep(&ts, &ts) == -1) {
+		if (errno != EINTR)
+			return -errno;
+		if (ts_rem.tv_sec == 0 && ts_rem.tv_nsec < 100)
+			break;
+		dlog("nanosleep interrupted; continuing");
+	}
+	return 0;
+}
+
+static int l_syscall_nanosleep(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	u64 nsec = luaL_checkinteger(L, 1);
+	AsyncWorkReq req = {
+		.op = AsyncWorkOp_NANOSLEEP,
+		.tid = t->tid,
+		.arg = nsec,
+	};
+	return t_asyncwork_req(t, &req, NULL, NULL);
+}
+
+
+typedef struct AddrInfoReq {
+	u16                       port;
+	const char*               hostname; // allocated together with the AddrInfoReq
+	struct addrinfo           hints;
+	struct addrinfo* nullable res;
+} AddrInfoReq;
+
+
+static void addrinfo_req_free(AddrInfoReq* aireq) {
+	if (aireq->res)
+		freeaddrinfo(aireq->res);
+	free(aireq);
+}
+
+
+static i64 asyncwork_do_addrinfo(const AsyncWorkReq* req) {
+	AddrInfoReq* aireq = (AddrInfoReq*)(uintptr)req->arg;
+
+	char service[8];
+	sprintf(service, "%u", aireq->port);
+	trace_sched("getaddrinfo BEGIN hostname=\"%s\" port=%s", aireq->hostname, service);
+
+	return getaddrinfo(aireq->hostname, service, &aireq->hints, &aireq->res);
+}
+
+static void l_syscall_addrinfo_cont_mkres(lua_State* L, AddrInfoReq* aireq) {
+	int index = 1;
+	char addr_str[INET6_ADDRSTRLEN];
+
+	#define KV_I(k, v) ( lua_pushstring(L, k), lua_pushinteger(L, v), lua_settable(L, -3) )
+	#define KV_S(k, v) ( lua_pushstring(L, k), lua_pushstring(L, v), lua_settable(L, -3) )
+
+	lua_createtable(L, 0, 0);
+
+	for (struct addrinfo *rp = aireq->res; rp != NULL; rp = rp->ai_next) {
+		lua_createtable(L, 0, 5); // Table with 5 fields
+		KV_I("family", rp->ai_family);
+		KV_I("socktype", rp->ai_socktype);
+		KV_I("protocol", rp->ai_protocol);
+		if (rp->ai_family == AF_INET) {
+			struct sockaddr_in* sa = (struct sockaddr_in*)rp->ai_addr;
+			KV_I("port", ntohs(sa->sin_port));
+			if (inet_ntop(AF_INET, &(sa->sin_addr), addr_str, INET_ADDRSTRLEN) != NULL)
+				KV_S("addr", addr_str);
+		} else if (rp->ai_family == AF_INET6) {
+			struct sockaddr_in6* sa = (struct sockaddr_in6*)rp->ai_addr;
+			KV_I("port", ntohs(sa->sin6_port));
+			if (inet_ntop(AF_INET6, &(sa->sin6_addr), addr_str, INET6_ADDRSTRLEN) != NULL)
+				KV_S("addr", addr_str);
+		}
+
+		// Add the address entry table to the main array at the current index
+		lua_rawseti(L, -2, index++);
+	}
+
+	#undef KV_I
+	#undef KV_S
+}
+
+static int l_syscall_addrinfo_cont(lua_State* L, int ltstatus, void* nullable arg) {
+	T* t = L_t(L);
+	AddrInfoReq* aireq = arg;
+
+	int res = (int)t->info.wait_async.result;
 	trace_sched("getaddrinfo FINISH => %d (%s)", res, res == 0 ? "" : gai_strerror(res));
 	int nret = 1;
 	if (res != 0) {
@@ -2482,9 +3823,7 @@ static int l_syscall_addrinfo_cont(lua_State* L, int ltstatus, void* nullable ar
 		// family, socktype, protocol, port, addr
 	}
 
-	if (aireq->res)
-		freeaddrinfo(aireq->res);
-	free(aireq);
+	addrinfo_req_free(aireq);
 
 	return nret;
 }
@@ -2495,7 +3834,8 @@ static int l_syscall_addrinfo_cont(lua_State* L, int ltstatus, void* nullable ar
 static int l_syscall_addrinfo(lua_State* L) {
 	T* t = REQUIRE_TASK(L);
 
-	const char* hostname = luaL_checkstring(L, 1);
+	usize hostname_len;
+	const char* hostname = luaL_checklstring(L, 1, &hostname_len);
 	if (!hostname)
 		return 0;
 
@@ -2517,11 +3857,13 @@ static int l_syscall_addrinfo(lua_State* L) {
 	if ((v = lua_tointegerx(L, 5, &isnum)), isnum) ai_socktype = v;
 	if ((v = lua_tointegerx(L, 6, &isnum)), isnum) ai_flags |= v;
 
-	AddrInfoReq* aireq = calloc(1, sizeof(AddrInfoReq));
+	// Note: the hostname is copied since the task, and its stack, may go away while the request
+	// is being worked on (see asyncwork_discard)
+	AddrInfoReq* aireq = calloc(1, sizeof(AddrInfoReq) + hostname_len + 1);
 	if (!aireq)
 		return l_errno_error(L, ENOMEM);
 	aireq->port = (u16)port;
-	aireq->hostname = hostname;
+	aireq->hostname = memcpy(aireq + 1, hostname, hostname_len + 1);
 	aireq->hints.ai_family = ai_family;
 	aireq->hints.ai_socktype = ai_socktype; // Datagram socket
 	aireq->hints.ai_flags = ai_flags;
@@ -2548,6 +3890,19 @@ static i64 asyncwork_do(const AsyncWorkReq* req) {
 }
 
 
+// asyncwork_discard frees memory owned by a request (or its result) of a task which exited
+// while waiting for it, in place of the request's continuation which is never called
+static void asyncwork_discard(u16 op, u64 arg) {
+	switch ((enum AsyncWorkOp)op) {
+	case AsyncWorkOp_ADDRINFO:
+		addrinfo_req_free((AddrInfoReq*)(uintptr)arg);
+		break;
+	default:
+		break;
+	}
+}
+
+
 static int l_yield(lua_State* L) {
 	T* t = REQUIRE_TASK(L);
 	int nargs = lua_gettop(L);
@@ -2737,7 +4092,7 @@ static int l_read_cont(lua_State* L, __attribute__((unused)) int ltstatus, IODes
 	#if 1 // version of the code that resizes buffer if needed
 		// TODO: check to see if there's a 3rd argument with explicit read limit
 		usize readlim = d->nread;
-		if (buf_reserve(buf, readlim) == NULL)
+		if (l_buf_reserve(L, buf, readlim) == NULL)
 			return l_errno_error(L, ENOMEM);
 	#else // version of the code that only reads what can fit in buf
 		// If there's no available space in buf (i.e. buf->cap - buf->len == 0) then read() will
@@ -2782,63 +4137,71 @@ static int l_read(lua_State* L) {
 	IODesc* d = l_iodesc_check(L, 1);
 	// TODO: if there's a 3rd argument 'nread' that is >0, wait unless d->nread >= nread.
 	// if there's nothing available to read, we will have to wait for it
-	if (d->nread == 0)
+	if (!iodesc_readable(d))
 		return t_iopoll_wait(t, d, l_read_cont);
 	return l_read_cont(L, 0, d);
 }
 
 
-static int l_msg_stow(lua_State* src_L, lua_State* dst_L, InboxMsg* msg) {
+// l_msg_stow moves the payload of a message to the stash of the destination task.
+// The caller must have reserved nres+1 slots with t_stash_reserve; the extra slot is used by
+// l_msg_unstow to move values one at a time.
+static void l_msg_stow(lua_State* src_L, T* dst_t, InboxMsg* msg) {
 	assert(msg->type == InboxMsgType_MSG || msg->type == InboxMsgType_MSG_DIRECT);
+	lua_State* stash = assertnotnull(dst_t->stash);
+	msg->msg.base = lua_gettop(stash) + 1;
+	lua_pushthread(src_L);                      // push sender "thread" onto its own stack
+	lua_xmove(src_L, stash, 1);                 // move sender "thread" to stash
+	lua_xmove(src_L, stash, msg->msg.nres - 1); // arguments passed after 'dst' to send()
+}
 
-	// Store message payload in a table.
-	// This way the message payload gets GC'd when the destination task is GC'd,
-	// regardless of message delivery.
-	lua_createtable(dst_L, msg->msg.nres, 0);
-
-	// first value is the sender task (Lua "thread")
-	lua_pushthread(src_L);      // push sender "thread" onto its own stack
-	lua_xmove(src_L, dst_L, 1); // move sender "thread" to receiver's stack
-	lua_rawseti(dst_L, -2, 1);  // Store in table at index 1
 
-	for (int i = 2; i <= msg->msg.nres; i++) {
-		lua_pushvalue(src_L, i);    // Get argument from its position in src_L ...
-		lua_xmove(src_L, dst_L, 1); // ... and move it to dst_L
-		lua_rawseti(dst_L, -2, i);  // Store in table at index (i-1)
+static int l_msg_unstow(lua_State* dst_L, T* t, InboxMsg* msg) {
+	// Note: Stack index 1 is occupied by msg->type, pushed by l_recv_deliver.
+	lua_State* stash = assertnotnull(t->stash);
+	int end = msg->msg.base + msg->msg.nres - 1; // stash index of last value
+	for (int i = msg->msg.base; i <= end; i++) {
+		lua_pushvalue(stash, i);
+		lua_xmove(stash, dst_L, 1);
 	}
 
-	#ifdef DEBUG
-	for (int i = 1; i <= msg->msg.nres; i++) {
-		lua_rawgeti(dst_L, -1, i);
-		if (lua_isnil(dst_L, -1)) {
-			lua_pop(dst_L, 2);  // pop nil and table
-			panic("failed to store argument %d", i);
-		} else {
-			// dlog("msg payload[%d] = %s", i, lua_typename(dst_L, lua_type(dst_L, -1)));
-		}
-		lua_pop(dst_L, 1);  // pop checked value
+	// Values of delivered messages are left in place until either the stash is empty, or they
+	// outnumber the values of messages still buffered, at which point the remaining values are
+	// moved to the bottom of the stash. This keeps delivery amortized O(1).
+	int top = lua_gettop(stash);
+	if (end == top) {
+		lua_settop(stash, 0);
+	} else if (end >= top - end) {
+		lua_rotate(stash, 1, -end);
+		lua_settop(stash, top - end);
+		t_stash_rebase(t, end);
 	}
-	#endif
 
-	msg->msg.ref = luaL_ref(dst_L, LUA_REGISTRYINDEX);
+	return 1 + msg->msg.nres; // msg.type + payload
+}
 
-	return 0;
+
+static int l_structclone_decode_p(lua_State* L) {
+	void* bytes = lua_touserdata(L, 1);
+	usize len = (usize)lua_tointeger(L, 2);
+	u64 flags = (u64)lua_tointeger(L, 3);
+	lua_settop(L, 0);
+	return structclone_decode(L, bytes, len, flags);
 }
 
 
-static int l_msg_unload(lua_State* dst_L, InboxMsg* msg) {
-	// Note: Payload table will be placed at index 2 in the stack.
-	// Stack index 1 is occupied by msg->type, pushed by l_recv_deliver.
-	lua_rawgeti(dst_L, LUA_REGISTRYINDEX, msg->msg.ref); // Get the payload table
-	assertf(lua_type(dst_L, 2) == LUA_TTABLE,
-			"%s", lua_typename(dst_L, lua_type(dst_L, 2)));
-	for (int i = 1; i <= msg->msg.nres; i++) {
-		lua_rawgeti(dst_L, 2, i); // get value i from table
-		assert(!lua_isnoneornil(dst_L, -1));
-	}
-	lua_remove(dst_L, 2); // remove payload table from stack
-	luaL_unref(dst_L, LUA_REGISTRYINDEX, msg->msg.ref); // free reference
-	return 1 + msg->msg.nres; // msg.type + payload
+// structclone_pdecode calls structclone_decode in protected mode, so that the caller can free
+// the encoded data if decoding fails. On success, *nresp is set to the number of values pushed
+// onto L's stack. On error, the error value is pushed and a LUA_ERR* status is returned.
+static int structclone_pdecode(lua_State* L, void* bytes, usize len, u64 flags, int* nresp) {
+	int top = lua_gettop(L);
+	lua_pushcfunction(L, l_structclone_decode_p);
+	lua_pushlightuserdata(L, bytes);
+	lua_pushinteger(L, (lua_Integer)len);
+	lua_pushinteger(L, (lua_Integer)flags);
+	int status = lua_pcall(L, 3, LUA_MULTRET, 0);
+	*nresp = lua_gettop(L) - top;
+	return status;
 }
 
 
@@ -2851,7 +4214,8 @@ static int l_recv_deliver_worker_msg(lua_State* L, InboxMsg* msg) {
 
     // decode structclone data onto T's stack
     // TODO: Handle exceptions; currently leaking buf_bytes memory if it would happen!
-    int nres = structclone_decode(L, msg->msg_remote.buf->bytes, msg->msg_remote.buf->len);
+    int nres = structclone_decode(
+    	L, msg->msg_remote.buf->bytes, msg->msg_remote.buf->len, StructCloneDec_PTRS);
     msg_msg_remote_free(msg);
 
 	return 2 + nres;
@@ -2881,6 +4245,19 @@ static int l_recv_deliver_worker_closed(lua_State* L, InboxMsg* msg) {
 }
 
 
+static int l_recv_deliver_publication(lua_State* L, InboxMsg* msg) {
+	Publication* pub = msg->publish.pub;
+	lua_pushlstring(L, pub->topic->name, pub->topic->namelen);
+	int nres;
+	int status = structclone_pdecode(
+		L, pub->buf->bytes, pub->buf->len, StructCloneDec_PTRS | StructCloneDec_SHARED, &nres);
+	msg_publish_free(msg);
+	if UNLIKELY(status != LUA_OK)
+		return lua_error(L);
+	return 2 + nres;
+}
+
+
 static int l_recv_deliver(lua_State* dst_L, T* t, InboxMsg* msg) {
 	trace_sched(T_ID_F " deliver %s", t_id(t), inbox_msg_type_str(msg->type));
 	assert(msg->type != InboxMsgType_MSG_DIRECT); // should never happen
@@ -2897,13 +4274,16 @@ static int l_recv_deliver(lua_State* dst_L, T* t, InboxMsg* msg) {
     	case InboxMsgType_TIMER:
     		return 1;
     	case InboxMsgType_MSG:
-    		return l_msg_unload(dst_L, msg);
+    		return l_msg_unstow(dst_L, t, msg);
     	case InboxMsgType_MSG_DIRECT:
     		return 1 + msg->msg.nres;
     	case InboxMsgType_MSG_REMOTE:
+    		s_worker_msg_uncount(t->s, t->tid);
     		return l_recv_deliver_worker_msg(dst_L, msg);
     	case InboxMsgType_WORKER_CLOSED:
     		return l_recv_deliver_worker_closed(dst_L, msg);
+    	case InboxMsgType_PUBLISH:
+    		return l_recv_deliver_publication(dst_L, msg);
     }
 
     panic("unexpected msg->type 0x%02x", msg->type);
@@ -2929,7 +4309,7 @@ static int l_recv(lua_State* L) {
 
 	// TODO: check "from" arguments.
 
-	// Remove all arguments. This is required for l_recv_deliver & l_msg_unload to
+	// Remove all arguments. This is required for l_recv_deliver & l_msg_unstow to
 	// work properly as they place return values onto the stack.
 	lua_pop(L, lua_gettop(L));
 
@@ -2971,6 +4351,14 @@ static int l_send_task_cont(lua_State* L, int ltstatus, void* arg) {
 
 
 static int l_send_task1(lua_State* L, T* t, T* dst_t) {
+	// a dead task will never recv; drop the message (its inbox and stash are already freed)
+	if UNLIKELY(dst_t->status == T_DEAD)
+		return 0;
+
+	// if the message will be buffered, make room for it before taking a slot in the inbox
+	if (dst_t->status != T_WAIT_RECV && !t_stash_reserve(L, dst_t, lua_gettop(L) + 1))
+		return l_errno_error(L, ENOMEM);
+
 	// place message in receiver's inbox
 	const u32 maxcap = 64;
 	InboxMsg* msg = inbox_add(&dst_t->inbox, maxcap);
@@ -3004,7 +4392,10 @@ static int l_send_task1(lua_State* L, T* t, T* dst_t) {
 	// the message will be delivered later.
 	if (dst_t->status != T_WAIT_RECV) {
 		trace_sched("send buffered to " T_ID_F, t_id(dst_t));
-		return l_msg_stow(src_L, dst_L, msg);
+		l_msg_stow(src_L, dst_t, msg);
+		if (dst_t->status == T_WAIT_SET)
+			t_waitset_wake_kind(dst_t, TWaitKind_RECV, dst_t, STWake_MSG, t->tid);
+		return 0;
 	}
 
 	trace_sched("send directly to " T_ID_F, t_id(dst_t));
@@ -3032,6 +4423,7 @@ static int l_send_task1(lua_State* L, T* t, T* dst_t) {
 	// So we are going through the scheduler. A wee bit less efficient but more correct.
 	//
 	// put destination task in the priority runq so that it runs asap
+	s_trace(t->s, STEv_WAKE, STWake_MSG, dst_t->tid, t->tid);
 	s_runq_put_runnext(t->s, dst_t);
 	//
 	// put the sender task at the end of the runq and return to scheduler loop (s_main)
@@ -3050,8 +4442,9 @@ static int l_send_task(lua_State* L) {
 
 // fun structclone_encode(flags uint, transfer_list [any], value ...any) Buf
 static int l_structclone_encode(lua_State* L) {
-	u64 flags = luaL_checkinteger(L, 1);
-	// ignore arg 2 "transfer_list" for now, until it's supported
+	// Note: flags may not include StructCloneEnc_PTRS since the result is a Buf accessible
+	// to Lua code. Bufs in transfer_list are copied, then detached.
+	u64 flags = luaL_checkinteger(L, 1) & ~StructCloneEnc_PTRS;
 
 	// create buffer (lifetime managed by GC)
 	Buf* buf = l_buf_createx(L, 512);
@@ -3079,6 +4472,9 @@ static int l_structclone_encode(lua_State* L) {
 	// pop transfer_list
 	lua_pop(L, 1);
 
+	// account for the memory of buf which grew beyond its embedded bytes while encoding
+	l_buf_account(L, buf_external_cap(buf));
+
 	// return buffer
 	return 1;
 }
@@ -3090,7 +4486,7 @@ static int l_structclone_decode(lua_State* L) {
 	if (!buf)
 		return 0;
 	lua_pop(L, 1); // remove buffer from stack
-	return structclone_decode(L, buf->bytes, buf->len);
+	return structclone_decode(L, buf->bytes, buf->len, 0);
 }
 
 
@@ -3110,6 +4506,12 @@ static S* nullable l_check_anytask(lua_State* L, int local_idx, T** local_t_out,
 		assertnotnull(rt);
 		sid = rt->sid;
 		*tid_out = rt->tid;
+		// A worker handle keeps its worker alive, even after it has exited and has been
+		// removed from sreg, so there's no need for a registry lookup.
+		if (rt->flags & RemoteTask_FLAG_WORKER_REF) {
+			*local_t_out = NULL;
+			return &rt->worker->s;
+		}
 	}
 
 	// check if task is local (current S == dst_sid)
@@ -3128,15 +4530,190 @@ static S* nullable l_check_anytask(lua_State* L, int local_idx, T** local_t_out,
 }
 
 
-static int l_send_remotetask_err_dead(lua_State* L) {
-	return luaL_error(L, "send to dead RemoteTask");
+// l_encode_msg_estimate returns the approximate encoded size of the nargs values at the top
+// of L's stack. It only looks at the values themselves, not inside tables, and is exact for
+// strings and Bufs, which make up most of the size of large messages.
+static usize l_encode_msg_estimate(lua_State* L, u64 flags, int nargs) {
+	usize size = 4; // header
+	for (int i = -nargs; i < 0; i++) {
+		switch (lua_type(L, i)) {
+		case LUA_TSTRING:
+			size += 5 + lua_rawlen(L, i);
+			break;
+		case LUA_TTABLE: {
+			// assume an array of numbers (packed); dicts are accounted for by msg_size_hint
+			u32 len = dew_lua_arraylen(L, i);
+			size += 5 + (len == U32_MAX ? 0 : (usize)len*sizeof(lua_Number));
+			break;
+		}
+		case LUA_TUSERDATA: {
+			UVal* uval = lua_touserdata(L, i);
+			if (uval->type == UValType_Buf && !(flags & StructCloneEnc_TRANSFER_LIST)) {
+				size += 10 + ((Buf*)uval)->len;
+			} else {
+				size += 26; // moved Buf or SharedBuf
+			}
+			break;
+		}
+		default:
+			size += 9;
+		}
+	}
+	return size;
 }
 
 
-static int l_send_remotetask(lua_State* L) {
-	T* t = REQUIRE_TASK(L);
+// MSG_SIZE_HINT_MAX limits S.msg_size_hint
+#define MSG_SIZE_HINT_MAX (64*1024)
 
-	// we accept destiation task as either GTID integer or RemoteTask object
+// MSG_SLACK_MAX is the largest number of unused bytes l_encode_msg leaves in a MiniBuf
+// (when the slack is also more than a quarter of the message size)
+#define MSG_SLACK_MAX 256
+
+// l_encode_msg structurally clones the nargs values at the top of L's stack into a
+// MiniBuf, which is owned by the caller. Pops the values.
+// flags are passed on to structclone_encode; with StructCloneEnc_TRANSFER_LIST, the transfer_list
+// is left on the stack. A MiniBuf encoded with StructCloneEnc_PTRS may own memory of moved
+// Bufs and references to SharedBufs, which structclone_discard releases.
+//
+// The buffer is allocated up front with room for the estimated size of the message plus
+// s->msg_size_hint, about the largest amount by which recent messages encoded on s exceeded
+// their estimate, so that most messages are encoded without reallocating the buffer.
+static MiniBuf* l_encode_msg(lua_State* L, S* s, u64 flags, int nargs) {
+	usize estimate = l_encode_msg_estimate(L, flags, nargs);
+
+	// allocate a buffer and make room for MiniBuf.len
+	Buf buf = {};
+	if UNLIKELY(!buf_reserve(&buf, sizeof(((MiniBuf*)0)->len) + estimate + s->msg_size_hint))
+		l_errno_error(L, ENOMEM);
+	buf.len += sizeof(((MiniBuf*)0)->len);
+
+	// structurally clone the arguments
+	int err = structclone_encode(L, &buf, flags, nargs);
+	if (err) {
+		buf_free(&buf);
+		l_errno_error(L, -err);
+	}
+
+	// Give back the slack of the buffer when it is large, since the MiniBuf may stay in
+	// flight for a while. The estimate counts 8 bytes per array element, which the encoder
+	// needs as scratch space before narrowing NUMARRAY elements, so this is common for
+	// arrays of small integers.
+	usize slack = buf.cap - buf.len;
+	if (slack > MSG_SLACK_MAX && slack > buf.len/4) {
+		u8* bytes = realloc(buf.bytes, buf.len);
+		if (bytes)
+			buf.bytes = bytes, buf.cap = buf.len;
+	}
+
+	// interpret data at buf.bytes as minibuf
+	MiniBuf* minibuf = (MiniBuf*)buf.bytes;
+	minibuf->len = buf.len - sizeof(minibuf->len);
+
+	// Update hint: grow it right away to the excess (plus some headroom), but let it shrink
+	// slowly, so that an occasional small message does not cause the next large one to
+	// reallocate.
+	usize excess = minibuf->len > estimate ? MIN(minibuf->len - estimate, MSG_SIZE_HINT_MAX) : 0;
+	if (excess > s->msg_size_hint) {
+		s->msg_size_hint = (u32)(excess + excess/8);
+	} else {
+		s->msg_size_hint -= (u32)((s->msg_size_hint - excess) / 32);
+	}
+
+	return minibuf;
+}
+
+
+// s_outbox_flush writes the messages in s's outbox to the destination's CQ, in as few
+// transactions as possible, and notifies the destination once.
+// Called when the outbox is full, when a task sends to another destination than the one
+// of the outbox, and when a task returns control to the scheduler loop.
+static void s_outbox_flush(S* s) {
+	S* dst_s = s->outbox_dst;
+	if (!dst_s)
+		return;
+	u32 len = s->outbox_len;
+	u32 n = 0;
+	while (n < len) {
+		u32 nwritten = chan_write_many(dst_s->asyncwork_cq, 0, &s->outbox[n], len - n);
+		if UNLIKELY(nwritten == 0) // CQ closed; worker has exited
+			break;
+		n += nwritten;
+	}
+	trace_sched("flush outbox to S%u (%u/%u msgs)", dst_s->sid, n, len);
+
+	// discard messages that could not be delivered
+	for (u32 i = n; i < len; i++) {
+		s_worker_msg_uncount(dst_s, s->outbox[i].msg.dst_tid);
+		MiniBuf* minibuf = s->outbox[i].msg.buf;
+		structclone_discard(minibuf->bytes, minibuf->len);
+		free(minibuf);
+	}
+
+	s->outbox_dst = NULL;
+	s->outbox_len = 0;
+
+	// notify the worker's scheduler that there's stuff in asyncwork_cq
+	if (n > 0)
+		s_notify(dst_s, S_NOTE_ASYNCWORK);
+
+	if (dst_s->isworker && !atomic_load_explicit(&g_exiting, memory_order_acquire))
+		worker_release(&s_worker(dst_s)->w);
+}
+
+
+// t_send_remote sends a message, encoded with l_encode_msg, from t to task dst_tid of
+// worker S dst_s. Takes ownership of minibuf.
+// The message is put in the outbox of t's S, which is flushed (see s_outbox_flush) at the
+// latest when t yields. The outbox only holds messages to one destination at a time, so
+// messages are delivered in the order they were sent, also across destinations.
+static void t_send_remote(T* t, S* dst_s, u32 dst_tid, MiniBuf* minibuf) {
+	trace_sched("send to remotetask S%u T%u", dst_s->sid, dst_tid);
+	S* s = t->s;
+
+	if (s->outbox_dst != dst_s) {
+		s_outbox_flush(s);
+		if UNLIKELY(!s->outbox && !( s->outbox = malloc(sizeof(AsyncWorkRes)*S_OUTBOX_CAP) )) {
+			structclone_discard(minibuf->bytes, minibuf->len);
+			free(minibuf);
+			l_errno_error(t_L(t), ENOMEM);
+			return;
+		}
+		// keep the worker alive until the outbox has been flushed
+		if (dst_s->isworker)
+			worker_retain(&s_worker(dst_s)->w);
+		s->outbox_dst = dst_s;
+	}
+
+	// count message as pending until the worker's main task receives it
+	if (dst_s->isworker && dst_tid == 1)
+		atomic_fetch_add_explicit(&s_worker(dst_s)->npending, 1, memory_order_relaxed);
+
+	AsyncWorkRes* res = &s->outbox[s->outbox_len++];
+	res->op = AsyncWorkOp_WORKER_MSG;
+	res->msg.buf = minibuf;
+	res->msg.sender_tid = t->tid;
+	res->msg.sender_sid = s->sid;
+	res->msg.dst_tid = dst_tid;
+
+	s_trace(s, STEv_SEND_REMOTE, 0, t->tid, dst_s->sid);
+
+	if (s->outbox_len == S_OUTBOX_CAP)
+		s_outbox_flush(s);
+}
+
+
+static int l_send_remotetask_err_dead(lua_State* L) {
+	return luaL_error(L, "send to dead RemoteTask");
+}
+
+
+// l_send_remotetask1 sends the values after the destination at stack index 1.
+// If transfer is true, a transfer_list is at stack index 2.
+static int l_send_remotetask1(lua_State* L, bool transfer) {
+	T* t = REQUIRE_TASK(L);
+
+	// we accept destiation task as either GTID integer or RemoteTask object
 	u32 dst_tid;
 	T* local_t;
 	S* dst_s = l_check_anytask(L, 1, &local_t, &dst_tid);
@@ -3152,52 +4729,710 @@ static int l_send_remotetask(lua_State* L) {
 		return luaL_error(L, "send to dead task");
 
 	// use l_send_task1 if task is local (current S == dst_sid)
-	if UNLIKELY(local_t)
+	if UNLIKELY(local_t) {
+		if (transfer) // values are passed by reference, so there's nothing to transfer
+			lua_remove(L, 2);
 		return l_send_task1(L, t, local_t);
+	}
 
-	// allocate a buffer and make room for MiniBuf.len
-	Buf buf = {};
-    if UNLIKELY(!buf_reserve(&buf, 128))
-        return l_errno_error(L, ENOMEM);
-    buf.len += sizeof(((MiniBuf*)0)->len);
-
-	// structurally clone the arguments
+	u64 flags = StructCloneEnc_PTRS;
 	int nargs = lua_gettop(L) - 1; // -1: not including worker
-	int err = structclone_encode(L, &buf, 0, nargs);
-	if (err)
-		return l_errno_error(L, -err);
+	if (transfer) {
+		flags |= StructCloneEnc_TRANSFER_LIST;
+		nargs--; // not including transfer_list
+	}
+	MiniBuf* minibuf = l_encode_msg(L, t->s, flags, nargs);
+	t_send_remote(t, dst_s, dst_tid, minibuf);
+	return 0;
+}
 
-	trace_sched("send to remotetask S%u T1", dst_s->sid);
 
-	// interpret data at buf.bytes as minibuf
-	MiniBuf* minibuf = (MiniBuf*)buf.bytes;
-	minibuf->len = buf.len - sizeof(minibuf->len);
+static int l_send_remotetask(lua_State* L) {
+	return l_send_remotetask1(L, false);
+}
 
-	// put message on target worker's CQ
-	ChanTx tx = chan_write_begin(dst_s->asyncwork_cq, 0);
-	assertf(tx.entry != NULL, "chan_write(cq) failed");
-	AsyncWorkRes* res = tx.entry;
 
-	res->op = AsyncWorkOp_WORKER_MSG;
-	res->msg.buf = minibuf;
+// fun send(Task|Worker|WorkerPool destination, msg... any)
+static int l_send(lua_State* L) {
+	if (lua_isthread(L, 1))
+		return l_send_task(L);
+	if (luaL_testudata(L, 1, "WorkerPool"))
+		return l_send_workerpool(L);
+	return l_send_remotetask(L);
+}
 
-	res->msg.sender_tid = t->tid;
-	res->msg.sender_sid = t->s->sid;
 
-	chan_write_commit(dst_s->asyncwork_cq, tx);
+// fun send_transfer(Task|Worker destination, transfer_list [Buf], msg... any)
+// Like send, but the Bufs in transfer_list are moved to the receiver instead of copied,
+// leaving them empty. Tasks of the same worker receive values by reference, as with send.
+static int l_send_transfer(lua_State* L) {
+	if (lua_isthread(L, 1)) {
+		lua_remove(L, 2);
+		return l_send_task(L);
+	}
+	return l_send_remotetask1(L, true);
+}
 
-	// notify the worker's scheduler that there's stuff in asyncwork_cq
-	s_notify(dst_s, S_NOTE_ASYNCWORK);
 
+// CHAN_CAP_MAX is the largest capacity of a channel created by chan(cap)
+#define CHAN_CAP_MAX (1u << 20)
+
+
+void channeldata_retain(ChannelData* ch) {
+	atomic_fetch_add_explicit(&ch->refcount, 1, memory_order_relaxed);
+}
+
+
+void channeldata_release(ChannelData* ch) {
+	if (atomic_fetch_sub_explicit(&ch->refcount, 1, memory_order_acq_rel) > 1)
+		return;
+	// Free values which were never received.
+	// Wait queues are empty, since a waiting task holds a reference (see t_chan_suspend.)
+	assert(ch->sendq == NULL && ch->recvq == NULL);
+	MiniBuf* minibuf;
+	while (chan_read(ch->q, CHAN_TRY, &minibuf)) {
+		structclone_discard(minibuf->bytes, minibuf->len);
+		free(minibuf);
+	}
+	chan_close(ch->q);
+	pthread_mutex_destroy(&ch->mu);
+	free(ch);
+}
+
+
+Channel* l_channel_createx(lua_State* L, ChannelData* ch) {
+	Channel* c = uval_new(L, UValType_Channel, sizeof(Channel), 0);
+	c->data = ch;
+	luaL_setmetatable(L, "Channel");
+	return c;
+}
+
+
+static ChannelData* l_chan_check(lua_State* L, int idx) {
+	Channel* c = luaL_checkudata(L, idx, "Channel");
+	return c->data;
+}
+
+
+// s_chan_wake wakes task tid of s, if it is still waiting for channel ch
+static void s_chan_wake(S* s, u32 tid, ChannelData* ch) {
+	T* t = s_task_checked(s, tid);
+	if (!t || t->status != T_WAIT_CHAN || t->chan != ch)
+		return; // already woken, or stopped
+	trace_sched("wake " T_ID_F " waiting on channel", t_id(t));
+	s_trace(s, STEv_WAKE, STWake_CHAN, t->tid, 0);
+	if UNLIKELY(!s_runq_put(s, t))
+		panic_oom();
+}
+
+
+static void chanwaiter_free(ChanWaiter* w) {
+	if (w->s->isworker && !atomic_load_explicit(&g_exiting, memory_order_acquire))
+		worker_release(&s_worker(w->s)->w);
+	free(w);
+}
+
+
+// chanwaiter_wake wakes the task of w, which has been removed from a wait queue of ch, and
+// frees w. A task of another S is woken by a message to that S (see s_asyncwork_read_cq.)
+static void chanwaiter_wake(ChanWaiter* w, ChannelData* ch) {
+	S* s = w->s;
+	if (s == tls_s) {
+		s_chan_wake(s, w->tid, ch);
+	} else if (
+		s->asyncwork_cq != NULL &&
+		(!s->isworker ||
+		 atomic_load_explicit(&s_worker(s)->w.status, memory_order_acquire) != Worker_CLOSED))
+	{
+		AsyncWorkRes res = { .op = AsyncWorkOp_CHAN_WAKE, .tid = w->tid, .result = (uintptr)ch };
+		if (chan_write(s->asyncwork_cq, 0, &res))
+			s_notify(s, S_NOTE_ASYNCWORK);
+	}
+	chanwaiter_free(w);
+}
+
+
+// chandata_wake_one wakes the task which has waited the longest in wait queue *qp of ch
+static void chandata_wake_one(ChannelData* ch, ChanWaiter** qp, _Atomic(u32)* np) {
+	if (atomic_load(np) == 0)
+		return;
+	pthread_mutex_lock(&ch->mu);
+	ChanWaiter* w = *qp;
+	if (w) {
+		*qp = w->next;
+		atomic_fetch_sub(np, 1);
+	}
+	pthread_mutex_unlock(&ch->mu);
+	if (w)
+		chanwaiter_wake(w, ch);
+}
+
+
+// chandata_wake_all wakes all tasks waiting to send to or receive from ch
+static void chandata_wake_all(ChannelData* ch) {
+	pthread_mutex_lock(&ch->mu);
+	ChanWaiter* lists[2] = { ch->sendq, ch->recvq };
+	ch->sendq = NULL;
+	ch->recvq = NULL;
+	atomic_store(&ch->nsendq, 0);
+	atomic_store(&ch->nrecvq, 0);
+	pthread_mutex_unlock(&ch->mu);
+	for (int i = 0; i < 2; i++) {
+		for (ChanWaiter* w = lists[i]; w;) {
+			ChanWaiter* next = w->next;
+			chanwaiter_wake(w, ch);
+			w = next;
+		}
+	}
+}
+
+
+// t_chan_enqueue adds t to the end of wait queue *qp of ch.
+// Once t is in the queue, the caller must check again if the channel is ready before
+// suspending t, since another thread may have made it ready just before.
+static int t_chan_enqueue(T* t, ChannelData* ch, ChanWaiter** qp, _Atomic(u32)* np) {
+	ChanWaiter* w = malloc(sizeof(ChanWaiter));
+	if UNLIKELY(!w)
+		return -ENOMEM;
+	w->next = NULL;
+	w->s = t->s;
+	w->tid = t->tid;
+	if (t->s->isworker) // keep S alive until w has been woken or removed
+		worker_retain(&s_worker(t->s)->w);
+	pthread_mutex_lock(&ch->mu);
+	while (*qp)
+		qp = &(*qp)->next;
+	*qp = w;
+	atomic_fetch_add(np, 1);
+	pthread_mutex_unlock(&ch->mu);
 	return 0;
 }
 
 
-// fun send(Task|Worker destination, msg... any)
-static int l_send(lua_State* L) {
-	if (lua_isthread(L, 1))
-		return l_send_task(L);
-	return l_send_remotetask(L);
+// t_chan_dequeue removes t from wait queue *qp of ch.
+// Returns false if t is not in the queue, i.e. it has been woken.
+static bool t_chan_dequeue(T* t, ChannelData* ch, ChanWaiter** qp, _Atomic(u32)* np) {
+	pthread_mutex_lock(&ch->mu);
+	ChanWaiter* w;
+	for (; (w = *qp); qp = &w->next) {
+		if (w->s == t->s && w->tid == t->tid) {
+			*qp = w->next;
+			atomic_fetch_sub(np, 1);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&ch->mu);
+	if (w)
+		chanwaiter_free(w);
+	return w != NULL;
+}
+
+
+// t_chan_unwait is called when t is stopped while waiting for a channel, or after having
+// been woken by it but before running
+static void t_chan_unwait(T* t) {
+	ChannelData* ch = t->chan;
+	t->chan = NULL;
+	if (!t_chan_dequeue(t, ch, &ch->sendq, &ch->nsendq) &&
+	    !t_chan_dequeue(t, ch, &ch->recvq, &ch->nrecvq))
+	{
+		// t has been woken, which it won't act on; pass the wakeup on to another task.
+		// A task woken without cause checks the channel again and goes back to waiting.
+		if (atomic_load(&ch->nfree) > 0)
+			chandata_wake_one(ch, &ch->sendq, &ch->nsendq);
+		if (atomic_load(&ch->nfree) < ch->cap)
+			chandata_wake_one(ch, &ch->recvq, &ch->nrecvq);
+	}
+	channeldata_release(ch);
+}
+
+
+static int t_chan_suspend(T* t, ChannelData* ch, TaskContinuation cont) {
+	S* s = t->s;
+	if UNLIKELY(
+		s->runnext == NULL && s->runq->fifo.head == s->runq->fifo.tail && // empty runq
+		s->nlive == 1 && // only task running
+		t->ntimers == 0 && // no timers
+		s->workers == NULL && !s->isworker) // no other S can use the channel
+	{
+		return -EDEADLK;
+	}
+	channeldata_retain(ch); // released by continuation or t_chan_unwait
+	t->chan = ch;
+	t->resume_nres = 0;
+	return t_suspend(t, T_WAIT_CHAN, ch, cont);
+}
+
+
+// chandata_take_slot claims a free slot for sending a value. Returns false if ch is full.
+static bool chandata_take_slot(ChannelData* ch) {
+	u32 n = atomic_load(&ch->nfree);
+	while (n > 0) {
+		if (atomic_compare_exchange_weak(&ch->nfree, &n, n - 1))
+			return true;
+	}
+	return false;
+}
+
+
+static int l_chan_send1(lua_State* L, T* t, ChannelData* ch);
+
+
+static int l_chan_send_cont(lua_State* L, int ltstatus, void* arg) {
+	ChannelData* ch = arg;
+	T* t = L_t(L);
+	t->chan = NULL;
+	channeldata_release(ch); // still referenced by Channel at stack index 1
+	return l_chan_send1(L, t, ch);
+}
+
+
+static int l_chan_send1(lua_State* L, T* t, ChannelData* ch) {
+	if UNLIKELY(atomic_load_explicit(&ch->closed, memory_order_acquire))
+		return luaL_error(L, "send on closed channel");
+
+	// encode a copy of the value, which stays at stack index 2 in case t has to wait
+	lua_pushvalue(L, 2);
+	MiniBuf* minibuf = l_encode_msg(L, t->s, StructCloneEnc_PTRS, 1);
+
+	if (!chandata_take_slot(ch)) {
+		// channel is full; wait in line for a receiver to free up a slot
+		int err = t_chan_enqueue(t, ch, &ch->sendq, &ch->nsendq);
+		if UNLIKELY(err) {
+			structclone_discard(minibuf->bytes, minibuf->len);
+			free(minibuf);
+			return l_errno_error(L, -err);
+		}
+		if (!chandata_take_slot(ch)) {
+			// the value is encoded again when t is woken up
+			structclone_discard(minibuf->bytes, minibuf->len);
+			free(minibuf);
+			if UNLIKELY(atomic_load(&ch->closed)) {
+				t_chan_dequeue(t, ch, &ch->sendq, &ch->nsendq);
+				return luaL_error(L, "send on closed channel");
+			}
+			if UNLIKELY(t_chan_suspend(t, ch, l_chan_send_cont) == -EDEADLK) {
+				t_chan_dequeue(t, ch, &ch->sendq, &ch->nsendq);
+				return luaL_error(L, "deadlock detected: channel send would never return");
+			}
+			return 0;
+		}
+		t_chan_dequeue(t, ch, &ch->sendq, &ch->nsendq);
+	}
+
+	bool ok = chan_write(ch->q, CHAN_TRY, &minibuf);
+	assertf(ok, "channel queue full"); // q has room for at least cap values
+	(void)ok;
+
+	chandata_wake_one(ch, &ch->recvq, &ch->nrecvq);
+
+	// pass on a wakeup which was not acted on, e.g. by a task which was stopped
+	if (atomic_load(&ch->nfree) > 0)
+		chandata_wake_one(ch, &ch->sendq, &ch->nsendq);
+	return 0;
+}
+
+
+static int l_chan_recv1(lua_State* L, T* t, ChannelData* ch);
+
+
+static int l_chan_recv_cont(lua_State* L, int ltstatus, void* arg) {
+	ChannelData* ch = arg;
+	T* t = L_t(L);
+	t->chan = NULL;
+	channeldata_release(ch); // still referenced by Channel at stack index 1
+	return l_chan_recv1(L, t, ch);
+}
+
+
+static int l_chan_recv1(lua_State* L, T* t, ChannelData* ch) {
+	MiniBuf* minibuf;
+	if (!chan_read(ch->q, CHAN_TRY, &minibuf)) {
+		if (atomic_load_explicit(&ch->closed, memory_order_acquire))
+			goto closed;
+
+		// channel is empty; wait in line for a sender
+		int err = t_chan_enqueue(t, ch, &ch->recvq, &ch->nrecvq);
+		if UNLIKELY(err)
+			return l_errno_error(L, -err);
+		if (!chan_read(ch->q, CHAN_TRY, &minibuf)) {
+			if (atomic_load(&ch->closed)) {
+				t_chan_dequeue(t, ch, &ch->recvq, &ch->nrecvq);
+				goto closed;
+			}
+			if UNLIKELY(t_chan_suspend(t, ch, l_chan_recv_cont) == -EDEADLK) {
+				t_chan_dequeue(t, ch, &ch->recvq, &ch->nrecvq);
+				return luaL_error(L, "deadlock detected: channel recv would never return");
+			}
+			return 0;
+		}
+		t_chan_dequeue(t, ch, &ch->recvq, &ch->nrecvq);
+	}
+
+	// free up the slot and let a waiting sender have it
+	atomic_fetch_add(&ch->nfree, 1);
+	chandata_wake_one(ch, &ch->sendq, &ch->nsendq);
+
+	// pass on a wakeup which was not acted on, e.g. by a task which was stopped
+	if (atomic_load(&ch->nfree) < ch->cap)
+		chandata_wake_one(ch, &ch->recvq, &ch->nrecvq);
+
+	int nres;
+	int status = structclone_pdecode(
+		L, minibuf->bytes, minibuf->len, StructCloneDec_PTRS, &nres);
+	if UNLIKELY(status != LUA_OK) {
+		structclone_discard(minibuf->bytes, minibuf->len);
+		free(minibuf);
+		return lua_error(L);
+	}
+	free(minibuf);
+	lua_pushboolean(L, 1);
+	return nres + 1;
+
+closed:
+	lua_pushnil(L);
+	lua_pushboolean(L, 0);
+	return 2;
+}
+
+
+// fun chan(cap uint) Channel
+// Creates a channel which buffers up to cap values.
+// A channel can be sent to other workers; values sent on it are copied like messages.
+static int l_chan(lua_State* L) {
+	lua_Integer cap = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, cap > 0 && cap <= CHAN_CAP_MAX, 1, "out of range");
+
+	ChannelData* ch = calloc(1, sizeof(ChannelData));
+	if UNLIKELY(!ch)
+		return l_errno_error(L, ENOMEM);
+	// Note: a Chan holds one value less than its capacity
+	if UNLIKELY(!( ch->q = chan_open(CEIL_POW2((u32)cap + 1), sizeof(MiniBuf*)) )) {
+		free(ch);
+		return l_errno_error(L, ENOMEM);
+	}
+	ch->refcount = 1;
+	ch->nfree = (u32)cap;
+	ch->cap = (u32)cap;
+	pthread_mutex_init(&ch->mu, NULL);
+
+	l_channel_createx(L, ch);
+	return 1;
+}
+
+
+// fun chan_send(ch Channel, v any)
+// Sends v on ch, waiting for a free slot if ch is full.
+// It is an error to send on a closed channel.
+static int l_chan_send(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	ChannelData* ch = l_chan_check(L, 1);
+	lua_settop(L, 2);
+	return l_chan_send1(L, t, ch);
+}
+
+
+// fun chan_recv(ch Channel) (v any, ok bool)
+// Receives a value from ch, waiting for one if ch is empty.
+// Returns nil, false once ch is closed and all values sent before that have been received.
+static int l_chan_recv(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	ChannelData* ch = l_chan_check(L, 1);
+	lua_settop(L, 1);
+	return l_chan_recv1(L, t, ch);
+}
+
+
+// fun chan_close(ch Channel)
+// Closes ch. Tasks waiting to send fail, tasks waiting to receive get the remaining values.
+static int l_chan_close(lua_State* L) {
+	ChannelData* ch = l_chan_check(L, 1);
+	if (atomic_exchange(&ch->closed, true))
+		return luaL_error(L, "close of closed channel");
+	chandata_wake_all(ch);
+	return 0;
+}
+
+
+static int l_channel_gc(lua_State* L) {
+	Channel* c = lua_touserdata(L, 1);
+	channeldata_release(c->data);
+	return 0;
+}
+
+
+static int l_channel_str(lua_State* L) {
+	Channel* c = lua_touserdata(L, 1);
+	lua_pushfstring(L, "Channel#%p(%d)", c->data, (int)c->data->cap);
+	return 1;
+}
+
+
+// #ch returns the number of values buffered in ch
+static int l_channel_len(lua_State* L) {
+	Channel* c = lua_touserdata(L, 1);
+	lua_pushinteger(L, c->data->cap - atomic_load(&c->data->nfree));
+	return 1;
+}
+
+
+// TOPIC_NAME_MAX is the longest topic name accepted by subscribe & publish
+#define TOPIC_NAME_MAX 256
+
+
+// topic_release_locked releases a reference to tp, freeing it if it was the last one.
+// Must be called with g_topics_mu held.
+static void topic_release_locked(Topic* tp) {
+	assert(tp->nrefs > 0);
+	if (--tp->nrefs > 0)
+		return;
+	Topic** pp = &g_topics;
+	while (*pp != tp)
+		pp = &(*pp)->next;
+	*pp = tp->next;
+	array_free((struct Array*)&tp->subs);
+	free(tp);
+}
+
+
+static void publication_release(Publication* pub) {
+	if (atomic_fetch_sub_explicit(&pub->refcount, 1, memory_order_acq_rel) > 1)
+		return;
+	if (pub->topic) {
+		pthread_mutex_lock(&g_topics_mu);
+		topic_release_locked(pub->topic);
+		pthread_mutex_unlock(&g_topics_mu);
+	}
+	structclone_discard(pub->buf->bytes, pub->buf->len);
+	free(pub->buf);
+	free(pub);
+}
+
+
+// topic_find returns the topic named name, or NULL if there is none.
+// Must be called with g_topics_mu held.
+static Topic* nullable topic_find(const char* name, usize namelen) {
+	for (Topic* tp = g_topics; tp; tp = tp->next) {
+		if (tp->namelen == namelen && memcmp(tp->name, name, namelen) == 0)
+			return tp;
+	}
+	return NULL;
+}
+
+
+// topic_get returns the topic named name, creating it if needed.
+// A new topic has no references; the caller must add one, or free it with topic_release_locked.
+// Must be called with g_topics_mu held.
+static Topic* nullable topic_get(const char* name, usize namelen) {
+	Topic* tp = topic_find(name, namelen);
+	if (tp)
+		return tp;
+	if (!( tp = calloc(1, sizeof(Topic) + namelen) ))
+		return NULL;
+	memcpy(tp->name, name, namelen);
+	tp->namelen = (u32)namelen;
+	tp->next = g_topics;
+	g_topics = tp;
+	return tp;
+}
+
+
+static const char* l_check_topic_name(lua_State* L, int idx, usize* namelenp) {
+	const char* name = luaL_checklstring(L, idx, namelenp);
+	luaL_argcheck(L, *namelenp > 0 && *namelenp <= TOPIC_NAME_MAX, idx, "invalid topic name");
+	return name;
+}
+
+
+// s_topics_unsubscribe removes subscriptions of task tid (or of all tasks if tid is 0) to
+// topic tp (or to all topics if tp is NULL.) s is removed from each topic which none of its
+// tasks subscribe to anymore.
+static void s_topics_unsubscribe(S* s, u32 tid, Topic* nullable tp) {
+	pthread_mutex_lock(&g_topics_mu);
+	u32 i = 0;
+	while (i < s->topicsubs.len) {
+		TopicSub sub = s->topicsubs.v[i];
+		if ((tid && sub.tid != tid) || (tp && sub.topic != tp)) {
+			i++;
+			continue;
+		}
+		// remove subscription (order does not matter)
+		s->topicsubs.v[i] = s->topicsubs.v[--s->topicsubs.len];
+
+		// remove s from the topic, unless another task of s subscribes to it
+		bool subscribed = false;
+		for (u32 j = 0; j < s->topicsubs.len && !subscribed; j++)
+			subscribed = s->topicsubs.v[j].topic == sub.topic;
+		if (!subscribed) {
+			Topic* topic = sub.topic;
+			for (u32 j = 0; j < topic->subs.len; j++) {
+				if (topic->subs.v[j] == s) {
+					topic->subs.v[j] = topic->subs.v[--topic->subs.len];
+					topic_release_locked(topic);
+					break;
+				}
+			}
+		}
+	}
+	pthread_mutex_unlock(&g_topics_mu);
+}
+
+
+// fun subscribe(topic string)
+// Subscribes the calling task to topic. Messages published to the topic, by any worker, are
+// received with recv as (type=5, topic string, msg... any).
+// A task is unsubscribed from all topics when it exits.
+static int l_subscribe(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	usize namelen;
+	const char* name = l_check_topic_name(L, 1, &namelen);
+	S* s = t->s;
+
+	// publishers of other workers hand off messages via s's CQ
+	int err;
+	if (s->asyncwork_cq == NULL && ( err = s_asyncwork_cq_setup(s) ))
+		return l_errno_error(L, -err);
+
+	pthread_mutex_lock(&g_topics_mu);
+	Topic* tp = topic_get(name, namelen);
+	if UNLIKELY(!tp)
+		goto oom;
+	bool subscribed = false;
+	for (u32 i = 0; i < s->topicsubs.len; i++) {
+		if (s->topicsubs.v[i].topic == tp) {
+			if (s->topicsubs.v[i].tid == t->tid) {
+				pthread_mutex_unlock(&g_topics_mu);
+				return 0;
+			}
+			subscribed = true;
+		}
+	}
+	if (!subscribed) {
+		tp->nrefs++; // released when s is removed from subs (see s_topics_unsubscribe)
+		if UNLIKELY(!array_append((struct Array*)&tp->subs, sizeof(S*), &s, 1)) {
+			topic_release_locked(tp);
+			goto oom;
+		}
+	}
+	TopicSub sub = { .topic = tp, .tid = t->tid };
+	if UNLIKELY(!array_append((struct Array*)&s->topicsubs, sizeof(sub), &sub, 1)) {
+		if (!subscribed) {
+			tp->subs.len--;
+			topic_release_locked(tp);
+		}
+		goto oom;
+	}
+	pthread_mutex_unlock(&g_topics_mu);
+	return 0;
+oom:
+	pthread_mutex_unlock(&g_topics_mu);
+	return l_errno_error(L, ENOMEM);
+}
+
+
+// fun unsubscribe(topic string) bool
+// Unsubscribes the calling task from topic. Returns false if it was not subscribed.
+// Messages which are already in the task's inbox are still delivered.
+static int l_unsubscribe(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	usize namelen;
+	const char* name = l_check_topic_name(L, 1, &namelen);
+	// look for the topic among t's subscriptions, which keep their topics alive
+	S* s = t->s;
+	for (u32 i = 0; i < s->topicsubs.len; i++) {
+		Topic* tp = s->topicsubs.v[i].topic;
+		if (s->topicsubs.v[i].tid == t->tid &&
+		    tp->namelen == namelen && memcmp(tp->name, name, namelen) == 0)
+		{
+			s_topics_unsubscribe(s, t->tid, tp);
+			lua_pushboolean(L, true);
+			return 1;
+		}
+	}
+	lua_pushboolean(L, false);
+	return 1;
+}
+
+
+// fun publish(topic string, msg... any) uint
+// Sends a message to every task subscribed to topic, in this and other workers.
+// The message is encoded once and handed to each worker by reference; receiving tasks decode
+// it when they recv it. Returns the number of schedulers (this one and workers) which have
+// subscribed tasks and were handed the message.
+static int l_publish(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	usize namelen;
+	const char* name = l_check_topic_name(L, 1, &namelen);
+	S* s = t->s;
+
+	MiniBuf* minibuf = l_encode_msg(L, s, StructCloneEnc_PTRS, lua_gettop(L) - 1); // -1: topic
+	Publication* pub = malloc(sizeof(Publication));
+	if UNLIKELY(!pub) {
+		structclone_discard(minibuf->bytes, minibuf->len);
+		free(minibuf);
+		return l_errno_error(L, ENOMEM);
+	}
+	pub->refcount = 1; // our reference, released below
+	pub->buf = minibuf;
+	pub->topic = NULL;
+
+	// Take a snapshot of the subscribers, so that no lock is held while writing to their CQs,
+	// which may block. Workers are retained to keep their S valid.
+	S* subs_storage[16];
+	S** subs = subs_storage;
+	u32 nsubs = 0;
+	pthread_mutex_lock(&g_topics_mu);
+	Topic* tp = topic_find(name, namelen);
+	if (tp) {
+		pub->topic = tp;
+		tp->nrefs++; // released by publication_release
+		nsubs = tp->subs.len;
+	}
+	if UNLIKELY(nsubs > countof(subs_storage) && !( subs = malloc(sizeof(S*) * nsubs) )) {
+		pthread_mutex_unlock(&g_topics_mu);
+		publication_release(pub);
+		return l_errno_error(L, ENOMEM);
+	}
+	for (u32 i = 0; i < nsubs; i++) {
+		subs[i] = pub->topic->subs.v[i];
+		if (subs[i] != s && subs[i]->isworker)
+			worker_retain(&s_worker(subs[i])->w);
+	}
+	pthread_mutex_unlock(&g_topics_mu);
+
+	// deliver messages sent earlier by this S first, to preserve send order
+	if (nsubs > 0)
+		s_outbox_flush(s);
+
+	u32 nsent = 0;
+	for (u32 i = 0; i < nsubs; i++) {
+		S* dst_s = subs[i];
+		if (dst_s == s) {
+			s_recv_publication(s, pub, s->sid);
+			nsent++;
+			continue;
+		}
+		if (!dst_s->isworker ||
+		    atomic_load_explicit(&s_worker(dst_s)->w.status, memory_order_acquire) != Worker_CLOSED)
+		{
+			atomic_fetch_add_explicit(&pub->refcount, 1, memory_order_relaxed);
+			AsyncWorkRes res = { .op = AsyncWorkOp_PUBLISH, .tid = s->sid, .result = (uintptr)pub };
+			if (chan_write(dst_s->asyncwork_cq, 0, &res)) {
+				s_notify(dst_s, S_NOTE_ASYNCWORK);
+				nsent++;
+			} else {
+				publication_release(pub); // CQ closed; worker has exited
+			}
+		}
+		if (dst_s->isworker && !atomic_load_explicit(&g_exiting, memory_order_acquire))
+			worker_release(&s_worker(dst_s)->w);
+	}
+	if (subs != subs_storage)
+		free(subs);
+
+	publication_release(pub);
+	lua_pushinteger(L, nsent);
+	return 1;
 }
 
 
@@ -3301,6 +5536,10 @@ static int l_await_remotetask(lua_State* L) {
 	if UNLIKELY(local_t)
 		return l_await_task(L);
 
+	// only the main task of a worker can be awaited, since it's linked to the worker's lifetime
+	if UNLIKELY(!dst_s->isworker || dst_tid != 1)
+		return luaL_error(L, "attempt to await task of a different Worker");
+
 	// add t to list of tasks waiting for worker uw to exit
 	UWorker* uw = s_worker(dst_s);
 	if (worker_add_waiter((Worker*)uw, t)) {
@@ -3321,18 +5560,594 @@ static int l_await(lua_State* L) {
 }
 
 
+// l_await_set_result pushes the result of the event of node n, as returned by await().
+// Returns the number of values pushed.
+static int l_await_set_result(lua_State* L, T* t, TWaitNode* n) {
+	if (n->kind == TWaitKind_WORKER)
+		return l_await_remotetask_cont1(L, n->target);
+	if (n->target)
+		return l_await_task_cont1(L, t, n->target);
+	// task (GTID) no longer exists
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+
+static int l_await_set_cont(lua_State* L, int ltstatus, void* arg) {
+	// stack: [tasks, ws, anchors]
+	TWaitSet* ws = arg;
+	T* t = ws->t;
+	int nres;
+	if (ws->any) {
+		assert(ws->first > 0);
+		lua_pushinteger(L, ws->first);
+		nres = 1 + l_await_set_result(L, t, &ws->nodes[ws->first - 1]);
+	} else {
+		lua_createtable(L, ws->len, 0);
+		int restab = lua_gettop(L);
+		for (u32 i = 0; i < ws->len; i++) {
+			int n = l_await_set_result(L, t, &ws->nodes[i]);
+			lua_createtable(L, n, 0);
+			lua_insert(L, -1 - n);
+			for (int j = n; j > 0; j--)
+				lua_rawseti(L, restab + 1, j);
+			lua_rawseti(L, restab, i + 1);
+		}
+		nres = 1;
+	}
+	t_waitset_release(ws);
+	return nres;
+}
+
+
+// l_waitset_check_task resolves the task value at the top of L's stack for node n.
+// If the value is a GTID of a local task, it is replaced with the task's thread (anchoring it.)
+static void l_waitset_check_task(lua_State* L, T* t, TWaitNode* n) {
+	T* other_t;
+	if (lua_isthread(L, -1)) {
+		other_t = l_check_task(L, -1);
+	} else {
+		// accept RemoteTask (worker) or GTID integer
+		u32 tid;
+		S* dst_s = l_check_anytask(L, lua_gettop(L), &other_t, &tid);
+		if (other_t) {
+			lua_pop(L, 1);
+			lua_pushthread(t_L(other_t));
+			lua_xmove(t_L(other_t), L, 1);
+		} else if (dst_s) {
+			if UNLIKELY(!dst_s->isworker || tid != 1 || s_worker(dst_s)->w.s != t->s)
+				luaL_error(L, "attempt to await task of a different Worker");
+			n->kind = TWaitKind_WORKER;
+			n->target = s_worker(dst_s);
+			return;
+		} // else: task no longer exists
+	}
+	if (other_t) {
+		if UNLIKELY(t == other_t)
+			luaL_error(L, "attempt to 'await' itself");
+		if UNLIKELY(other_t->s != t->s)
+			luaL_error(L, "attempt to await task of a different Worker");
+	}
+	n->kind = TWaitKind_TASK;
+	n->target = other_t;
+}
+
+
+// t_waitset_link_task adds n to the list of waiters of its task or worker.
+// Returns false if the task or worker has already exited.
+static bool t_waitset_link_task(TWaitNode* n) {
+	if (n->kind == TWaitKind_WORKER) {
+		Worker* w = n->target;
+		worker_retain(w); // released by t_waitset_release
+		if (atomic_load_explicit(&w->status, memory_order_acquire) == Worker_CLOSED)
+			return false;
+		n->next = w->mwaiters;
+		w->mwaiters = n;
+	} else {
+		T* other_t = n->target;
+		if (other_t == NULL || other_t->status == T_DEAD)
+			return false;
+		n->next = other_t->mwaiters;
+		other_t->mwaiters = n;
+	}
+	n->linked = true;
+	return true;
+}
+
+
+// l_waitset_new pushes a new wait set with room for len nodes onto L's stack.
+// Its memory remains valid while t is suspended since it's on t's stack.
+static TWaitSet* l_waitset_new(lua_State* L, T* t, u32 len) {
+	usize size = sizeof(TWaitSet) + (usize)len*sizeof(TWaitNode);
+	TWaitSet* ws = lua_newuserdatauv(L, size, 0);
+	memset(ws, 0, size);
+	ws->t = t;
+	ws->len = len;
+	for (u32 i = 0; i < len; i++)
+		ws->nodes[i].ws = ws;
+	return ws;
+}
+
+
+static int l_await_set(lua_State* L, bool any) {
+	T* t = REQUIRE_TASK(L);
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_settop(L, 1);
+	lua_Unsigned len = lua_rawlen(L, 1);
+	if UNLIKELY(len == 0 || len > INT_MAX)
+		return luaL_argerror(L, 1, len ? "too many tasks" : "empty list");
+
+	// Targets are kept alive by "anchors", a copy of the list of tasks
+	TWaitSet* ws = l_waitset_new(L, t, (u32)len);
+	ws->any = any;
+	lua_createtable(L, (int)len, 0); // anchors
+
+	// resolve targets. Note: this may raise errors, so don't link anything yet
+	for (u32 i = 0; i < ws->len; i++) {
+		lua_rawgeti(L, 1, i + 1);
+		l_waitset_check_task(L, t, &ws->nodes[i]);
+		lua_rawseti(L, 3, i + 1);
+	}
+
+	// register t as a waiter on every target which has not yet exited
+	u32 nlinked = 0;
+	for (u32 i = 0; i < ws->len; i++) {
+		if (t_waitset_link_task(&ws->nodes[i])) {
+			nlinked++;
+		} else if (ws->first == 0) {
+			ws->first = i + 1;
+		}
+	}
+
+	if (nlinked == 0 || (any && ws->first)) {
+		// nothing to wait for
+		return l_await_set_cont(L, LUA_OK, ws);
+	}
+	ws->nwait = any ? 1 : nlinked;
+
+	t->info.wait_set.ws = ws;
+	t->resume_nres = 0;
+	return t_suspend(t, T_WAIT_SET, ws, l_await_set_cont);
+}
+
+
+// fun await_all(tasks [Task|RemoteTask]) [[any]]
+// Waits for all tasks to exit. Returns a list with one entry for each task, in the same order
+// as tasks, where each entry is a list of the values await(task) would return.
+static int l_await_all(lua_State* L) {
+	return l_await_set(L, false);
+}
+
+
+// fun await_any(tasks [Task|RemoteTask]) (i uint, ... any)
+// Waits for any of tasks to exit. Returns the index in tasks of the task that exited first,
+// followed by the values await(tasks[i]) would return.
+static int l_await_any(lua_State* L) {
+	return l_await_set(L, true);
+}
+
+
+static T* l_select_timeout(Timer* timer, void* arg) {
+	T* t = arg;
+	t_waitset_wake_kind(t, TWaitKind_TIMER, timer, STWake_TIMER, 0);
+	return NULL; // t_waitset_wake_kind has put t on the runq
+}
+
+
+static int l_select_cont(lua_State* L, int ltstatus, void* arg) {
+	TWaitSet* ws = arg;
+	u32 first = ws->first;
+	if (ws->nodes[first - 1].kind == TWaitKind_TIMER)
+		first = 0; // timed out
+	t_waitset_release(ws);
+	lua_pushinteger(L, first);
+	return 1;
+}
+
+
+// fun select(sources [Task|RemoteTask|FD|"recv"], timeout TimeDuration = -1) int
+// Waits for the first of several events to occur:
+// - Task or RemoteTask: the task has exited (await will not block)
+// - FD: the file descriptor is readable (read will not block)
+// - "recv": there's a message in the inbox of the calling task (recv will not block)
+// Returns the index in sources of the first source that is ready,
+// or 0 if timeout (if >=0) expired before any source became ready.
+static int l_select(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	luaL_checktype(L, 1, LUA_TTABLE);
+	DTimeDuration timeout = luaL_optinteger(L, 2, -1);
+	lua_settop(L, 1);
+	lua_Unsigned len = lua_rawlen(L, 1);
+	if UNLIKELY(len > INT_MAX - 1)
+		return luaL_argerror(L, 1, "too many sources");
+
+	// one extra node for the timeout
+	TWaitSet* ws = l_waitset_new(L, t, (u32)len + (timeout > 0));
+	ws->any = true;
+
+	// resolve sources. Note: this may raise errors, so don't link anything yet
+	for (u32 i = 0; i < (u32)len; i++) {
+		TWaitNode* n = &ws->nodes[i];
+		int typ = lua_rawgeti(L, 1, i + 1);
+		if (typ == LUA_TSTRING) {
+			if UNLIKELY(strcmp(lua_tostring(L, -1), "recv") != 0)
+				return luaL_error(L, "invalid select source #%d", (int)i + 1);
+			n->kind = TWaitKind_RECV;
+			n->target = t;
+		} else if (typ == LUA_TUSERDATA &&
+		           ((UVal*)lua_touserdata(L, -1))->type == UValType_IODesc)
+		{
+			IODesc* d = l_iodesc_check(L, -1);
+			if UNLIKELY(d->fd < 0)
+				return luaL_error(L, "select source #%d: file is closed", (int)i + 1);
+			if UNLIKELY(d->t != NULL && d->t != t)
+				return luaL_error(L, "select source #%d: already waited on by another task",
+				                  (int)i + 1);
+			n->kind = TWaitKind_IO;
+			n->target = d;
+		} else {
+			// Note: local tasks addressed by GTID are kept alive by S while they are running
+			l_waitset_check_task(L, t, n);
+		}
+		lua_pop(L, 1);
+	}
+
+	// register t with every source, or stop at the first source which is already ready
+	for (u32 i = 0; i < (u32)len && ws->first == 0; i++) {
+		TWaitNode* n = &ws->nodes[i];
+		switch ((enum TWaitKind)n->kind) {
+		case TWaitKind_TASK:
+		case TWaitKind_WORKER:
+			if (!t_waitset_link_task(n))
+				ws->first = i + 1;
+			break;
+		case TWaitKind_RECV:
+			if (!inbox_isempty(t->inbox)) {
+				ws->first = i + 1;
+			} else {
+				n->linked = true;
+			}
+			break;
+		case TWaitKind_IO:
+			if (iodesc_readable(n->target)) {
+				ws->first = i + 1;
+			} else {
+				((IODesc*)n->target)->t = t;
+				n->linked = true;
+			}
+			break;
+		case TWaitKind_TIMER:
+			unreachable();
+		}
+	}
+	if (ws->first || timeout == 0) {
+		t_waitset_release(ws);
+		lua_pushinteger(L, ws->first);
+		return 1;
+	}
+
+	if (timeout > 0) {
+		if UNLIKELY(++t->ntimers == 0) {
+			t->ntimers--;
+			t_waitset_release(ws);
+			return luaL_error(L, "too many concurrent timers (%d)", t->ntimers);
+		}
+		DTime when = DTimeNow() + timeout;
+		Timer* timer = s_timer_start(t->s, when, 0, -1, t, l_select_timeout);
+		if UNLIKELY(!timer) {
+			t->ntimers--;
+			t_waitset_release(ws);
+			return l_errno_error(L, ENOMEM);
+		}
+		TWaitNode* n = &ws->nodes[len];
+		n->kind = TWaitKind_TIMER;
+		n->target = timer;
+		n->linked = true;
+	} else if UNLIKELY(len == 0) {
+		return luaL_error(L, "deadlock detected: select would never return");
+	}
+
+	ws->nwait = 1;
+	t->info.wait_set.ws = ws;
+	t->resume_nres = 0;
+	return t_suspend(t, T_WAIT_SET, ws, l_select_cont);
+}
+
+
+// TaskBlockHandle is returned by taskblock_begin
+typedef struct TaskBlockHandle {
+	u32 tid; // task which opened the block
+	u32 id;  // TaskBlock.id
+} TaskBlockHandle;
+
+
+// fun taskblock_begin() TaskBlock
+// Opens a task block. Tasks spawned by the calling task until the matching call to
+// taskblock_end are members of the block.
+// Returns a handle which can be used as a to-be-closed variable, which closes the block if it
+// is still open when the variable goes out of scope, e.g. because of an error:
+//   local tb <close> = taskblock_begin()
 static int l_taskblock_begin(lua_State* L) {
 	T* t = REQUIRE_TASK(L);
-	trace_sched("taskblock_begin");
-	// TODO
-	return t_yield(t, 0);
+	trace_sched(T_ID_F " taskblock_begin", t_id(t));
+	TaskBlockHandle* h = lua_newuserdatauv(L, sizeof(TaskBlockHandle), 0);
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &g_taskblock_luatabkey);
+	lua_setmetatable(L, -2);
+	TaskBlock* tb = calloc(1, sizeof(TaskBlock));
+	if UNLIKELY(!tb)
+		return l_errno_error(L, ENOMEM);
+	tb->errref = LUA_NOREF;
+	tb->id = ++t->s->tblock_idgen;
+	tb->outer = t->tblock;
+	t->tblock = tb;
+	h->tid = t->tid;
+	h->id = tb->id;
+	return 1;
 }
 
 
+// __close of the handle returned by taskblock_begin.
+// If the block is still open, it is closed along with any blocks nested in it, stopping their
+// members which are still running. The error of a member which failed is raised, unless the
+// variable is closed because of another error, in which case it is reported as uncaught.
+static int l_taskblock_close(lua_State* L) {
+	TaskBlockHandle* h = lua_touserdata(L, 1);
+	T* t = REQUIRE_TASK(L);
+	if UNLIKELY(t->tid != h->tid)
+		return luaL_error(L, "task block closed by another task");
+	TaskBlock* tb = t->tblock;
+	while (tb && tb->id != h->id)
+		tb = tb->outer;
+	if (!tb) // already closed by taskblock_end
+		return 0;
+	int errref = LUA_NOREF;
+	for (;;) {
+		tb = t->tblock;
+		t_taskblock_stop(t, tb);
+		if (errref == LUA_NOREF) {
+			errref = tb->errref;
+			tb->errref = LUA_NOREF;
+		}
+		u32 id = tb->id;
+		t_taskblock_pop(t);
+		if (id == h->id)
+			break;
+	}
+	if (errref == LUA_NOREF)
+		return 0;
+	if (!lua_isnil(L, 2)) {
+		t_taskblock_report_error(t, errref);
+		return 0;
+	}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, errref);
+	luaL_unref(L, LUA_REGISTRYINDEX, errref);
+	return lua_error(L);
+}
+
+
+static int l_taskblock_end_cont(lua_State* L, int ltstatus, void* nullable arg) {
+	T* t = L_t(L);
+	if (arg)
+		t_waitset_release(arg);
+	TaskBlock* tb = t->tblock;
+	int errref = tb->errref;
+	tb->errref = LUA_NOREF;
+	t_taskblock_pop(t);
+	if (errref == LUA_NOREF)
+		return 0;
+	// raise the error of the member which failed
+	lua_rawgeti(L, LUA_REGISTRYINDEX, errref);
+	luaL_unref(L, LUA_REGISTRYINDEX, errref);
+	return lua_error(L);
+}
+
+
+// fun taskblock_end(stop bool = false)
+// Closes the innermost task block opened by the calling task, waiting for all of its members
+// to exit, or stopping them if stop is true.
+// If a member fails with an error, the other members are stopped and the error is raised.
 static int l_taskblock_end(lua_State* L) {
 	T* t = REQUIRE_TASK(L);
-	trace_sched("taskblock_end");
-	return t_yield(t, 0);
+	trace_sched(T_ID_F " taskblock_end", t_id(t));
+	TaskBlock* tb = t->tblock;
+	if UNLIKELY(!tb)
+		return luaL_error(L, "taskblock_end without taskblock_begin");
+	bool stop = lua_toboolean(L, 1);
+	lua_settop(L, 0);
+
+	if (stop) {
+		t_taskblock_stop(t, tb);
+		return l_taskblock_end_cont(L, LUA_OK, NULL);
+	}
+
+	// wait for all members which are still running
+	u32 nlive = 0;
+	for (u32 i = 0; i < tb->len; i++) {
+		T* member = s_task_checked(t->s, tb->tids[i]);
+		if (member && member->status != T_DEAD)
+			tb->tids[nlive++] = tb->tids[i];
+	}
+	tb->len = nlive;
+	if (nlive == 0)
+		return l_taskblock_end_cont(L, LUA_OK, NULL);
+	TWaitSet* ws = l_waitset_new(L, t, nlive);
+	for (u32 i = 0; i < nlive; i++) {
+		TWaitNode* n = &ws->nodes[i];
+		n->kind = TWaitKind_TASK;
+		n->target = s_task(t->s, tb->tids[i]);
+		bool ok = t_waitset_link_task(n);
+		assert(ok);
+	}
+	ws->nwait = nlive;
+	t->info.wait_set.ws = ws;
+	t->resume_nres = 0;
+	return t_suspend(t, T_WAIT_SET, ws, l_taskblock_end_cont);
+}
+
+
+// fun worker_placement(policy "none"|"core" = nil) (prev_policy string)
+// Sets the runtime-wide policy for where user workers' threads run.
+// "core" pins each new worker to the next physical core (round-robin), unless the worker
+// is spawned with explicit CPUs. "none" lets the OS decide (the default.)
+// Returns the previous policy.
+static int l_worker_placement(lua_State* L) {
+	static const char* const names[] = { "none", "core", NULL };
+	u8 prev = atomic_load_explicit(&g_worker_placement_policy, memory_order_relaxed);
+	if (!lua_isnoneornil(L, 1)) {
+		u8 policy = (u8)luaL_checkoption(L, 1, NULL, names);
+		#if !defined(__linux__)
+		if (policy != WorkerPlacementPolicy_NONE)
+			return l_errno_error(L, ENOTSUP);
+		#endif
+		atomic_store_explicit(&g_worker_placement_policy, policy, memory_order_relaxed);
+	}
+	lua_pushstring(L, names[prev]);
+	return 1;
+}
+
+
+// fun sched_spin(max uint = nil) (prev_max, hits, misses uint)
+// Sets the maximum number of iterations the current S spins, waiting for events from other
+// threads, before blocking in iopoll. 0 disables spinning. The default is 0 on single-CPU
+// systems. Returns the previous max, and how many times spinning found work ("hits") vs how
+// many times S blocked after spinning ("misses").
+static int l_sched_spin(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	S* s = t->s;
+	lua_pushinteger(L, s->spin_max);
+	lua_pushinteger(L, s->spin_hits);
+	lua_pushinteger(L, s->spin_misses);
+	if (!lua_isnoneornil(L, 1)) {
+		lua_Integer max = luaL_checkinteger(L, 1);
+		luaL_argcheck(L, max >= 0 && max <= U32_MAX, 1, "out of range");
+		s->spin_max = s->spin_limit = (u32)max;
+	}
+	return 3;
+}
+
+
+// fun asyncwork_pool(opts {min, max uint, idle_timeout TimeDuration} = nil) {...}
+// Configures the pool of threads which the current S uses for blocking work, like
+// syscall_addrinfo. Threads are started on demand, up to max, after which requests wait in
+// a queue for a thread to become available. Threads which have been idle for idle_timeout
+// exit, down to min (idle_timeout=0 keeps them forever.) Raising min starts threads right away.
+// Returns the current configuration and metrics as a table:
+//   min, max, idle_timeout -- configuration
+//   nworkers               -- number of threads
+//   nbusy                  -- number of threads performing work
+//   queued                 -- number of requests waiting for a thread
+//   queued_max             -- highest number of requests which have waited at the same time
+//   nspawned, nreaped      -- number of threads started, and stopped for being idle
+static int l_asyncwork_pool(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	S* s = t->s;
+	if (!lua_isnoneornil(L, 1)) {
+		luaL_checktype(L, 1, LUA_TTABLE);
+		lua_Integer min = s->asyncwork_min, max = s->asyncwork_max;
+		DTimeDuration idle_timeout = s->asyncwork_idle_timeout;
+		if (lua_getfield(L, 1, "min") != LUA_TNIL)
+			min = luaL_checkinteger(L, -1);
+		if (lua_getfield(L, 1, "max") != LUA_TNIL)
+			max = luaL_checkinteger(L, -1);
+		if (lua_getfield(L, 1, "idle_timeout") != LUA_TNIL)
+			idle_timeout = luaL_checkinteger(L, -1);
+		lua_pop(L, 3);
+		if (max < 1 || max > ASYNCWORK_MAX_NWORKERS)
+			return luaL_error(L, "max out of range");
+		if (min < 0 || min > max)
+			return luaL_error(L, "min out of range");
+		if (idle_timeout < 0)
+			return luaL_error(L, "idle_timeout out of range");
+
+		s->asyncwork_min = (u32)min;
+		s->asyncwork_max = (u32)max;
+		s->asyncwork_idle_timeout = idle_timeout;
+		for (u32 i = 0; i < s->asyncwork_nworkers; i++) {
+			atomic_store_explicit(
+				&s->asyncwork_workers[i]->idle_timeout, idle_timeout, memory_order_relaxed);
+		}
+
+		// start threads for min and for requests which are waiting for one
+		AWorker* aw;
+		int err;
+		while (s->asyncwork_nworkers < s->asyncwork_max &&
+		       (s->asyncwork_nworkers < s->asyncwork_min || s_asyncwork_backlog_len(s) > 0))
+		{
+			if UNLIKELY(( err = s_asyncwork_spawn_worker(s, &aw) ))
+				return l_errno_error(L, -err);
+			AsyncWorkReq* req = s_asyncwork_backlog_pop(s);
+			if (req)
+				s_asyncwork_submit(s, aw, req);
+		}
+
+		// stop idle threads in excess of max
+		if (s->asyncwork_nworkers > s->asyncwork_max)
+			s_asyncwork_reap(s);
+	}
+
+	u32 nbusy = 0;
+	for (u32 i = 0; i < s->asyncwork_nworkers; i++)
+		nbusy += s->asyncwork_workers[i]->nqueued > 0;
+
+	lua_createtable(L, 0, 9);
+	#define F(NAME, VALUE) (lua_pushinteger(L, (lua_Integer)(VALUE)), lua_setfield(L, -2, NAME))
+	F("min", s->asyncwork_min);
+	F("max", s->asyncwork_max);
+	F("idle_timeout", s->asyncwork_idle_timeout);
+	F("nworkers", s->asyncwork_nworkers);
+	F("nbusy", nbusy);
+	F("queued", s_asyncwork_backlog_len(s));
+	F("queued_max", s->asyncwork_backlog_max);
+	F("nspawned", s->asyncwork_nspawned);
+	F("nreaped", s->asyncwork_nreaped);
+	#undef F
+	return 1;
+}
+
+
+// fun schedtrace_start(cap uint = 65536)
+// Starts recording scheduler events of the current task's S into a ring buffer of cap records.
+// Any previously recorded events are discarded.
+static int l_schedtrace_start(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	lua_Integer cap = luaL_optinteger(L, 1, 65536);
+	if (cap < 1 || cap > 0x80000000)
+		return luaL_error(L, "invalid capacity %I", cap);
+	SchedTrace* st = schedtrace_open((u32)cap);
+	if (!st)
+		return l_errno_error(L, ENOMEM);
+	schedtrace_close(t->s->trace);
+	t->s->trace = st;
+	return 0;
+}
+
+
+// fun schedtrace_stop()
+static int l_schedtrace_stop(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	schedtrace_close(t->s->trace);
+	t->s->trace = NULL;
+	return 0;
+}
+
+
+// fun schedtrace_dump() str|nil
+// Returns the events recorded by the current task's S as Chrome trace JSON,
+// or nil if tracing is not enabled.
+static int l_schedtrace_dump(lua_State* L) {
+	T* t = REQUIRE_TASK(L);
+	if (t->s->trace == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	Buf buf = {};
+	if (!schedtrace_json(t->s->trace, t->s->sid, &buf)) {
+		buf_free(&buf);
+		return l_errno_error(L, ENOMEM);
+	}
+	lua_pushlstring(L, (const char*)buf.bytes, buf.len);
+	buf_free(&buf);
+	return 1;
 }
 
 
@@ -3393,6 +6208,11 @@ static const luaL_Reg dew_lib[] = {
 	{"main", l_main},
 	{"spawn_task", l_spawn_task},
 	{"spawn_worker", l_spawn_worker},
+	{"spawn_worker_pool", l_spawn_worker_pool},
+	{"worker_prewarm", l_worker_prewarm},
+	{"pool_broadcast", l_pool_broadcast},
+	{"pool_resize", l_pool_resize},
+	{"pool_workers", l_pool_workers},
 	{"yield", l_yield},
 	{"sleep", l_sleep},
 	{"socket", l_socket},
@@ -3402,24 +6222,43 @@ static const luaL_Reg dew_lib[] = {
 	{"buf_create", l_buf_create},
 	{"buf_resize", l_buf_resize},
 	{"buf_str", l_buf_str},
+	{"sharedbuf_create", l_sharedbuf_create},
 
 	{"timer_start", l_timer_start},
 	{"timer_update", l_timer_update},
 	{"timer_stop", l_timer_stop},
 
 	{"await", l_await},
+	{"await_all", l_await_all},
+	{"await_any", l_await_any},
+	{"select", l_select},
 	{"recv", l_recv},
 	{"send", l_send},
+	{"send_transfer", l_send_transfer},
 	{"tid", l_tid},
+	{"chan", l_chan},
+	{"chan_send", l_chan_send},
+	{"chan_recv", l_chan_recv},
+	{"chan_close", l_chan_close},
+	{"subscribe", l_subscribe},
+	{"unsubscribe", l_unsubscribe},
+	{"publish", l_publish},
 
 	{"structclone_encode", l_structclone_encode},
 	{"structclone_decode", l_structclone_decode},
 
+	{"sched_spin", l_sched_spin},
+	{"asyncwork_pool", l_asyncwork_pool},
+	{"worker_placement", l_worker_placement},
+	{"schedtrace_start", l_schedtrace_start},
+	{"schedtrace_stop", l_schedtrace_stop},
+	{"schedtrace_dump", l_schedtrace_dump},
+
 	// potentially long-time blocking syscalls, performed in worker thread pool
 	{"syscall_nanosleep", l_syscall_nanosleep},
 	{"syscall_addrinfo", l_syscall_addrinfo},
 
-	// WIP
+	// structured task groups
 	{"taskblock_begin", l_taskblock_begin},
 	{"taskblock_end", l_taskblock_end},
 
@@ -3459,6 +6298,12 @@ int luaopen_runtime(lua_State* L) {
 	lua_setfield(L, -2, "__gc");
 	lua_rawsetp(L, LUA_REGISTRYINDEX, &g_timerobj_luatabkey);
 
+	// TaskBlock
+	luaL_newmetatable(L, "TaskBlock");
+	lua_pushcfunction(L, l_taskblock_close);
+	lua_setfield(L, -2, "__close");
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &g_taskblock_luatabkey);
+
 	// Worker
 	luaL_newmetatable(L, "Worker");
 	lua_pushcfunction(L, l_uworker_uval_gc);
@@ -3475,6 +6320,34 @@ int luaopen_runtime(lua_State* L) {
     lua_setfield(L, -2, "__tostring");
 	lua_rawsetp(L, LUA_REGISTRYINDEX, &g_remotetask_luatabkey);
 
+	// WorkerPool
+	luaL_newmetatable(L, "WorkerPool");
+	lua_pushcfunction(L, l_workerpool_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_pushcfunction(L, l_workerpool_str);
+	lua_setfield(L, -2, "__tostring");
+	lua_pushcfunction(L, l_workerpool_len);
+	lua_setfield(L, -2, "__len");
+	lua_pop(L, 1);
+
+	// Channel
+	luaL_newmetatable(L, "Channel");
+	lua_pushcfunction(L, l_channel_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_pushcfunction(L, l_channel_str);
+	lua_setfield(L, -2, "__tostring");
+	lua_pushcfunction(L, l_channel_len);
+	lua_setfield(L, -2, "__len");
+	lua_createtable(L, 0, 3);
+	lua_pushcfunction(L, l_chan_send);
+	lua_setfield(L, -2, "send");
+	lua_pushcfunction(L, l_chan_recv);
+	lua_setfield(L, -2, "recv");
+	lua_pushcfunction(L, l_chan_close);
+	lua_setfield(L, -2, "close");
+	lua_setfield(L, -2, "__index");
+	lua_pop(L, 1);
+
 	// export libc & syscall constants
 	#define _(NAME) \
 		lua_pushinteger(L, NAME); \
@@ -6,6 +6,7 @@
 #include "fifo.h"
 #include "iopoll.h"
 #include "inbox.h"
+#include "schedtrace.h"
 
 API_BEGIN
 
@@ -13,8 +14,17 @@ typedef struct S    S;    // scheduler (M+P in Go lingo)
 typedef struct T    T;    // task
 typedef struct RunQ RunQ; // run queue (FIFO)
 
-// Worker forward declaration since S uses Worker
-typedef struct Worker Worker;
+// Worker forward declarations since S uses Worker
+typedef struct Worker  Worker;
+typedef struct AWorker AWorker;
+
+typedef struct Topic Topic; // named destination for publish (see worker.h)
+
+// TopicSub is a subscription of a task to a topic (S.topicsubs)
+typedef struct TopicSub {
+	Topic* topic;
+	u32    tid;
+} TopicSub;
 
 struct RunQ {
 	FIFO fifo;
@@ -30,6 +40,8 @@ enum TStatus {
 	T_WAIT_TASK,   // suspended, waiting for a task to exit
 	T_WAIT_WORKER, // suspended, waiting for a worker to exit
 	T_WAIT_ASYNC,  // suspended, waiting for an async operation (e.g. syscall) to finish
+	T_WAIT_SET,    // suspended, waiting for one or all of several events (info.wait_set)
+	T_WAIT_CHAN,   // suspended, waiting to send to or receive from a channel (T.chan)
 	T_DEAD,        // dead
 };
 
@@ -39,11 +51,19 @@ enum TDied {
 	TDied_STOP,  // stopped by parent task
 };
 
-struct T {
-	S*              s;     // owning S
-	Inbox* nullable inbox; // message queue
+typedef struct TWaitSet  TWaitSet;
+typedef struct TWaitNode TWaitNode;
+typedef struct TaskBlock TaskBlock;
 
-	u32 tid;   // task identifier (with embedded generation value)
+struct T {
+	S*                   s;        // owning S
+	Inbox* nullable      inbox;    // message queue
+	TWaitNode* nullable  mwaiters; // list of T_WAIT_SET tasks waiting for this task to exit
+	TaskBlock* nullable  tblock;   // innermost task block opened by this task
+	lua_State* nullable  stash;    // payload of buffered messages (see t_stash)
+	struct ChannelData* nullable chan; // channel waited for, until resumed (retained)
+
+	u32 tid;   // task identifier (index and generation; see TID_IDX_BITS)
 	u32 nrefs; // references to task (when 0, T may be GC'd)
 
 	u8  status;      // T_ constant (enum TStatus)
@@ -68,20 +88,65 @@ struct T {
 		struct { // T_WAIT_ASYNC
 			i64 result;
 		} wait_async;
+		struct { // T_WAIT_SET
+			TWaitSet* ws;
+		} wait_set;
 		struct { // T_DEAD
 			u8 how; // TDied_ constant
 			// Note: Must not overlay wait_task.wait_tid.
 			// Even though a task may be T_DEAD, its memory is still valid b/c GC refs.
 		} dead;
+		struct { // GC'd; memory kept for reuse (S.tfree)
+			T* next; // link to next task in S.tfree list
+		} free;
 		u64 _align;
 	} info;
 
 	// rest of struct is a lua_State struct
 };
 
+enum TWaitKind {
+	TWaitKind_TASK,   // exit of a task of the same S (T.mwaiters)
+	TWaitKind_WORKER, // exit of a worker spawned by the same S (Worker.mwaiters)
+	TWaitKind_RECV,   // message in the inbox of the waiting task (target is the waiting T)
+	TWaitKind_IO,     // file descriptor is readable (target is IODesc, IODesc.t)
+	TWaitKind_TIMER,  // timeout (target is Timer)
+};
+
+// TWaitNode links a T_WAIT_SET task into the list of waiters of one of the things it waits for
+struct TWaitNode {
+	TWaitNode* nullable next;   // next node in list of waiters
+	TWaitSet*           ws;     // set this node belongs to
+	void* nullable      target; // T, Worker, IODesc or Timer, depending on kind
+	u8                  kind;   // enum TWaitKind
+	bool                linked; // node is in target's list of waiters
+};
+
+// TWaitSet holds the state of a task waiting for several things at once (T_WAIT_SET)
+struct TWaitSet {
+	T*        t;     // waiting task
+	u32       nwait; // number of events still to occur before t is woken
+	u32       first; // index+1 of node which event occurred first (0 if none yet)
+	u32       len;   // number of nodes
+	bool      any;   // wake on first event (await_any) rather than on all events
+	TWaitNode nodes[];
+};
+
+// TaskBlock is a group of tasks spawned by a task between taskblock_begin and taskblock_end
+struct TaskBlock {
+	TaskBlock* nullable outer;  // enclosing block of the same task
+	u32* nullable       tids;   // member tasks (may include tasks which have exited)
+	u32                 len;    // number of entries in tids
+	u32                 cap;    // capacity of tids
+	int                 errref; // Lua registry ref to error of first member that failed
+	u32                 id;     // identifies the block to its handle (see taskblock_begin)
+};
+
 enum { // S.notes
 	S_NOTE_WEXIT     = 1u<<0, // a worker spawned by this S has exited
 	S_NOTE_ASYNCWORK = 1u<<1, // a worker completed AsyncWorkReq
+	S_NOTE_AWIDLE    = 1u<<2, // an asyncwork worker has been idle for a while (see s_asyncwork_reap)
+	S_NOTE_WARMFILL  = 1u<<3, // a pre-warmed worker was handed out (see s_warm_fill)
 };
 
 struct S {
@@ -91,10 +156,14 @@ struct S {
 	u32           sid;
 	u32           nlive;     // number of live (not T_DEAD) tasks
 	_Atomic(bool) isclosed;  // true when the parent worker is shutting down
-	_Atomic(u8)   notes;     // events from a worker (e.g. worker exited; S_NOTE_ bits)
+	_Atomic(u8)   notes;     // events from a worker (e.g. worker exited) or deferred work (S_NOTE_ bits)
 	bool          exiterr;   // true if S ended because of a runtime error
 	bool          doexit;    // call exit(exiterr) when S ends
 	bool          isworker;  // true if S is part of a Worker
+	_Atomic(bool) ispolling; // true while S is (about to be) blocked in iopoll (see s_notify)
+
+	T* nullable tfree;     // free list of GC'd tasks, which Lua threads can be reused
+	u32         tfree_len; // number of tasks in 'tfree' list
 
 	RunQ*       runq;    // queue of tasks ready to run; a circular buffer
 	T* nullable runnext; // task to be run immediately, skipping runq
@@ -105,23 +174,59 @@ struct S {
 	// workers spawned by this S
 	Worker* nullable workers; // list
 
-	// asyncwork threads
-	u32            asyncwork_nworkers; // number of live workers (monotonic)
-	_Atomic(u32)   asyncwork_nreqs;    // number of pending work requests
-	Chan* nullable asyncwork_sq;       // submission queue
-	Chan* nullable asyncwork_cq;       // completion queue, also used for cross-worker send/recv
+	// asyncwork threads, each with its own submission & completion queue (see t_asyncwork_req)
+	u32                asyncwork_nworkers; // number of live workers
+	AWorker** nullable asyncwork_workers;  // array of live workers
+	Chan* nullable     asyncwork_cq;       // queue of messages from other workers (send/recv)
+
+	// asyncwork thread pool limits & metrics (see asyncwork_pool)
+	u32            asyncwork_min;          // workers kept alive when idle
+	u32            asyncwork_max;          // workers started at most
+	DTimeDuration  asyncwork_idle_timeout; // idle time after which a worker exits (0 = never)
+	FIFO* nullable asyncwork_backlog;      // AsyncWorkReq waiting for a worker (at max workers)
+	u32            asyncwork_backlog_max;  // highest number of requests seen in backlog
+	u64            asyncwork_nspawned;     // number of workers started
+	u64            asyncwork_nreaped;      // number of workers stopped for being idle
+
+	SchedTrace* nullable trace; // event trace ring, when tracing is enabled
+
+	u32 tblock_idgen; // source of TaskBlock.id
+
+	// pre-warmed user workers, parked until spawn_worker hands them a main function
+	UWorker* nullable warm_workers; // list (UWorker.warm_next)
+	u32               warm_len;     // number of workers in warm_workers
+	u32               warm_target;  // number of parked workers to maintain
+	int               warm_fnref;   // function preloaded by parked workers (or LUA_NOREF)
+	Buf               warm_lcode;   // bytecode of warm_fnref
+
+	// spinning before blocking in iopoll (see s_spin)
+	u32 spin_max;    // max iterations to spin (0 disables spinning)
+	u32 spin_limit;  // current adaptive limit (<= spin_max)
+	u64 spin_hits;   // number of times spinning found work
+	u64 spin_misses; // number of times spinning gave up and S blocked in iopoll
+
+	u32 msg_size_hint; // extra space to allocate for messages sent by tasks (see l_encode_msg)
+
+	// messages sent by tasks to another worker, not yet written to its CQ (see t_send_remote)
+	S* nullable            outbox_dst; // destination of messages in outbox
+	struct AsyncWorkRes*   outbox;     // array of S_OUTBOX_CAP entries (allocated on demand)
+	u32                    outbox_len; // number of messages in outbox
+
+	// topic subscriptions of tasks of this S (see subscribe)
+	Array(TopicSub) topicsubs;
 };
 
 enum {
-	RemoteTask_FLAG_WORKER_REF = 1<<0, // RemoteTask owns a ref to S of sid, which is a worker
+	RemoteTask_FLAG_WORKER_REF = 1<<0, // RemoteTask owns a ref to worker, which is S of sid
 };
 
 // RemoteTask represents a task (T) of another worker (S)
 typedef struct RemoteTask {
-    UVal uval;  // .type=UValType_RemoteTask
-    u8   flags; // bits of RemoteTask_FLAG_
-    u32  tid;   // task
-    u32  sid;   // scheduler that owns the task
+    UVal              uval;   // .type=UValType_RemoteTask
+    u8                flags;  // bits of RemoteTask_FLAG_
+    u32               tid;    // task
+    u32               sid;    // scheduler that owns the task
+    UWorker* nullable worker; // set when flags & RemoteTask_FLAG_WORKER_REF
 } RemoteTask;
 
 // GTID uniquely identifies a task across an entire dew runtime instance (sid+tid)
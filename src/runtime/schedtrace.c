@@ -0,0 +1,193 @@
+#include "schedtrace.h"
+#include "runtime.h"
+
+
+SchedTrace* nullable schedtrace_open(u32 cap) {
+    if (cap < 2)
+        cap = 2;
+    if (cap > 0x80000000u)
+        return NULL;
+    cap = CEIL_POW2(cap);
+    SchedTrace* st = malloc(sizeof(SchedTrace) + (usize)cap*sizeof(SchedTraceRec));
+    if (!st)
+        return NULL;
+    st->mask = cap - 1;
+    st->count = 0;
+    st->start = DTimeNow();
+    return st;
+}
+
+
+u32 schedtrace_cap_from_env() {
+    const char* s = getenv("DEW_SCHEDTRACE");
+    if (!s || *s == 0)
+        return 0;
+    char* end;
+    unsigned long cap = strtoul(s, &end, 10);
+    if (end == s) {
+        // not a number; e.g. DEW_SCHEDTRACE=on enables tracing with the smallest capacity
+        if (strcmp(s, "off") == 0 || strcmp(s, "false") == 0 || strcmp(s, "no") == 0)
+            return 0;
+    } else if (cap == 0) { // DEW_SCHEDTRACE=0
+        return 0;
+    }
+    return cap < 4096 ? 4096 : cap > 0x80000000u ? 0x80000000u : (u32)cap;
+}
+
+
+const char* schedtrace_ev_str(u8 ev) {
+    switch ((enum SchedTraceEv)ev) {
+        case STEv_RESUME:      return "resume";
+        case STEv_SUSPEND:     return "suspend";
+        case STEv_WAKE:        return "wake";
+        case STEv_SPAWN:       return "spawn";
+        case STEv_EXIT:        return "exit";
+        case STEv_POLL_ENTER:  return "poll_enter";
+        case STEv_POLL_EXIT:   return "poll_exit";
+        case STEv_SEND_REMOTE: return "send_remote";
+    }
+    return "?";
+}
+
+
+const char* schedtrace_wake_str(u8 wake) {
+    switch ((enum SchedTraceWake)wake) {
+        case STWake_TIMER:      return "timer";
+        case STWake_IOPOLL:     return "iopoll";
+        case STWake_TASK:       return "task";
+        case STWake_WORKER:     return "worker";
+        case STWake_ASYNCWORK:  return "asyncwork";
+        case STWake_MSG:        return "msg";
+        case STWake_MSG_REMOTE: return "msg_remote";
+        case STWake_WORKER_MSG: return "worker_msg";
+        case STWake_CHAN:       return "chan";
+        case STWake_PUBLISH:    return "publish";
+    }
+    return "?";
+}
+
+
+static const char* tstatus_str(u8 status) {
+    switch ((enum TStatus)status) {
+        case T_READY:       return "yield";
+        case T_RUNNING:     return "running";
+        case T_WAIT_IO:     return "wait_io";
+        case T_WAIT_SEND:   return "wait_send";
+        case T_WAIT_RECV:   return "wait_recv";
+        case T_WAIT_TASK:   return "wait_task";
+        case T_WAIT_WORKER: return "wait_worker";
+        case T_WAIT_ASYNC:  return "wait_async";
+        case T_WAIT_SET:    return "wait_set";
+        case T_WAIT_CHAN:   return "wait_chan";
+        case T_DEAD:        return "dead";
+    }
+    return "?";
+}
+
+
+static const char* tdied_str(u8 how) {
+    switch ((enum TDied)how) {
+        case TDied_ERR:   return "error";
+        case TDied_CLEAN: return "clean";
+        case TDied_STOP:  return "stopped";
+    }
+    return "?";
+}
+
+
+ATTR_FORMAT(printf, 2, 3)
+static bool appendf(Buf* buf, const char* fmt, ...) {
+    va_list ap;
+    usize avail = buf->cap - buf->len;
+    for (;;) {
+        va_start(ap, fmt);
+        int n = vsnprintf((char*)buf->bytes + buf->len, avail, fmt, ap);
+        va_end(ap);
+        if UNLIKELY(n < 0)
+            return false;
+        if LIKELY((usize)n < avail) {
+            buf->len += (usize)n;
+            return true;
+        }
+        if (!buf_reserve(buf, (usize)n + 1))
+            return false;
+        avail = buf->cap - buf->len;
+    }
+}
+
+
+bool schedtrace_json(const SchedTrace* st, u32 sid, Buf* buf) {
+    // Chrome trace event format:
+    // https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nzsKchhAUkw
+    if (!buf_reserve(buf, 4096))
+        return false;
+    bool ok = appendf(buf,
+        "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"S%u\"}},\n"
+        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,"
+        "\"args\":{\"name\":\"scheduler\"}}",
+        sid, sid, sid);
+
+    // if the ring has wrapped around, start with the oldest record
+    u64 end = st->count;
+    u64 i = end > (u64)st->mask + 1 ? end - ((u64)st->mask + 1) : 0;
+
+    // Since S runs one task at a time, "begin" and "end" events never interleave.
+    // Track what's open so that we don't emit an "end" whose "begin" was overwritten.
+    u32 running_tid = 0;
+    bool running = false, polling = false;
+
+    for (; i < end && ok; i++) {
+        const SchedTraceRec* r = &st->recs[i & st->mask];
+        // timestamps are in microseconds
+        u64 ts_us = r->time / 1000, ts_ns = r->time % 1000;
+        #define EV(ph, name, tid, fmt, ...) \
+            appendf(buf, ",\n{\"name\":\"%s\",\"ph\":\"" ph "\",\"ts\":%lu.%03lu," \
+                    "\"pid\":%u,\"tid\":%u" fmt "}", \
+                    name, ts_us, ts_ns, sid, tid, ##__VA_ARGS__)
+        switch ((enum SchedTraceEv)r->ev) {
+        case STEv_RESUME:
+            running = true;
+            running_tid = r->tid;
+            ok = EV("B", "run", r->tid, "");
+            break;
+        case STEv_SUSPEND:
+            if (!running || running_tid != r->tid)
+                break;
+            running = false;
+            ok = EV("E", "run", r->tid, ",\"args\":{\"status\":\"%s\"}", tstatus_str(r->sub));
+            break;
+        case STEv_WAKE:
+            ok = EV("i", "wake", r->tid, ",\"s\":\"t\",\"args\":{\"source\":\"%s\",\"arg\":%u}",
+                    schedtrace_wake_str(r->sub), r->arg);
+            break;
+        case STEv_SPAWN:
+            ok = EV("i", "spawn", r->tid, ",\"s\":\"t\",\"args\":{\"parent\":%u}", r->arg);
+            break;
+        case STEv_EXIT:
+            ok = EV("i", "exit", r->tid, ",\"s\":\"t\",\"args\":{\"how\":\"%s\"}",
+                    tdied_str(r->sub));
+            break;
+        case STEv_POLL_ENTER:
+            polling = true;
+            if (r->arg == U32_MAX) {
+                ok = EV("B", "iopoll", 0u, "");
+            } else {
+                ok = EV("B", "iopoll", 0u, ",\"args\":{\"timeout_ms\":%u}", r->arg);
+            }
+            break;
+        case STEv_POLL_EXIT:
+            if (!polling)
+                break;
+            polling = false;
+            ok = EV("E", "iopoll", 0u, ",\"args\":{\"result\":%d}", (int)r->arg);
+            break;
+        case STEv_SEND_REMOTE:
+            ok = EV("i", "send_remote", r->tid, ",\"s\":\"t\",\"args\":{\"dst_sid\":%u}", r->arg);
+            break;
+        }
+        #undef EV
+    }
+
+    return ok && appendf(buf, "\n]}\n");
+}
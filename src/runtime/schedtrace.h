@@ -0,0 +1,81 @@
+// scheduler event tracing: a binary ring buffer of events, recorded per S
+#pragma once
+#include "../dew.h"
+#include "buf.h"
+#include "time.h"
+API_BEGIN
+
+typedef struct SchedTrace    SchedTrace;
+typedef struct SchedTraceRec SchedTraceRec;
+
+enum SchedTraceEv {
+    STEv_RESUME,      // task is resumed by S
+    STEv_SUSPEND,     // task handed control back to S (sub=TStatus, e.g. T_READY for yield)
+    STEv_WAKE,        // task was made runnable (sub=STWake)
+    STEv_SPAWN,       // task was spawned (arg=parent tid)
+    STEv_EXIT,        // task exited (sub=TDied)
+    STEv_POLL_ENTER,  // S is about to block in iopoll (arg=ms until deadline or U32_MAX)
+    STEv_POLL_EXIT,   // S returned from iopoll (arg=result of iopoll_poll)
+    STEv_SEND_REMOTE, // task sent a message to another S (arg=destination sid)
+};
+
+enum SchedTraceWake { // SchedTraceRec.sub for STEv_WAKE
+    STWake_TIMER,      // timer expired
+    STWake_IOPOLL,     // I/O event
+    STWake_TASK,       // awaited task exited (or inbox has space for a blocked sender)
+    STWake_WORKER,     // awaited worker exited
+    STWake_ASYNCWORK,  // async work completed
+    STWake_MSG,        // message from a task of the same S
+    STWake_MSG_REMOTE, // message from another S (arg=sender sid)
+    STWake_WORKER_MSG, // runtime message about a worker (e.g. "worker closed")
+    STWake_CHAN,       // channel which the task waits for has a value or free slot
+    STWake_PUBLISH,    // message published to a topic the task subscribes to (arg=publisher sid)
+};
+
+struct SchedTraceRec {
+    DTime time; // DTimeNow() when the event was recorded
+    u32   tid;  // task the event is about (0 for S-level events, like POLL_ENTER)
+    u32   arg;  // event-specific argument
+    u8    ev;   // enum SchedTraceEv
+    u8    sub;  // event-specific sub-kind (see enum SchedTraceEv)
+    u16   _unused1;
+    u32   _unused2;
+};
+
+struct SchedTrace {
+    u32           mask;  // capacity-1 (capacity is a power of two)
+    u32           _unused;
+    u64           count; // total number of records written (monotonic; head = count & mask)
+    DTime         start; // time the trace was started
+    SchedTraceRec recs[];
+};
+
+// schedtrace_open allocates a trace ring with room for at least cap records.
+// Returns NULL if memory allocation fails.
+SchedTrace* nullable schedtrace_open(u32 cap);
+inline static void schedtrace_close(SchedTrace* nullable st) { free(st); }
+
+// schedtrace_rec records an event, overwriting the oldest record when the ring is full
+inline static void schedtrace_rec(SchedTrace* st, u8 ev, u8 sub, u32 tid, u32 arg) {
+    SchedTraceRec* r = &st->recs[st->count++ & st->mask];
+    r->time = DTimeNow();
+    r->tid = tid;
+    r->arg = arg;
+    r->ev = ev;
+    r->sub = sub;
+}
+
+// schedtrace_cap_from_env returns the capacity set by the DEW_SCHEDTRACE environment variable,
+// at least 4096, or 0 if it is not set, "0", "off", "false" or "no".
+// Used to enable tracing without changing program code.
+u32 schedtrace_cap_from_env();
+
+// schedtrace_json appends the records of the trace ring to buf in Chrome trace JSON format,
+// loadable in Perfetto (ui.perfetto.dev) or chrome://tracing.
+// Each S is presented as a process (pid=sid) and each task as a thread (tid=tid).
+bool schedtrace_json(const SchedTrace* st, u32 sid, Buf* buf);
+
+const char* schedtrace_ev_str(u8 ev);
+const char* schedtrace_wake_str(u8 wake);
+
+API_END
@@ -0,0 +1,126 @@
+/* single-producer, single-consumer inter-thread ring buffer
+
+head is only written by the producer and tail only by the consumer, so neither side needs
+atomic read-modify-write operations. Each side caches the other side's index, and only loads
+it again (touching the other side's cache line) when the ring looks full or empty.
+
+    tail       head
+  0   │   2   3   │   5   6   7
+┌───┬─│─┬───┬───┬─│─┬───┬───┬───┐
+│   │ A │ B │ C │ D │   │   │   │
+└───┴───┴───┴───┴───┴───┴───┴───┘
+      ╰───────────╯
+         unread
+*/
+#include "spsc.h"
+#include <stdatomic.h>
+API_BEGIN
+
+
+struct SPSC { // aligned to CPU_CACHE_LINE_SIZE
+    // producer fields
+    _Atomic(u32) head;
+    u32          head_cached_tail;
+
+    // consumer fields
+    _Atomic(u32) tail __attribute__((aligned(CPU_CACHE_LINE_SIZE)));
+    u32          tail_cached_head;
+
+    // read-only fields
+    u32 mask __attribute__((aligned(CPU_CACHE_LINE_SIZE)));
+    u32 entsize;
+    u8  entries[] __attribute__((aligned(8)));
+};
+
+
+SPSC* nullable spsc_open(u32 cap, u32 entsize) {
+    assertf(cap > 1 && IS_POW2(cap), "cap must be pow2");
+    if (cap < 2 || !IS_POW2(cap))
+        return NULL;
+    usize nbyte = ALIGN2(sizeof(SPSC) + ((usize)cap * (usize)entsize), CPU_CACHE_LINE_SIZE);
+    SPSC* q = aligned_alloc(CPU_CACHE_LINE_SIZE, nbyte);
+    if (!q)
+        return NULL;
+    q->head = 0;
+    q->head_cached_tail = 0;
+    q->tail = 0;
+    q->tail_cached_head = 0;
+    q->mask = cap - 1;
+    q->entsize = entsize;
+    return q;
+}
+
+
+void spsc_close(SPSC* q) {
+    free(q);
+}
+
+
+u32 spsc_cap(const SPSC* q) {
+    return q->mask + 1;
+}
+
+
+void* nullable spsc_write_begin(SPSC* q) {
+    u32 head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if UNLIKELY(head - q->head_cached_tail > q->mask) {
+        // looks full; check if the consumer has made progress since we last looked
+        q->head_cached_tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (head - q->head_cached_tail > q->mask)
+            return NULL;
+    }
+    return &q->entries[(head & q->mask) * q->entsize];
+}
+
+
+void spsc_write_commit(SPSC* q) {
+    u32 head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+
+void* nullable spsc_read_begin(SPSC* q) {
+    u32 tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail == q->tail_cached_head) {
+        // looks empty; check if the producer has made progress since we last looked
+        q->tail_cached_head = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (tail == q->tail_cached_head)
+            return NULL;
+    }
+    return &q->entries[(tail & q->mask) * q->entsize];
+}
+
+
+void spsc_read_commit(SPSC* q) {
+    u32 tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+
+bool spsc_isempty(const SPSC* q) {
+    return atomic_load_explicit(&q->head, memory_order_acquire) ==
+           atomic_load_explicit(&q->tail, memory_order_acquire);
+}
+
+
+bool spsc_write(SPSC* q, const void* value_src) {
+    void* entry = spsc_write_begin(q);
+    if (entry == NULL)
+        return false;
+    memcpy(entry, value_src, q->entsize);
+    spsc_write_commit(q);
+    return true;
+}
+
+
+bool spsc_read(SPSC* q, void* value_dst) {
+    void* entry = spsc_read_begin(q);
+    if (entry == NULL)
+        return false;
+    memcpy(value_dst, entry, q->entsize);
+    spsc_read_commit(q);
+    return true;
+}
+
+
+API_END
@@ -0,0 +1,31 @@
+// single-producer, single-consumer inter-thread ring buffer (lock free, non blocking)
+#pragma once
+#include "../dew.h"
+API_BEGIN
+
+typedef struct SPSC SPSC;
+
+SPSC* nullable spsc_open(u32 cap, u32 entsize); // cap must be pow2
+void spsc_close(SPSC* q);
+u32 spsc_cap(const SPSC* q);
+
+// spsc_write_begin returns the next free entry, or NULL if the queue is full.
+// The entry is made visible to the consumer by spsc_write_commit.
+// Must only be called by the producer thread.
+void* nullable spsc_write_begin(SPSC* q);
+void           spsc_write_commit(SPSC* q);
+
+// spsc_read_begin returns the oldest unread entry, or NULL if the queue is empty.
+// The entry is made available for reuse by spsc_read_commit.
+// Must only be called by the consumer thread.
+void* nullable spsc_read_begin(SPSC* q);
+void           spsc_read_commit(SPSC* q);
+
+// spsc_isempty can be called from either thread
+bool spsc_isempty(const SPSC* q);
+
+// convenience functions which copies the value. Returns false if full or empty, respectively.
+bool spsc_write(SPSC* q, const void* value_src);
+bool spsc_read(SPSC* q, void* value_dst);
+
+API_END
@@ -0,0 +1,27 @@
+#include "spsc.c"
+
+#define NUM_PRODUCER_THREADS 1
+#define NUM_CONSUMER_THREADS 1
+#define OPS_PER_PRODUCER 1000000
+
+SPSC* nullable queue_create() {
+    u32 cap = 64;
+    u32 entsize = sizeof(int);
+    return spsc_open(cap, entsize);
+}
+
+bool queue_enqueue(SPSC* q, int value) {
+    return spsc_write(q, &value);
+}
+
+bool queue_dequeue(SPSC* q, int* value_out) {
+    return spsc_read(q, value_out);
+}
+
+void queue_destroy(SPSC* q) {
+    spsc_close(q);
+}
+
+#define Queue SPSC
+
+#include "queue_test.h"
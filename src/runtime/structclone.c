@@ -1,4 +1,5 @@
 #include "structclone.h"
+#include "worker.h" // Channel
 #include "qsort.h"
 #include "lutil.h"
 #include "../hexdump.h"
@@ -19,8 +20,9 @@ enum SCTag {
     SCTag_UVAL   = 0xB,
     SCTag_REFZ   = 0xC, // reference to an already-serialized value (embedded in tag)
     SCTag_REF    = 0xD, // reference to an already-serialized value (u24)
-    // UNUSED    = 0xE,
-    SCTag_MAX    = SCTag_REF
+    SCTag_NUMARRAY = 0xE, // array of numbers of the same type, packed (SCNumArrayType in tag)
+    SCTag_RECORD = 0xF, // dict with string keys, which are listed in a "shape"
+    SCTag_MAX    = SCTag_RECORD
 };
 
 #define CODEC_VERSION 1 // stream codec version
@@ -40,6 +42,35 @@ enum SCTag {
 
 #define SCTagValHeaderReservedMask ((u8)1 << SCTagValShift)
 
+// SCTagValHeaderHasPtrs is set in the header when the data ends with a table listing the
+// offsets of values encoded by pointer (StructCloneEnc_PTRS)
+#define SCTagValHeaderHasPtrs SCTagValHeaderReservedMask
+
+// SCTagValPtr is set on a UVAL tag for a value encoded by pointer: a Buf which bytes were
+// moved rather than copied, a SharedBuf or a Channel
+#define SCTagValPtr ((u8)2 << SCTagValShift)
+
+// SCNumArrayType is the element type of a NUMARRAY, stored in the tag above SCTagValHasRef
+enum SCNumArrayType {
+    SCNumArray_I8  = 0,
+    SCNumArray_I16 = 1,
+    SCNumArray_I32 = 2,
+    SCNumArray_I64 = 3,
+    SCNumArray_F64 = 4,
+};
+#define SCTagValNumArrayShift (SCTagValShift + 1)
+
+// SC_NUMARRAY_MIN: arrays with fewer elements than this are never packed
+#define SC_NUMARRAY_MIN 4
+
+// SCTagValShapeDef is set on a RECORD tag which defines a new shape
+#define SCTagValShapeDef ((u8)2 << SCTagValShift)
+
+// SC_SHAPES_MAX: max number of shapes per encoding; further dicts are encoded as DICT.
+// SC_SHAPE_MAXKEYS: dicts with more keys than this are encoded as DICT.
+#define SC_SHAPES_MAX    256
+#define SC_SHAPE_MAXKEYS 64
+
 static_assert(SCTag_MAX <= SCTagTypeMax, "SCTagTypeBits too small for SCTag_MAX");
 
 // REFTAB_IDX: stack index the reftab lives at
@@ -59,12 +90,28 @@ static_assert(SCTag_MAX <= SCTagTypeMax, "SCTagTypeBits too small for SCTag_MAX"
 #endif
 
 
+typedef struct EncPtr {
+    UVal* src;    // Buf, SharedBuf or Channel
+    u32   offset; // offset of record in encoded data, relative to header
+} EncPtr;
+
+typedef struct EncShape {
+    u32 hash;
+    u32 keystart; // index of first key in Encoder.shapekeys
+    u32 nkeys;
+} EncShape;
+
 typedef struct Encoder {
     Buf*  buf;
     usize buf_startoffs;
     int   err_no;
     u32   nrefs;
     bool  has_reftab;
+    u64   flags;
+    int   transfer_list_idx; // stack index of transfer_list (without reftab), or 0 if none
+    Buf   ptrs;              // EncPtr[]
+    Buf   shapes;            // EncShape[]
+    Buf   shapekeys;         // const void*[], key strings of shapes
 } Encoder;
 
 typedef struct Decoder {
@@ -75,6 +122,10 @@ typedef struct Decoder {
     u32       nrefs;
     u32*      refmap; // used if nrefs > 256 (holds nrefs entries in heap memory)
     u32       refidxgen;
+    u64       flags;
+    bool      has_keytab;  // true if a table is at REFTAB_IDX, even if nrefs is 0
+    u32       nshapes;
+    u32       shapekeys[SC_SHAPES_MAX + 1]; // shape N has keys [shapekeys[N], shapekeys[N+1])
 } Decoder;
 
 static u8 g_reftabkey;
@@ -99,6 +150,8 @@ static const char* SCTagStr(u8 tag) {
         case SCTag_UVAL:   return "UVAL";
         case SCTag_REFZ:   return "REFZ";
         case SCTag_REF:    return "REF";
+        case SCTag_NUMARRAY: return "NUMARRAY";
+        case SCTag_RECORD: return "RECORD";
     }
     static char buf[4];
     sprintf(buf, "?%02x", tag);
@@ -149,6 +202,13 @@ static void dec_error_bad(lua_State* L, Decoder* dec) {
     codec_error(L, dec, EBADMSG, "Invalid data");
 }
 
+// dec_error_drop removes the n values below the error at the top of the stack, which a
+// decoding function pushed before it failed, so that it leaves only the error
+static void dec_error_drop(lua_State* L, int n) {
+    lua_replace(L, -1 - n);
+    lua_pop(L, n - 1);
+}
+
 
 static void enc_append_byte(lua_State* L, Encoder* enc, u8 byte) {
     if UNLIKELY(!buf_append_byte(enc->buf, byte))
@@ -357,7 +417,7 @@ static void encode_number(lua_State* L, Encoder* enc, int vi) {
     int isint;
     lua_Integer vv = lua_tointegerx(L, vi, &isint);
     if (isint) {
-        if (vv <= (lua_Integer)SCTagValMax) {
+        if (vv >= 0 && vv <= (lua_Integer)SCTagValMax) {
             enc_append_byte(L, enc, (u8)SCTag_INTZ | ((u8)vv << SCTagValShift));
         } else {
             enc_append_byte(L, enc, SCTag_INT);
@@ -434,10 +494,11 @@ static void encode_str(lua_State* L, Encoder* enc, int vi) {
 
 static void decode_str(lua_State* L, Decoder* dec) {
     usize bufavail = dec->bufend - dec->buf;
-    usize header_len = (dec->buf[0] & SCTag_STR1) ? 2 : 5;
-    if LIKELY(bufavail > header_len) {
+    bool isstr1 = (dec->buf[0] & SCTagTypeMask) == SCTag_STR1;
+    usize header_len = isstr1 ? 2 : 5;
+    if LIKELY(bufavail >= header_len) {
         u32 len;
-        if (dec->buf[0] & SCTag_STR1) {
+        if (isstr1) {
             len = dec->buf[1];
         } else {
             memcpy(&len, &dec->buf[1], sizeof(len));
@@ -454,7 +515,106 @@ static void decode_str(lua_State* L, Decoder* dec) {
 }
 
 
+// enc_shape_lookup returns the id of the shape with keys keyv, defining a new shape if needed.
+// Returns -1 if there's no room for another shape.
+static int enc_shape_lookup(lua_State* L, Encoder* enc, const void** keyv, u32 nkeys, bool* isnew) {
+    u32 hash = 2166136261u; // FNV-1a
+    for (u32 i = 0; i < nkeys; i++)
+        hash = (hash ^ (u32)((uintptr)keyv[i] >> 3)) * 16777619u;
+
+    EncShape* shapev = (EncShape*)enc->shapes.bytes;
+    u32 nshapes = enc->shapes.len / sizeof(EncShape);
+    const void** shapekeyv = (const void**)enc->shapekeys.bytes;
+    for (u32 id = 0; id < nshapes; id++) {
+        if (shapev[id].hash == hash && shapev[id].nkeys == nkeys &&
+            memcmp(&shapekeyv[shapev[id].keystart], keyv, nkeys*sizeof(void*)) == 0)
+        {
+            *isnew = false;
+            return (int)id;
+        }
+    }
+
+    if (nshapes == SC_SHAPES_MAX)
+        return -1;
+    EncShape* shape = buf_reserve(&enc->shapes, sizeof(EncShape));
+    if UNLIKELY(!shape || !buf_append(&enc->shapekeys, keyv, nkeys*sizeof(void*)))
+        return enc_error_nomem(L, enc), -1;
+    shape->hash = hash;
+    shape->keystart = enc->shapekeys.len/sizeof(void*) - nkeys;
+    shape->nkeys = nkeys;
+    enc->shapes.len += sizeof(EncShape);
+    *isnew = true;
+    return (int)nshapes;
+}
+
+
+// encode_record attempts to encode the dict at the top of the stack as a RECORD.
+// Returns false, without having written anything, if the dict has keys that are not strings,
+// too many keys, or if there's no room for another shape.
+// The first dict of a shape defines it, listing its keys ahead of the values.
+// Later dicts with the same keys, in the same order, only list values.
+//
+//   ┌─────────────────┬─────────────┬─────── ~ ───────┬──────── ~ ────────┐
+//   │ tag|ShapeDef u8 │ nkeys u8    │ key ...         │ value ...         │
+//   └─────────────────┴─────────────┴─────── ~ ───────┴──────── ~ ────────┘
+//   ┌─────────────────┬─────────────┬──────── ~ ────────┐
+//   │ tag u8          │ shapeid u8  │ value ...         │
+//   └─────────────────┴─────────────┴──────── ~ ────────┘
+//
+// Keys are compared by identity, which for short (interned) strings means by value.
+// The key strings stay alive while encoding since the dicts are referenced by the reftab.
+static bool encode_record(lua_State* L, Encoder* enc) {
+    const void* keyv[SC_SHAPE_MAXKEYS];
+    u32 nkeys = 0;
+
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0) {
+        if (lua_type(L, -2) != LUA_TSTRING || nkeys == SC_SHAPE_MAXKEYS) {
+            lua_pop(L, 2);
+            return false;
+        }
+        keyv[nkeys++] = lua_topointer(L, -2);
+        lua_pop(L, 1);
+    }
+
+    bool isnew;
+    int id = enc_shape_lookup(L, enc, keyv, nkeys, &isnew);
+    if (id < 0)
+        return enc->err_no != 0;
+
+    u8* dst = buf_reserve(enc->buf, 2);
+    if UNLIKELY(!dst)
+        return enc_error_nomem(L, enc), true;
+    enc->buf->len += 2;
+
+    if (isnew) {
+        sc_trace("encode record, new shape #%d", id);
+        dst[0] = (u8)SCTag_RECORD | SCTagValShapeDef;
+        dst[1] = (u8)nkeys;
+        lua_pushnil(L);
+        while (lua_next(L, -2) != 0) {
+            encode_value(L, enc, -2); // key
+            lua_pop(L, 1);
+        }
+    } else {
+        sc_trace("encode record, shape #%d", id);
+        dst[0] = SCTag_RECORD;
+        dst[1] = (u8)id;
+    }
+
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0) {
+        encode_value(L, enc, -1); // value
+        lua_pop(L, 1);
+    }
+    return true;
+}
+
+
 static void encode_dict(lua_State* L, Encoder* enc, int vi) {
+    if (encode_record(L, enc))
+        return;
+
     sc_trace("encode dict");
 
     // 1 byte tag + 4 bytes count
@@ -474,9 +634,82 @@ static void encode_dict(lua_State* L, Encoder* enc, int vi) {
 }
 
 
+// encode_numarray attempts to encode the array at the top of the stack as a NUMARRAY.
+// Returns false, without having written anything, if it holds anything but only integers or
+// only floats. Integers are stored with the smallest width that fits all of them.
+//
+//   ┌───────────┬─────────────┬──────────── ~ ────────────┐
+//   │ tag u8    │ count u32   │ count * (1, 2, 4 or 8) B  │
+//   └───────────┴─────────────┴──────────── ~ ────────────┘
+static bool encode_numarray(lua_State* L, Encoder* enc, u32 count) {
+    // values are first written as 8 byte elements, then narrowed in place
+    usize start = enc->buf->len;
+    u8* dst = buf_reserve(enc->buf, 1 + sizeof(u32) + (usize)count*8);
+    if UNLIKELY(!dst)
+        return enc_error_nomem(L, enc), true;
+    dst += 1 + sizeof(u32);
+
+    lua_rawgeti(L, -1, 1);
+    bool isint = lua_isinteger(L, -1);
+    lua_pop(L, 1);
+    i64 minval = 0, maxval = 0;
+
+    for (u32 i = 1; i <= count; i++) {
+        if UNLIKELY(lua_rawgeti(L, -1, i) != LUA_TNUMBER || lua_isinteger(L, -1) != isint) {
+            lua_pop(L, 1);
+            return false;
+        }
+        if (isint) {
+            i64 v = lua_tointeger(L, -1);
+            minval = MIN(minval, v);
+            maxval = MAX(maxval, v);
+            memcpy(dst + (usize)(i-1)*8, &v, 8);
+        } else {
+            float64 v = lua_tonumber(L, -1);
+            memcpy(dst + (usize)(i-1)*8, &v, 8);
+        }
+        lua_pop(L, 1);
+    }
+
+    enum SCNumArrayType t = SCNumArray_F64;
+    usize elemsize = 8;
+    if (isint) {
+        if (minval == (i8)minval && maxval == (i8)maxval) {
+            t = SCNumArray_I8, elemsize = 1;
+            for (u32 i = 0; i < count; i++) {
+                i64 v; memcpy(&v, dst + (usize)i*8, 8);
+                dst[i] = (u8)(i8)v;
+            }
+        } else if (minval == (i16)minval && maxval == (i16)maxval) {
+            t = SCNumArray_I16, elemsize = 2;
+            for (u32 i = 0; i < count; i++) {
+                i64 v; memcpy(&v, dst + (usize)i*8, 8);
+                i16 v2 = (i16)v; memcpy(dst + (usize)i*2, &v2, 2);
+            }
+        } else if (minval == (i32)minval && maxval == (i32)maxval) {
+            t = SCNumArray_I32, elemsize = 4;
+            for (u32 i = 0; i < count; i++) {
+                i64 v; memcpy(&v, dst + (usize)i*8, 8);
+                i32 v2 = (i32)v; memcpy(dst + (usize)i*4, &v2, 4);
+            }
+        } else {
+            t = SCNumArray_I64;
+        }
+    }
+
+    enc->buf->bytes[start] = (u8)SCTag_NUMARRAY | ((u8)t << SCTagValNumArrayShift);
+    memcpy(&enc->buf->bytes[start + 1], &count, sizeof(u32));
+    enc->buf->len += 1 + sizeof(u32) + (usize)count*elemsize;
+    return true;
+}
+
+
 static void encode_array(lua_State* L, Encoder* enc, int vi, u32 count) {
     sc_trace("encode array len=%u", count);
 
+    if (count >= SC_NUMARRAY_MIN && encode_numarray(L, enc, count))
+        return;
+
     // 1 byte tag + 4 bytes count
     enc->buf->bytes[enc->buf->len] = SCTag_ARRAY;
     memcpy(&enc->buf->bytes[enc->buf->len + 1], &count, sizeof(u32));
@@ -532,6 +765,145 @@ static void decode_array(lua_State* L, Decoder* dec) {
 }
 
 
+static void decode_numarray(lua_State* L, Decoder* dec) {
+    usize bufavail = dec->bufend - dec->buf;
+    if UNLIKELY(bufavail < 5)
+        return dec_error_short(L, dec);
+
+    u32 count;
+    memcpy(&count, dec->buf + 1, sizeof(count));
+    enum SCNumArrayType t = dec->buf[0] >> SCTagValNumArrayShift;
+    usize elemsize;
+    switch (t) {
+        case SCNumArray_I8:  elemsize = 1; break;
+        case SCNumArray_I16: elemsize = 2; break;
+        case SCNumArray_I32: elemsize = 4; break;
+        case SCNumArray_I64:
+        case SCNumArray_F64: elemsize = 8; break;
+        default:             return dec_error_bad(L, dec);
+    }
+    if UNLIKELY((bufavail - 5) / elemsize < count)
+        return dec_error_short(L, dec);
+
+    lua_createtable(L, (int)MIN(count, (u32)I32_MAX), 0);
+
+    if (*dec->buf & SCTagValHasRef)
+        dec_ref_register(L, dec);
+
+    const u8* src = dec->buf + 1 + sizeof(count); // tag + count
+    dec->buf = src + (usize)count*elemsize;
+
+    switch (t) {
+    case SCNumArray_I8:
+        for (u32 i = 0; i < count; i++) {
+            lua_pushinteger(L, (i8)src[i]);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        break;
+    case SCNumArray_I16:
+        for (u32 i = 0; i < count; i++) {
+            i16 v; memcpy(&v, src + (usize)i*2, 2);
+            lua_pushinteger(L, v);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        break;
+    case SCNumArray_I32:
+        for (u32 i = 0; i < count; i++) {
+            i32 v; memcpy(&v, src + (usize)i*4, 4);
+            lua_pushinteger(L, v);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        break;
+    case SCNumArray_I64:
+        for (u32 i = 0; i < count; i++) {
+            i64 v; memcpy(&v, src + (usize)i*8, 8);
+            lua_pushinteger(L, v);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        break;
+    case SCNumArray_F64:
+        for (u32 i = 0; i < count; i++) {
+            float64 v; memcpy(&v, src + (usize)i*8, 8);
+            lua_pushnumber(L, v);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        break;
+    }
+}
+
+
+// decode_record decodes a RECORD written by encode_record.
+// Keys of shapes are stored in the table at REFTAB_IDX, after the refs.
+static void decode_record(lua_State* L, Decoder* dec) {
+    usize bufavail = dec->bufend - dec->buf;
+    if UNLIKELY(bufavail < 2)
+        return dec_error_short(L, dec);
+    u8 tag = dec->buf[0];
+    u32 id, keystart, nkeys;
+
+    if (tag & SCTagValShapeDef) {
+        nkeys = dec->buf[1];
+        dec->buf += 2;
+        if UNLIKELY(dec->nshapes == SC_SHAPES_MAX)
+            return dec_error_bad(L, dec);
+        id = dec->nshapes;
+        keystart = dec->shapekeys[id];
+    } else {
+        id = dec->buf[1];
+        dec->buf += 2;
+        if UNLIKELY(id >= dec->nshapes)
+            return dec_error_bad(L, dec);
+        keystart = dec->shapekeys[id];
+        nkeys = dec->shapekeys[id + 1] - keystart;
+    }
+
+    // Create & register the table before decoding the keys of a new shape; the record's tag
+    // comes before its keys in the stream, so its ref precedes any refs of the keys.
+    lua_createtable(L, 0, (int)nkeys);
+    if (tag & SCTagValHasRef)
+        dec_ref_register(L, dec);
+
+    if (tag & SCTagValShapeDef) {
+        // create a table at REFTAB_IDX, for the keys, if there's no reftab
+        if (!dec->has_keytab) {
+            lua_createtable(L, 0, 0);
+            lua_rotate(L, 1, REFTAB_IDX);
+            dec->has_keytab = true;
+        }
+
+        for (u32 i = 0; i < nkeys; i++) {
+            if UNLIKELY(dec->buf >= dec->bufend) {
+                lua_pop(L, 1); // table
+                return dec_error_short(L, dec);
+            }
+            decode_value(L, dec);
+            if UNLIKELY(dec->err_no)
+                return dec_error_drop(L, 1); // table
+            if UNLIKELY(lua_type(L, -1) != LUA_TSTRING) {
+                lua_pop(L, 2); // key, table
+                return dec_error_bad(L, dec);
+            }
+            lua_rawseti(L, REFTAB_IDX, (lua_Integer)dec->nrefs + 1 + keystart + i);
+        }
+        dec->nshapes++;
+        dec->shapekeys[dec->nshapes] = keystart + nkeys;
+    }
+
+    lua_Integer keyidx = (lua_Integer)dec->nrefs + 1 + keystart;
+    for (u32 i = 0; i < nkeys; i++) {
+        if UNLIKELY(dec->buf >= dec->bufend) {
+            lua_pop(L, 1); // table
+            return dec_error_short(L, dec);
+        }
+        lua_rawgeti(L, REFTAB_IDX, keyidx + i); // key
+        decode_value(L, dec); // value
+        if UNLIKELY(dec->err_no)
+            return dec_error_drop(L, 2); // key, table
+        lua_rawset(L, -3); // table[key] = value
+    }
+}
+
+
 static void decode_dict(lua_State* L, Decoder* dec) {
     usize bufavail = dec->bufend - dec->buf;
     if UNLIKELY(bufavail < 5)
@@ -559,10 +931,74 @@ static void decode_dict(lua_State* L, Decoder* dec) {
 }
 
 
+// enc_is_transfer returns true if the value at vi is in the transfer_list
+static bool enc_is_transfer(lua_State* L, Encoder* enc, int vi) {
+    if (enc->transfer_list_idx == 0)
+        return false;
+    vi = lua_absindex(L, vi);
+    int listidx = enc->transfer_list_idx + (int)enc->has_reftab;
+    for (lua_Integer i = 1; lua_rawgeti(L, listidx, i) != LUA_TNIL; i++) {
+        bool found = lua_rawequal(L, -1, vi);
+        lua_pop(L, 1);
+        if (found)
+            return true;
+    }
+    lua_pop(L, 1); // nil
+    return false;
+}
+
+
+// enc_add_ptr registers a value encoded by pointer at the current offset, for the table
+// written by encode_ptrtab
+static bool enc_add_ptr(lua_State* L, Encoder* enc, UVal* src) {
+    EncPtr* p = buf_reserve(&enc->ptrs, sizeof(EncPtr));
+    if UNLIKELY(!p)
+        return enc_error_nomem(L, enc), false;
+    if UNLIKELY(enc->buf->len - enc->buf_startoffs > U32_MAX)
+        return codec_error(L, enc, EMSGSIZE, "Message too large"), false;
+    p->src = src;
+    p->offset = (u32)(enc->buf->len - enc->buf_startoffs);
+    enc->ptrs.len += sizeof(EncPtr);
+    return true;
+}
+
+
+static void encode_uval_buf_moved(lua_State* L, Encoder* enc, int vi, Buf* buf) {
+    usize needbytes = 2 + sizeof(u64)*3; // header + uval_type + len + cap + bytes
+    if UNLIKELY(!buf_reserve(enc->buf, needbytes))
+        return enc_error_nomem(L, enc);
+
+    // the source Buf is detached later, in enc_finalize_ptrs
+    if (!enc_add_ptr(L, enc, &buf->uval))
+        return;
+
+    u8* dst = &enc->buf->bytes[enc->buf->len];
+    *dst++ = SCTag_UVAL | SCTagValPtr;
+    *dst++ = buf->uval.type;
+    u64 v = buf->len;
+    memcpy(dst, &v, sizeof(u64)); dst += sizeof(u64);
+    v = buf->cap;
+    memcpy(dst, &v, sizeof(u64)); dst += sizeof(u64);
+    v = (uintptr)buf->bytes;
+    memcpy(dst, &v, sizeof(u64));
+    enc->buf->len += needbytes;
+}
+
+
 static void encode_uval_buf(lua_State* L, Encoder* enc, int vi, Buf* buf) {
     if (!enc_ref_intern(L, enc, vi))
         return;
 
+    // Move bytes of a transferred Buf into the message, unless they are embedded in the
+    // Buf object (small buffers), in which case we copy them.
+    if ((enc->flags & StructCloneEnc_PTRS) &&
+        buf->bytes != (u8*)buf + sizeof(*buf) &&
+        buf->bytes != NULL &&
+        enc_is_transfer(L, enc, vi))
+    {
+        return encode_uval_buf_moved(L, enc, vi, buf);
+    }
+
     usize needbytes = 2 + sizeof(u64) + buf->len; // header + uval_type + buf.len + buf.bytes
     if UNLIKELY(!buf_reserve(enc->buf, needbytes))
         return enc_error_nomem(L, enc);
@@ -579,6 +1015,128 @@ static void encode_uval_buf(lua_State* L, Encoder* enc, int vi, Buf* buf) {
 }
 
 
+static void encode_uval_sharedbuf(lua_State* L, Encoder* enc, int vi, SharedBuf* sb) {
+    if UNLIKELY(!(enc->flags & StructCloneEnc_PTRS))
+        return codec_error(L, enc, EINVAL, "SharedBuf can only be cloned by send");
+
+    if (!enc_ref_intern(L, enc, vi))
+        return;
+
+    usize needbytes = 2 + sizeof(u64); // header + uval_type + data
+    if UNLIKELY(!buf_reserve(enc->buf, needbytes))
+        return enc_error_nomem(L, enc);
+
+    // a reference to data is acquired later, in enc_finalize_ptrs
+    if (!enc_add_ptr(L, enc, &sb->buf.uval))
+        return;
+
+    u8* dst = &enc->buf->bytes[enc->buf->len];
+    *dst++ = SCTag_UVAL | SCTagValPtr;
+    *dst++ = sb->buf.uval.type;
+    u64 v = (uintptr)sb->data;
+    memcpy(dst, &v, sizeof(u64));
+    enc->buf->len += needbytes;
+}
+
+
+static void encode_uval_channel(lua_State* L, Encoder* enc, int vi, Channel* c) {
+    if UNLIKELY(!(enc->flags & StructCloneEnc_PTRS))
+        return codec_error(L, enc, EINVAL, "Channel can only be cloned by send");
+
+    if (!enc_ref_intern(L, enc, vi))
+        return;
+
+    usize needbytes = 2 + sizeof(u64); // header + uval_type + data
+    if UNLIKELY(!buf_reserve(enc->buf, needbytes))
+        return enc_error_nomem(L, enc);
+
+    // a reference to data is acquired later, in enc_finalize_ptrs
+    if (!enc_add_ptr(L, enc, &c->uval))
+        return;
+
+    u8* dst = &enc->buf->bytes[enc->buf->len];
+    *dst++ = SCTag_UVAL | SCTagValPtr;
+    *dst++ = c->uval.type;
+    u64 v = (uintptr)c->data;
+    memcpy(dst, &v, sizeof(u64));
+    enc->buf->len += needbytes;
+}
+
+
+// ptrrec_ptroffs returns the offset of the pointer in a record encoded with SCTagValPtr
+static usize ptrrec_ptroffs(u8 uval_type) {
+    return uval_type == UValType_Buf ? 2 + sizeof(u64)*2 : 2;
+}
+
+
+static void retain_ptr(u8 uval_type, u8* ptrp);
+
+
+// dec_take_ptr loads the pointer of a record encoded with SCTagValPtr, which starts at
+// dec->buf-2, and clears it in the encoded data, taking ownership of what it points to.
+// With StructCloneDec_SHARED, the data is left as is and a new reference is acquired instead.
+static void* nullable dec_take_ptr(lua_State* L, Decoder* dec, u8 uval_type) {
+    usize ptroffs = ptrrec_ptroffs(uval_type) - 2;
+    usize bufavail = dec->bufend - dec->buf;
+    if UNLIKELY(bufavail < ptroffs + sizeof(u64))
+        return dec_error_short(L, dec), NULL;
+    if UNLIKELY(!(dec->flags & StructCloneDec_PTRS))
+        return dec_error_bad(L, dec), NULL;
+    u64 ptr;
+    memcpy(&ptr, dec->buf + ptroffs, sizeof(u64));
+    if UNLIKELY(ptr == 0) // already decoded
+        return codec_error(L, dec, EINVAL, "Value has already been decoded"), NULL;
+    if (dec->flags & StructCloneDec_SHARED) {
+        if UNLIKELY(uval_type == UValType_Buf)
+            return codec_error(L, dec, EINVAL, "moved Buf can not be shared"), NULL;
+        retain_ptr(uval_type, (u8*)dec->buf + ptroffs);
+    } else {
+        memset((u8*)dec->buf + ptroffs, 0, sizeof(u64));
+    }
+    return (void*)(uintptr)ptr;
+}
+
+
+static void decode_uval_buf_moved(lua_State* L, Decoder* dec) {
+    u8* bytes = dec_take_ptr(L, dec, UValType_Buf);
+    if UNLIKELY(!bytes)
+        return;
+    u64 len, cap;
+    memcpy(&len, dec->buf, sizeof(u64));
+    memcpy(&cap, dec->buf + sizeof(u64), sizeof(u64));
+    dec->buf += sizeof(u64)*3;
+
+    Buf* buf = l_buf_createx(L, 0);
+    if UNLIKELY(!buf) {
+        free(bytes);
+        return dec_error_nomem(L, dec);
+    }
+    buf->bytes = bytes;
+    buf->cap = (usize)cap;
+    buf->len = (usize)len;
+    l_buf_account(L, (usize)cap);
+}
+
+
+static void decode_uval_sharedbuf(lua_State* L, Decoder* dec) {
+    SharedBufData* data = dec_take_ptr(L, dec, UValType_SharedBuf);
+    if UNLIKELY(!data)
+        return;
+    dec->buf += sizeof(u64);
+    if UNLIKELY(!l_sharedbuf_createx(L, data))
+        return dec_error_nomem(L, dec);
+}
+
+
+static void decode_uval_channel(lua_State* L, Decoder* dec) {
+    ChannelData* data = dec_take_ptr(L, dec, UValType_Channel);
+    if UNLIKELY(!data)
+        return;
+    dec->buf += sizeof(u64);
+    l_channel_createx(L, data);
+}
+
+
 static void decode_uval_buf(lua_State* L, Decoder* dec) {
     usize bufavail = dec->bufend - dec->buf;
     if UNLIKELY(bufavail < sizeof(u64))
@@ -604,9 +1162,14 @@ static void encode_uval(lua_State* L, Encoder* enc, int vi) {
     switch ((enum UValType)uval->type) {
         case UValType_Buf:
             return encode_uval_buf(L, enc, vi, (Buf*)uval);
+        case UValType_SharedBuf:
+            return encode_uval_sharedbuf(L, enc, vi, (SharedBuf*)uval);
+        case UValType_Channel:
+            return encode_uval_channel(L, enc, vi, (Channel*)uval);
         case UValType_Timer:
         case UValType_RemoteTask:
         case UValType_IODesc:
+        case UValType_WorkerPool:
             return codec_error(L, enc, EINVAL,
                                "Cannot clone value of type %s", uval_typename(L, vi));
     }
@@ -618,11 +1181,21 @@ static void decode_uval(lua_State* L, Decoder* dec) {
     usize bufavail = dec->bufend - dec->buf;
     if UNLIKELY(bufavail < 2) // header + uval_type
         return dec_error_short(L, dec);
-    dec->buf++; // consume SCTag_UVAL
+    u8 tag = *dec->buf++;
     u8 uval_type = *dec->buf++;
-    if (uval_type == UValType_Buf)
-        return decode_uval_buf(L, dec);
-    dec_error_bad(L, dec);
+    if (uval_type == UValType_Buf && (tag & SCTagValPtr)) {
+        decode_uval_buf_moved(L, dec);
+    } else if (uval_type == UValType_Buf) {
+        decode_uval_buf(L, dec);
+    } else if (uval_type == UValType_SharedBuf && (tag & SCTagValPtr)) {
+        decode_uval_sharedbuf(L, dec);
+    } else if (uval_type == UValType_Channel && (tag & SCTagValPtr)) {
+        decode_uval_channel(L, dec);
+    } else {
+        return dec_error_bad(L, dec);
+    }
+    if ((tag & SCTagValHasRef) && dec->err_no == 0)
+        dec_ref_register(L, dec);
 }
 
 
@@ -740,6 +1313,8 @@ static void decode_value(lua_State* L, Decoder* dec) {
         case SCTag_UVAL:   return_tail decode_uval(L, dec);
         case SCTag_REFZ:   return_tail decode_refz(L, dec);
         case SCTag_REF:    return_tail decode_ref(L, dec);
+        case SCTag_NUMARRAY: return_tail decode_numarray(L, dec);
+        case SCTag_RECORD: return_tail decode_record(L, dec);
         case SCTag_HEADER: break; // TODO: stop gracefully if this is encountered at top level
     }
     dlog("unexpected byte 0x%02x at offset %zu", dec->buf[0], (usize)(dec->buf - dec->bufstart));
@@ -862,8 +1437,150 @@ static void decode_refmap(lua_State* L, Decoder* dec) {
 }
 
 
+// enc_check_transfer_list checks the transfer_list at stack index idx, which must be nil or
+// an array of Bufs
+static void enc_check_transfer_list(lua_State* L, Encoder* enc, int idx) {
+    if (lua_isnil(L, idx))
+        return;
+    if UNLIKELY(!lua_istable(L, idx))
+        return codec_error(L, enc, EINVAL, "transfer_list must be an array");
+    for (lua_Integer i = 1; lua_rawgeti(L, idx, i) != LUA_TNIL; i++) {
+        UVal* uval = lua_type(L, -1) == LUA_TUSERDATA ? lua_touserdata(L, -1) : NULL;
+        lua_pop(L, 1);
+        if UNLIKELY(!uval || uval->type != UValType_Buf)
+            return codec_error(L, enc, EINVAL, "transfer_list[%d] is not a Buf", (int)i);
+    }
+    lua_pop(L, 1); // nil
+    enc->transfer_list_idx = idx;
+}
+
+
+// enc_finalize_ptrs is called after successful encoding. It acquires a reference to each
+// SharedBuf and Channel encoded by pointer and empties all Bufs in transfer_list. The memory of moved
+// Bufs is now owned by the encoded data; other transferred Bufs' memory is freed.
+static void enc_finalize_ptrs(lua_State* L, Encoder* enc) {
+    EncPtr* ptrv = (EncPtr*)enc->ptrs.bytes;
+    u32 nptrs = enc->ptrs.len / sizeof(EncPtr);
+    for (u32 i = 0; i < nptrs; i++) {
+        if (ptrv[i].src->type == UValType_SharedBuf) {
+            sharedbufdata_retain(((SharedBuf*)ptrv[i].src)->data);
+        } else if (ptrv[i].src->type == UValType_Channel) {
+            channeldata_retain(((Channel*)ptrv[i].src)->data);
+        }
+    }
+    if (enc->transfer_list_idx == 0)
+        return;
+    for (lua_Integer i = 1; lua_rawgeti(L, enc->transfer_list_idx, i) != LUA_TNIL; i++) {
+        Buf* buf = lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        u8* embedded_bytes = (u8*)buf + sizeof(*buf);
+        if (buf->bytes != embedded_bytes) {
+            bool moved = false;
+            for (u32 j = 0; j < nptrs && !moved; j++)
+                moved = ptrv[j].src == &buf->uval;
+            if (!moved)
+                free(buf->bytes);
+            buf->bytes = embedded_bytes;
+        }
+        buf->cap = 0;
+        buf->len = 0;
+    }
+    lua_pop(L, 1); // nil
+}
+
+
+// encode_ptrtab writes the offsets of records encoded by pointer to the end of the data
+//
+//   ┌──────────── ~ ────────────┬───────────┐
+//   │ offset u32 ...            │ count u32 │
+//   └──────────── ~ ────────────┴───────────┘
+static void encode_ptrtab(lua_State* L, Encoder* enc) {
+    EncPtr* ptrv = (EncPtr*)enc->ptrs.bytes;
+    u32 nptrs = enc->ptrs.len / sizeof(EncPtr);
+    u8* dst = buf_reserve(enc->buf, (nptrs + 1) * sizeof(u32));
+    if UNLIKELY(!dst)
+        return enc_error_nomem(L, enc);
+    for (u32 i = 0; i < nptrs; i++) {
+        memcpy(dst, &ptrv[i].offset, sizeof(u32));
+        dst += sizeof(u32);
+    }
+    memcpy(dst, &nptrs, sizeof(u32));
+    enc->buf->len += (nptrs + 1) * sizeof(u32);
+}
+
+
+// decode_ptrtab locates the table written by encode_ptrtab, returning the number of entries
+// and setting *offsv to its start. Returns U32_MAX if the table is invalid.
+static u32 decode_ptrtab(const u8* buf, usize buflen, const u8** offsv) {
+    u32 nptrs;
+    if UNLIKELY(buflen < 4 + sizeof(u32))
+        return U32_MAX;
+    memcpy(&nptrs, buf + buflen - sizeof(u32), sizeof(u32));
+    if UNLIKELY((u64)nptrs + 1 > (buflen - 4) / sizeof(u32))
+        return U32_MAX;
+    *offsv = buf + buflen - ((usize)nptrs + 1) * sizeof(u32);
+    return nptrs;
+}
+
+
+// ptrtab_foreach calls fn with the type and pointer location of every record encoded by
+// pointer which has not yet been decoded
+static void ptrtab_foreach(u8* buf, usize buflen, void(*fn)(u8 uval_type, u8* ptrp)) {
+    const u8* offsv;
+    if (buflen == 0 || (*buf & SCTagValHeaderHasPtrs) == 0)
+        return;
+    u32 nptrs = decode_ptrtab(buf, buflen, &offsv);
+    for (u32 i = 0; i < nptrs; i++) {
+        u32 offset;
+        u64 ptr;
+        memcpy(&offset, offsv + i*sizeof(u32), sizeof(u32));
+        u8 uval_type = buf[offset + 1];
+        u8* ptrp = buf + offset + ptrrec_ptroffs(uval_type);
+        memcpy(&ptr, ptrp, sizeof(u64));
+        if (ptr)
+            fn(uval_type, ptrp);
+    }
+}
+
+
+static void discard_ptr(u8 uval_type, u8* ptrp) {
+    u64 ptr;
+    memcpy(&ptr, ptrp, sizeof(u64));
+    if (uval_type == UValType_SharedBuf) {
+        sharedbufdata_release((SharedBufData*)(uintptr)ptr);
+    } else if (uval_type == UValType_Channel) {
+        channeldata_release((ChannelData*)(uintptr)ptr);
+    } else {
+        free((void*)(uintptr)ptr);
+    }
+    memset(ptrp, 0, sizeof(u64));
+}
+
+
+static void retain_ptr(u8 uval_type, u8* ptrp) {
+    u64 ptr;
+    memcpy(&ptr, ptrp, sizeof(u64));
+    assertf(uval_type != UValType_Buf, "moved Buf can not be shared");
+    if (uval_type == UValType_Channel) {
+        channeldata_retain((ChannelData*)(uintptr)ptr);
+    } else {
+        sharedbufdata_retain((SharedBufData*)(uintptr)ptr);
+    }
+}
+
+
+void structclone_discard(void* buf, usize buflen) {
+    ptrtab_foreach(buf, buflen, discard_ptr);
+}
+
+
+void structclone_retain(void* buf, usize buflen) {
+    ptrtab_foreach(buf, buflen, retain_ptr);
+}
+
+
 int structclone_encode(lua_State* L, Buf* buf, u64 flags, int nargs) {
-    Encoder enc = { .buf = buf, .buf_startoffs = buf->len };
+    Encoder enc = { .buf = buf, .buf_startoffs = buf->len, .flags = flags };
 
     #if 0
         // fill the first 4 kB with AA
@@ -872,7 +1589,12 @@ int structclone_encode(lua_State* L, Buf* buf, u64 flags, int nargs) {
         memset(p, 0xAA, 4*1024);
     #endif
 
-    // TODO: if flags&StructCloneEnc_TRANSFER_LIST, there's a transfer_list array at L[nargs-1]
+    // if flags&StructCloneEnc_TRANSFER_LIST, there's a transfer_list array below the values
+    if (flags & StructCloneEnc_TRANSFER_LIST) {
+        enc_check_transfer_list(L, &enc, lua_gettop(L) - nargs);
+        if UNLIKELY(enc.err_no)
+            return enc.err_no;
+    }
 
     // reserve some reasonable amount of space up front
     // Note: 120 instead of 128 for scenarios of MiniBuf
@@ -896,6 +1618,10 @@ int structclone_encode(lua_State* L, Buf* buf, u64 flags, int nargs) {
     if (enc.nrefs)
         encode_refmap(L, &enc);
 
+    // write table of values encoded by pointer
+    if (enc.ptrs.len && enc.err_no == 0)
+        encode_ptrtab(L, &enc);
+
     // write header (4 bytes)
     //
     //   bit  1   2   3   4   5   6   7   8   9    ...    32
@@ -904,7 +1630,7 @@ int structclone_encode(lua_State* L, Buf* buf, u64 flags, int nargs) {
     //      └───────────┴─┬─┴───────────────┴────── ~ ──────┘
     //                 reserved
     buf->bytes[enc.buf_startoffs] = (u8)SCTag_HEADER
-                                  //| ((u8)(enc.reserved > 0) << SCTagValShift)
+                                  | (enc.ptrs.len ? SCTagValHeaderHasPtrs : 0)
                                   | ((u8)CODEC_VERSION << (SCTagValShift + 1));
     assert(enc.nrefs <= (1 << (3*8)) - 1);
     memcpy(&buf->bytes[enc.buf_startoffs + 1], &enc.nrefs, 3);
@@ -918,11 +1644,18 @@ int structclone_encode(lua_State* L, Buf* buf, u64 flags, int nargs) {
     if (enc.has_reftab)
         lua_remove(L, REFTAB_IDX);
 
+    // take ownership of values encoded by pointer, now that we know that encoding succeeded
+    if (enc.err_no == 0)
+        enc_finalize_ptrs(L, &enc);
+    buf_free(&enc.ptrs);
+    buf_free(&enc.shapes);
+    buf_free(&enc.shapekeys);
+
     return enc.err_no;
 }
 
 
-int structclone_decode(lua_State* L, const void* bufp, usize buflen) {
+int structclone_decode(lua_State* L, void* bufp, usize buflen, u64 flags) {
     const u8* buf = bufp;
 
     // check buflen and header
@@ -938,8 +1671,19 @@ int structclone_decode(lua_State* L, const void* bufp, usize buflen) {
         .bufstart = buf,
         .bufend = buf + buflen,
         .buf = buf + 4, // 4 bytes past header
+        .flags = flags,
     };
 
+    // adjust bufend to right before the table of values encoded by pointer
+    if (*buf & SCTagValHeaderHasPtrs) {
+        const u8* offsv;
+        if UNLIKELY(decode_ptrtab(buf, buflen, &offsv) == U32_MAX) {
+            luaL_error(L, "Invalid data");
+            return -EBADMSG;
+        }
+        dec.bufend = offsv;
+    }
+
     int top_start = lua_gettop(L);
     int stack_base = top_start+1;
 
@@ -954,6 +1698,7 @@ int structclone_decode(lua_State* L, const void* bufp, usize buflen) {
         lua_createtable(L, nrefs, 0);
         lua_rotate(L, 1, REFTAB_IDX); // move reftab down into stack at REFTAB_IDX
         stack_base++;
+        dec.has_keytab = true;
     }
 
     // Decode values in buffer.
@@ -962,8 +1707,9 @@ int structclone_decode(lua_State* L, const void* bufp, usize buflen) {
         decode_value(L, &dec);
 
     // free reftab & refmap, if used
-    if (nrefs) {
+    if (dec.has_keytab)
         lua_remove(L, REFTAB_IDX);
+    if (nrefs) {
         if (dec.refmap && (u8*)dec.refmap != dec.bufend)
             free(dec.refmap);
     } else {
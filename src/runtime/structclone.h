@@ -6,8 +6,37 @@ API_BEGIN
 
 // StructCloneEnc_ are flags for structclone_encode
 #define StructCloneEnc_TRANSFER_LIST (1ul<<0) // transfer_list on L's stack
+#define StructCloneEnc_PTRS          (1ul<<1) // encode by pointer (moved Bufs, SharedBufs, Channels)
 
+// StructCloneDec_ are flags for structclone_decode
+#define StructCloneDec_PTRS   (1ul<<0) // accept data encoded with StructCloneEnc_PTRS
+#define StructCloneDec_SHARED (1ul<<1) // data is shared by several decoders (see below)
+
+// structclone_encode encodes the nargs values at the top of L's stack, appending to buf.
+// With StructCloneEnc_TRANSFER_LIST, an array of Bufs (or nil) is on the stack just below
+// the values. Each Buf in that list is detached (left empty) when encoding succeeds.
+// With StructCloneEnc_PTRS, the encoded data takes ownership of the heap memory of transferred
+// Bufs instead of copying it, and holds a reference to each SharedBuf and Channel. Such data contains
+// pointers and must never be exposed to Lua code. It must be passed to structclone_decode with
+// StructCloneDec_PTRS or to structclone_discard.
 int structclone_encode(lua_State* L, Buf* buf, u64 flags, int nargs);
-int structclone_decode(lua_State* L, const void* buf, usize buflen);
+
+// structclone_decode decodes values in buf, pushing them onto L's stack.
+// Ownership of moved Bufs and SharedBuf references passes to the decoded values;
+// buf is updated to reflect that.
+// With StructCloneDec_SHARED, buf is left unchanged and the decoded values acquire their own
+// references instead, so that the same data can be decoded any number of times, also
+// concurrently. Such data must not contain moved Bufs.
+int structclone_decode(lua_State* L, void* buf, usize buflen, u64 flags);
+
+// structclone_discard frees memory of moved Bufs and releases SharedBuf references which
+// have not been taken over by structclone_decode.
+// Must be called before freeing data encoded with StructCloneEnc_PTRS.
+void structclone_discard(void* buf, usize buflen);
+
+// structclone_retain acquires an additional reference to each SharedBuf in data encoded
+// with StructCloneEnc_PTRS, for use when making a copy of the data.
+// The data must not contain moved Bufs, since those can only have one owner.
+void structclone_retain(void* buf, usize buflen);
 
 API_END
@@ -7,6 +7,9 @@ enum UValType {
     UValType_Timer,
     UValType_RemoteTask,
     UValType_IODesc,
+    UValType_WorkerPool,
+    UValType_SharedBuf,
+    UValType_Channel,
 };
 
 // UVal is the common header of Lua userdata values
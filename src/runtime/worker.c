@@ -17,3 +17,162 @@ const char* fmtaworker(const AWorker* aw) {
     snprintf(buf, fmtbuf_cap(), AWORKER_ID_F, aworker_id(aw));
     return buf;
 }
+
+
+void worker_placement_init(WorkerPlacement* p) {
+    memset(p, 0, sizeof(*p));
+    p->numa_node = -1;
+}
+
+
+#if defined(__linux__)
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+
+#define MPOL_PREFERRED 1 // from linux/mempolicy.h
+
+// parse_cpulist parses a Linux "cpu list", e.g. "0-3,8,10-11", adding CPUs to mask.
+// Returns the first CPU in the list, or -1 if the list is empty or invalid.
+static int parse_cpulist(const char* s, u64* mask, u32 maxcpu) {
+    int first = -1;
+    while (*s >= '0' && *s <= '9') {
+        char* end;
+        unsigned long start = strtoul(s, &end, 10), last = start;
+        if (*end == '-')
+            last = strtoul(end + 1, &end, 10);
+        if (last < start)
+            return -1;
+        for (unsigned long cpu = start; cpu <= last && cpu < maxcpu; cpu++) {
+            if (mask)
+                mask[cpu / 64] |= (u64)1 << (cpu % 64);
+        }
+        if (first == -1)
+            first = (int)start;
+        if (*end != ',')
+            break;
+        s = end + 1;
+    }
+    return first;
+}
+
+
+static int read_cpulist(const char* path, u64* nullable mask) {
+    char buf[512];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    int err = -errno;
+    close(fd);
+    if (n < 0)
+        return err;
+    buf[n] = 0;
+    int first = parse_cpulist(buf, mask, WORKER_MAXCPUS);
+    return first < 0 ? -EINVAL : first;
+}
+
+
+int worker_placement_numa_cpus(WorkerPlacement* p, u32 node) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+    int first = read_cpulist(path, p->cpumask);
+    return first < 0 ? first : 0;
+}
+
+
+// g_cores is the list of physical cores (one CPU per core) available to the process
+static u16*           g_cores;
+static u32            g_cores_len;
+static _Atomic(u32)   g_cores_next;
+static pthread_once_t g_cores_once = PTHREAD_ONCE_INIT;
+
+
+static void cores_init() {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+    if (!( g_cores = malloc(sizeof(*g_cores) * (usize)CPU_COUNT(&allowed)) ))
+        return;
+    for (u32 cpu = 0; cpu < MIN(CPU_SETSIZE, WORKER_MAXCPUS); cpu++) {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+        // A CPU represents its core if it's the first of its SMT siblings.
+        // If topology is unknown, treat each CPU as a core.
+        char path[80];
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", cpu);
+        int first_sibling = read_cpulist(path, NULL);
+        if (first_sibling < 0 || (u32)first_sibling == cpu || !CPU_ISSET(first_sibling, &allowed))
+            g_cores[g_cores_len++] = (u16)cpu;
+    }
+}
+
+
+int worker_placement_next_core(WorkerPlacement* p) {
+    pthread_once(&g_cores_once, cores_init);
+    if (g_cores_len == 0)
+        return -ENOTSUP;
+    u32 i = atomic_fetch_add_explicit(&g_cores_next, 1, memory_order_relaxed);
+    memset(p->cpumask, 0, sizeof(p->cpumask));
+    worker_placement_setcpu(p, g_cores[i % g_cores_len]);
+    return 0;
+}
+
+
+int worker_thread_attr(const WorkerPlacement* p, pthread_attr_t* attr) {
+    int err;
+    if (p->stack_size && (err = pthread_attr_setstacksize(attr, p->stack_size)))
+        return -err;
+    if (worker_placement_hascpus(p)) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (u32 cpu = 0; cpu < MIN(CPU_SETSIZE, WORKER_MAXCPUS); cpu++) {
+            if (p->cpumask[cpu / 64] & ((u64)1 << (cpu % 64)))
+                CPU_SET(cpu, &cpus);
+        }
+        if (( err = pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus) ))
+            return -err;
+    }
+    return 0;
+}
+
+
+int worker_thread_set_numa_node(u32 node) {
+    unsigned long nodemask[WORKER_MAXCPUS / (8 * sizeof(unsigned long))] = {};
+    if (node >= WORKER_MAXCPUS)
+        return -EINVAL;
+    nodemask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodemask, (unsigned long)WORKER_MAXCPUS + 1))
+        return -errno;
+    return 0;
+}
+
+
+#else // no CPU affinity or NUMA support
+
+
+int worker_placement_numa_cpus(WorkerPlacement* p, u32 node) {
+    return -ENOTSUP;
+}
+
+int worker_placement_next_core(WorkerPlacement* p) {
+    return -ENOTSUP;
+}
+
+int worker_thread_attr(const WorkerPlacement* p, pthread_attr_t* attr) {
+    int err;
+    if (worker_placement_hascpus(p))
+        return -ENOTSUP;
+    if (p->stack_size && (err = pthread_attr_setstacksize(attr, p->stack_size)))
+        return -err;
+    return 0;
+}
+
+int worker_thread_set_numa_node(u32 node) {
+    return -ENOTSUP;
+}
+
+
+#endif
@@ -1,6 +1,8 @@
 #pragma once
 #include "../dew.h"
 #include "runtime.h"
+#include "tsem.h"
+#include "spsc.h"
 
 #if defined(__linux__) || defined(__APPLE__)
     #include <pthread.h>
@@ -22,6 +24,9 @@ enum AsyncWorkOp {
     AsyncWorkOp_NANOSLEEP = 1,
     AsyncWorkOp_ADDRINFO = 2,
     AsyncWorkOp_WORKER_MSG = 0x1000, // message sent to the worker's main task from another worker
+    AsyncWorkOp_CHAN_WAKE = 0x1001,  // a channel which a task is waiting for is ready (result=ch)
+    AsyncWorkOp_PUBLISH = 0x1002,    // message published to a topic
+                                     // (result=Publication, owned; tid=publisher's sid)
 };
 
 #define AsyncWorkFlag_HAS_CONT ((u16)1 << 0) // has continuation
@@ -40,12 +45,13 @@ typedef struct AsyncWorkRes {
             u16 flags;  //
             u32 tid;    // task waiting for this work
             i64 result; // output result
+            u64 arg;    // input argument (AsyncWorkReq.arg)
         } __attribute__((packed));
         struct { // op == AsyncWorkOp_WORKER_MSG
             u16      _unused1;
             u32      sender_sid;
             u32      sender_tid; // tid in namespace of receiving worker's parent S
-            u32      _unsued2;
+            u32      dst_tid;    // receiving task, in namespace of receiving S
             MiniBuf* buf; // owned by this AsyncWorkRes
         } __attribute__((packed)) msg;
     };
@@ -62,6 +68,19 @@ enum WorkerKind {
     WorkerKind_ASYNC, // AWorker: for blocking async work like syscalls
 };
 
+// WorkerPlacement configures the OS thread of a worker (see worker_start)
+#define WORKER_MAXCPUS 1024
+typedef struct WorkerPlacement {
+    u32 stack_size; // thread stack size in bytes (0 = OS default)
+    i32 numa_node;  // NUMA node for memory allocations (-1 = no preference)
+    u64 cpumask[WORKER_MAXCPUS / 64]; // CPUs the thread may run on (all zero = no affinity)
+} WorkerPlacement;
+
+enum WorkerPlacementPolicy {
+    WorkerPlacementPolicy_NONE, // OS decides where workers run
+    WorkerPlacementPolicy_CORE, // each new user worker is pinned to the next physical core
+};
+
 struct Worker {
     // state accessed by both parent thread and worker thread
     u8           wkind;   // enum WorkerKind
@@ -71,14 +90,23 @@ struct Worker {
     OSThread     thread;
 
     // state accessed only by parent thread
-    S*               s;    // S which spawned this worker
-    Worker* nullable next; // list link in S.workers
+    S*                  s;        // S which spawned this worker
+    Worker* nullable    next;     // list link in S.workers
+    TWaitNode* nullable mwaiters; // list of T_WAIT_SET tasks waiting for this worker to exit
 };
 
 struct UWorker { // wkind == WorkerKind_USER
     Worker w;
     u32    spawned_by_tid;
-    u32    _unused;
+    i32    numa_node; // NUMA node for memory allocations of the worker's thread (or -1)
+    _Atomic(u32) npending; // messages sent to the main task which it has not yet received
+    bool         iswarm;   // started "pre-warmed"; parks until handed a main function
+
+    // pre-warmed worker state (see s_warm_fill)
+    UWorker* nullable warm_next;  // list link in S.warm_workers
+    void* nullable    warm_lcode; // code of main function handed over, or NULL for preloaded
+    u32               warm_lcode_len;
+    TSem              warm_sem;   // signalled when handed a main function (or closed)
     union { // input & output data (as input for workeru_open, as output from worker exit.)
         struct { // input
             // mainfun_lcode contains Lua bytecode for the main function, used during setup.
@@ -99,14 +127,14 @@ struct UWorker { // wkind == WorkerKind_USER
 
 struct AWorker { // wkind == WorkerKind_ASYNC
     Worker w;
-    //
-    // ———— HERE ————
-    // change to...
-    // - using one SPSC queue per worker (can use AsyncWorkCQ)
-    // - upon work to be done, selecting a free worker (1:1 S:AWorker so no race)
-    // - get rid of TSQ
-    //
-    // AsyncWorkCQ q;
+    SPSC*         sq;       // submission queue of AsyncWorkReq, written by S
+    SPSC*         cq;       // completion queue of AsyncWorkRes, read by S
+    TSem          sem;      // signalled by S when there's work in sq (or when closed)
+    _Atomic(bool) sleeping; // true while waiting on sem
+    u32           nqueued;  // requests submitted but not yet completed (accessed only by S)
+    bool          reaped;   // closed by S for being idle (accessed only by S)
+    _Atomic(DTime)         idle_since;   // when the worker last finished work
+    _Atomic(DTimeDuration) idle_timeout; // S.asyncwork_idle_timeout (0 = wait forever)
     union {
         uintptr      req_is_active; // 0 when work is unused
         AsyncWorkReq req;           // work currently being processed
@@ -120,6 +148,102 @@ typedef struct UWorkerUVal {
     UWorker* uw;
 } UWorkerUVal;
 
+// worker_placement_init initializes p to "no placement" (OS defaults)
+void worker_placement_init(WorkerPlacement* p);
+inline static void worker_placement_setcpu(WorkerPlacement* p, u32 cpu) {
+    p->cpumask[cpu / 64] |= (u64)1 << (cpu % 64);
+}
+inline static bool worker_placement_hascpus(const WorkerPlacement* p) {
+    for (usize i = 0; i < countof(p->cpumask); i++) {
+        if (p->cpumask[i])
+            return true;
+    }
+    return false;
+}
+
+// worker_placement_numa_cpus adds the CPUs of NUMA node to p's cpumask.
+// Returns -errno on error, e.g. -ENOENT if there's no such node.
+int worker_placement_numa_cpus(WorkerPlacement* p, u32 node);
+
+// worker_placement_next_core sets p's cpumask to the next physical core in round-robin order.
+// SMT siblings (hyperthreads) count as one core. Only CPUs available to the process are used.
+// Returns -errno on error.
+int worker_placement_next_core(WorkerPlacement* p);
+
+// worker_thread_attr configures attr according to p.
+// Returns -errno on error, e.g. -ENOTSUP if CPU affinity is not supported on the platform.
+int worker_thread_attr(const WorkerPlacement* p, pthread_attr_t* attr);
+
+// worker_thread_set_numa_node makes the calling thread prefer memory of NUMA node
+// for future allocations. Returns -errno on error.
+int worker_thread_set_numa_node(u32 node);
+
+// WorkerPool is a Lua-managed group of user workers running the same function.
+// Messages sent to the pool are dispatched to the worker with the fewest pending messages.
+typedef struct WorkerPool {
+    UVal      uval;    // .type=UValType_WorkerPool
+    u32       len;     // number of workers
+    u32       cap;     // capacity of workers array
+    u32       next;    // index of worker to consider first when dispatching
+    u32       spawned_by_tid;
+    UWorker** workers; // pool holds a reference to each worker
+    Buf       lcode;   // Lua bytecode of the workers' main function (for growing the pool)
+} WorkerPool;
+
+// ChanWaiter is a task waiting to send to or receive from a channel
+typedef struct ChanWaiter ChanWaiter;
+struct ChanWaiter {
+    ChanWaiter* nullable next;
+    S*                   s;   // scheduler of the task; retained by the entry if a worker
+    u32                  tid; // waiting task
+};
+
+// ChannelData is the state of a channel, shared by the workers which have a reference to it.
+// Values are structclone-encoded MiniBufs so that they can be received by any worker.
+typedef struct ChannelData {
+    _Atomic(u32)         refcount;
+    _Atomic(u32)         nfree;  // free slots; a sender claims one before writing to q
+    _Atomic(u32)         nsendq; // number of entries in sendq
+    _Atomic(u32)         nrecvq; // number of entries in recvq
+    _Atomic(bool)        closed;
+    u32                  cap;    // capacity requested by chan(cap)
+    Chan*                q;      // queue of MiniBuf*
+    pthread_mutex_t      mu;     // guards sendq & recvq
+    ChanWaiter* nullable sendq;  // tasks waiting for a free slot (FIFO)
+    ChanWaiter* nullable recvq;  // tasks waiting for a value (FIFO)
+} ChannelData;
+
+// Channel is a Lua-managed reference to ChannelData
+typedef struct Channel {
+    UVal         uval; // .type=UValType_Channel
+    ChannelData* data;
+} Channel;
+
+void channeldata_retain(ChannelData* ch);
+void channeldata_release(ChannelData* ch);
+
+// l_channel_createx puts a Channel for ch on L's stack, taking over a reference to ch
+Channel* l_channel_createx(lua_State* L, ChannelData* ch);
+
+// Topic is a named destination for publish. It lists the schedulers which have at least one
+// task subscribed to it. Topics are created on first use and freed when no scheduler
+// subscribes to them and no publication to them is in flight (see topic_release.)
+struct Topic {
+    Topic* nullable next;    // next topic in g_topics
+    Array(S*)       subs;    // schedulers with subscribed tasks (guarded by g_topics_mu)
+    u32             nrefs;   // one per entry in subs + Publications (guarded by g_topics_mu)
+    u32             namelen;
+    char            name[];
+};
+
+// Publication is a message published to a topic. It is encoded once and shared by reference
+// by all receiving tasks, each of which decodes it when it receives it.
+struct Publication {
+    _Atomic(u32) refcount;
+    Topic*       topic;
+    MiniBuf*     buf; // encoded with StructCloneEnc_PTRS, decoded with StructCloneDec_SHARED
+};
+
 // uworker_id formats a UWorker for logging
 #define uworker_id(uw) (unsigned long)(uintptr)(uw), (uw)->s.sid
 #define UWORKER_ID_F   "UWorker#%lx(S%u)"
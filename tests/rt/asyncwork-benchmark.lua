@@ -0,0 +1,25 @@
+-- measures throughput of blocking syscalls offloaded to async worker threads
+__rt.main(function()
+	local N = tonumber(os.getenv("N") or "20000") -- total number of syscalls
+	local function bench(ntasks)
+		local tasks = {}
+		local time = __rt.monotime()
+		for i = 1, ntasks do
+			tasks[i] = __rt.spawn_task(function()
+				for i = 1, N // ntasks do
+					__rt.syscall_nanosleep(0)
+				end
+			end)
+		end
+		for i = 1, ntasks do
+			__rt.await(tasks[i])
+		end
+		time = __rt.monotime() - time
+		print(string.format("%3d concurrent tasks: %d syscalls in %.2fms, avg %dns",
+		                    ntasks, N, time / 1000000.0, time // N))
+	end
+	bench(1)
+	bench(4)
+	bench(16)
+	bench(64)
+end)
@@ -0,0 +1,102 @@
+-- the async work thread pool is bounded; requests beyond max wait in a queue, and threads
+-- which have been idle for a while exit
+__rt.main(function()
+	local ms = 1000*1000 -- TimeDuration of one millisecond
+
+	assert(not pcall(__rt.asyncwork_pool, {max = 0}))
+	assert(not pcall(__rt.asyncwork_pool, {min = 3, max = 2}))
+	assert(not pcall(__rt.asyncwork_pool, {idle_timeout = -1}))
+
+	local stats = __rt.asyncwork_pool({min = 1, max = 4, idle_timeout = 50*ms})
+	assert(stats.min == 1 and stats.max == 4 and stats.idle_timeout == 50*ms)
+	assert(stats.nworkers == 1) -- min threads are started right away
+	assert(stats.queued == 0)
+
+	-- more concurrent requests than max
+	local N = 20
+	local ndone = 0
+	local tasks = {}
+	for i = 1, N do
+		tasks[i] = __rt.spawn_task(function()
+			assert(__rt.syscall_nanosleep(100*ms) == 0)
+			ndone = ndone + 1
+		end)
+	end
+	__rt.yield() -- let all tasks submit their requests
+	stats = __rt.asyncwork_pool()
+	assert(stats.nworkers == 4, tostring(stats.nworkers))
+	assert(stats.nbusy == 4, tostring(stats.nbusy))
+	assert(stats.queued == N - 4, tostring(stats.queued))
+	for i = 1, N do
+		assert(__rt.await(tasks[i]))
+	end
+	assert(ndone == N)
+	stats = __rt.asyncwork_pool()
+	assert(stats.queued == 0)
+	assert(stats.queued_max == N - 4, tostring(stats.queued_max))
+	assert(stats.nspawned == 4, tostring(stats.nspawned))
+
+	-- idle threads exit, down to min
+	local deadline = __rt.monotime() + 5000*ms
+	repeat
+		__rt.sleep(20*ms)
+		stats = __rt.asyncwork_pool()
+	until stats.nworkers == 1 or __rt.monotime() > deadline
+	assert(stats.nworkers == 1, tostring(stats.nworkers))
+	assert(stats.nreaped == 3, tostring(stats.nreaped))
+
+	-- the pool grows again on demand
+	tasks = {}
+	for i = 1, 3 do
+		tasks[i] = __rt.spawn_task(function()
+			assert(__rt.syscall_nanosleep(20*ms) == 0)
+		end)
+	end
+	for i = 1, 3 do
+		assert(__rt.await(tasks[i]))
+	end
+	stats = __rt.asyncwork_pool({idle_timeout = 0})
+	assert(stats.nspawned == 6, tostring(stats.nspawned))
+
+	-- requests of tasks which are stopped while waiting are dropped when a thread frees up
+	local parent = __rt.spawn_task(function()
+		for i = 1, N do
+			__rt.spawn_task(function()
+				__rt.syscall_nanosleep(200*ms)
+				error("unreachable")
+			end)
+		end
+		__rt.yield() -- let the children submit their requests
+	end) -- children are stopped when their parent exits
+	assert(__rt.await(parent))
+	repeat
+		__rt.sleep(20*ms)
+		stats = __rt.asyncwork_pool()
+	until stats.nbusy == 0
+	assert(stats.queued == 0, tostring(stats.queued))
+
+	-- memory owned by dropped requests is freed.
+	-- Keep all threads busy so that the requests wait in the queue until their tasks are gone.
+	tasks = {}
+	for i = 1, 4 do
+		tasks[i] = __rt.spawn_task(function()
+			assert(__rt.syscall_nanosleep(200*ms) == 0)
+		end)
+	end
+	__rt.yield() -- let the tasks submit their requests
+	parent = __rt.spawn_task(function()
+		for i = 1, N do
+			__rt.spawn_task(function()
+				__rt.syscall_addrinfo("127.0.0.1", 80)
+			end)
+		end
+		__rt.yield() -- let the children submit their requests
+	end)
+	assert(__rt.await(parent))
+	stats = __rt.asyncwork_pool()
+	assert(stats.queued == N, tostring(stats.queued))
+	for i = 1, 4 do
+		assert(__rt.await(tasks[i]))
+	end
+	assert(__rt.asyncwork_pool().queued == 0)
+end)
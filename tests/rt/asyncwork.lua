@@ -0,0 +1,21 @@
+-- blocking syscalls are offloaded to async worker threads. More concurrent requests than
+-- there are worker threads are queued; all of them complete.
+__rt.main(function()
+	local N = 200
+	local ndone = 0
+	local tasks = {}
+	local time = __rt.monotime()
+	for i = 1, N do
+		tasks[i] = __rt.spawn_task(function()
+			assert(__rt.syscall_nanosleep(10*1000*1000) == 0)
+			ndone = ndone + 1
+		end)
+	end
+	for i = 1, N do
+		__rt.await(tasks[i])
+	end
+	assert(ndone == N)
+	-- requests ran concurrently (serially this would take N*10ms)
+	time = __rt.monotime() - time
+	assert(time < N*10*1000*1000 / 4, "took " .. time // 1000000 .. "ms")
+end)
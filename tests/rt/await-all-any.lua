@@ -0,0 +1,60 @@
+-- await_all and await_any wait for several tasks at once
+__rt.main(function()
+	do	-- await_all returns what await would return, for each task
+		local T2 = __rt.spawn_task(function() __rt.sleep(2*1000*1000); return 2, "two" end)
+		local T3 = __rt.spawn_task(function() return 3 end)
+		local T4 -- stopped when its parent exits
+		__rt.await(__rt.spawn_task(function()
+			T4 = __rt.spawn_task(function() __rt.sleep(1*1000*1000) end)
+		end))
+		local T5 = __rt.spawn_task(function() end)
+		__rt.await(T5) -- already exited
+		local res = __rt.await_all({ T2, T3, T4, T5 })
+		assert(#res == 4)
+		assert(res[1][1] == 1 and res[1][2] == 2 and res[1][3] == "two")
+		assert(res[2][1] == 1 and res[2][2] == 3)
+		assert(res[3][1] == 2)
+		assert(res[4][1] == 1 and #res[4] == 1)
+	end
+
+	do	-- await_any returns the index of the first task to exit
+		local T2 = __rt.spawn_task(function() __rt.sleep(50*1000*1000); return 2 end)
+		local T3 = __rt.spawn_task(function() __rt.sleep(1*1000*1000); return 3 end)
+		local i, ok, v = __rt.await_any({ T2, T3 })
+		assert(i == 2 and ok == 1 and v == 3)
+		-- T2 is no longer being waited on; regular await still works
+		ok, v = __rt.await(T2)
+		assert(ok == 1 and v == 2)
+		-- returns immediately when a task has already exited
+		i, ok, v = __rt.await_any({ T3, T2 })
+		assert(i == 1 and ok == 1 and v == 3)
+	end
+
+	do	-- a task waiting in await_any can be stopped
+		local T3 = __rt.spawn_task(function() __rt.sleep(5*1000*1000) end)
+		local T2 = __rt.spawn_task(function()
+			__rt.spawn_task(function() __rt.await_any({ T3 }) end)
+		end)
+		__rt.await(T2)
+		-- T3 must not try to wake the stopped task
+		assert(__rt.await(T3) == 1)
+	end
+
+	do	-- mixing local tasks and workers
+		local W1 = __rt.spawn_worker(function() __rt.sleep(5*1000*1000) end)
+		local W2 = __rt.spawn_worker(function() end)
+		local T2 = __rt.spawn_task(function() return 2 end)
+		local res = __rt.await_all({ W1, T2, W2 })
+		assert(res[1][1] == true)
+		assert(res[2][1] == 1 and res[2][2] == 2)
+		assert(res[3][1] == true)
+		-- worker which has already exited
+		local i, ok = __rt.await_any({ W1, T2 })
+		assert(i == 1 and ok == true)
+	end
+
+	do	-- invalid arguments
+		assert(not pcall(__rt.await_all, {}))
+		assert(not pcall(__rt.await_any, { 123.5 }))
+	end
+end)
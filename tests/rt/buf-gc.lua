@@ -0,0 +1,36 @@
+-- the memory of large Bufs, which is allocated outside of Lua, causes garbage collections
+__rt.main(function()
+	local function check(name, create)
+		collectgarbage("collect")
+		local live = setmetatable({}, {__mode = "k"})
+		local n = 256
+		for i = 1, n do
+			live[create()] = true
+		end
+		local count = 0
+		for _ in pairs(live) do
+			count = count + 1
+		end
+		assert(count < n/2,
+			count .. " of " .. n .. " unreachable 1 MiB Bufs (" .. name .. ") were not collected")
+	end
+
+	check("created", function()
+		return __rt.buf_create(1024*1024)
+	end)
+
+	-- Bufs which start small and grow
+	check("resized", function()
+		local buf = __rt.buf_create(64)
+		buf:resize(1024*1024)
+		return buf
+	end)
+	local chunk = string.rep("x", 64*1024)
+	check("appended", function()
+		local buf = __rt.buf_create(64)
+		for i = 1, 16 do
+			buf:append(chunk)
+		end
+		return buf
+	end)
+end)
@@ -0,0 +1,120 @@
+-- channels pass values between tasks and workers, suspending the task on a full or empty channel
+__rt.main(function()
+	-- capacity is exact; a full channel suspends the sender until a value is received
+	local ch = __rt.chan(3)
+	assert(#ch == 0)
+	local nsent = 0
+	local T = __rt.spawn_task(function()
+		for i = 1, 10 do
+			ch:send({i = i})
+			nsent = i
+		end
+		ch:close()
+	end)
+	__rt.yield()
+	assert(nsent == 3, tostring(nsent))
+	assert(#ch == 3)
+	for i = 1, 10 do
+		local v, ok = ch:recv()
+		assert(ok == true)
+		assert(v.i == i, "got " .. tostring(v.i) .. ", expected " .. i)
+	end
+	assert(__rt.await(T))
+
+	-- a closed channel delivers its remaining values, then nil,false
+	ch = __rt.chan(4)
+	ch:send(1)
+	ch:send(2)
+	ch:close()
+	assert(select(2, ch:recv()) == true)
+	assert(ch:recv() == 2)
+	local v, ok = ch:recv()
+	assert(v == nil and ok == false)
+	assert(not pcall(ch.send, ch, 3))
+	assert(not pcall(ch.close, ch))
+
+	-- closing a channel wakes up all waiting receivers
+	ch = __rt.chan(1)
+	local tasks = {}
+	for i = 1, 3 do
+		tasks[i] = __rt.spawn_task(function()
+			local v, ok = ch:recv()
+			assert(v == nil and ok == false)
+		end)
+	end
+	__rt.yield()
+	ch:close()
+	for i = 1, 3 do
+		assert(__rt.await(tasks[i]))
+	end
+
+	-- a receiver which is stopped after being woken passes the value on to the next receiver
+	ch = __rt.chan(1)
+	local go = __rt.chan(1)
+	local parent = __rt.spawn_task(function()
+		__rt.spawn_task(function() -- first in line to receive
+			ch:recv()
+			error("unreachable")
+		end)
+		__rt.yield()
+		go:recv()
+		ch:send("v") -- wakes the child, which is stopped when we return, before it runs
+	end)
+	__rt.yield()
+	local receiver = __rt.spawn_task(function()
+		local v, ok = ch:recv()
+		assert(v == "v" and ok == true)
+	end)
+	__rt.yield()
+	go:send(true)
+	assert(__rt.await(receiver))
+	assert(__rt.await(parent))
+
+	-- a task which would wait forever is an error rather than a hang
+	ch = __rt.chan(1)
+	local ok, err = pcall(ch.recv, ch)
+	assert(not ok and err:find("deadlock"), err)
+	ch:send(1)
+	ok, err = pcall(ch.send, ch, 2)
+	assert(not ok and err:find("deadlock"), err)
+
+	-- channels can not be encoded into a Buf
+	assert(__rt.structclone_encode(0, nil, ch) == nil)
+
+	-- a pipeline of workers, connected by channels with backpressure
+	local function stage_main()
+		local typ, sender, input, output = __rt.recv()
+		while true do
+			local v, ok = input:recv()
+			if not ok then
+				break
+			end
+			output:send(v * 2)
+		end
+		output:close()
+	end
+	local c1, c2, c3 = __rt.chan(2), __rt.chan(2), __rt.chan(2)
+	local w1 = __rt.spawn_worker(stage_main)
+	local w2 = __rt.spawn_worker(stage_main)
+	__rt.send(w1, c1, c2)
+	__rt.send(w2, c2, c3)
+	local N = 500
+	local producer = __rt.spawn_task(function()
+		for i = 1, N do
+			c1:send(i)
+		end
+		c1:close()
+	end)
+	local sum = 0
+	while true do
+		local v, ok = c3:recv()
+		if not ok then
+			break
+		end
+		sum = sum + v
+	end
+	assert(sum == 4 * N * (N + 1) / 2, tostring(sum))
+	assert(__rt.await(producer))
+	assert(__rt.await(w1) == true)
+	assert(__rt.await(w2) == true)
+end)
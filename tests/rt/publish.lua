@@ -0,0 +1,128 @@
+-- messages published to a topic reach every subscribed task, in this and other workers
+__rt.main(function()
+	local PUBLISH = 5 -- recv type of published messages
+
+	-- nobody is subscribed yet
+	assert(__rt.publish("config", 1) == 0)
+
+	-- tasks of the same S
+	local got = {}
+	local tasks = {}
+	for i = 1, 3 do
+		tasks[i] = __rt.spawn_task(function()
+			__rt.subscribe("config")
+			__rt.subscribe("config") -- no effect
+			local typ, topic, v = __rt.recv()
+			assert(typ == PUBLISH, tostring(typ))
+			assert(topic == "config")
+			got[i] = v
+		end)
+	end
+	__rt.yield() -- let tasks subscribe
+	local cfg = {name = "a", n = 1}
+	assert(__rt.publish("config", cfg) == 1) -- one scheduler: this one
+	for i = 1, 3 do
+		assert(__rt.await(tasks[i]))
+		assert(got[i].name == "a" and got[i].n == 1)
+		assert(got[i] ~= cfg) -- a copy
+	end
+	-- exited tasks are unsubscribed
+	assert(__rt.publish("config", cfg) == 0)
+
+	-- unsubscribe
+	__rt.subscribe("x")
+	assert(__rt.unsubscribe("x") == true)
+	assert(__rt.unsubscribe("x") == false)
+	assert(__rt.unsubscribe("never") == false)
+	assert(not pcall(__rt.subscribe, ""))
+
+	-- workers decode their own copy of a message that was encoded once
+	local function worker_main()
+		local PUBLISH = 5
+		__rt.subscribe("config")
+		__rt.subscribe("stop")
+		local typ, sender = __rt.recv() -- "ready?"
+		__rt.send(sender, "ready")
+		local n = 0
+		local last
+		while true do
+			local typ, topic, v, sb = __rt.recv()
+			assert(typ == PUBLISH, tostring(typ))
+			if topic == "stop" then
+				break
+			end
+			assert(v.gen == n + 1, "got " .. tostring(v.gen) .. ", expected " .. (n + 1))
+			assert(sb:get_u8(0) == 7)
+			n = v.gen
+		end
+		__rt.send(sender, "count", n)
+	end
+
+	local N = 3
+	local workers = {}
+	for i = 1, N do
+		workers[i] = __rt.spawn_worker(worker_main)
+		__rt.send(workers[i], "ready?")
+		local typ, sender, msg = __rt.recv()
+		assert(msg == "ready", tostring(msg))
+	end
+
+	-- also a local subscriber
+	local local_n = 0
+	local T = __rt.spawn_task(function()
+		__rt.subscribe("config")
+		__rt.subscribe("stop")
+		while true do
+			local typ, topic, v = __rt.recv()
+			if topic == "stop" then
+				break
+			end
+			local_n = v.gen
+		end
+	end)
+	__rt.yield()
+
+	local buf = __rt.buf_create(8, 8)
+	buf:set_u8(0, 7)
+	local sb = __rt.sharedbuf_create(buf)
+	local NPUB = 100
+	for gen = 1, NPUB do
+		assert(__rt.publish("config", {gen = gen, data = string.rep("x", 64)}, sb) == N + 1)
+	end
+	sb = nil
+	assert(__rt.publish("stop") == N + 1)
+
+	-- workers report how many messages they saw
+	local nreplies = 0
+	while nreplies < N do
+		local typ, sender, kind, n = __rt.recv()
+		if kind == "count" then
+			assert(n == NPUB, tostring(n))
+			nreplies = nreplies + 1
+		end
+	end
+	for i = 1, N do
+		assert(__rt.await(workers[i]) == true)
+	end
+	assert(__rt.await(T))
+	assert(local_n == NPUB)
+
+	-- a worker which exited is no longer subscribed
+	assert(__rt.publish("config", {}) == 0)
+
+	-- topics without subscribers are freed, also when many distinct names are used;
+	-- messages already in the inbox are still delivered after unsubscribing
+	for i = 1, 100 do
+		local topic = "dyn" .. i
+		__rt.subscribe(topic)
+		assert(__rt.publish(topic, i) == 1)
+		assert(__rt.unsubscribe(topic) == true)
+		assert(__rt.unsubscribe(topic) == false)
+		assert(__rt.publish(topic, i) == 0)
+		local typ, topic2, v
+		repeat
+			typ, topic2, v = __rt.recv()
+		until typ == PUBLISH -- skip "worker closed" messages
+		assert(topic2 == topic and v == i)
+	end
+end)
@@ -0,0 +1,40 @@
+-- sched_spin configures spinning before S blocks in iopoll
+__rt.main(function()
+	local prev_max, hits, misses = __rt.sched_spin()
+	assert(prev_max >= 0 and hits >= 0 and misses >= 0)
+
+	local function pingpong(n)
+		local W1 = __rt.spawn_worker(function()
+			while true do
+				local _, sender, v = __rt.recv()
+				if v == nil then break end
+				__rt.send(sender, v + 1)
+			end
+		end)
+		for i = 1, n do
+			__rt.send(W1, i)
+			local typ, _, v
+			repeat -- skip "worker closed" messages from previous workers
+				typ, _, v = __rt.recv()
+			until typ ~= 4 -- 4 == WORKER_CLOSED
+			assert(v == i + 1)
+		end
+		__rt.send(W1)
+		assert(__rt.await(W1) == true)
+	end
+
+	-- messages are delivered with spinning enabled...
+	assert(__rt.sched_spin(4096) == prev_max)
+	pingpong(100)
+	local max, hits2, misses2 = __rt.sched_spin(0)
+	assert(max == 4096)
+	assert(hits2 + misses2 >= hits + misses)
+
+	-- ...and with spinning disabled, in which case counters don't change
+	pingpong(100)
+	max, hits, misses = __rt.sched_spin(prev_max)
+	assert(max == 0)
+	assert(hits == hits2 and misses == misses2)
+
+	assert(not pcall(__rt.sched_spin, -1))
+end)
@@ -0,0 +1,43 @@
+__rt.main(function()
+	-- dump returns nil when tracing is not enabled
+	-- (unless it's enabled for all schedulers with DEW_SCHEDTRACE)
+	if os.getenv("DEW_SCHEDTRACE") == nil then
+		assert(__rt.schedtrace_dump() == nil)
+	end
+
+	__rt.schedtrace_start(1024)
+
+	local T2 = __rt.spawn_task(function()
+		__rt.yield()
+		__rt.sleep(1000000, 0)
+		return 1
+	end)
+	__rt.await(T2)
+
+	local json = __rt.schedtrace_dump()
+	assert(type(json) == "string")
+	assert(string.find(json, '"traceEvents":[', 1, true))
+	assert(string.find(json, '"name":"spawn"', 1, true))
+	assert(string.find(json, '"name":"run","ph":"B"', 1, true))
+	assert(string.find(json, '"status":"yield"', 1, true))
+	assert(string.find(json, '"status":"wait_io"', 1, true))
+	assert(string.find(json, '"status":"wait_task"', 1, true))
+	assert(string.find(json, '"source":"timer"', 1, true))
+	assert(string.find(json, '"source":"task"', 1, true))
+	assert(string.find(json, '"name":"iopoll","ph":"B"', 1, true))
+	assert(string.find(json, '"how":"clean"', 1, true))
+
+	-- ring wraps around, keeping the most recent events
+	__rt.schedtrace_start(4)
+	for i = 1, 10 do
+		__rt.yield()
+	end
+	json = __rt.schedtrace_dump()
+	local _, nevents = string.gsub(json, '"ph":"[BEi]"', "")
+	assert(nevents <= 4, nevents)
+
+	__rt.schedtrace_stop()
+	if os.getenv("DEW_SCHEDTRACE") == nil then
+		assert(__rt.schedtrace_dump() == nil)
+	end
+end)
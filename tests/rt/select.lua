@@ -0,0 +1,48 @@
+-- select waits for the first of several events: messages, task exit and timeout
+__rt.main(function()
+	do	-- message arrives before task exits
+		local self = coroutine.running()
+		local T2 = __rt.spawn_task(function()
+			__rt.send(self, "hello")
+			__rt.sleep(10*1000*1000)
+		end)
+		local i = __rt.select({ T2, "recv" })
+		assert(i == 2, i)
+		local _, _, msg = __rt.recv()
+		assert(msg == "hello")
+		-- T2 exits later
+		i = __rt.select({ "recv", T2 })
+		assert(i == 2, i)
+		assert(__rt.await(T2) == 1)
+	end
+
+	do	-- timeout
+		local start = __rt.monotime()
+		local i = __rt.select({ "recv" }, 2*1000*1000)
+		assert(i == 0, i)
+		assert(__rt.monotime() - start >= 2*1000*1000)
+		-- zero timeout polls without waiting
+		assert(__rt.select({ "recv" }, 0) == 0)
+	end
+
+	do	-- a source which is ready is returned immediately, even with a timeout
+		local T2 = __rt.spawn_task(function() end)
+		__rt.await(T2)
+		assert(__rt.select({ "recv", T2 }, 10*1000*1000) == 2)
+	end
+
+	do	-- timer messages wake a task waiting on "recv"
+		local T2 = __rt.spawn_task(function() __rt.sleep(100*1000*1000) end)
+		__rt.timer_start(__rt.monotime() + 1000000, 0, 0)
+		assert(__rt.select({ T2, "recv" }) == 2)
+		assert(__rt.recv() == 0) -- InboxMsgType_TIMER
+		-- the timer of an abandoned select does not fire later
+		assert(__rt.select({ T2 }, 1000000) == 0)
+		assert(__rt.select({ "recv" }, 3*1000*1000) == 0)
+	end
+
+	do	-- invalid arguments
+		assert(not pcall(__rt.select, { "nope" }))
+		assert(not pcall(__rt.select, {}))
+	end
+end)
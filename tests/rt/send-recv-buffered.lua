@@ -0,0 +1,49 @@
+-- messages buffered in a task's inbox are delivered in order with all their values
+__rt.main(function()
+	local main = coroutine.running()
+	local N = 1000
+	local T2 = __rt.spawn_task(function()
+		__rt.yield() -- let the main task fill up our inbox
+		for i = 1, N do
+			local typ, sender, v, a, b = __rt.recv()
+			assert(sender == main, tostring(sender))
+			assert(v == i, "got " .. tostring(v) .. ", expected " .. i)
+			if i % 3 == 0 then
+				assert(a == nil and b == "x" .. i)
+			elseif i % 3 == 1 then
+				assert(a == nil and b == nil)
+			else
+				assert(a.i == i and b == nil)
+			end
+			-- keep a few messages in the inbox at all times
+			if i % 7 == 0 then
+				__rt.yield()
+			end
+		end
+	end)
+	for i = 1, N do
+		if i % 3 == 0 then
+			__rt.send(T2, i, nil, "x" .. i)
+		elseif i % 3 == 1 then
+			__rt.send(T2, i)
+		else
+			__rt.send(T2, i, {i = i})
+		end
+	end
+	local ok, err = __rt.await(T2)
+	assert(ok, err)
+
+	-- values of messages which are never received are released when the receiver exits
+	local weak = setmetatable({}, {__mode = "v"})
+	local T3 = __rt.spawn_task(function()
+		__rt.recv()
+	end)
+	for i = 1, 4 do
+		local v = {}
+		weak[i] = v
+		__rt.send(T3, v)
+	end
+	assert(__rt.await(T3))
+	collectgarbage()
+	assert(weak[1] == nil and weak[4] == nil)
+end)
@@ -10,4 +10,18 @@ __rt.main(function()
 
     -- send should fail
     expect_error("send to dead task", __rt.send, W1)
+
+    -- a message which is buffered (not yet delivered) when the worker exits is discarded
+    local function worker_main()
+        __rt.recv()
+    end
+    local W2 = __rt.spawn_worker(worker_main)
+    local W3 = __rt.spawn_worker(worker_main)
+    __rt.send(W2, "exit")
+    __rt.send(W3, "exit") -- delivers the message to W2
+    __rt.send(W2, "late") -- buffered until we yield
+    -- block this thread (no other tasks, so we don't yield) while W2 exits
+    assert(__rt.syscall_nanosleep(50*1000*1000) == 0)
+    assert(__rt.await(W2) == true)
+    assert(__rt.await(W3) == true)
 end)
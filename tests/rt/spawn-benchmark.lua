@@ -0,0 +1,11 @@
+__rt.main(function()
+	local function f(i) return i end
+	local N = 200000
+	local time = __rt.monotime()
+	for i = 1, N do
+		__rt.await(__rt.spawn_task(f, i))
+	end
+	time = __rt.monotime() - time
+	print(string.format("Spawned and awaited %d tasks: total %.2fms, avg %dns",
+	                    N, time / 1000000.0, time // N))
+end)
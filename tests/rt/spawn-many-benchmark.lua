@@ -0,0 +1,19 @@
+-- Spawns a large number of concurrent tasks, which all wait for a message,
+-- and reports time and memory used per task
+__rt.main(function()
+	local N = tonumber(os.getenv("N")) or 1000000
+	local function f() __rt.recv() end
+	collectgarbage("collect")
+	local mem = collectgarbage("count")
+	local time = __rt.monotime()
+	for i = 1, N do
+		__rt.spawn_task(f)
+		if i % 1000 == 0 then __rt.yield() end -- let tasks start
+	end
+	__rt.yield()
+	time = __rt.monotime() - time
+	mem = collectgarbage("count") - mem
+	print(string.format("Spawned %d concurrent tasks: total %.2fms, avg %dns, %d B/task",
+	                    N, time / 1000000.0, time // N, math.floor(mem * 1024 / N)))
+	-- tasks are stopped when the main task exits
+end)
@@ -0,0 +1,25 @@
+-- measures spawn_worker latency, with and without pre-warmed workers
+__rt.main(function()
+	local N = tonumber(os.getenv("N") or "200")
+	local function worker_main()
+		local _, sender = __rt.recv()
+		__rt.send(sender)
+	end
+	local function bench(label)
+		local time = __rt.monotime()
+		for i = 1, N do
+			local W = __rt.spawn_worker(worker_main)
+			__rt.send(W)
+			while __rt.recv() == 4 do end -- skip WORKER_CLOSED
+		end
+		time = __rt.monotime() - time
+		print(string.format("%-22s %d workers: total %.2fms, avg %dus",
+		                    label, N, time / 1000000.0, time // N // 1000))
+	end
+	bench("cold")
+	__rt.worker_prewarm(4)
+	bench("pre-warmed")
+	__rt.worker_prewarm(4, worker_main)
+	bench("pre-warmed+preloaded")
+	__rt.worker_prewarm(0)
+end)
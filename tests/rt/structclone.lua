@@ -31,6 +31,13 @@ __rt.main(function()
     assert(#res == 2)
     assert(rawequal(res[1], res[2]))
 
+    -- strings longer than 255 bytes have a 4-byte size prefix
+    local longstr = string.rep("x", 300)
+    res = table.pack(__rt.structclone_decode(__rt.structclone_encode(0, nil, longstr, "")))
+    assert(res.n == 2)
+    assert(res[1] == longstr)
+    assert(res[2] == "")
+
     -- tables (specialized encoding for array vs dicts)
     -- array
     buf = __rt.structclone_encode(0, nil, {1, "B", "C"})
@@ -49,6 +56,68 @@ __rt.main(function()
     assert(res["Two"] == "B")
     assert(res["Three"] == "C")
 
+    -- arrays of only integers or only floats are packed, integers into the smallest width
+    -- which fits all elements
+    for _, v in ipairs({-128, 127, 32767, -2147483648, math.maxinteger, math.mininteger}) do
+        local a = {}
+        for i = 1, 100 do a[i] = i % 2 == 0 and v or 1 end
+        buf = __rt.structclone_encode(0, nil, a)
+        res = __rt.structclone_decode(buf)
+        assert(#res == 100)
+        for i = 1, 100 do assert(math.type(res[i]) == "integer" and res[i] == a[i]) end
+    end
+    local a8, a64 = {}, {}
+    for i = 1, 100 do a8[i] = i; a64[i] = i + math.maxinteger - 100 end
+    buf = __rt.structclone_encode(0, nil, a8)
+    buf2 = __rt.structclone_encode(0, nil, a64)
+    assert(#buf < 120)
+    assert(#buf2 > 800)
+    -- floats stay floats, even when their value is integral
+    local af = {}
+    for i = 1, 100 do af[i] = i / 2 end
+    buf = __rt.structclone_encode(0, nil, af)
+    res = __rt.structclone_decode(buf)
+    for i = 1, 100 do assert(math.type(res[i]) == "float" and res[i] == af[i]) end
+    -- mixed arrays are encoded element by element
+    res = __rt.structclone_decode(__rt.structclone_encode(0, nil, {1, 2, 3, 4.5, 5}))
+    assert(res[3] == 3 and res[4] == 4.5)
+    res = __rt.structclone_decode(__rt.structclone_encode(0, nil, {1, 2, 3, 4, "5"}))
+    assert(res[5] == "5")
+    -- packed arrays are interned like other tables
+    res = table.pack(__rt.structclone_decode(__rt.structclone_encode(0, nil, af, {af})))
+    assert(res[2][1] == res[1])
+
+    -- dicts with the same string keys share a "shape"; only the first one lists the keys
+    local rows = {}
+    for i = 1, 100 do
+        rows[i] = {id = i, name = "row" .. i, pos = {x = i, y = -i}}
+    end
+    buf = __rt.structclone_encode(0, nil, rows)
+    assert(#buf < 100 * 40) -- ~65 B per row when keys are repeated
+    res = __rt.structclone_decode(buf)
+    assert(#res == 100)
+    for i = 1, 100 do
+        assert(__rt.typename(res[i]) == "dict")
+        assert(res[i].id == i and res[i].name == "row" .. i)
+        assert(res[i].pos.x == i and res[i].pos.y == -i)
+    end
+    -- dicts with different or non-string keys
+    res = table.pack(__rt.structclone_decode(__rt.structclone_encode(0, nil,
+        {a = 1, b = 2}, {a = 3}, {a = 4, b = 5}, {[1.5] = "x", a = 6}, {a = 7})))
+    assert(res.n == 5)
+    assert(res[1].a == 1 and res[1].b == 2)
+    assert(res[2].a == 3 and res[2].b == nil)
+    assert(res[3].a == 4 and res[3].b == 5)
+    assert(res[4][1.5] == "x" and res[4].a == 6)
+    assert(res[5].a == 7)
+    -- a referenced dict whose shape has a referenced (long) key
+    local k = string.rep("k", 50)
+    local t = {[k] = 1}
+    res = table.pack(__rt.structclone_decode(__rt.structclone_encode(0, nil, t, t, k)))
+    assert(type(res[1]) == "table" and res[1][k] == 1)
+    assert(res[2] == res[1])
+    assert(res[3] == k)
+
     -- tables are interned
     local a = {1, "B", "C"}
     buf = __rt.structclone_encode(0, nil, a)
@@ -78,6 +147,18 @@ __rt.main(function()
     assert(buf ~= buf2)
     assert(buf:equal(buf2))
 
+    -- Bufs in transfer_list are detached (left empty.) The encoded data holds a copy, since
+    -- it's accessible to Lua code. Repeated Bufs decode as references to the same Buf.
+    local b1 = __rt.buf_create(2000, 2000)
+    b1:set_u8(1999, 7)
+    buf = __rt.structclone_encode(0, {b1}, b1, b1)
+    assert(#b1 == 0)
+    res = table.pack(__rt.structclone_decode(buf))
+    assert(#res == 2)
+    assert(res[1] == res[2])
+    assert(#res[1] == 2000)
+    assert(res[1]:get_u8(1999) == 7)
+
     -- We can even encode functions
     buf = __rt.structclone_encode(0, nil, function (a, b, c)
         return a * b * c
@@ -112,6 +193,21 @@ __rt.main(function()
     assert(#res == 1)
     assert(res[1] == f)
 
+    -- malformed records fail to decode, with an error
+    for _, hex in ipairs({
+        "20000000" .. "0802000000" .. "2f01" .. "0640" .. "6964", -- array of record missing value
+        "20000000" .. "2f01" .. "0640" .. "6964",                 -- record missing value
+        "20000000" .. "2f01" .. "00",                             -- record with non-string key
+        "20000000" .. "2f02" .. "0640",                           -- record missing key
+    }) do
+        local n = #hex // 2
+        buf = __rt.buf_create(n, n)
+        for i = 0, n - 1 do
+            buf:set_u8(i, tonumber(hex:sub(i*2 + 1, i*2 + 2), 16))
+        end
+        assert(not pcall(__rt.structclone_decode, buf), hex)
+    end
+
     -- -- Snippet for printing results. Needs require("../../src/util") for print_table
     -- local res = table.pack(__rt.structclone_decode(buf))
     -- local seen = {}
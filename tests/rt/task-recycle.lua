@@ -0,0 +1,53 @@
+-- Lua threads of dead tasks are recycled for new tasks.
+-- This checks that a recycled thread behaves like a fresh one, regardless of how the
+-- task that previously used it ended.
+__rt.main(function()
+	local function deep(n)
+		if n == 0 then return 0 end
+		return 1 + deep(n - 1)
+	end
+
+	for round = 1, 3 do
+		local tasks = {}
+		for i = 1, 50 do
+			local kind = i % 4
+			if kind == 0 then -- exits cleanly, with results & grown stack
+				tasks[i] = __rt.spawn_task(function(a, b) return a + b, deep(200) end, i, round)
+			elseif kind == 1 then -- raises & catches an error, leaving an unwound stack
+				tasks[i] = __rt.spawn_task(function() return select(2, pcall(error, "oops")) end)
+			elseif kind == 2 then -- suspended, then exits
+				tasks[i] = __rt.spawn_task(function(a) __rt.yield(); return a end, i)
+			else -- stopped by its parent exiting while waiting for a message
+				tasks[i] = __rt.spawn_task(function()
+					__rt.spawn_task(function() __rt.recv() end)
+					return i
+				end)
+			end
+		end
+		for i = 1, #tasks do
+			local ok, res1, res2 = __rt.await(tasks[i])
+			local kind = i % 4
+			if kind == 0 then
+				assert(ok == 1 and res1 == i + round and res2 == 200)
+			elseif kind == 1 then
+				assert(ok == 1 and res1 == "oops", res1)
+			else
+				assert(ok == 1 and res1 == i, res1)
+			end
+		end
+		tasks = nil
+		collectgarbage("collect")
+		collectgarbage("collect")
+	end
+
+	-- tid of a recycled task must not match its previous tid (generation differs)
+	local T2 = __rt.spawn_task(function() end)
+	local tid2 = __rt.tid(T2)
+	__rt.await(T2)
+	T2 = nil
+	collectgarbage("collect")
+	collectgarbage("collect")
+	local T3 = __rt.spawn_task(function() end)
+	assert(__rt.tid(T3) ~= tid2)
+	__rt.await(T3)
+end)
@@ -10,13 +10,13 @@ bit 00000000 011111111112222222222333 33333334 444444444555555555566666
    │                              gtid (64)                            │
    ├─────────────────────────────────┬─────────────────────────────────┤
    │             tid (32)            │             sid (32)            │
-   ├────────────────────────┬────────┼────────────────────────┬────────┤
-   │         idx (24)       │ gen (8)│         idx (24)       │ gen (8)│
-   └────────────────────────┴────────┴────────────────────────┴────────┘
+   ├────────────────────────┬────────┼──────────────────────┬──────────┤
+   │         idx (24)       │ gen (8)│       idx (22)       │ gen (10) │
+   └────────────────────────┴────────┴──────────────────────┴──────────┘
 
-E.g. {s_gen=0, s_idx=1, t_gen=1, t_idx=3} 0x0000000101000003 in little endian:
-    00000000 000000000000000000000001 00000001 000000000000000000000011
-    └─s_gen┘ └─────────s_idx────────┘ └─t_gen┘ └─────────t_idx────────┘
+E.g. {s_gen=0, s_idx=1, t_gen=1, t_idx=3} 0x0000000100400003 in little endian:
+    00000000 000000000000000000000001 0000000001 0000000000000000000011
+    └─s_gen┘ └─────────s_idx────────┘ └──t_gen─┘ └───────t_idx────────┘
 
 fun tid(task T = nil) uint
 ]]
@@ -56,10 +56,10 @@ __rt.main(function()
     assert((tid3b >> 32) & 0xffffff == 1); tid3b = tid3b & 0xffffffff
 
     -- extract t_idx & t_gen from tid
-    local gen2a, gen3a = tid2a >> 24, tid3a >> 24
-    local gen2b, gen3b = tid2b >> 24, tid3b >> 24
-    tid2a, tid3a = tid2a & 0xffffff, tid3a & 0xffffff
-    tid2b, tid3b = tid2b & 0xffffff, tid3b & 0xffffff
+    local gen2a, gen3a = tid2a >> 22, tid3a >> 22
+    local gen2b, gen3b = tid2b >> 22, tid3b >> 22
+    tid2a, tid3a = tid2a & 0x3fffff, tid3a & 0x3fffff
+    tid2b, tid3b = tid2b & 0x3fffff, tid3b & 0x3fffff
 
     -- print(string.format("tid2a, tid3a = %d, %d", tid2a, tid3a))
     -- print(string.format("tid2b, tid3b = %d, %d", tid2b, tid3b))
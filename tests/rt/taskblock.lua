@@ -0,0 +1,92 @@
+-- Task blocks group tasks spawned between taskblock_begin and taskblock_end
+__rt.main(function()
+	do	-- taskblock_end waits for all members to exit
+		local done = 0
+		__rt.taskblock_begin()
+		for i = 1, 20 do
+			__rt.spawn_task(function()
+				__rt.sleep((i % 3) * 1000000)
+				done = done + 1
+			end)
+		end
+		__rt.taskblock_end()
+		assert(done == 20, done)
+	end
+
+	do	-- taskblock_end(true) stops members which are still running
+		local done = 0
+		__rt.taskblock_begin()
+		local T2 = __rt.spawn_task(function() done = done + 1 end)
+		local T3 = __rt.spawn_task(function() __rt.sleep(100*1000*1000); done = done + 1 end)
+		__rt.yield()
+		__rt.taskblock_end(true)
+		assert(done == 1, done)
+		assert(__rt.await(T3) == 2) -- stopped
+	end
+
+	do	-- nested blocks; tasks are members of the innermost block
+		local order = {}
+		__rt.taskblock_begin()
+		__rt.spawn_task(function() __rt.sleep(3000000); order[#order + 1] = "outer" end)
+		__rt.taskblock_begin()
+		__rt.spawn_task(function() __rt.sleep(1000000); order[#order + 1] = "inner" end)
+		__rt.taskblock_end()
+		assert(#order == 1 and order[1] == "inner")
+		__rt.taskblock_end()
+		assert(#order == 2 and order[2] == "outer")
+	end
+
+	do	-- an error in a member stops the other members and is raised by taskblock_end
+		local T3
+		local ok, err = pcall(function()
+			__rt.taskblock_begin()
+			__rt.spawn_task(function() __rt.sleep(1000000); error("member error") end)
+			T3 = __rt.spawn_task(function() __rt.sleep(100*1000*1000) end)
+			__rt.taskblock_end()
+		end)
+		assert(not ok and string.find(err, "member error", 1, true), err)
+		assert(__rt.await(T3) == 2) -- stopped
+	end
+
+	do	-- many short-lived members don't grow the block without bound
+		__rt.taskblock_begin()
+		for i = 1, 10000 do
+			__rt.spawn_task(function() end)
+			if i % 100 == 0 then __rt.yield() end
+		end
+		__rt.taskblock_end()
+	end
+
+	do	-- an error raised while a block is open closes it when the block's handle is closed
+		local T2
+		local ok, err = pcall(function()
+			local tb <close> = __rt.taskblock_begin()
+			T2 = __rt.spawn_task(function() __rt.sleep(100*1000*1000) end)
+			error("owner error")
+		end)
+		assert(not ok and string.find(err, "owner error", 1, true), err)
+		assert(__rt.await(T2) == 2) -- stopped
+		assert(not pcall(__rt.taskblock_end)) -- no block is open
+		-- tasks spawned later are not members of the closed block
+		local T3 = __rt.spawn_task(function() end)
+		assert(__rt.await(T3) == 1)
+	end
+
+	do	-- closing the handle of a block which ended is a no-op
+		local tb <close> = __rt.taskblock_begin()
+		__rt.spawn_task(function() end)
+		__rt.taskblock_end()
+	end
+
+	do	-- closing the handle raises the error of a member
+		local ok, err = pcall(function()
+			local tb <close> = __rt.taskblock_begin()
+			__rt.spawn_task(function() error("member error") end)
+			__rt.yield()
+		end)
+		assert(not ok and string.find(err, "member error", 1, true), err)
+		assert(not pcall(__rt.taskblock_end))
+	end
+
+	assert(not pcall(__rt.taskblock_end))
+end)
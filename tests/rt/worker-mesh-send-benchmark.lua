@@ -0,0 +1,72 @@
+-- measures throughput of messages sent between workers addressed by GTID,
+-- which resolves the destination through the scheduler registry (sreg_get) on every send.
+-- Every worker sends pings round-robin to all other workers and answers pings with pongs.
+-- Each worker has at most one ping in flight, which keeps workers' inboxes from filling up.
+__rt.main(function()
+	local N = tonumber(os.getenv("N") or "5000") -- round trips per worker
+	local MAXW = tonumber(os.getenv("W") or "32")
+
+	local function worker_main()
+		local _, parent, N, peers = __rt.recv()
+		__rt.send(parent, "ready")
+		local npeers, i = #peers, 0
+		local function send_ping()
+			if i < N then
+				i = i + 1
+				__rt.send(peers[(i % npeers) + 1], "ping")
+			else
+				__rt.send(parent, "done")
+			end
+		end
+		while true do
+			local _, sender, msg = __rt.recv()
+			if msg == "ping" then
+				-- peers may start pinging us before we get "go" from the parent
+				__rt.send(sender, "pong")
+			elseif msg == "pong" or msg == "go" then
+				send_ping()
+			elseif msg == "stop" then
+				return
+			end
+		end
+	end
+
+	local function bench(nworkers)
+		local workers, gtids = {}, {}
+		for i = 1, nworkers do
+			workers[i] = __rt.spawn_worker(worker_main)
+			gtids[i] = __rt.tid(workers[i])
+		end
+		for i = 1, nworkers do
+			-- every worker pings every other worker (or itself, if it's alone)
+			local peers = {}
+			for j = 1, nworkers do
+				if j ~= i or nworkers == 1 then peers[#peers + 1] = gtids[j] end
+			end
+			__rt.send(workers[i], N, peers)
+		end
+		local function wait_for(want)
+			local n = 0
+			while n < nworkers do
+				local typ, _, msg = __rt.recv()
+				if typ ~= 4 and msg == want then n = n + 1 end -- 4 == WORKER_CLOSED
+			end
+		end
+		wait_for("ready")
+		local time = __rt.monotime()
+		for i = 1, nworkers do __rt.send(workers[i], "go") end
+		wait_for("done")
+		time = __rt.monotime() - time
+		for i = 1, nworkers do __rt.send(workers[i], "stop") end
+		for i = 1, nworkers do __rt.await(workers[i]) end
+		local nmsg = 2 * N * nworkers
+		print(string.format("%2d workers: %d msgs in %.2fms, %.0f msgs/s",
+		                    nworkers, nmsg, time / 1000000.0, nmsg / (time / 1e9)))
+	end
+
+	local nworkers = 1
+	while nworkers <= MAXW do
+		bench(nworkers)
+		nworkers = nworkers * 2
+	end
+end)
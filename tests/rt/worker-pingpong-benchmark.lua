@@ -0,0 +1,32 @@
+-- measures round-trip latency of messages between a task and a worker,
+-- with and without spinning before blocking in iopoll
+__rt.main(function()
+	local N = tonumber(os.getenv("N") or "20000")
+	local function bench(spin_max)
+		__rt.sched_spin(spin_max)
+		local W1 = __rt.spawn_worker(function()
+			local _, _, spin_max = __rt.recv()
+			__rt.sched_spin(spin_max)
+			while true do
+				local _, sender, v = __rt.recv()
+				if v == nil then break end
+				__rt.send(sender, v)
+			end
+		end)
+		__rt.send(W1, spin_max)
+		local time = __rt.monotime()
+		for i = 1, N do
+			__rt.send(W1, i)
+			while __rt.recv() == 4 do end -- skip WORKER_CLOSED of previous worker
+		end
+		time = __rt.monotime() - time
+		__rt.send(W1)
+		__rt.await(W1)
+		local _, hits, misses = __rt.sched_spin()
+		print(string.format("spin_max=%-5d %d round trips: total %.2fms, avg %dns" ..
+		                    " (spin hits %d, misses %d)",
+		                    spin_max, N, time / 1000000.0, time // N, hits, misses))
+	end
+	bench(0)
+	bench(1024)
+end)
@@ -0,0 +1,59 @@
+-- spawn_worker options for thread placement: CPU affinity, stack size and NUMA node
+__rt.main(function()
+	local function run(opts)
+		local W1 = __rt.spawn_worker(function()
+			-- deep recursion to exercise the (custom-sized) stack
+			local function f(n) if n == 0 then return 0 end return 1 + f(n - 1) end
+			assert(f(1000) == 1000)
+		end, opts)
+		local ok, err = __rt.await(W1)
+		assert(ok, err)
+	end
+
+	-- first CPU the process may run on, or nil if unknown (not Linux)
+	local function allowed_cpu()
+		local f = io.open("/proc/self/status")
+		if not f then
+			return nil
+		end
+		local status = f:read("a")
+		f:close()
+		return tonumber(status:match("Cpus_allowed_list:%s*(%d+)"))
+	end
+
+	-- true if NUMA node 0 is described by sysfs
+	local function has_numa()
+		local f = io.open("/sys/devices/system/node/node0/cpulist")
+		if f then
+			f:close()
+		end
+		return f ~= nil
+	end
+
+	run({ stack_size = 256*1024 })
+	local cpu = allowed_cpu()
+	if cpu then
+		run({ cpu = cpu })
+		run({ cpu = { cpu }, stack_size = 1024*1024 })
+		if has_numa() then
+			-- explicit cpu since node 0 may have no CPUs in our affinity mask
+			run({ numa_node = 0, cpu = cpu })
+		end
+	end
+
+	-- "core" policy pins each new worker to a physical core (ENOTSUP if not supported)
+	local ok, prev = pcall(__rt.worker_placement, "core")
+	if ok then
+		assert(prev == "none")
+		run()
+		run()
+		assert(__rt.worker_placement("none") == "core")
+	end
+
+	-- invalid options
+	assert(not pcall(__rt.spawn_worker, function() end, { stack_size = 1 }))
+	assert(not pcall(__rt.spawn_worker, function() end, { cpu = -1 }))
+	assert(not pcall(__rt.spawn_worker, function() end, { numa_node = 1000 }))
+	assert(not pcall(__rt.spawn_worker, function() end, 123))
+	assert(not pcall(__rt.worker_placement, "nope"))
+end)
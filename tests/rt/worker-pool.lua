@@ -0,0 +1,81 @@
+-- worker pools dispatch messages to the least loaded worker
+__rt.main(function()
+	local function worker_main()
+		local nhandled = 0
+		while true do
+			local typ, sender, cmd, v = __rt.recv()
+			if cmd == "stop" then
+				return
+			elseif cmd == "work" then
+				nhandled = nhandled + 1
+				__rt.send(sender, "done", v * 2)
+			elseif cmd == "count" then
+				__rt.send(sender, "count", nhandled)
+			end
+		end
+	end
+
+	-- recv_reply skips "worker closed" messages
+	local function recv_reply()
+		while true do
+			local typ, sender, kind, v = __rt.recv()
+			if typ ~= 4 then -- 4 == WORKER_CLOSED
+				return kind, v
+			end
+		end
+	end
+
+	local pool = __rt.spawn_worker_pool(worker_main, 3)
+	assert(#pool == 3)
+
+	-- every message is handled exactly once
+	local N = 30
+	for i = 1, N do
+		__rt.send(pool, "work", i)
+	end
+	local sum = 0
+	for i = 1, N do
+		local kind, v = recv_reply()
+		assert(kind == "done")
+		sum = sum + v
+	end
+	assert(sum == N * (N + 1))
+
+	-- broadcast reaches every worker; all workers got some of the work
+	assert(__rt.pool_broadcast(pool, "count") == 3)
+	local total = 0
+	for i = 1, 3 do
+		local kind, n = recv_reply()
+		assert(kind == "count")
+		assert(n > 0, "a worker was never dispatched to")
+		total = total + n
+	end
+	assert(total == N)
+
+	-- grow the pool
+	assert(#__rt.pool_resize(pool, 4) == 0)
+	assert(#pool == 4)
+	assert(__rt.pool_broadcast(pool, "count") == 4)
+	for i = 1, 4 do recv_reply() end
+
+	-- shrink the pool; removed workers keep running until we stop them
+	local removed = __rt.pool_resize(pool, 2)
+	assert(#removed == 2 and #pool == 2)
+	for _, w in ipairs(removed) do
+		__rt.send(w, "stop")
+	end
+	for _, res in ipairs(__rt.await_all(removed)) do
+		assert(res[1] == true)
+	end
+	__rt.send(pool, "work", 1)
+	assert(recv_reply() == "done")
+
+	-- stop the remaining workers
+	__rt.pool_broadcast(pool, "stop")
+	for _, res in ipairs(__rt.await_all(__rt.pool_workers(pool))) do
+		assert(res[1] == true)
+	end
+	assert(not pcall(__rt.send, pool, "work", 1))
+
+	assert(not pcall(__rt.spawn_worker_pool, worker_main, 0))
+end)
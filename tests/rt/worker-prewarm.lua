@@ -0,0 +1,53 @@
+-- worker_prewarm keeps parked workers ready to run the function passed to spawn_worker
+__rt.main(function()
+	local function echo()
+		local _, sender, v = __rt.recv()
+		__rt.send(sender, v)
+	end
+	local function double()
+		local _, sender, v = __rt.recv()
+		__rt.send(sender, v * 2)
+	end
+
+	-- recv_reply skips "worker closed" messages
+	local function recv_reply()
+		while true do
+			local typ, _, v = __rt.recv()
+			if typ ~= 4 then -- 4 == WORKER_CLOSED
+				return v
+			end
+		end
+	end
+
+	local function run(fn, v)
+		local W = __rt.spawn_worker(fn)
+		__rt.send(W, v)
+		local result = recv_reply()
+		assert(__rt.await(W) == true)
+		return result
+	end
+
+	-- without preloaded function
+	assert(__rt.worker_prewarm(2) == 2)
+	assert(run(echo, 1) == 1)
+	assert(run(double, 2) == 4)
+
+	-- with preloaded function; other functions can still be spawned
+	assert(__rt.worker_prewarm(2, double) == 2)
+	assert(run(double, 3) == 6)
+	assert(run(double, 4) == 8)
+	assert(run(echo, 5) == 5)
+
+	-- changing the function replaces parked workers
+	assert(__rt.worker_prewarm(1, echo) == 1)
+	assert(run(echo, 6) == 6)
+	assert(run(double, 7) == 14)
+
+	-- errors in pre-warmed workers are reported as usual
+	local W = __rt.spawn_worker(function() error("oops") end)
+	local ok, err = __rt.await(W)
+	assert(ok == false and string.find(err, "oops"), err)
+
+	-- parked workers are closed when S exits, without blocking exit
+	assert(__rt.worker_prewarm(3) == 3)
+end)
@@ -0,0 +1,47 @@
+-- messages sent to workers in a burst are delivered in order, also across destinations
+__rt.main(function()
+	local function worker_main()
+		local expect = 1
+		while true do
+			local typ, sender, cmd, v = __rt.recv()
+			if cmd == "stop" then
+				break
+			elseif cmd == "msg" then
+				assert(v == expect, "got " .. tostring(v) .. ", expected " .. expect)
+				expect = expect + 1
+			elseif cmd == "sync" then
+				__rt.send(sender, "count", expect - 1)
+			end
+		end
+	end
+
+	local w1 = __rt.spawn_worker(worker_main)
+	local w2 = __rt.spawn_worker(worker_main)
+
+	-- many more messages than fit in a worker's queue, without yielding
+	local N = 1000
+	for i = 1, N do
+		__rt.send(w1, "msg", i)
+	end
+
+	-- interleaved destinations
+	for i = 1, N do
+		__rt.send(w2, "msg", i)
+		__rt.send(w1, "msg", N + i)
+	end
+
+	__rt.send(w1, "sync")
+	local typ, sender, kind, n = __rt.recv()
+	assert(kind == "count")
+	assert(n == 2*N, tostring(n))
+
+	__rt.send(w2, "sync")
+	typ, sender, kind, n = __rt.recv()
+	assert(kind == "count")
+	assert(n == N, tostring(n))
+
+	__rt.send(w1, "stop")
+	__rt.send(w2, "stop")
+	assert(__rt.await(w1) == true)
+	assert(__rt.await(w2) == true)
+end)
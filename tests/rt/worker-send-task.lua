@@ -0,0 +1,59 @@
+-- messages sent to a worker can be addressed to any of its tasks, not just the main task
+__rt.main(function()
+	local function worker_main()
+		-- first message tells us who the parent is
+		local typ, parent, cmd = __rt.recv()
+		assert(cmd == "start")
+
+		-- subtask receives messages sent directly to it by the parent
+		local sub = __rt.spawn_task(function(parent)
+			__rt.send(parent, "hello", __rt.tid())
+			local typ, sender, cmd, v = __rt.recv()
+			assert(sender == parent)
+			assert(cmd == "ping", tostring(cmd))
+			__rt.send(parent, "pong", v + 1)
+		end, parent)
+		__rt.await(sub)
+		__rt.send(parent, "subdone")
+
+		-- messages sent to the (now dead) subtask are dropped, not delivered to us
+		local typ, sender, cmd = __rt.recv()
+		assert(cmd == "stop", tostring(cmd))
+	end
+
+	-- recv_reply skips "worker closed" messages
+	local function recv_reply()
+		while true do
+			local typ, sender, kind, v = __rt.recv()
+			if typ ~= 4 then -- 4 == WORKER_CLOSED
+				return sender, kind, v
+			end
+		end
+	end
+
+	local w = __rt.spawn_worker(worker_main)
+	__rt.send(w, "start")
+
+	local sender, kind, sub_tid = recv_reply()
+	assert(kind == "hello")
+	assert(sender == sub_tid)
+	assert(sub_tid ~= __rt.tid(w))
+
+	__rt.send(sub_tid, "ping", 41)
+	local sender, kind, v = recv_reply()
+	assert(sender == sub_tid)
+	assert(kind == "pong")
+	assert(v == 42)
+
+	-- awaiting a task other than a worker's main task is not supported
+	local ok, err = pcall(__rt.await, sub_tid)
+	assert(not ok)
+
+	-- wait for the subtask to exit, then send to its stale tid
+	local _, kind = recv_reply()
+	assert(kind == "subdone")
+	__rt.send(sub_tid, "ping", 0)
+	__rt.send(w, "stop")
+
+	assert(__rt.await(w) == true)
+end)
@@ -0,0 +1,68 @@
+-- send_transfer moves Bufs to the receiver instead of copying them, leaving them empty
+__rt.main(function()
+	local function worker_main()
+		while true do
+			local typ, sender, cmd, buf, n = __rt.recv()
+			if cmd == "stop" then
+				break
+			end
+			assert(cmd == "echo", tostring(cmd))
+			assert(#buf == n)
+			assert(buf:get_u8(0) == 1)
+			assert(buf:get_u8(n - 1) == 2)
+			__rt.send_transfer(sender, {buf}, "echo", buf)
+			assert(#buf == 0)
+		end
+	end
+
+	-- recv_reply skips "worker closed" messages
+	local function recv_reply()
+		while true do
+			local typ, sender, kind, v = __rt.recv()
+			if typ ~= 4 then -- 4 == WORKER_CLOSED
+				return sender, kind, v
+			end
+		end
+	end
+
+	local function make_buf(n)
+		local buf = __rt.buf_create(n, n)
+		buf:set_u8(0, 1)
+		buf:set_u8(n - 1, 2)
+		return buf
+	end
+
+	local w = __rt.spawn_worker(worker_main)
+
+	-- small Bufs have their bytes embedded and are copied; large Bufs are moved
+	for _, n in ipairs({16, 4096, 1024*1024}) do
+		local buf = make_buf(n)
+		__rt.send_transfer(w, {buf}, "echo", buf, n)
+		assert(#buf == 0)
+		local sender, kind, buf2 = recv_reply()
+		assert(kind == "echo")
+		assert(#buf2 == n)
+		assert(buf2:get_u8(0) == 1)
+		assert(buf2:get_u8(n - 1) == 2)
+	end
+
+	-- Bufs in transfer_list which are not part of the message are emptied as well
+	local buf1, buf2 = make_buf(4096), make_buf(4096)
+	__rt.send_transfer(w, {buf1, buf2}, "echo", buf1, 4096)
+	assert(#buf1 == 0)
+	assert(#buf2 == 0)
+	recv_reply()
+
+	-- tasks of the same worker receive values by reference, as with send
+	local t = __rt.spawn_task(function()
+		local typ, sender, buf = __rt.recv()
+		assert(#buf == 4096)
+	end)
+	local buf = make_buf(4096)
+	__rt.send_transfer(t, {buf}, buf)
+	assert(#buf == 4096)
+	__rt.await(t)
+
+	__rt.send(w, "stop")
+	assert(__rt.await(w) == true)
+end)
@@ -0,0 +1,94 @@
+-- SharedBuf is an immutable buffer which workers read without copying
+__rt.main(function()
+	local function worker_main()
+		local sb
+		while true do
+			local typ, sender, cmd, v = __rt.recv()
+			if cmd == "stop" then
+				break
+			elseif cmd == "keep" then
+				sb = v
+			end
+			-- reply with the sum of a few bytes of the most recently received SharedBuf
+			local b = v or sb
+			__rt.send(sender, "sum", #b, b:get_u8(0) + b:get_u8(#b - 1))
+		end
+	end
+
+	-- recv_reply skips "worker closed" messages
+	local function recv_reply()
+		while true do
+			local typ, sender, kind, n, sum = __rt.recv()
+			if typ ~= 4 then -- 4 == WORKER_CLOSED
+				return kind, n, sum
+			end
+		end
+	end
+
+	-- creating a SharedBuf takes over the memory of the source Buf, leaving it empty
+	for _, n in ipairs({16, 1024*1024}) do
+		local buf = __rt.buf_create(n, n)
+		buf:set_u8(0, 1)
+		buf:set_u8(n - 1, 2)
+		local sb = __rt.sharedbuf_create(buf)
+		assert(#buf == 0)
+		assert(#sb == n)
+		assert(sb:get_u8(0) == 1 and sb:get_u8(n - 1) == 2)
+	end
+
+	local N = 1024*1024
+	local buf = __rt.buf_create(N, N)
+	buf:set_u8(0, 3)
+	buf:set_u8(N - 1, 4)
+	local sb = __rt.sharedbuf_create(buf)
+
+	-- SharedBuf is read-only
+	assert(sb.set_u8 == nil)
+	assert(sb.append == nil)
+	assert(sb:equal(sb))
+
+	-- SharedBuf can not be cloned into a Buf
+	assert(__rt.structclone_encode(0, nil, sb) == nil)
+
+	-- every worker of a pool can hold on to the same SharedBuf
+	local pool = __rt.spawn_worker_pool(worker_main, 3)
+	assert(__rt.pool_broadcast(pool, "keep", sb) == 3)
+	for i = 1, 3 do
+		local kind, n, sum = recv_reply()
+		assert(kind == "sum")
+		assert(n == N)
+		assert(sum == 7)
+	end
+
+	-- the data outlives the sender's reference
+	sb = nil
+	collectgarbage()
+	assert(__rt.pool_broadcast(pool, "read") == 3)
+	for i = 1, 3 do
+		local kind, n, sum = recv_reply()
+		assert(n == N)
+		assert(sum == 7)
+	end
+
+	-- messages which are never received release their reference
+	local w = __rt.spawn_worker(worker_main)
+	buf = __rt.buf_create(64, 64)
+	__rt.send(w, "stop")
+	pcall(__rt.send, w, "read", __rt.sharedbuf_create(buf)) -- fails if w has already exited
+	assert(__rt.await(w) == true)
+
+	-- tasks of the same worker receive the SharedBuf by reference
+	buf = __rt.buf_create(64, 64)
+	local sb2 = __rt.sharedbuf_create(buf)
+	local t = __rt.spawn_task(function()
+		local typ, sender, v = __rt.recv()
+		assert(v == sb2)
+	end)
+	__rt.send(t, sb2)
+	__rt.await(t)
+
+	__rt.pool_broadcast(pool, "stop")
+	for _, w in ipairs(__rt.pool_workers(pool)) do
+		__rt.await(w)
+	end
+end)